@@ -3,6 +3,7 @@
   include(CheckFunctionExists)
   include(CheckLibraryExists)
   include(CheckIncludeFiles)
+  include(CheckSymbolExists)
 
   check_include_files(arpa/inet.h HAVE_ARPA_INET)
   check_include_files(crypt.h HAVE_CRYPT)
@@ -44,3 +45,6 @@
   check_include_files(sys/un.h HAVE_SYS_UN)
   check_include_files(time.h HAVE_TIME)
   check_include_files(unistd.h HAVE_UNISTD)
+
+  # The io_uring backend needs multishot receives with provided buffers
+  check_symbol_exists(IORING_RECV_MULTISHOT linux/io_uring.h HAVE_IO_URING)
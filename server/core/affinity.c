@@ -0,0 +1,550 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file affinity.c  - CPU affinity and NUMA placement of the MaxScale threads
+ *
+ * The value of the cpu_affinity parameter is either "none", "auto" or a list
+ * of CPUs such as "0-7,16-23". With "auto" the polling threads are spread
+ * over the NUMA nodes, one CPU per thread, and the other threads use the
+ * CPUs that no polling thread uses. With a list of CPUs the polling threads
+ * are pinned to the listed CPUs in order and the other threads may run on
+ * any of the listed CPUs.
+ *
+ * The NUMA topology is read from sysfs. Memory allocated by a thread is
+ * placed on the node where the thread runs by the kernel so pinning the
+ * polling threads keeps the DCBs and buffers they allocate local. Memory
+ * that is allocated for a polling thread by another thread is bound to the
+ * node of the polling thread with affinity_bind_array.
+ */
+
+#include <affinity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <dcb.h>
+#include <maxconfig.h>
+#include <log_manager.h>
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+#define AFFINITY_NODE_PATH "/sys/devices/system/node"
+#define AFFINITY_MAX_NODES 64
+
+typedef enum
+{
+    AFFINITY_NONE,      /*< The threads are not pinned */
+    AFFINITY_AUTO,      /*< Pinned according to the NUMA topology */
+    AFFINITY_LIST       /*< Pinned to the configured CPUs */
+} affinity_policy_t;
+
+static affinity_policy_t policy = AFFINITY_NONE;
+static int n_nodes = 1;                 /*< Number of NUMA nodes */
+static int cpu_node[CPU_SETSIZE];       /*< The NUMA node of each CPU */
+static cpu_set_t available;             /*< CPUs that MaxScale may run on */
+static cpu_set_t other_cpus;            /*< CPUs of the non-polling threads */
+static bool pin_others = false;         /*< Whether the non-polling threads are pinned */
+static int *thread_cpu = NULL;          /*< CPU of each polling thread, -1 if not pinned */
+static int n_poll_threads = 0;
+
+/**
+ * Parse a list of CPUs
+ *
+ * @param str   List of CPUs and ranges of CPUs, e.g. "0-3,8,10-11"
+ * @param cpus  The CPUs are added here
+ * @return True if the list was valid
+ */
+static bool
+affinity_parse_list(const char *str, cpu_set_t *cpus)
+{
+    const char *ptr = str;
+
+    CPU_ZERO(cpus);
+
+    while (*ptr)
+    {
+        char *end;
+        long first = strtol(ptr, &end, 10);
+        long last = first;
+
+        if (end == ptr || first < 0 || first >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        ptr = end;
+
+        if (*ptr == '-')
+        {
+            ptr++;
+            last = strtol(ptr, &end, 10);
+            if (end == ptr || last < first || last >= CPU_SETSIZE)
+            {
+                return false;
+            }
+            ptr = end;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+        }
+
+        while (isspace(*ptr))
+        {
+            ptr++;
+        }
+        if (*ptr == ',' && *(ptr + 1) != '\0')
+        {
+            ptr++;
+        }
+        else if (*ptr != '\0')
+        {
+            return false;
+        }
+    }
+
+    return CPU_COUNT(cpus) > 0;
+}
+
+/**
+ * Check whether a value of the cpu_affinity parameter is valid
+ *
+ * @param spec  The value of the parameter
+ * @return True if the value is valid
+ */
+bool
+affinity_valid(const char *spec)
+{
+    cpu_set_t cpus;
+
+    return strcmp(spec, "none") == 0 || strcmp(spec, "auto") == 0 ||
+           affinity_parse_list(spec, &cpus);
+}
+
+/**
+ * Format a set of CPUs as a list of ranges
+ *
+ * @param cpus  The CPUs
+ * @param buf   Buffer where the list is written
+ * @param size  Size of the buffer
+ * @return The buffer
+ */
+static char *
+affinity_format_list(const cpu_set_t *cpus, char *buf, size_t size)
+{
+    size_t len = 0;
+    int cpu = 0;
+
+    buf[0] = '\0';
+
+    while (cpu < CPU_SETSIZE && len < size)
+    {
+        if (!CPU_ISSET(cpu, cpus))
+        {
+            cpu++;
+            continue;
+        }
+
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+        {
+            last++;
+        }
+
+        len += snprintf(buf + len, size - len, len ? ",%d" : "%d", cpu);
+        if (last > cpu && len < size)
+        {
+            len += snprintf(buf + len, size - len, "-%d", last);
+        }
+        cpu = last + 1;
+    }
+
+    return buf;
+}
+
+/**
+ * Read the NUMA node of each CPU from sysfs. If the information is not
+ * available all CPUs are on node 0.
+ */
+static void
+affinity_read_topology()
+{
+    DIR *dir;
+    struct dirent *entry;
+
+    memset(cpu_node, 0, sizeof(cpu_node));
+    n_nodes = 1;
+
+    if ((dir = opendir(AFFINITY_NODE_PATH)) == NULL)
+    {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char path[PATH_MAX];
+        char line[1024];
+        cpu_set_t cpus;
+        int node;
+        FILE *file;
+
+        if (sscanf(entry->d_name, "node%d", &node) != 1 ||
+            node < 0 || node >= AFFINITY_MAX_NODES)
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s/cpulist", AFFINITY_NODE_PATH, entry->d_name);
+
+        if ((file = fopen(path, "r")) == NULL)
+        {
+            continue;
+        }
+
+        if (fgets(line, sizeof(line), file))
+        {
+            line[strcspn(line, "\n")] = '\0';
+            if (affinity_parse_list(line, &cpus))
+            {
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                {
+                    if (CPU_ISSET(cpu, &cpus))
+                    {
+                        cpu_node[cpu] = node;
+                    }
+                }
+            }
+        }
+        fclose(file);
+
+        if (node >= n_nodes)
+        {
+            n_nodes = node + 1;
+        }
+    }
+
+    closedir(dir);
+}
+
+/**
+ * Order the available CPUs so that consecutive CPUs are on different NUMA
+ * nodes
+ *
+ * @param order The CPUs are stored here
+ * @return Number of CPUs
+ */
+static int
+affinity_interleave(int *order)
+{
+    int next[AFFINITY_MAX_NODES] = {0};
+    int n = 0;
+    bool found = true;
+
+    while (found)
+    {
+        found = false;
+
+        for (int node = 0; node < n_nodes; node++)
+        {
+            /** Take the next available CPU of this node */
+            while (next[node] < CPU_SETSIZE &&
+                   (!CPU_ISSET(next[node], &available) || cpu_node[next[node]] != node))
+            {
+                next[node]++;
+            }
+            if (next[node] < CPU_SETSIZE)
+            {
+                order[n++] = next[node]++;
+                found = true;
+            }
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Pin a thread to a set of CPUs
+ *
+ * @param thread    The thread
+ * @param cpus      The CPUs
+ * @param name      Name of the thread for the log messages
+ */
+static void
+affinity_pin(pthread_t thread, const cpu_set_t *cpus, const char *name)
+{
+    int rc = pthread_setaffinity_np(thread, sizeof(cpu_set_t), cpus);
+
+    if (rc != 0)
+    {
+        char errbuf[STRERROR_BUFLEN];
+        MXS_WARNING("Failed to set the CPU affinity of the %s thread: %d, %s",
+                    name, rc, strerror_r(rc, errbuf, sizeof(errbuf)));
+    }
+}
+
+/**
+ * Plan the placement of the threads. Must be called after the configuration
+ * has been read and before any polling, housekeeper or monitor threads are
+ * started. The already running log writer thread is pinned here.
+ */
+void
+affinity_init()
+{
+    const char *spec = config_cpu_affinity();
+    int order[CPU_SETSIZE];
+    int n = 0;
+
+    n_poll_threads = config_threadcount();
+    if ((thread_cpu = (int *)malloc(n_poll_threads * sizeof(int))) == NULL)
+    {
+        perror("Fatal error: Memory allocation failed.");
+        exit(-1);
+    }
+    for (int i = 0; i < n_poll_threads; i++)
+    {
+        thread_cpu[i] = -1;
+    }
+
+    affinity_read_topology();
+    if (sched_getaffinity(0, sizeof(available), &available) != 0)
+    {
+        CPU_ZERO(&available);
+    }
+
+    if (spec == NULL || strcmp(spec, "none") == 0)
+    {
+        policy = AFFINITY_NONE;
+        return;
+    }
+    else if (strcmp(spec, "auto") == 0)
+    {
+        policy = AFFINITY_AUTO;
+        n = affinity_interleave(order);
+    }
+    else
+    {
+        cpu_set_t listed;
+
+        policy = AFFINITY_LIST;
+        affinity_parse_list(spec, &listed);
+        CPU_AND(&available, &available, &listed);
+
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &available))
+            {
+                order[n++] = cpu;
+            }
+        }
+    }
+
+    if (n == 0)
+    {
+        MXS_WARNING("None of the CPUs in 'cpu_affinity=%s' are available, "
+                    "the threads are not pinned.", spec);
+        policy = AFFINITY_NONE;
+        return;
+    }
+
+    for (int i = 0; i < n_poll_threads; i++)
+    {
+        thread_cpu[i] = order[i % n];
+    }
+
+    other_cpus = available;
+    pin_others = policy == AFFINITY_LIST;
+
+    if (policy == AFFINITY_AUTO && n > n_poll_threads)
+    {
+        /** Keep the other threads off the CPUs of the polling threads */
+        for (int i = 0; i < n_poll_threads; i++)
+        {
+            CPU_CLR(thread_cpu[i], &other_cpus);
+        }
+        pin_others = true;
+    }
+
+    MXS_NOTICE("Pinning %d polling threads to %d CPUs on %d NUMA nodes.",
+               n_poll_threads, n < n_poll_threads ? n : n_poll_threads, n_nodes);
+
+    pthread_t writer;
+    if (pin_others && mxs_log_get_writer_thread(&writer))
+    {
+        affinity_pin(writer, &other_cpus, "log writer");
+    }
+}
+
+/**
+ * Pin the calling polling thread to its CPU
+ *
+ * @param thread_id The ID of the polling thread
+ */
+void
+affinity_set_poll_thread(int thread_id)
+{
+    if (thread_cpu && thread_id < n_poll_threads && thread_cpu[thread_id] >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(thread_cpu[thread_id], &cpus);
+        affinity_pin(pthread_self(), &cpus, "polling");
+    }
+}
+
+/**
+ * Pin the calling thread to the CPUs of the threads that do not poll
+ *
+ * @param name  Name of the thread for the log messages
+ */
+void
+affinity_set_other_thread(const char *name)
+{
+    if (pin_others)
+    {
+        affinity_pin(pthread_self(), &other_cpus, name);
+    }
+}
+
+/**
+ * Return the CPU of a polling thread
+ *
+ * @param thread_id The ID of the polling thread
+ * @return The CPU or -1 if the thread is not pinned
+ */
+int
+affinity_thread_cpu(int thread_id)
+{
+    return thread_cpu && thread_id < n_poll_threads ? thread_cpu[thread_id] : -1;
+}
+
+/**
+ * Return the NUMA node of a polling thread
+ *
+ * @param thread_id The ID of the polling thread
+ * @return The node or -1 if the thread is not pinned
+ */
+int
+affinity_thread_node(int thread_id)
+{
+    int cpu = affinity_thread_cpu(thread_id);
+    return cpu >= 0 ? cpu_node[cpu] : -1;
+}
+
+/**
+ * Bind an array with one element per polling thread to the NUMA nodes of
+ * the threads
+ *
+ * The pages that are completely inside an element are moved to the node
+ * of the thread, the pages shared by two elements are left where they are.
+ * Does nothing unless the threads are pinned on a system with several nodes.
+ *
+ * @param array     The array
+ * @param elem_size Size of an element
+ * @param n_elems   Number of elements, at most the number of polling threads
+ */
+void
+affinity_bind_array(void *array, size_t elem_size, int n_elems)
+{
+    if (policy == AFFINITY_NONE || n_nodes < 2)
+    {
+        return;
+    }
+
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+
+    for (int i = 0; i < n_elems && i < n_poll_threads; i++)
+    {
+        uintptr_t start = (uintptr_t)array + i * elem_size;
+        uintptr_t end = start + elem_size;
+
+        start = (start + page - 1) & ~(page - 1);
+        end &= ~(page - 1);
+
+        if (end > start && thread_cpu[i] >= 0)
+        {
+            unsigned long nodemask = 1UL << cpu_node[thread_cpu[i]];
+
+            if (syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, &nodemask,
+                        sizeof(nodemask) * 8, MPOL_MF_MOVE) != 0)
+            {
+                char errbuf[STRERROR_BUFLEN];
+                MXS_DEBUG("Failed to bind the memory of polling thread %d to NUMA node %d: %d, %s",
+                          i, cpu_node[thread_cpu[i]], errno,
+                          strerror_r(errno, errbuf, sizeof(errbuf)));
+            }
+        }
+    }
+}
+
+/**
+ * Print the NUMA topology and the placement of the threads
+ *
+ * @param dcb   The DCB to print to
+ */
+void
+affinity_show(DCB *dcb)
+{
+    char buf[512];
+    cpu_set_t cpus;
+
+    dcb_printf(dcb, "CPU affinity: %s\n",
+               policy == AFFINITY_AUTO ? "auto" : policy == AFFINITY_LIST ? "CPU list" : "none");
+
+    for (int node = 0; node < n_nodes; node++)
+    {
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &available) && cpu_node[cpu] == node)
+            {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        if (CPU_COUNT(&cpus))
+        {
+            dcb_printf(dcb, "NUMA node %d: CPUs %s\n", node,
+                       affinity_format_list(&cpus, buf, sizeof(buf)));
+        }
+    }
+
+    if (policy == AFFINITY_NONE)
+    {
+        dcb_printf(dcb, "\n");
+        return;
+    }
+
+    dcb_printf(dcb, "Housekeeper, log writer and monitor threads: %s\n\n",
+               pin_others ? affinity_format_list(&other_cpus, buf, sizeof(buf)) : "any CPU");
+    dcb_printf(dcb, " ID | CPU  | Node\n");
+    dcb_printf(dcb, "----+------+------\n");
+    for (int i = 0; i < n_poll_threads; i++)
+    {
+        dcb_printf(dcb, " %2d | %4d | %4d\n", i, affinity_thread_cpu(i), affinity_thread_node(i));
+    }
+    dcb_printf(dcb, "\n");
+}
@@ -36,15 +36,26 @@
  *                                      gwbuf_count and gwbuf_alloc_and_load functions.
  *
  * @endverbatim
+ *
+ * The header, the shared descriptor and the data of a buffer are placed in
+ * one block of memory that is taken from a pool of blocks of the same size
+ * class. Each thread keeps a small cache of free blocks of every class and
+ * exchanges them with a global depot in batches, so most allocations and
+ * frees touch neither locks nor malloc. The headers of cloned buffers come
+ * from a pool of their own. When the last reference to the shared data is
+ * released, the whole block goes back to the pool.
  */
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <buffer.h>
+#include <dcb.h>
 #include <atomic.h>
 #include <skygw_debug.h>
 #include <skygw_utils.h>
 #include <spinlock.h>
 #include <hint.h>
 #include <log_manager.h>
+#include <platform.h>
 #include <errno.h>
 
 #if defined(BUFFER_TRACE)
@@ -55,6 +66,8 @@ static HASHTABLE *buffer_hashtable = NULL;
 #endif
 
 static void gwbuf_free_one(GWBUF *buf);
+static void *buffer_block_alloc(int cls, size_t size);
+static void buffer_block_free(int cls, void *block);
 static buffer_object_t* gwbuf_remove_buffer_object(GWBUF*           buf,
                                                    buffer_object_t* bufobj);
 
@@ -65,12 +78,485 @@ static int bcmpfn (void *key1, void *key2);
 static void gwbuf_remove_from_hashtable(GWBUF *buf);
 #endif
 
+/** Number of block size classes, class 0 holds the headers of clones */
+#define BUFFER_N_CLASSES    6
+/** Largest number of free blocks of one class in a thread cache */
+#define BUFFER_CACHE_SIZE   64
+/** Number of blocks moved between a thread cache and the depot at a time */
+#define BUFFER_BATCH_SIZE   32
+/** Largest amount of memory kept in the depot of one class */
+#define BUFFER_DEPOT_BYTES  (16 * 1024 * 1024)
+/** Alignment of the blocks taken from the arena */
+#define BUFFER_ALIGN        64
+
+/** Size of the blocks of each class, class 0 is set to the size of a header */
+static size_t buffer_class_size[BUFFER_N_CLASSES] = {0, 256, 1024, 4096, 16384, 65536};
+
+/**
+ * A free block. The blocks are linked into batches and the first block of
+ * a batch links the batches of the depot.
+ */
+typedef struct buffer_block
+{
+    struct buffer_block *next;       /*< Next block in the batch */
+    struct buffer_block *next_batch; /*< Next batch in the depot */
+} BUFFER_BLOCK;
+
+/** The global depot of free blocks of one class */
+typedef struct
+{
+    SPINLOCK     lock;
+    BUFFER_BLOCK *batches;  /*< Stack of free batches */
+    int          n_blocks;  /*< Number of blocks in the depot */
+    uint64_t     refills;   /*< Batches given to thread caches */
+    uint64_t     misses;    /*< Blocks allocated from the arena or the system */
+    uint64_t     returns;   /*< Batches returned by thread caches */
+    uint64_t     frees;     /*< Blocks given back to the system */
+} BUFFER_DEPOT;
+
+/** The free blocks of one class cached by a thread */
+typedef struct
+{
+    int      count;
+    void     *blocks[BUFFER_CACHE_SIZE];
+    uint64_t hits;          /*< Allocations served from the cache */
+} BUFFER_CACHE_CLASS;
+
+typedef struct buffer_cache
+{
+    BUFFER_CACHE_CLASS  classes[BUFFER_N_CLASSES];
+    struct buffer_cache *next; /*< All the thread caches, for the statistics */
+} BUFFER_CACHE;
+
+/** The optional arena of huge pages */
+typedef struct
+{
+    SPINLOCK lock;
+    char     *start;
+    char     *end;
+    char     *next;         /*< First unused byte */
+    bool     hugetlb;       /*< Explicit huge pages instead of transparent ones */
+} BUFFER_ARENA;
+
+static BUFFER_DEPOT buffer_depots[BUFFER_N_CLASSES];
+static BUFFER_ARENA buffer_arena;
+static BUFFER_CACHE *buffer_caches = NULL;
+static SPINLOCK buffer_caches_lock = SPINLOCK_INIT;
+static thread_local BUFFER_CACHE *buffer_cache = NULL;
+static thread_local bool buffer_cache_failed = false;
+
+/**
+ * Initialise the depots
+ *
+ * Called from the pool functions, the size of a header is not a constant
+ * expression that can be used in the initialiser.
+ */
+static void
+buffer_depots_init()
+{
+    static SPINLOCK init_lock = SPINLOCK_INIT;
+    static volatile bool initialised = false;
+
+    if (!initialised)
+    {
+        spinlock_acquire(&init_lock);
+        if (!initialised)
+        {
+            buffer_class_size[0] = sizeof(GWBUF);
+            for (int i = 0; i < BUFFER_N_CLASSES; i++)
+            {
+                spinlock_init(&buffer_depots[i].lock);
+            }
+            spinlock_init(&buffer_arena.lock);
+            initialised = true;
+        }
+        spinlock_release(&init_lock);
+    }
+}
+
+/**
+ * Return the size class of a block
+ *
+ * @param size  Size of the block
+ * @return The class or -1 if blocks of this size are not pooled
+ */
+static int
+buffer_class(size_t size)
+{
+    for (int i = 1; i < BUFFER_N_CLASSES; i++)
+    {
+        if (size <= buffer_class_size[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Return the cache of the calling thread, creating it on first use
+ *
+ * @return The cache or NULL if it could not be allocated
+ */
+static BUFFER_CACHE *
+buffer_get_cache()
+{
+    if (buffer_cache == NULL && !buffer_cache_failed)
+    {
+        BUFFER_CACHE *cache = (BUFFER_CACHE *)calloc(1, sizeof(BUFFER_CACHE));
+
+        if (cache)
+        {
+            buffer_depots_init();
+            spinlock_acquire(&buffer_caches_lock);
+            cache->next = buffer_caches;
+            buffer_caches = cache;
+            spinlock_release(&buffer_caches_lock);
+            buffer_cache = cache;
+        }
+        else
+        {
+            /** Use the depot directly instead of trying again on every call */
+            buffer_cache_failed = true;
+            buffer_depots_init();
+        }
+    }
+    return buffer_cache;
+}
+
+/**
+ * Check whether a block was taken from the arena
+ *
+ * @param block The block
+ * @return True if the block is in the arena
+ */
+static inline bool
+buffer_in_arena(void *block)
+{
+    return (char *)block >= buffer_arena.start && (char *)block < buffer_arena.end;
+}
+
+/**
+ * Reserve a region of memory backed by huge pages for the buffers
+ *
+ * Blocks are carved from the arena when the depot of their class is empty
+ * and they are never given back to the system. When the arena is used up,
+ * the blocks are allocated with malloc. Explicit huge pages are used if the
+ * system has enough of them, otherwise transparent huge pages are requested.
+ *
+ * @param mb    Size of the arena in megabytes, 0 for no arena
+ * @return True if the arena was created or was not requested
+ */
+bool
+gwbuf_arena_init(size_t mb)
+{
+    size_t size = mb * 1024 * 1024;
+    bool hugetlb = true;
+    void *mem;
+
+    if (size == 0)
+    {
+        return true;
+    }
+
+    buffer_depots_init();
+
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#else
+    mem = MAP_FAILED;
+#endif
+
+    if (mem == MAP_FAILED)
+    {
+        hugetlb = false;
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (mem == MAP_FAILED)
+        {
+            char errbuf[STRERROR_BUFLEN];
+            MXS_ERROR("Failed to reserve %lu MB for the buffer arena: %s",
+                      (unsigned long)mb, strerror_r(errno, errbuf, sizeof(errbuf)));
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    spinlock_acquire(&buffer_arena.lock);
+    buffer_arena.start = (char *)mem;
+    buffer_arena.next = (char *)mem;
+    buffer_arena.end = (char *)mem + size;
+    buffer_arena.hugetlb = hugetlb;
+    spinlock_release(&buffer_arena.lock);
+
+    MXS_NOTICE("Using a %lu MB arena of %s huge pages for the buffers.",
+               (unsigned long)mb, hugetlb ? "explicit" : "transparent");
+    return true;
+}
+
+/**
+ * Allocate a new block when the depot is empty
+ *
+ * @param cls   Size class of the block, -1 if not pooled
+ * @param size  Size of the block
+ * @return The block or NULL on failure
+ */
+static void *
+buffer_block_new(int cls, size_t size)
+{
+    void *block = NULL;
+
+    if (cls >= 0 && buffer_arena.start)
+    {
+        size_t aligned = (size + BUFFER_ALIGN - 1) & ~((size_t)BUFFER_ALIGN - 1);
+
+        spinlock_acquire(&buffer_arena.lock);
+        if (buffer_arena.end - buffer_arena.next >= aligned)
+        {
+            block = buffer_arena.next;
+            buffer_arena.next += aligned;
+        }
+        spinlock_release(&buffer_arena.lock);
+    }
+
+    if (block == NULL)
+    {
+        block = malloc(size);
+    }
+    return block;
+}
+
+/**
+ * Allocate a block of memory
+ *
+ * @param cls   Size class of the block, -1 if not pooled
+ * @param size  Size of the block, not larger than the class size
+ * @return The block or NULL on failure
+ */
+static void *
+buffer_block_alloc(int cls, size_t size)
+{
+    if (cls < 0)
+    {
+        return malloc(size);
+    }
+
+    BUFFER_CACHE *cache = buffer_get_cache();
+    BUFFER_DEPOT *depot = &buffer_depots[cls];
+    BUFFER_BLOCK *batch;
+
+    if (cache)
+    {
+        BUFFER_CACHE_CLASS *c = &cache->classes[cls];
+
+        if (c->count > 0)
+        {
+            c->hits++;
+            return c->blocks[--c->count];
+        }
+    }
+
+    spinlock_acquire(&depot->lock);
+    if ((batch = depot->batches) != NULL)
+    {
+        depot->batches = batch->next_batch;
+        depot->refills++;
+
+        if (cache == NULL)
+        {
+            /** Take one block, the rest of the batch stays in the depot */
+            if (batch->next)
+            {
+                batch->next->next_batch = depot->batches;
+                depot->batches = batch->next;
+            }
+            depot->n_blocks--;
+            spinlock_release(&depot->lock);
+            return batch;
+        }
+
+        for (BUFFER_BLOCK *b = batch->next; b; b = b->next)
+        {
+            depot->n_blocks--;
+        }
+        depot->n_blocks--;
+    }
+    else
+    {
+        depot->misses++;
+    }
+    spinlock_release(&depot->lock);
+
+    if (batch == NULL)
+    {
+        return buffer_block_new(cls, buffer_class_size[cls]);
+    }
+
+    /** Keep the rest of the batch in the cache */
+    BUFFER_CACHE_CLASS *c = &cache->classes[cls];
+
+    for (BUFFER_BLOCK *b = batch->next; b; b = b->next)
+    {
+        c->blocks[c->count++] = b;
+    }
+    return batch;
+}
+
+/**
+ * Put a batch of blocks into the depot
+ *
+ * If the depot already holds its limit, the blocks that came from the
+ * system are given back to it. The blocks of the arena are always kept.
+ *
+ * @param cls       Size class of the blocks
+ * @param blocks    The blocks
+ * @param n         Number of blocks
+ */
+static void
+buffer_depot_put(int cls, void **blocks, int n)
+{
+    BUFFER_DEPOT *depot = &buffer_depots[cls];
+    int limit = BUFFER_DEPOT_BYTES / buffer_class_size[cls];
+    BUFFER_BLOCK *batch = NULL;
+    int n_freed = 0;
+    int n_kept = 0;
+
+    spinlock_acquire(&depot->lock);
+    bool full = depot->n_blocks + n > limit;
+    spinlock_release(&depot->lock);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (full && !buffer_in_arena(blocks[i]))
+        {
+            free(blocks[i]);
+            n_freed++;
+        }
+        else
+        {
+            BUFFER_BLOCK *block = (BUFFER_BLOCK *)blocks[i];
+            block->next = batch;
+            batch = block;
+            n_kept++;
+        }
+    }
+
+    spinlock_acquire(&depot->lock);
+    if (batch)
+    {
+        batch->next_batch = depot->batches;
+        depot->batches = batch;
+        depot->n_blocks += n_kept;
+    }
+    depot->returns++;
+    depot->frees += n_freed;
+    spinlock_release(&depot->lock);
+}
+
+/**
+ * Release a block of memory
+ *
+ * @param cls   Size class of the block, -1 if not pooled
+ * @param block The block
+ */
+static void
+buffer_block_free(int cls, void *block)
+{
+    if (cls < 0)
+    {
+        free(block);
+        return;
+    }
+
+    BUFFER_CACHE *cache = buffer_get_cache();
+
+    if (cache == NULL)
+    {
+        buffer_depot_put(cls, &block, 1);
+        return;
+    }
+
+    BUFFER_CACHE_CLASS *c = &cache->classes[cls];
+
+    if (c->count == BUFFER_CACHE_SIZE)
+    {
+        c->count -= BUFFER_BATCH_SIZE;
+        buffer_depot_put(cls, &c->blocks[c->count], BUFFER_BATCH_SIZE);
+    }
+    c->blocks[c->count++] = block;
+}
+
+/**
+ * Print the statistics of the buffer pools to a DCB
+ *
+ * @param pdcb  DCB to print to
+ */
+void
+dprintBufferPools(void *pdcb)
+{
+    DCB *dcb = (DCB *)pdcb;
+
+    buffer_depots_init();
+
+    dcb_printf(dcb, "Buffer Pools\n\n");
+    dcb_printf(dcb, " Block Size | Thread Hits | Refills    | Misses     | Returns    | Frees      | In Depot\n");
+    dcb_printf(dcb, "------------+-------------+------------+------------+------------+------------+----------\n");
+
+    for (int i = 0; i < BUFFER_N_CLASSES; i++)
+    {
+        BUFFER_DEPOT *depot = &buffer_depots[i];
+        uint64_t hits = 0;
+
+        spinlock_acquire(&buffer_caches_lock);
+        for (BUFFER_CACHE *cache = buffer_caches; cache; cache = cache->next)
+        {
+            hits += cache->classes[i].hits;
+        }
+        spinlock_release(&buffer_caches_lock);
+
+        spinlock_acquire(&depot->lock);
+        dcb_printf(dcb, " %-10lu | %-11lu | %-10lu | %-10lu | %-10lu | %-10lu | %d\n",
+                   (unsigned long)buffer_class_size[i], (unsigned long)hits,
+                   (unsigned long)depot->refills, (unsigned long)depot->misses,
+                   (unsigned long)depot->returns, (unsigned long)depot->frees,
+                   depot->n_blocks);
+        spinlock_release(&depot->lock);
+    }
+
+    if (buffer_arena.start)
+    {
+        spinlock_acquire(&buffer_arena.lock);
+        dcb_printf(dcb, "\nArena of %s huge pages: %lu of %lu kB used\n",
+                   buffer_arena.hugetlb ? "explicit" : "transparent",
+                   (unsigned long)((buffer_arena.next - buffer_arena.start) / 1024),
+                   (unsigned long)((buffer_arena.end - buffer_arena.start) / 1024));
+        spinlock_release(&buffer_arena.lock);
+    }
+}
+
+/**
+ * Initialise the fields of a header that are not copied from another buffer
+ *
+ * @param buf   The header
+ */
+static void
+gwbuf_init_header(GWBUF *buf)
+{
+    spinlock_init(&buf->gwbuf_lock);
+    buf->next = NULL;
+    buf->tail = buf;
+    buf->hint = NULL;
+    buf->properties = NULL;
+}
+
 /**
  * Allocate a new gateway buffer structure of size bytes.
  *
- * For now we allocate memory directly from malloc for buffer the management
- * structure and the actual data buffer itself. We may swap at a future date
- * to a more efficient mechanism.
+ * The header, the shared buffer and the data area are allocated as one
+ * block from the pool of the smallest size class that fits them. Blocks
+ * larger than the largest class are allocated directly with malloc.
  *
  * @param       size The size in bytes of the data area required
  * @return      Pointer to the buffer structure or NULL if memory could not
@@ -81,39 +567,23 @@ gwbuf_alloc(unsigned int size)
 {
     GWBUF      *rval;
     SHARED_BUF *sbuf;
+    size_t     total = sizeof(GWBUF) + sizeof(SHARED_BUF) + size;
+    int        cls = buffer_class(total);
 
-    /* Allocate the buffer header */
-    if ((rval = (GWBUF *)malloc(sizeof(GWBUF))) == NULL)
-    {
-        goto retblock;
-    }
-
-    /* Allocate the shared data buffer */
-    if ((sbuf = (SHARED_BUF *)malloc(sizeof(SHARED_BUF))) == NULL)
+    if ((rval = (GWBUF *)buffer_block_alloc(cls, total)) == NULL)
     {
-        free(rval);
-        rval = NULL;
+        ss_dassert(rval != NULL);
         goto retblock;
     }
 
-    /* Allocate the space for the actual data */
-    if ((sbuf->data = (unsigned char *)malloc(size)) == NULL)
-    {
-        ss_dassert(sbuf->data != NULL);
-        free(rval);
-        free(sbuf);
-        rval = NULL;
-        goto retblock;
-    }
-    spinlock_init(&rval->gwbuf_lock);
+    sbuf = (SHARED_BUF *)(rval + 1);
+    sbuf->data = (unsigned char *)(sbuf + 1);
+    sbuf->refcount = 1;
+    sbuf->pool = cls;
+    gwbuf_init_header(rval);
     rval->start = sbuf->data;
     rval->end = (void *)((char *)rval->start + size);
-    sbuf->refcount = 1;
     rval->sbuf = sbuf;
-    rval->next = NULL;
-    rval->tail = rval;
-    rval->hint = NULL;
-    rval->properties = NULL;
     rval->gwbuf_type = GWBUF_TYPE_UNDEFINED;
     rval->gwbuf_info = GWBUF_INFO_NONE;
     rval->gwbuf_bufobj = NULL;
@@ -273,6 +743,10 @@ gwbuf_free(GWBUF *buf)
 /**
  * Free a single gateway buffer
  *
+ * The header of the buffer that allocated the data lives in the same block
+ * as the data, so it is released only with the last reference to the data.
+ * The headers of the clones are released right away.
+ *
  * @param buf The buffer to free
  */
 static void
@@ -280,19 +754,9 @@ gwbuf_free_one(GWBUF *buf)
 {
     BUF_PROPERTY    *prop;
     buffer_object_t *bo;
+    SHARED_BUF      *sbuf = buf->sbuf;
+    bool            embedded = (void *)sbuf == (void *)(buf + 1);
 
-    if (atomic_add(&buf->sbuf->refcount, -1) == 1)
-    {
-        free(buf->sbuf->data);
-        free(buf->sbuf);
-        bo = buf->gwbuf_bufobj;
-
-        while (bo != NULL)
-        {
-            bo = gwbuf_remove_buffer_object(buf, bo);
-        }
-
-    }
     while (buf->properties)
     {
         prop = buf->properties;
@@ -311,7 +775,23 @@ gwbuf_free_one(GWBUF *buf)
 #if defined(BUFFER_TRACE)
     gwbuf_remove_from_hashtable(buf);
 #endif
-    free(buf);
+
+    if (atomic_add(&sbuf->refcount, -1) == 1)
+    {
+        bo = buf->gwbuf_bufobj;
+
+        while (bo != NULL)
+        {
+            bo = gwbuf_remove_buffer_object(buf, bo);
+        }
+
+        buffer_block_free(sbuf->pool, (char *)sbuf - sizeof(GWBUF));
+    }
+
+    if (!embedded)
+    {
+        buffer_block_free(0, buf);
+    }
 }
 
 /**
@@ -329,7 +809,7 @@ gwbuf_clone(GWBUF *buf)
 {
     GWBUF *rval;
 
-    if ((rval = (GWBUF *)calloc(1, sizeof(GWBUF))) == NULL)
+    if ((rval = (GWBUF *)buffer_block_alloc(0, sizeof(GWBUF))) == NULL)
     {
         ss_dassert(rval != NULL);
         char errbuf[STRERROR_BUFLEN];
@@ -339,14 +819,13 @@ gwbuf_clone(GWBUF *buf)
     }
 
     atomic_add(&buf->sbuf->refcount, 1);
+    gwbuf_init_header(rval);
     rval->sbuf = buf->sbuf;
     rval->start = buf->start;
     rval->end = buf->end;
     rval->gwbuf_type = buf->gwbuf_type;
     rval->gwbuf_info = buf->gwbuf_info;
     rval->gwbuf_bufobj = buf->gwbuf_bufobj;
-    rval->tail = rval;
-    rval->next = NULL;
     CHK_GWBUF(rval);
 #if defined(BUFFER_TRACE)
     gwbuf_add_to_hashtable(rval);
@@ -393,7 +872,7 @@ static GWBUF *gwbuf_clone_portion(GWBUF *buf,
     CHK_GWBUF(buf);
     ss_dassert(start_offset + length <= GWBUF_LENGTH(buf));
 
-    if ((clonebuf = (GWBUF *)malloc(sizeof(GWBUF))) == NULL)
+    if ((clonebuf = (GWBUF *)buffer_block_alloc(0, sizeof(GWBUF))) == NULL)
     {
         ss_dassert(clonebuf != NULL);
         char errbuf[STRERROR_BUFLEN];
@@ -402,17 +881,14 @@ static GWBUF *gwbuf_clone_portion(GWBUF *buf,
         return NULL;
     }
     atomic_add(&buf->sbuf->refcount, 1);
+    gwbuf_init_header(clonebuf);
     clonebuf->sbuf = buf->sbuf;
     clonebuf->gwbuf_type = buf->gwbuf_type; /*< clone info bits too */
     clonebuf->start = (void *)((char*)buf->start + start_offset);
     clonebuf->end = (void *)((char *)clonebuf->start + length);
     clonebuf->gwbuf_type = buf->gwbuf_type; /*< clone the type for now */
-    clonebuf->properties = NULL;
-    clonebuf->hint = NULL;
     clonebuf->gwbuf_info = buf->gwbuf_info;
     clonebuf->gwbuf_bufobj = buf->gwbuf_bufobj;
-    clonebuf->next = NULL;
-    clonebuf->tail = clonebuf;
     CHK_GWBUF(clonebuf);
 #if defined(BUFFER_TRACE)
     gwbuf_add_to_hashtable(clonebuf);
@@ -688,6 +1164,8 @@ gwbuf_rtrim(GWBUF *head, unsigned int n_bytes)
     if (GWBUF_EMPTY(head))
     {
         rval = head->next;
+        /** Only the trimmed buffer is freed, not the rest of the chain */
+        head->next = NULL;
         gwbuf_free(head);
     }
     return rval;
@@ -986,3 +1464,86 @@ size_t gwbuf_copy_data(GWBUF *buffer, size_t offset, size_t bytes, uint8_t* dest
 
     return bytes_read;
 }
+
+/**
+ * Move a cursor out of consumed and empty buffers
+ *
+ * @param cur The cursor
+ */
+static inline void gwbuf_cursor_settle(GWBUF_CURSOR *cur)
+{
+    while (cur->buf && cur->ptr >= (uint8_t*) cur->buf->end)
+    {
+        cur->buf = cur->buf->next;
+        cur->ptr = cur->buf ? (uint8_t*) GWBUF_DATA(cur->buf) : NULL;
+    }
+}
+
+/**
+ * @brief Place a cursor at the start of a buffer chain
+ *
+ * @param cur The cursor
+ * @param buf Buffer chain, may be NULL
+ */
+void gwbuf_cursor_init(GWBUF_CURSOR *cur, GWBUF *buf)
+{
+    cur->buf = buf;
+    cur->ptr = buf ? (uint8_t*) GWBUF_DATA(buf) : NULL;
+    gwbuf_cursor_settle(cur);
+}
+
+/**
+ * @brief Move a cursor forward
+ *
+ * The data is not touched, only the buffers that are passed are walked.
+ *
+ * @param cur   The cursor
+ * @param bytes Number of bytes to skip
+ * @return Number of bytes skipped, less than @c bytes if the chain ended
+ */
+size_t gwbuf_cursor_skip(GWBUF_CURSOR *cur, size_t bytes)
+{
+    size_t skipped = 0;
+
+    while (cur->buf && skipped < bytes)
+    {
+        size_t n = MIN(GWBUF_CURSOR_AVAIL(cur), bytes - skipped);
+        cur->ptr += n;
+        skipped += n;
+        gwbuf_cursor_settle(cur);
+    }
+
+    return skipped;
+}
+
+/**
+ * @brief Copy bytes at an offset from a cursor
+ *
+ * The cursor is not moved. Like gwbuf_copy_data, this works across buffer
+ * boundaries but starts from the cursor instead of the head of the chain.
+ *
+ * @param cur    The cursor
+ * @param offset Offset from the cursor
+ * @param bytes  Number of bytes to copy
+ * @param dest   Destination where the bytes are copied
+ * @return Number of bytes copied
+ */
+size_t gwbuf_cursor_peek(const GWBUF_CURSOR *cur, size_t offset, size_t bytes, uint8_t* dest)
+{
+    GWBUF_CURSOR pos = *cur;
+    size_t copied = 0;
+
+    if (gwbuf_cursor_skip(&pos, offset) == offset)
+    {
+        while (pos.buf && copied < bytes)
+        {
+            size_t n = MIN(GWBUF_CURSOR_AVAIL(&pos), bytes - copied);
+            memcpy(dest + copied, pos.ptr, n);
+            pos.ptr += n;
+            copied += n;
+            gwbuf_cursor_settle(&pos);
+        }
+    }
+
+    return copied;
+}
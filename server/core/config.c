@@ -65,6 +65,7 @@
 #include <sys/ioctl.h>
 #include <net/if.h>
 #include <housekeeper.h>
+#include <affinity.h>
 #include <notification.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -192,6 +193,7 @@ static char *server_params[] =
     "monitoruser",
     "monitorpw",
     "persistpoolmax",
+    "persistpoolmin",
     "persistmaxtime",
     "ssl_cert",
     "ssl_ca_cert",
@@ -412,6 +414,13 @@ config_load(char *file)
 
     config_file = file;
 
+    if (gateway.writeq_high_water && gateway.writeq_low_water >= gateway.writeq_high_water)
+    {
+        MXS_ERROR("The value of 'writeq_low_water' (%u) must be smaller than the value "
+                  "of 'writeq_high_water' (%u).", gateway.writeq_low_water, gateway.writeq_high_water);
+        return 0;
+    }
+
     if (check_config_objects(config.next) && process_config_context(config.next))
     {
         rval = true;
@@ -864,6 +873,118 @@ config_pollsleep()
     return gateway.pollsleep;
 }
 
+/**
+ * Return the configured polling mode
+ *
+ * @return The way the polling threads share the descriptors
+ */
+poll_mode_t
+config_poll_mode()
+{
+    return gateway.poll_mode;
+}
+
+/**
+ * Return whether listeners are sharded with SO_REUSEPORT
+ *
+ * @return True if each polling thread should have its own listening socket
+ */
+bool
+config_reuseport()
+{
+    return gateway.reuseport;
+}
+
+/**
+ * Return the goal of the busy-poll governors
+ *
+ * @return The governor mode
+ */
+governor_mode_t
+config_poll_governor()
+{
+    return gateway.poll_governor;
+}
+
+/**
+ * Return the configured network I/O backend
+ *
+ * @return The I/O backend
+ */
+io_backend_t
+config_io_backend()
+{
+    return gateway.io_backend;
+}
+
+/**
+ * Return the CPU affinity of the threads
+ *
+ * @return The value of cpu_affinity, "none" if it was not set
+ */
+char *
+config_cpu_affinity()
+{
+    return gateway.cpu_affinity ? gateway.cpu_affinity : "none";
+}
+
+/**
+ * Return the size of the huge page arena of the buffers
+ *
+ * @return Size in megabytes, 0 if no arena is used
+ */
+unsigned int
+config_buffer_hugepages()
+{
+    return gateway.buffer_hugepages;
+}
+
+/**
+ * Return the timeout for establishing backend connections
+ *
+ * @return The timeout in seconds, 0 if the connections are not timed out
+ */
+unsigned int
+config_backend_connect_timeout()
+{
+    return gateway.backend_connect_timeout;
+}
+
+/**
+ * Return the size of a client write queue at which the reads of the backend
+ * connections of the session are paused
+ *
+ * @return The size in bytes, 0 if the reads are never paused
+ */
+unsigned int
+config_writeq_high_water()
+{
+    return gateway.writeq_high_water;
+}
+
+/**
+ * Return the size of a client write queue at which the paused reads of the
+ * backend connections are resumed
+ *
+ * @return The size in bytes
+ */
+unsigned int
+config_writeq_low_water()
+{
+    return gateway.writeq_low_water;
+}
+
+/**
+ * Return the limit of the data buffered by all sessions
+ *
+ * @return The limit in megabytes, 0 if the data is not limited
+ */
+unsigned int
+config_buffer_budget()
+{
+    return gateway.buffer_budget;
+}
+
 /**
  * Return the feedback config data pointer
  *
@@ -941,6 +1062,65 @@ handle_global_item(const char *name, const char *value)
     {
         gateway.pollsleep = atoi(value);
     }
+    else if (strcmp(name, "poll_mode") == 0)
+    {
+        if (strcmp(value, "global") == 0)
+        {
+            gateway.poll_mode = POLL_MODE_GLOBAL;
+        }
+        else if (strcmp(value, "worker") == 0)
+        {
+            gateway.poll_mode = POLL_MODE_WORKER;
+        }
+        else if (strcmp(value, "stealing") == 0)
+        {
+            gateway.poll_mode = POLL_MODE_STEALING;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for 'poll_mode': %s. Expected 'global', 'worker' "
+                      "or 'stealing'.", value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, "poll_governor") == 0)
+    {
+        if (strcmp(value, "efficiency") == 0)
+        {
+            gateway.poll_governor = GOVERNOR_EFFICIENCY;
+        }
+        else if (strcmp(value, "latency") == 0)
+        {
+            gateway.poll_governor = GOVERNOR_LATENCY;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for 'poll_governor': %s. Expected 'efficiency' "
+                      "or 'latency'.", value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, "io_backend") == 0)
+    {
+        if (strcmp(value, "epoll") == 0)
+        {
+            gateway.io_backend = IO_BACKEND_EPOLL;
+        }
+        else if (strcmp(value, "io_uring") == 0)
+        {
+            gateway.io_backend = IO_BACKEND_URING;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for 'io_backend': %s. Expected 'epoll' "
+                      "or 'io_uring'.", value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, "reuseport") == 0)
+    {
+        gateway.reuseport = config_truth_value((char*)value);
+    }
     else if (strcmp(name, "ms_timestamp") == 0)
     {
         mxs_log_set_highprecision_enabled(config_truth_value((char*)value));
@@ -958,6 +1138,81 @@ handle_global_item(const char *name, const char *value)
             MXS_WARNING("Invalid timeout value for 'auth_connect_timeout': %s", value);
         }
     }
+    else if (strcmp(name, "cpu_affinity") == 0)
+    {
+        if (!affinity_valid(value))
+        {
+            MXS_ERROR("Invalid value for 'cpu_affinity': %s. Use 'none', 'auto' "
+                      "or a list of CPUs such as '0-7,16-23'.", value);
+            return 0;
+        }
+        free(gateway.cpu_affinity);
+        gateway.cpu_affinity = strdup(value);
+    }
+    else if (strcmp(name, "buffer_hugepages") == 0)
+    {
+        char* endptr;
+        long intval = strtol(value, &endptr, 0);
+        if (*value != '\0' && *endptr == '\0' && intval >= 0)
+        {
+            gateway.buffer_hugepages = intval;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for 'buffer_hugepages': %s. Expected the size "
+                      "of the arena in megabytes.", value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, "backend_connect_timeout") == 0)
+    {
+        char* endptr;
+        int intval = strtol(value, &endptr, 0);
+        if (*endptr == '\0' && intval >= 0)
+        {
+            gateway.backend_connect_timeout = intval;
+        }
+        else
+        {
+            MXS_WARNING("Invalid timeout value for 'backend_connect_timeout': %s", value);
+        }
+    }
+    else if (strcmp(name, "writeq_high_water") == 0 || strcmp(name, "writeq_low_water") == 0)
+    {
+        char* endptr;
+        long intval = strtol(value, &endptr, 0);
+        if (*value != '\0' && *endptr == '\0' && intval >= 0 && intval <= INT_MAX)
+        {
+            if (strcmp(name, "writeq_high_water") == 0)
+            {
+                gateway.writeq_high_water = intval;
+            }
+            else
+            {
+                gateway.writeq_low_water = intval;
+            }
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for '%s': %s. Expected a size in bytes.", name, value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, "buffer_budget") == 0)
+    {
+        char* endptr;
+        long intval = strtol(value, &endptr, 0);
+        if (*value != '\0' && *endptr == '\0' && intval >= 0 && intval <= INT_MAX)
+        {
+            gateway.buffer_budget = intval;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for 'buffer_budget': %s. Expected the size "
+                      "in megabytes.", value);
+            return 0;
+        }
+    }
     else if (strcmp(name, "auth_read_timeout") == 0)
     {
         char* endptr;
@@ -1220,7 +1475,18 @@ global_defaults()
     gateway.n_threads = DEFAULT_NTHREADS;
     gateway.n_nbpoll = DEFAULT_NBPOLLS;
     gateway.pollsleep = DEFAULT_POLLSLEEP;
+    gateway.poll_mode = POLL_MODE_GLOBAL;
+    gateway.poll_governor = GOVERNOR_EFFICIENCY;
+    gateway.io_backend = IO_BACKEND_EPOLL;
+    gateway.reuseport = false;
+    free(gateway.cpu_affinity);
+    gateway.cpu_affinity = NULL;
+    gateway.buffer_hugepages = 0;
     gateway.auth_conn_timeout = DEFAULT_AUTH_CONNECT_TIMEOUT;
+    gateway.backend_connect_timeout = 0;
+    gateway.writeq_high_water = DEFAULT_WRITEQ_HIGH_WATER;
+    gateway.writeq_low_water = DEFAULT_WRITEQ_LOW_WATER;
+    gateway.buffer_budget = 0;
     gateway.auth_read_timeout = DEFAULT_AUTH_READ_TIMEOUT;
     gateway.auth_write_timeout = DEFAULT_AUTH_WRITE_TIMEOUT;
     if (version_string != NULL)
@@ -2472,6 +2738,22 @@ int create_new_server(CONFIG_CONTEXT *obj)
             }
         }
 
+        const char *poolmin = config_get_value_string(obj->parameters, "persistpoolmin");
+        if (poolmin)
+        {
+            long int persistpoolmin = strtol(poolmin, &endptr, 0);
+            if (*endptr != '\0' || persistpoolmin < 0)
+            {
+                MXS_ERROR("Invalid value for 'persistpoolmin' for server %s: %s",
+                          server->unique_name, poolmin);
+                error_count++;
+            }
+            else
+            {
+                server->persistpoolmin = persistpoolmin;
+            }
+        }
+
         const char *persistmax = config_get_value_string(obj->parameters, "persistmaxtime");
         if (persistmax)
         {
@@ -88,18 +88,65 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <platform.h>
+
+/** Largest number of buffers sent with one writev */
+#define DCB_WRITEV_MAX      IOV_MAX
+/** Largest amount of data in one TLS record */
+#define DCB_SSL_RECORD_SIZE 16384
+/** Size of the receive region, the buffer headers fit in the same 16 kB block */
+#define DCB_RECV_SIZE       (16 * 1024 - 256)
+/** A region with less room than this is replaced before a read */
+#define DCB_RECV_MIN        1024
+
+/** Number of free DCBs a thread keeps, the excess goes to the shared depot */
+#define DCB_POOL_MAX        64
+#define DCB_CACHE_LINE      64
+/** A batched write queue this large is written without waiting for the end of the batch */
+#define DCB_BATCH_MAX       (64 * 1024)
+/** Seconds between the checks of an idle DCB in a persistent pool */
+#define DCB_PERSIST_CHECK_SECS 10
 
-static  DCB             *allDCBs = NULL;        /* Diagnostics need a list of DCBs */
-static  DCB             *lastDCB = NULL;
-static  DCB             *wasfreeDCB = NULL;
-static  int             freeDCBcount = 0;
-static  int             nDCBs = 0;
-static  int             maxDCBs = 0;
-static  DCB             *zombies = NULL;
-static  int             nzombies = 0;
-static  int             maxzombies = 0;
-static  SPINLOCK        dcbspin = SPINLOCK_INIT;
-static  SPINLOCK        zombiespin = SPINLOCK_INIT;
+/**
+ * The registry of all DCB memory. The DCBs are never freed so the registry
+ * only grows and it is only needed when new memory is allocated and by the
+ * diagnostics and the lookups that go through all DCBs.
+ */
+static  DCB             **dcb_registry = NULL;
+static  int             dcb_registry_count = 0;
+static  int             dcb_registry_size = 0;
+static  SPINLOCK        dcb_registry_lock = SPINLOCK_INIT;
+
+/** The free DCBs of the calling thread, linked through memdata.next */
+static  thread_local DCB *dcb_pool = NULL;
+static  thread_local int dcb_pool_count = 0;
+/** Free DCBs given up by the threads that have too many or that do not poll */
+static  DCB             *dcb_depot = NULL;
+
+/** The epoch published by a polling thread, padded to a cache line */
+typedef struct
+{
+    uint64_t    epoch;
+    char        pad[DCB_CACHE_LINE - sizeof(uint64_t)];
+} DCB_THREAD_EPOCH;
+
+static  uint64_t        dcb_epoch = 1;
+static  DCB_THREAD_EPOCH *dcb_thread_epochs = NULL;
+static  int             dcb_n_threads = 0;
+/** The zombies closed by the calling polling thread */
+static  thread_local DCB *dcb_zombies = NULL;
+/** The zombies closed by other threads, adopted by the polling threads */
+static  DCB             *dcb_orphans = NULL;
+
+/** Nesting depth of the write batch of the calling thread */
+static  thread_local int dcb_batch_depth = 0;
+/** The DCBs written in the current batch, linked through batch_next */
+static  thread_local DCB *dcb_batch_list = NULL;
+
+/** Number of client DCBs with write queue data charged to the budget */
+static  int             n_writeq_clients = 0;
 
 static void dcb_final_free(DCB *dcb);
 static void dcb_call_callback(DCB *dcb, DCB_REASON reason);
@@ -110,12 +157,16 @@ static inline DCB * dcb_find_in_list(DCB *dcb);
 static inline void dcb_process_victim_queue(DCB *listofdcb);
 static void dcb_stop_polling_and_shutdown (DCB *dcb);
 static bool dcb_maybe_add_persistent(DCB *);
+static void dcb_persistent_expire(void *data);
+static void dcb_persistent_prewarm(DCB *dcb);
+static long dcb_persistent_check_ms(SERVER *server);
+static DCB *dcb_connect_new(SERVER *server, SESSION *session, const char *protocol, int flags);
+static void dcb_connect_timeout(void *data);
 static inline bool dcb_write_parameter_check(DCB *dcb, GWBUF *queue);
-static int dcb_bytes_readable(DCB *dcb);
 static int dcb_read_no_bytes_available(DCB *dcb, int nreadtotal);
 static int dcb_create_SSL(DCB* dcb, SSL_LISTENER *ssl);
 static int dcb_read_SSL(DCB *dcb, GWBUF **head);
-static GWBUF *dcb_basic_read(DCB *dcb, int bytesavailable, int maxbytes, int nreadtotal, int *nsingleread);
+static GWBUF *dcb_basic_read(DCB *dcb, int maxbytes, int *nsingleread, bool *drained);
 static GWBUF *dcb_basic_read_SSL(DCB *dcb, int *nsingleread);
 #if defined(FAKE_CODE)
 static inline void dcb_write_fake_code(DCB *dcb);
@@ -126,12 +177,25 @@ static int gw_write(DCB *dcb, GWBUF *writeq, bool *stop_writing);
 static int gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing);
 static int dcb_log_errors_SSL (DCB *dcb, const char *called_by, int ret);
 static int dcb_accept_one_connection(DCB *listener, struct sockaddr *client_conn);
-static int dcb_listen_create_socket_inet(const char *config_bind);
+static int dcb_listen_create_socket_inet(const char *config_bind, bool reuseport);
 static int dcb_listen_create_socket_unix(const char *config_bind);
 static int dcb_set_socket_option(int sockfd, int level, int optname, void *optval, socklen_t optlen);
-static void dcb_add_to_all_list(DCB *dcb);
+static bool dcb_register(DCB *dcb);
 static DCB *dcb_find_free();
+static void dcb_pool_put(DCB *dcb);
+static void dcb_retire(DCB *dcb);
+static uint64_t dcb_safe_epoch();
 static GWBUF *dcb_grab_writeq(DCB *dcb, bool first_time);
+static void dcb_splice_release(DCB *dcb);
+static void dcb_splice_write_ready(DCB *dcb);
+static bool dcb_throttle_pause(DCB *dcb, DCB *owner);
+static bool dcb_throttle_can_release(DCB *owner);
+static void dcb_throttle_release(DCB *client);
+static void dcb_throttle_cancel(DCB *dcb);
+static bool dcb_session_is_heavy(DCB *dcb);
+static void dcb_buffered_release_all(DCB *dcb);
+static inline void dcb_writeq_client_update(int before, int after);
+static inline int dcb_pool_id(DCB *dcb);
 
 size_t dcb_get_session_id(
     DCB *dcb)
@@ -166,14 +230,38 @@ bool dcb_get_ses_log_info(
 }
 
 /**
- * Return the pointer to the list of zombie DCB's
+ * Return the pointer to the list of zombie DCB's of the calling thread or,
+ * if it has none, to the zombies that wait to be adopted by a polling thread
  *
  * @return Zombies DCB list
  */
 DCB *
 dcb_get_zombies(void)
 {
-    return zombies;
+    return dcb_zombies ? dcb_zombies : dcb_orphans;
+}
+
+/**
+ * Set up the epochs of the polling threads
+ *
+ * Must be called before the polling threads are started. Until a polling
+ * thread has passed its first quiescent point no zombies are freed.
+ *
+ * @param n_threads Number of polling threads
+ */
+void
+dcb_epoch_init(int n_threads)
+{
+    DCB_THREAD_EPOCH *epochs = calloc(n_threads, sizeof(DCB_THREAD_EPOCH));
+
+    if (epochs == NULL)
+    {
+        MXS_ERROR("Failed to allocate the epochs of the polling threads.");
+        return;
+    }
+    free(dcb_thread_epochs);
+    dcb_thread_epochs = epochs;
+    dcb_n_threads = n_threads;
 }
 
 /**
@@ -190,18 +278,10 @@ dcb_alloc(dcb_role_t role, SERV_LISTENER *listener)
 {
     DCB *newdcb;
 
-    spinlock_acquire(&dcbspin);
     if ((newdcb = dcb_find_free()) == NULL)
     {
-        spinlock_release(&dcbspin);
         return NULL;
     }
-    nDCBs++;
-    if (nDCBs > maxDCBs)
-    {
-        maxDCBs = nDCBs;
-    }
-    spinlock_release(&dcbspin);
 
     newdcb->dcb_chk_top = CHK_NUM_DCB;
     newdcb->dcb_chk_tail = CHK_NUM_DCB;
@@ -215,6 +295,7 @@ dcb_alloc(dcb_role_t role, SERV_LISTENER *listener)
     spinlock_init(&newdcb->cb_lock);
     spinlock_init(&newdcb->pollinlock);
     spinlock_init(&newdcb->polloutlock);
+    spinlock_init(&newdcb->throttlelock);
     newdcb->pollinbusy = 0;
     newdcb->readcheck = 0;
     newdcb->polloutbusy = 0;
@@ -225,14 +306,22 @@ dcb_alloc(dcb_role_t role, SERV_LISTENER *listener)
     newdcb->evq.prev = NULL;
     newdcb->evq.pending_events = 0;
     newdcb->evq.processing = 0;
+    newdcb->evq.sched = DCB_SCHED_IDLE;
+    newdcb->evq.posted_events = 0;
     spinlock_init(&newdcb->evq.eventqlock);
+    newdcb->owner = -1;
+    newdcb->persistpool = -1;
+    newdcb->uring = NULL;
+    newdcb->splice = NULL;
+    newdcb->recv_region = NULL;
 
     memset(&newdcb->stats, 0, sizeof(DCBSTATS));        // Zero the statistics
     newdcb->state = DCB_STATE_ALLOC;
-    bitmask_init(&newdcb->memdata.bitmask);
     newdcb->writeqlen = 0;
     newdcb->high_water = 0;
     newdcb->low_water = 0;
+    memset(newdcb->buffered, 0, sizeof(newdcb->buffered));
+    newdcb->budget_service = NULL;
     newdcb->session = NULL;
     newdcb->server = NULL;
     newdcb->service = NULL;
@@ -251,94 +340,121 @@ dcb_alloc(dcb_role_t role, SERV_LISTENER *listener)
 }
 
 /**
- * Add a new DCB to the list of all DCBs.
- *
- * Must be called with the general DCB lock held.
+ * Add new DCB memory to the registry of all DCBs.
  *
- * A pointer, lastDCB, is held to find the end of the list, and the new DCB
- * is linked to the end of the list.  The pointer, wasfreeDCB, that is used to
- * search for a free DCB is initialised if not already set. There cannot be
- * any free DCBs until this routine has been called at least once, so
- * wasfreeDCB will not be referred to before it is initialised.
- *
- * @param dcb    The DCB to be added to the list
+ * @param dcb    The DCB to be added to the registry
+ * @return True if the DCB was added
  */
-static void
-dcb_add_to_all_list(DCB *dcb)
+static bool
+dcb_register(DCB *dcb)
 {
-    if (allDCBs == NULL)
-    {
-        allDCBs = dcb;
-    }
-    else
+    bool rval = true;
+
+    spinlock_acquire(&dcb_registry_lock);
+    if (dcb_registry_count == dcb_registry_size)
     {
-        lastDCB->next = dcb;
+        int size = dcb_registry_size ? dcb_registry_size * 2 : 256;
+        DCB **registry = realloc(dcb_registry, size * sizeof(DCB *));
+
+        if (registry)
+        {
+            dcb_registry = registry;
+            dcb_registry_size = size;
+        }
+        else
+        {
+            rval = false;
+        }
     }
-    lastDCB = dcb;
-    if (NULL == wasfreeDCB)
+    if (rval)
     {
-        wasfreeDCB = dcb;
+        dcb_registry[dcb_registry_count++] = dcb;
     }
+    spinlock_release(&dcb_registry_lock);
+    return rval;
 }
 
 /**
- * Find a free DCB or allocate memory for a new one.
+ * Take a free DCB or allocate memory for a new one.
  *
- * This routine looks to see whether there are free DCB memory areas.
- * If not, new memory is allocated, if possible, and the new DCB is added to
- * the list of all DCBs.
- *
- * Must be called with the general DCB lock held.
+ * The DCB is taken from the pool of the calling thread or, if that is
+ * empty, the DCBs in the shared depot are moved to the pool. New memory is
+ * only allocated if there are no free DCBs in either.
  *
  * @return An available DCB or NULL if none could be allocated.
  */
 static DCB *
 dcb_find_free()
 {
-    DCB *nextdcb;
-    int loopcount = 0;
+    DCB *dcb;
 
-    if (freeDCBcount <= 0)
+    if (dcb_pool == NULL && dcb_depot)
     {
-        DCB *newdcb;
-        if ((newdcb = calloc(1, sizeof(DCB))) == NULL)
+        dcb_pool = __sync_lock_test_and_set(&dcb_depot, NULL);
+        for (dcb = dcb_pool; dcb; dcb = dcb->memdata.next)
         {
-            return NULL;
+            dcb_pool_count++;
         }
-        newdcb->next = NULL;
-        dcb_add_to_all_list(newdcb);
-        newdcb->dcb_is_in_use = true;
-        return newdcb;
     }
-    /* Starting at the last place a free DCB was found, loop through the */
-    /* list of DCBs searching for one that is not in use. */
-    while (wasfreeDCB->dcb_is_in_use)
+
+    if ((dcb = dcb_pool) != NULL)
+    {
+        dcb_pool = dcb->memdata.next;
+        dcb_pool_count--;
+        memset(dcb, 0, sizeof(DCB));
+    }
+    else if ((dcb = calloc(1, sizeof(DCB))) != NULL && !dcb_register(dcb))
+    {
+        free(dcb);
+        dcb = NULL;
+    }
+
+    if (dcb)
+    {
+        dcb->dcb_is_in_use = true;
+    }
+    return dcb;
+}
+
+/**
+ * Return a freed DCB to the pool of the calling thread.
+ *
+ * A thread that is not a polling thread would never reuse the DCB and a
+ * polling thread keeps at most DCB_POOL_MAX of them, so the DCB or half of
+ * the pool is pushed to the shared depot where any thread can take them.
+ *
+ * @param dcb    The freed DCB
+ */
+static void
+dcb_pool_put(DCB *dcb)
+{
+    DCB *first = dcb, *last = dcb;
+
+    if (poll_thread_id() >= 0)
     {
-        wasfreeDCB = wasfreeDCB->next;
-        if (NULL == wasfreeDCB)
+        dcb->memdata.next = dcb_pool;
+        dcb_pool = dcb;
+
+        if (++dcb_pool_count <= DCB_POOL_MAX)
         {
-            loopcount++;
-            if (loopcount > 1)
-            {
-                /* Shouldn't need to loop round more than once */
-                MXS_ERROR("Find free DCB failed to find a free DCB even"
-                          " though the free count was positive");
-                return NULL;
-            }
-            wasfreeDCB = allDCBs;
+            return;
+        }
+
+        first = last = dcb_pool;
+        for (int i = 1; i < DCB_POOL_MAX / 2; i++)
+        {
+            last = last->memdata.next;
         }
+        dcb_pool = last->memdata.next;
+        dcb_pool_count -= DCB_POOL_MAX / 2;
     }
-    /* Dropping out of the loop means we have found a DCB that is not in use */
-    freeDCBcount--;
-    ss_dassert(freeDCBcount >= 0);
-    /* Clear the old data, then reset the list forward link */
-    nextdcb = wasfreeDCB->next;
-    memset(wasfreeDCB, 0, sizeof(DCB));
-    wasfreeDCB->next = nextdcb;
-    wasfreeDCB->dcb_is_in_use = true;
-    return wasfreeDCB;
-}
 
+    do
+    {
+        last->memdata.next = dcb_depot;
+    }
+    while (!__sync_bool_compare_and_swap(&dcb_depot, last->memdata.next, first));
+}
 
 /**
  * Provided only for consistency, simply calls dcb_close to guarantee
@@ -413,6 +529,8 @@ dcb_final_free(DCB *dcb)
         MXS_ERROR("dcb_final_free: DCB %p has outstanding events.", dcb);
     }
 
+    poll_timer_cancel(&dcb->timer);
+
     if (dcb->session)
     {
         /*<
@@ -488,11 +606,23 @@ dcb_free_all_memory(DCB *dcb)
         gwbuf_free(dcb->writeq);
         dcb->writeq = NULL;
     }
+    dcb_buffered_release_all(dcb);
     if (dcb->dcb_readqueue)
     {
         gwbuf_free(dcb->dcb_readqueue);
         dcb->dcb_readqueue = NULL;
     }
+    if (dcb->uring)
+    {
+        free(dcb->uring);
+        dcb->uring = NULL;
+    }
+    dcb_splice_release(dcb);
+    if (dcb->recv_region)
+    {
+        gwbuf_free(dcb->recv_region);
+        dcb->recv_region = NULL;
+    }
 
     spinlock_acquire(&dcb->cb_lock);
     while ((cb_dcb = dcb->callbacks) != NULL)
@@ -505,132 +635,154 @@ dcb_free_all_memory(DCB *dcb)
     {
         SSL_free(dcb->ssl);
     }
-    bitmask_free(&dcb->memdata.bitmask);
 
     /* We never free the actual DCB, it is available for reuse*/
-    spinlock_acquire(&dcbspin);
     dcb->dcb_is_in_use = false;
-    freeDCBcount++;
-    nDCBs--;
-    spinlock_release(&dcbspin);
+    dcb_pool_put(dcb);
+}
+
+/**
+ * Add a closed DCB to the zombies of the calling thread
+ *
+ * The DCB is stamped with the current epoch and the global epoch is advanced.
+ * The zombies of the threads that are not polling threads are adopted by the
+ * next polling thread that processes its zombies.
+ *
+ * @param dcb   The closed DCB
+ */
+static void
+dcb_retire(DCB *dcb)
+{
+    dcb->memdata.epoch = __sync_fetch_and_add(&dcb_epoch, 1);
+
+    if (poll_thread_id() >= 0)
+    {
+        dcb->memdata.next = dcb_zombies;
+        dcb_zombies = dcb;
+    }
+    else
+    {
+        do
+        {
+            dcb->memdata.next = dcb_orphans;
+        }
+        while (!__sync_bool_compare_and_swap(&dcb_orphans, dcb->memdata.next, dcb));
+    }
+}
+
+/**
+ * Return the oldest epoch published by the polling threads
+ *
+ * The DCBs closed before this epoch can no longer be referenced.
+ *
+ * @return The oldest published epoch
+ */
+static uint64_t
+dcb_safe_epoch()
+{
+    uint64_t rval = UINT64_MAX;
+
+    for (int i = 0; i < dcb_n_threads; i++)
+    {
+        uint64_t epoch = *(volatile uint64_t *)&dcb_thread_epochs[i].epoch;
 
+        if (epoch < rval)
+        {
+            rval = epoch;
+        }
+    }
+    return rval;
 }
 
 /**
  * Process the DCB zombie queue
  *
- * This routine is called by each of the polling threads with
- * the thread id of the polling thread. It must clear the bit in
- * the memdata bitmask for the polling thread that calls it. If the
- * operation of clearing this bit means that no bits are set in
- * the memdata.bitmask then the DCB is no longer able to be
- * referenced and it can be finally removed.
+ * This routine is called by each of the polling threads with the thread id
+ * of the polling thread at a point where the thread holds no references to
+ * DCBs. It publishes the current epoch for the calling thread and frees the
+ * zombies of the thread that were closed before the oldest epoch published
+ * by any thread.
  *
  * @param       threadid        The thread ID of the caller
+ * @return The remaining zombies of the calling thread
  */
 DCB *
 dcb_process_zombies(int threadid)
 {
     DCB *zombiedcb;
-    DCB *previousdcb = NULL, *nextdcb;
+    DCB *nextdcb;
+    DCB **previous = &dcb_zombies;
     DCB *listofdcb = NULL;
 
-    /**
-     * Perform a dirty read to see if there is anything in the queue.
-     * This avoids threads hitting the queue spinlock when the queue
-     * is empty. This will really help when the only entry is being
-     * freed, since the queue is updated before the expensive call to
-     * dcb_final_free.
-     */
-    if (!zombies)
+    if (threadid >= 0 && threadid < dcb_n_threads)
+    {
+        dcb_thread_epochs[threadid].epoch = *(volatile uint64_t *)&dcb_epoch;
+        __sync_synchronize();
+    }
+
+    /** A dirty read avoids the atomic exchange when there are no orphans */
+    if (dcb_orphans)
+    {
+        DCB *orphans = __sync_lock_test_and_set(&dcb_orphans, NULL);
+
+        while (orphans)
+        {
+            nextdcb = orphans->memdata.next;
+            orphans->memdata.next = dcb_zombies;
+            dcb_zombies = orphans;
+            orphans = nextdcb;
+        }
+    }
+
+    if (dcb_zombies == NULL)
     {
         return NULL;
     }
 
-    /*
-     * Process the zombie queue and create a list of DCB's that can be
-     * finally freed. This processing is down under a spinlock that
-     * will prevent new entries being added to the zombie queue. Therefore
-     * we do not want to do any expensive operations under this spinlock
-     * as it will block other threads. The expensive operations will be
-     * performed on the victim queue within holding the zombie queue
-     * spinlock.
-     */
-    spinlock_acquire(&zombiespin);
-    zombiedcb = zombies;
-    while (zombiedcb)
+    uint64_t safe = dcb_safe_epoch();
+
+    for (zombiedcb = dcb_zombies; zombiedcb; zombiedcb = nextdcb)
     {
         CHK_DCB(zombiedcb);
         nextdcb = zombiedcb->memdata.next;
         /*
          * Skip processing of DCB's that are
-         * in the event queue waiting to be processed.
+         * in the event queue waiting to be processed
+         * or still have io_uring requests in flight.
+         * The requests are only cancelled when the DCB
+         * is removed from the poll set, so a DCB that
+         * is still polling is processed regardless.
          */
-        if (zombiedcb->evq.next || zombiedcb->evq.prev)
+        if (zombiedcb->memdata.epoch >= safe || DCB_POLL_BUSY(zombiedcb) ||
+            (DCB_URING_BUSY(zombiedcb) && zombiedcb->state != DCB_STATE_POLLING))
         {
-            previousdcb = zombiedcb;
+            previous = &zombiedcb->memdata.next;
         }
         else
         {
-
-            if (bitmask_clear_without_spinlock(&zombiedcb->memdata.bitmask, threadid))
-            {
-                /**
-                 * Remove the DCB from the zombie queue
-                 * and call the final free routine for the
-                 * DCB
-                 *
-                 * zombiedcb is the DCB we are processing
-                 * previousdcb is the previous DCB on the zombie
-                 * queue or NULL if the DCB is at the head of the
-                 * queue.  Remove zombiedcb from the zombies list.
-                 */
-                if (NULL == previousdcb)
-                {
-                    zombies = zombiedcb->memdata.next;
-                }
-                else
-                {
-                    previousdcb->memdata.next = zombiedcb->memdata.next;
-                }
-
-                MXS_DEBUG("%lu [%s] Remove dcb "
-                          "%p fd %d in state %s from the "
-                          "list of zombies.",
-                          pthread_self(),
-                          __func__,
-                          zombiedcb,
-                          zombiedcb->fd,
-                          STRDCBSTATE(zombiedcb->state));
-                /*<
-                 * Move zombie dcb to linked list of victim dcbs.
-                 * The variable dcb is used to hold the last DCB
-                 * to have been added to the linked list, or NULL
-                 * if none has yet been added.  If the list
-                 * (listofdcb) is not NULL, then it follows that
-                 * dcb will also not be null.
-                 */
-                nzombies--;
-                zombiedcb->memdata.next = listofdcb;
-                listofdcb = zombiedcb;
-            }
-            else
-            {
-                /* Since we didn't remove this dcb from the zombies
-                   list, we need to advance the previous pointer */
-                previousdcb = zombiedcb;
-            }
+            MXS_DEBUG("%lu [%s] Remove dcb "
+                      "%p fd %d in state %s from the "
+                      "list of zombies.",
+                      pthread_self(),
+                      __func__,
+                      zombiedcb,
+                      zombiedcb->fd,
+                      STRDCBSTATE(zombiedcb->state));
+            /*<
+             * Move zombie dcb to linked list of victim dcbs.
+             */
+            *previous = nextdcb;
+            zombiedcb->memdata.next = listofdcb;
+            listofdcb = zombiedcb;
         }
-        zombiedcb = nextdcb;
     }
-    spinlock_release(&zombiespin);
 
     if (listofdcb)
     {
         dcb_process_victim_queue(listofdcb);
     }
 
-    return zombies;
+    return dcb_zombies;
 }
 
 /**
@@ -650,6 +802,13 @@ dcb_process_victim_queue(DCB *listofdcb)
     while (dcb != NULL)
     {
         DCB *nextdcb;
+
+        if ((dcb->flags & DCBF_PREWARM) && dcb->server)
+        {
+            /** The pool may be filled again whether or not this one made it there */
+            dcb->flags &= ~DCBF_PREWARM;
+            atomic_add(&server_get_pool(dcb->server, dcb_pool_id(dcb))->warming, -1);
+        }
         /*<
          * Stop dcb's listening and modify state accordingly.
          */
@@ -680,17 +839,9 @@ dcb_process_victim_queue(DCB *listofdcb)
                 {
                     DCB *next2dcb;
                     dcb_stop_polling_and_shutdown(dcb);
-                    spinlock_acquire(&zombiespin);
-                    bitmask_copy(&dcb->memdata.bitmask, poll_bitmask());
+                    /** Events that were already returned may still refer to it */
                     next2dcb = dcb->memdata.next;
-                    dcb->memdata.next = zombies;
-                    zombies = dcb;
-                    nzombies++;
-                    if (nzombies > maxzombies)
-                    {
-                        maxzombies = nzombies;
-                    }
-                    spinlock_release(&zombiespin);
+                    dcb_retire(dcb);
                     dcb = next2dcb;
                     continue;
                 }
@@ -716,7 +867,7 @@ dcb_process_victim_queue(DCB *listofdcb)
         }
         if (dcb->server && 0 == dcb->persistentstart)
         {
-            atomic_add(&dcb->server->stats.n_current, -1);
+            ts_stats_add(dcb->server->stats.n_current, -1);
         }
 
         if (dcb->fd > 0)
@@ -800,9 +951,6 @@ DCB *
 dcb_connect(SERVER *server, SESSION *session, const char *protocol)
 {
     DCB         *dcb;
-    GWPROTOCOL  *funcs;
-    int         fd;
-    int         rc;
     char        *user;
 
     user = session_getUser(session);
@@ -813,6 +961,8 @@ dcb_connect(SERVER *server, SESSION *session, const char *protocol)
         dcb = server_get_persistent(server, user, protocol);
         if (dcb)
         {
+            /** Out of the pool, a failed link closes the DCB normally */
+            dcb->persistentstart = 0;
             /**
              * Link dcb to session. Unlink is called in dcb_final_free
              */
@@ -826,7 +976,10 @@ dcb_connect(SERVER *server, SESSION *session, const char *protocol)
             }
             MXS_DEBUG("%lu [dcb_connect] Reusing a persistent connection, dcb %p\n",
                       pthread_self(), dcb);
-            dcb->persistentstart = 0;
+            /** The protocol resets the session state before the first query */
+            dcb->flags |= DCBF_REUSED;
+            /** An unowned DCB returns to the pool of the thread that reused it */
+            dcb->persistpool = poll_thread_id();
             return dcb;
         }
         else
@@ -836,6 +989,31 @@ dcb_connect(SERVER *server, SESSION *session, const char *protocol)
         }
     }
 
+    if ((dcb = dcb_connect_new(server, session, protocol, 0)) != NULL)
+    {
+        dcb_persistent_prewarm(dcb);
+    }
+
+    return dcb;
+}
+
+/**
+ * Open a new connection to a server
+ *
+ * @param server        The server to connect to
+ * @param session       The session this connection is being made for
+ * @param protocol      The protocol module to use
+ * @param flags         DCB flags set before the DCB is added to the poll set
+ * @return              The new allocated dcb or NULL if the DCB was not connected
+ */
+static DCB *
+dcb_connect_new(SERVER *server, SESSION *session, const char *protocol, int flags)
+{
+    DCB         *dcb;
+    GWPROTOCOL  *funcs;
+    int         fd;
+    int         rc;
+
     if ((dcb = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL)) == NULL)
     {
         return NULL;
@@ -912,6 +1090,16 @@ dcb_connect(SERVER *server, SESSION *session, const char *protocol)
      * EPOLLOUT event that will be received once the connection
      * is established.
      */
+    dcb->flags |= flags;
+    dcb->persistpool = poll_thread_id();
+
+    if (config_backend_connect_timeout() > 0)
+    {
+        /** Cleared by the first EPOLLOUT event, armed before the DCB can get events */
+        dcb->flags |= DCBF_CONNECTING;
+        poll_timer_add(&dcb->timer, dcb_connect_timeout, dcb,
+                       config_backend_connect_timeout() * 1000);
+    }
 
     /**
      * Add the dcb in the poll set
@@ -927,8 +1115,8 @@ dcb_connect(SERVER *server, SESSION *session, const char *protocol)
     /**
      * The dcb will be addded into poll set by dcb->func.connect
      */
-    atomic_add(&server->stats.n_connections, 1);
-    atomic_add(&server->stats.n_current, 1);
+    ts_stats_add(server->stats.n_connections, 1);
+    ts_stats_add(server->stats.n_current, 1);
 
     return dcb;
 }
@@ -961,6 +1149,12 @@ int dcb_read(DCB   *dcb,
         spinlock_release(&dcb->authlock);
     }
 
+    if (dcb->uring)
+    {
+        /** The io_uring backend has already placed the data in the read queue */
+        return nreadtotal;
+    }
+
     if (SSL_HANDSHAKE_DONE == dcb->ssl_state || SSL_ESTABLISHED == dcb->ssl_state)
     {
         return dcb_read_SSL(dcb, head);
@@ -980,78 +1174,46 @@ int dcb_read(DCB   *dcb,
 
     while (0 == maxbytes || nreadtotal < maxbytes)
     {
-        int bytes_available;
+        GWBUF *buffer;
+        bool drained = false;
 
-        bytes_available = dcb_bytes_readable(dcb);
-        if (bytes_available <= 0)
+        buffer = dcb_basic_read(dcb, maxbytes ? maxbytes - nreadtotal : 0, &nsingleread, &drained);
+        if (buffer)
         {
-            return bytes_available < 0 ? -1 :
-                   /** Handle closed client socket */
-                   dcb_read_no_bytes_available(dcb, nreadtotal);
-        }
-        else
-        {
-            GWBUF *buffer;
             dcb->last_read = hkheartbeat;
+            nreadtotal += nsingleread;
+            /* <editor-fold defaultstate="collapsed" desc=" Debug Logging "> */
+            MXS_DEBUG("%lu [dcb_read] Read %d bytes from dcb %p in state %s "
+                      "fd %d.",
+                      pthread_self(),
+                      nsingleread,
+                      dcb,
+                      STRDCBSTATE(dcb->state),
+                      dcb->fd);
+            /* </editor-fold> */
+            /*< Append read data to the gwbuf */
+            *head = gwbuf_append(*head, buffer);
 
-            buffer = dcb_basic_read(dcb, bytes_available, maxbytes, nreadtotal, &nsingleread);
-            if (buffer)
-            {
-                nreadtotal += nsingleread;
-                /* <editor-fold defaultstate="collapsed" desc=" Debug Logging "> */
-                MXS_DEBUG("%lu [dcb_read] Read %d bytes from dcb %p in state %s "
-                          "fd %d.",
-                          pthread_self(),
-                          nsingleread,
-                          dcb,
-                          STRDCBSTATE(dcb->state),
-                          dcb->fd);
-                /* </editor-fold> */
-                /*< Append read data to the gwbuf */
-                *head = gwbuf_append(*head, buffer);
-            }
-            else
+            if (drained)
             {
+                /** A short read emptied the socket, the next read would block */
                 break;
             }
         }
+        else if (nsingleread < 0)
+        {
+            return nreadtotal;
+        }
+        else
+        {
+            /** Handle closed client socket */
+            return dcb_read_no_bytes_available(dcb, nreadtotal);
+        }
     } /*< while (0 == maxbytes || nreadtotal < maxbytes) */
 
     return nreadtotal;
 }
 
-/**
- * Find the number of bytes available for the DCB's socket
- *
- * @param dcb       The DCB to read from
- * @return          -1 on error, otherwise the total number of bytes available
- */
-static int
-dcb_bytes_readable(DCB *dcb)
-{
-    int bytesavailable;
-
-    if (-1 == ioctl(dcb->fd, FIONREAD, &bytesavailable))
-    {
-        char errbuf[STRERROR_BUFLEN];
-        /* <editor-fold defaultstate="collapsed" desc=" Error Logging "> */
-        MXS_ERROR("%lu [dcb_read] Error : ioctl FIONREAD for dcb %p in "
-                  "state %s fd %d failed due error %d, %s.",
-                  pthread_self(),
-                  dcb,
-                  STRDCBSTATE(dcb->state),
-                  dcb->fd,
-                  errno,
-                  strerror_r(errno, errbuf, sizeof(errbuf)));
-        /* </editor-fold> */
-        return -1;
-    }
-    else
-    {
-        return bytesavailable;
-    }
-}
-
 /**
  * Determine the return code needed when read has run out of data
  *
@@ -1085,27 +1247,68 @@ dcb_read_no_bytes_available(DCB *dcb, int nreadtotal)
 }
 
 /**
- * Basic read function to carry out a single read operation on the DCB socket.
+ * Make sure that the receive region of a DCB has room for a read
  *
- * @param dcb               The DCB to read from
- * @param bytesavailable    Pointer to linked list to append data to
- * @param maxbytes          Maximum bytes to read (0 = no limit)
- * @param nreadtotal        Total number of bytes already read
- * @param nsingleread       To be set as the number of bytes read this time
- * @return                  GWBUF* buffer containing new data, or null.
+ * The region is allocated on the first read. When every buffer sliced from
+ * it has been freed, it is rewound and reused. When it has too little room
+ * left, the DCB drops its reference and a new region is allocated; the old
+ * one is freed with the last buffer that refers to it.
+ *
+ * @param dcb   The DCB
+ * @return The region or NULL if it could not be allocated
  */
 static GWBUF *
-dcb_basic_read(DCB *dcb, int bytesavailable, int maxbytes, int nreadtotal, int *nsingleread)
+dcb_recv_region(DCB *dcb)
 {
-    GWBUF *buffer;
+    GWBUF *region = dcb->recv_region;
+
+    if (region && region->sbuf->refcount == 1)
+    {
+        /** Only the DCB refers to the region, it can be reused from the start */
+        region->start = region->sbuf->data;
+    }
+
+    if (region && GWBUF_LENGTH(region) < DCB_RECV_MIN)
+    {
+        gwbuf_free(region);
+        region = NULL;
+    }
 
-    int bufsize = MIN(bytesavailable, MAX_BUFFER_SIZE);
-    if (maxbytes)
+    if (region == NULL)
     {
-        bufsize = MIN(bufsize, maxbytes - nreadtotal);
+        region = gwbuf_alloc(DCB_RECV_SIZE);
     }
 
-    if ((buffer = gwbuf_alloc(bufsize)) == NULL)
+    dcb->recv_region = region;
+    return region;
+}
+
+/**
+ * Basic read function to carry out a single read operation on the DCB socket.
+ *
+ * The data is read into the free part of the DCB's receive region and the
+ * returned buffer refers to it without copying. What does not fit in the
+ * region is read into a per-thread overflow area in the same readv and
+ * copied into a buffer of its own.
+ *
+ * @param dcb           The DCB to read from
+ * @param maxbytes      Maximum bytes to read (0 = no limit)
+ * @param nsingleread   To be set as the number of bytes read this time, 0 if
+ *                      the socket had no data and -1 on error
+ * @param drained       Set to true if the read emptied the socket
+ * @return              GWBUF* buffer containing new data, or null.
+ */
+static GWBUF *
+dcb_basic_read(DCB *dcb, int maxbytes, int *nsingleread, bool *drained)
+{
+    static thread_local unsigned char overflow[MAX_BUFFER_SIZE];
+    GWBUF *region;
+    GWBUF *buffer = NULL;
+    struct iovec iov[2];
+    int in_region;
+    int requested;
+
+    if ((region = dcb_recv_region(dcb)) == NULL)
     {
         /*<
          * This is a fatal error which should cause shutdown.
@@ -1122,35 +1325,76 @@ dcb_basic_read(DCB *dcb, int bytesavailable, int maxbytes, int nreadtotal, int *
                   strerror_r(errno, errbuf, sizeof(errbuf)));
         /* </editor-fold> */
         *nsingleread = -1;
+        return NULL;
     }
-    else
-    {
-        *nsingleread = read(dcb->fd, GWBUF_DATA(buffer), bufsize);
-        dcb->stats.n_reads++;
 
-        if (*nsingleread <= 0)
+    in_region = GWBUF_LENGTH(region);
+    iov[0].iov_base = GWBUF_DATA(region);
+    iov[0].iov_len = maxbytes ? MIN(in_region, maxbytes) : in_region;
+    iov[1].iov_base = overflow;
+    iov[1].iov_len = maxbytes ? MIN(MAX_BUFFER_SIZE, maxbytes - iov[0].iov_len) : MAX_BUFFER_SIZE;
+    requested = iov[0].iov_len + iov[1].iov_len;
+
+    errno = 0;
+    *nsingleread = readv(dcb->fd, iov, iov[1].iov_len ? 2 : 1);
+    dcb->stats.n_reads++;
+
+    if (*nsingleread <= 0)
+    {
+        if (*nsingleread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
         {
-            if (errno != 0 && errno != EAGAIN && errno != EWOULDBLOCK)
-            {
-                char errbuf[STRERROR_BUFLEN];
-                /* <editor-fold defaultstate="collapsed" desc=" Error Logging "> */
-                MXS_ERROR("%lu [dcb_read] Error : Read failed, dcb %p in state "
-                          "%s fd %d, due %d, %s.",
-                          pthread_self(),
-                          dcb,
-                          STRDCBSTATE(dcb->state),
-                          dcb->fd,
-                          errno,
-                          strerror_r(errno, errbuf, sizeof(errbuf)));
-                /* </editor-fold> */
-            }
-            gwbuf_free(buffer);
-            buffer = NULL;
+            *nsingleread = 0;
         }
-    }
-    return buffer;
-}
-
+        else if (*nsingleread < 0)
+        {
+            char errbuf[STRERROR_BUFLEN];
+            /* <editor-fold defaultstate="collapsed" desc=" Error Logging "> */
+            MXS_ERROR("%lu [dcb_read] Error : Read failed, dcb %p in state "
+                      "%s fd %d, due %d, %s.",
+                      pthread_self(),
+                      dcb,
+                      STRDCBSTATE(dcb->state),
+                      dcb->fd,
+                      errno,
+                      strerror_r(errno, errbuf, sizeof(errbuf)));
+            /* </editor-fold> */
+        }
+        return NULL;
+    }
+
+    *drained = *nsingleread < requested;
+
+    /** Slice the new data out of the region */
+    if ((buffer = gwbuf_clone(region)) != NULL)
+    {
+        int len = MIN(*nsingleread, (int)iov[0].iov_len);
+
+        buffer->end = (char *)buffer->start + len;
+        region->start = (char *)region->start + len;
+
+        if (*nsingleread > len)
+        {
+            GWBUF *rest = gwbuf_alloc_and_load(*nsingleread - len, overflow);
+
+            if (rest == NULL)
+            {
+                gwbuf_free(buffer);
+                buffer = NULL;
+            }
+            else
+            {
+                buffer = gwbuf_append(buffer, rest);
+            }
+        }
+    }
+
+    if (buffer == NULL)
+    {
+        *nsingleread = -1;
+    }
+    return buffer;
+}
+
 /**
  * General purpose read routine to read data from a socket through the SSL
  * structure lined with this DCB and append it to a linked list of buffers.
@@ -1377,6 +1621,8 @@ dcb_write(DCB *dcb, GWBUF *queue)
 {
     bool empty_queue;
     bool below_water;
+    bool batch;
+    int bytes;
 
     below_water = (dcb->high_water && dcb->writeqlen < dcb->high_water);
     // The following guarantees that queue is not NULL
@@ -1384,6 +1630,15 @@ dcb_write(DCB *dcb, GWBUF *queue)
     {
         return 0;
     }
+    bytes = gwbuf_length(queue);
+    /** Charged before the data can be written and released by another thread */
+    dcb_buffered_add(dcb, MEMBUDGET_WRITEQ, bytes);
+    /**
+     * Only polled DCBs are batched, they are closed through the zombie list
+     * and stay valid until the batch ends. The io_uring backend already
+     * sends the whole queue at the end of the polling cycle.
+     */
+    batch = dcb_batch_depth > 0 && dcb->state == DCB_STATE_POLLING && dcb->uring == NULL;
 
     spinlock_acquire(&dcb->writeqlock);
     empty_queue = (dcb->writeq == NULL);
@@ -1393,8 +1648,14 @@ dcb_write(DCB *dcb, GWBUF *queue)
      * If it did not already have data, we call the drain write queue
      * function immediately to attempt to write the data.
      */
-    atomic_add(&dcb->writeqlen, gwbuf_length(queue));
+    atomic_add(&dcb->writeqlen, bytes);
     dcb->writeq = gwbuf_append(dcb->writeq, queue);
+    if (batch && !dcb->batched)
+    {
+        dcb->batched = true;
+        dcb->batch_next = dcb_batch_list;
+        dcb_batch_list = dcb;
+    }
     spinlock_release(&dcb->writeqlock);
     dcb->stats.n_buffered++;
     MXS_DEBUG("%lu [dcb_write] Append to writequeue. %d writes "
@@ -1404,7 +1665,7 @@ dcb_write(DCB *dcb, GWBUF *queue)
               dcb,
               STRDCBSTATE(dcb->state),
               dcb->fd);
-    if (empty_queue)
+    if (batch ? dcb->writeqlen >= DCB_BATCH_MAX : empty_queue)
     {
         dcb_drain_writeq(dcb);
     }
@@ -1413,6 +1674,52 @@ dcb_write(DCB *dcb, GWBUF *queue)
     return 1;
 }
 
+/**
+ * Start a write batch in the calling thread
+ *
+ * Until the batch ends, the data written to polled DCBs is only appended to
+ * their write queues. The queues are then written with one system call each
+ * instead of one per write, so a reply that is made of many packets goes out
+ * in as few TCP segments as possible. The polling threads run each event
+ * handler in a batch. Batches can be nested, the outermost one writes the
+ * queues.
+ */
+void
+dcb_batch_begin()
+{
+    dcb_batch_depth++;
+}
+
+/**
+ * End a write batch and write the queues of the DCBs written in it
+ */
+void
+dcb_batch_end()
+{
+    DCB *dcb;
+
+    if (--dcb_batch_depth > 0)
+    {
+        return;
+    }
+
+    while ((dcb = dcb_batch_list) != NULL)
+    {
+        dcb_batch_list = dcb->batch_next;
+
+        spinlock_acquire(&dcb->writeqlock);
+        dcb->batched = false;
+        dcb->batch_next = NULL;
+        spinlock_release(&dcb->writeqlock);
+
+        /** A closed DCB wrote its queue when it was closed */
+        if (!dcb->dcb_is_zombie)
+        {
+            dcb_drain_writeq(dcb);
+        }
+    }
+}
+
 #if defined(FAKE_CODE)
 /**
  * Fake code for dcb_write
@@ -1617,10 +1924,17 @@ dcb_drain_writeq(DCB *dcb)
      * callback does not mean that a non-empty queue has been drained, or even
      * that the queue is presently empty.
      */
+    if (dcb->uring)
+    {
+        /** The io_uring backend sends the queue and calls the callbacks when the send completes */
+        return poll_uring_send(dcb);
+    }
+
     local_writeq = dcb_grab_writeq(dcb, true);
     if (NULL == local_writeq)
     {
         dcb_call_callback(dcb, DCB_REASON_DRAINED);
+        dcb_splice_write_ready(dcb);
         return 0;
     }
     above_water = (dcb->low_water && gwbuf_length(local_writeq) > dcb->low_water);
@@ -1683,26 +1997,732 @@ dcb_drain_writeq(DCB *dcb)
     while ((local_writeq = dcb_grab_writeq(dcb, false)) != NULL);
     /* The write queue has drained, potentially need to call a callback function */
     dcb_call_callback(dcb, DCB_REASON_DRAINED);
+    /* Spliced data waits for the queue to drain */
+    dcb_splice_write_ready(dcb);
+
+wrap_up:
+
+    /*
+     * If nothing has been written, the callback events cannot have occurred
+     * and there is no need to adjust the length of the write queue.
+     */
+    if (total_written)
+    {
+        atomic_add(&dcb->writeqlen, -total_written);
+        dcb_buffered_add(dcb, MEMBUDGET_WRITEQ, -total_written);
+
+        /* Check if the draining has taken us from above water to below water */
+        if (above_water && dcb->writeqlen < dcb->low_water)
+        {
+            atomic_add(&dcb->stats.n_low_water, 1);
+            dcb_call_callback(dcb, DCB_REASON_LOW_WATER);
+        }
+        if (dcb->throttled && dcb->writeqlen <= dcb->low_water)
+        {
+            dcb_throttle_release(dcb);
+        }
+    }
+    return total_written;
+}
+
+/**
+ * Remove the data that the io_uring backend has sent from the write queue
+ *
+ * The buffers stay in the write queue while the kernel sends them. This is
+ * called by the owning polling thread when the send completes.
+ *
+ * @param dcb       The DCB
+ * @param written   Number of bytes sent
+ */
+void
+dcb_uring_sent(DCB *dcb, int written)
+{
+    bool above_water;
+    bool drained;
+
+    spinlock_acquire(&dcb->writeqlock);
+    above_water = (dcb->low_water && dcb->writeqlen > dcb->low_water);
+    dcb->writeq = gwbuf_consume(dcb->writeq, written);
+    drained = (dcb->writeq == NULL);
+    spinlock_release(&dcb->writeqlock);
+
+    atomic_add(&dcb->writeqlen, -written);
+    dcb_buffered_add(dcb, MEMBUDGET_WRITEQ, -written);
+
+    if (above_water && dcb->writeqlen < dcb->low_water)
+    {
+        atomic_add(&dcb->stats.n_low_water, 1);
+        dcb_call_callback(dcb, DCB_REASON_LOW_WATER);
+    }
+    if (dcb->throttled && dcb->writeqlen <= dcb->low_water)
+    {
+        dcb_throttle_release(dcb);
+    }
+    if (drained)
+    {
+        dcb_call_callback(dcb, DCB_REASON_DRAINED);
+    }
+}
+
+/**
+ * Pause the reads of a DCB whose data can not be buffered at the moment
+ *
+ * Called before a read event of the DCB is processed. If the write queue of
+ * the client DCB is over its high water mark, a backend DCB stops reading
+ * and is added to the DCBs that the client DCB resumes when its write queue
+ * has drained to the low water mark. The data is left in the socket, so TCP
+ * flow control slows down the server instead of the data piling up in the
+ * memory of MaxScale.
+ *
+ * If the data buffered by all sessions is over the budget, the DCBs of the
+ * sessions with the longest client write queues stop reading in the same
+ * way and are resumed when that write queue has drained to the low water
+ * mark. Only the write queue is used, as it is the one data that draining
+ * the client frees: the session command history or the delay queues could
+ * keep a session paused forever. A client whose write queue is already at
+ * the low water mark is never paused.
+ *
+ * @param dcb   The DCB that is about to read
+ * @return True if the reads of the DCB are paused and the event is skipped
+ */
+bool
+dcb_throttle_reads(DCB *dcb)
+{
+    DCB *client;
+
+    if (dcb->throttled_by)
+    {
+        /** A read event that was queued before the reads were paused */
+        return true;
+    }
+
+    if (dcb->session == NULL || (client = dcb->session->client_dcb) == NULL)
+    {
+        return false;
+    }
+
+    if (dcb->dcb_role == DCB_ROLE_BACKEND_HANDLER)
+    {
+        if (DCB_ABOVE_HIGH_WATER(client) ||
+            (membudget_kind_exceeded(MEMBUDGET_WRITEQ) && dcb_session_is_heavy(client)))
+        {
+            return dcb_throttle_pause(dcb, client);
+        }
+    }
+    else if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER && dcb == client &&
+             membudget_kind_exceeded(MEMBUDGET_WRITEQ) && dcb_session_is_heavy(client))
+    {
+        return dcb_throttle_pause(dcb, client);
+    }
+
+    return false;
+}
+
+/**
+ * Check whether the session of a client DCB is one of the heaviest ones
+ *
+ * A session is heavy if its client write queue is at least the average of
+ * the write queues of the clients that have queued data. The session with
+ * the longest write queue always is.
+ *
+ * @param client    The client DCB of the session
+ * @return True if the session should stop reading
+ */
+static bool
+dcb_session_is_heavy(DCB *client)
+{
+    int64_t weight = client->writeqlen;
+
+    return weight > 0 && weight * n_writeq_clients >= membudget_kind_total(MEMBUDGET_WRITEQ);
+}
+
+/**
+ * Return the number of client DCBs that have write queue data charged to the
+ * buffered data budget
+ *
+ * @return Number of clients with a non-empty write queue
+ */
+int
+dcb_writeq_client_count()
+{
+    return n_writeq_clients;
+}
+
+/**
+ * Check whether a client DCB can resume the DCBs it has paused
+ *
+ * @param owner The client DCB
+ * @return True if the write queue of the client DCB has drained to its low
+ * water mark
+ */
+static bool
+dcb_throttle_can_release(DCB *owner)
+{
+    return owner->writeqlen <= owner->low_water;
+}
+
+/**
+ * Pause the reads of a DCB and add it to the DCBs that another one resumes
+ *
+ * @param dcb   The DCB that is about to read
+ * @param owner The client DCB of the session
+ * @return True if the reads were paused
+ */
+static bool
+dcb_throttle_pause(DCB *dcb, DCB *owner)
+{
+    bool paused = false;
+
+    spinlock_acquire(&owner->throttlelock);
+    if (owner->state == DCB_STATE_POLLING && !dcb_throttle_can_release(owner))
+    {
+        dcb->throttled_by = owner;
+        dcb->throttle_next = owner->throttled;
+        owner->throttled = dcb;
+        poll_pause_reads(dcb);
+        paused = true;
+    }
+    spinlock_release(&owner->throttlelock);
+
+    if (paused)
+    {
+        atomic_add(&dcb->stats.n_throttled, 1);
+        MXS_DEBUG("%lu [dcb_throttle_pause] Paused the reads of DCB %p, the write queue "
+                  "of client DCB %p has %d of the %lld buffered bytes.", pthread_self(), dcb,
+                  owner, owner->writeqlen, (long long)membudget_total());
+        /**
+         * The data may have drained before the DCB was in the list of the
+         * owner, so the condition is checked again now that it is there.
+         */
+        __sync_synchronize();
+        if (dcb_throttle_can_release(owner))
+        {
+            dcb_throttle_release(owner);
+        }
+    }
+    return paused;
+}
+
+/**
+ * Count a client DCB whose write queue charge changes between empty and
+ * non-empty
+ *
+ * @param before    The charge before the change
+ * @param after     The charge after the change
+ */
+static inline void
+dcb_writeq_client_update(int before, int after)
+{
+    if (before == 0 && after != 0)
+    {
+        atomic_add(&n_writeq_clients, 1);
+    }
+    else if (before != 0 && after == 0)
+    {
+        atomic_add(&n_writeq_clients, -1);
+    }
+}
+
+/**
+ * Charge the data queued in a DCB to the buffered data budget
+ *
+ * The data is charged to the service of the DCB and to its session.
+ *
+ * @param dcb   The DCB that queues the data
+ * @param kind  The queue that holds the data
+ * @param bytes Number of bytes added, negative when the data is released
+ */
+void
+dcb_buffered_add(DCB *dcb, membudget_kind_t kind, int bytes)
+{
+    SESSION *session = dcb->session;
+
+    if (dcb->budget_service == NULL)
+    {
+        dcb->budget_service = session && session->service ? session->service : dcb->service;
+    }
+
+    int before = atomic_add(&dcb->buffered[kind], bytes);
+    membudget_add(kind, dcb->budget_service, bytes);
+
+    if (kind == MEMBUDGET_WRITEQ && dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
+    {
+        dcb_writeq_client_update(before, before + bytes);
+    }
+
+    if (session)
+    {
+        session_add_weight(session, bytes);
+    }
+}
+
+/**
+ * Release the charges of a DCB whose queues have been freed
+ *
+ * The session of the DCB has already been freed, only the totals are updated.
+ *
+ * @param dcb   The DCB
+ */
+static void
+dcb_buffered_release_all(DCB *dcb)
+{
+    for (int kind = 0; kind < MEMBUDGET_N_KINDS; kind++)
+    {
+        if (dcb->buffered[kind])
+        {
+            if (kind == MEMBUDGET_WRITEQ && dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
+            {
+                dcb_writeq_client_update(dcb->buffered[kind], 0);
+            }
+            membudget_add(kind, dcb->budget_service, -dcb->buffered[kind]);
+            dcb->buffered[kind] = 0;
+        }
+    }
+    dcb->budget_service = NULL;
+}
+
+/**
+ * Resume the reads of the DCBs that a client DCB has paused
+ *
+ * @param client    The client DCB
+ */
+static void
+dcb_throttle_release(DCB *client)
+{
+    DCB *dcb;
+
+    spinlock_acquire(&client->throttlelock);
+    while ((dcb = client->throttled) != NULL)
+    {
+        client->throttled = dcb->throttle_next;
+        dcb->throttle_next = NULL;
+        dcb->throttled_by = NULL;
+        poll_resume_reads(dcb);
+        MXS_DEBUG("%lu [dcb_throttle_release] Resumed the reads of DCB %p.", pthread_self(), dcb);
+    }
+    spinlock_release(&client->throttlelock);
+}
+
+/**
+ * Remove a closed DCB from the DCBs paused by its client DCB
+ *
+ * The reads are resumed so that the DCB is in the normal state if it goes to
+ * the persistent pool.
+ *
+ * @param dcb   The backend DCB or the client DCB itself
+ */
+static void
+dcb_throttle_cancel(DCB *dcb)
+{
+    DCB *client = dcb->throttled_by;
+
+    if (client)
+    {
+        spinlock_acquire(&client->throttlelock);
+        if (dcb->throttled_by == client)
+        {
+            DCB **prev = &client->throttled;
+
+            while (*prev != dcb)
+            {
+                prev = &(*prev)->throttle_next;
+            }
+            *prev = dcb->throttle_next;
+            dcb->throttle_next = NULL;
+            dcb->throttled_by = NULL;
+            poll_resume_reads(dcb);
+        }
+        spinlock_release(&client->throttlelock);
+    }
+}
+
+/** Result of moving data in one direction of a splice */
+typedef enum
+{
+    SPLICE_DONE,        /*< The source has no more data */
+    SPLICE_BLOCKED,     /*< The destination does not accept more data */
+    SPLICE_EOF,         /*< The source was closed */
+    SPLICE_ERROR        /*< A socket error, left to the normal path */
+} splice_result_t;
+
+/**
+ * Move data from one connection of a splice to the other. Called with the
+ * splice locked.
+ *
+ * Data that is in the write queue of the destination is sent before the
+ * spliced data, so nothing is written while the queue is not empty. The
+ * writing of the queue continues the splice when the queue drains.
+ *
+ * @param sp    The splice
+ * @param from  Index of the source connection
+ * @return What stopped the moving
+ */
+static splice_result_t
+dcb_splice_move(DCB_SPLICE *sp, int from)
+{
+    DCB *src = sp->dcbs[from];
+    DCB *dst = sp->dcbs[1 - from];
+    ssize_t n;
+
+    while (true)
+    {
+        while (sp->pending[from] > 0)
+        {
+            if (dst->writeq)
+            {
+                return SPLICE_BLOCKED;
+            }
+
+            n = splice(sp->pipes[from][0], NULL, dst->fd, NULL, sp->pending[from],
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+            if (n > 0)
+            {
+                sp->pending[from] -= n;
+                dst->stats.n_writes++;
+            }
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return SPLICE_BLOCKED;
+            }
+            else
+            {
+                return SPLICE_ERROR;
+            }
+        }
+
+        /** The pipe is empty so it can only block on the socket */
+        n = splice(src->fd, NULL, sp->pipes[from][1], NULL, DCB_SPLICE_SIZE,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if (n > 0)
+        {
+            sp->pending[from] += n;
+            sp->bytes[from] += n;
+            src->stats.n_reads++;
+            src->last_read = hkheartbeat;
+        }
+        else if (n == 0)
+        {
+            return SPLICE_EOF;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return SPLICE_DONE;
+        }
+        else
+        {
+            return SPLICE_ERROR;
+        }
+    }
+}
+
+/**
+ * Deactivate a splice and take the data that is still in its pipes. Called
+ * with the splice locked.
+ *
+ * @param sp    The splice
+ * @param data  The data read from each connection that was not yet sent
+ */
+static void
+dcb_splice_deactivate(DCB_SPLICE *sp, GWBUF *data[2])
+{
+    sp->active = false;
+
+    for (int i = 0; i < 2; i++)
+    {
+        data[i] = NULL;
+
+        while (sp->pending[i] > 0)
+        {
+            GWBUF *buf = gwbuf_alloc(sp->pending[i]);
+            ssize_t n;
+
+            if (buf == NULL)
+            {
+                break;
+            }
+
+            n = read(sp->pipes[i][0], GWBUF_DATA(buf), sp->pending[i]);
+
+            if (n <= 0)
+            {
+                gwbuf_free(buf);
+                break;
+            }
+
+            sp->pending[i] -= n;
+            gwbuf_rtrim(buf, GWBUF_LENGTH(buf) - n);
+            data[i] = gwbuf_append(data[i], buf);
+        }
+    }
+}
+
+/**
+ * Queue the data taken from the pipes of a deactivated splice to the
+ * connections it was destined to. Called after the splice is unlocked.
+ *
+ * @param dcbs  The two connections of the splice
+ * @param data  The data read from each connection
+ */
+static void
+dcb_splice_requeue(DCB *dcbs[2], GWBUF *data[2])
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (data[i])
+        {
+            dcb_write(dcbs[1 - i], data[i]);
+        }
+    }
+}
+
+/**
+ * Start moving the data between a client and a backend connection with
+ * splice instead of reading it into buffers and writing it out again.
+ *
+ * Only plain connections whose buffered input has been processed can be
+ * spliced. The protocol modules do not see the spliced data, so the caller
+ * must make sure that nothing needs to inspect or modify it.
+ *
+ * @param client    The client connection
+ * @param backend   The backend connection
+ * @return True if the splice was started
+ */
+bool
+dcb_splice_start(DCB *client, DCB *backend)
+{
+    DCB_SPLICE *sp;
+
+    if (client->ssl || backend->ssl || client->uring || backend->uring ||
+        client->dcb_readqueue || backend->dcb_readqueue || backend->delayq ||
+        client->state != DCB_STATE_POLLING || backend->state != DCB_STATE_POLLING ||
+        (client->splice && client->splice->active) || (backend->splice && backend->splice->active))
+    {
+        return false;
+    }
+
+    if ((sp = (DCB_SPLICE *)calloc(1, sizeof(DCB_SPLICE))) == NULL)
+    {
+        return false;
+    }
+
+    if (pipe2(sp->pipes[0], O_NONBLOCK) == -1)
+    {
+        free(sp);
+        return false;
+    }
+
+    if (pipe2(sp->pipes[1], O_NONBLOCK) == -1)
+    {
+        close(sp->pipes[0][0]);
+        close(sp->pipes[0][1]);
+        free(sp);
+        return false;
+    }
+
+    /** Stale splices of reused connections are no longer active */
+    dcb_splice_release(client);
+    dcb_splice_release(backend);
+
+    spinlock_init(&sp->lock);
+    sp->dcbs[0] = client;
+    sp->dcbs[1] = backend;
+    sp->refs = 2;
+    sp->active = true;
+
+    spinlock_acquire(&sp->lock);
+    client->splice = sp;
+    backend->splice = sp;
+
+    /** Move what arrived while the previous reads were being processed */
+    splice_result_t res0 = dcb_splice_move(sp, 0);
+    splice_result_t res1 = dcb_splice_move(sp, 1);
+    bool failed = res0 >= SPLICE_EOF || res1 >= SPLICE_EOF;
+    GWBUF *data[2] = {NULL, NULL};
+
+    if (failed)
+    {
+        dcb_splice_deactivate(sp, data);
+    }
+    spinlock_release(&sp->lock);
+
+    if (failed)
+    {
+        DCB *dcbs[2] = {client, backend};
+        dcb_splice_requeue(dcbs, data);
+        poll_fake_read_event(res0 >= SPLICE_EOF ? client : backend);
+        return false;
+    }
+
+    MXS_INFO("Splicing the data of client %p and backend %p.", client, backend);
+    return true;
+}
+
+/**
+ * Stop splicing the data of a connection and its peer. The data that is
+ * still in the pipes is queued to the connections it was meant for and the
+ * connections are read through the normal path from then on.
+ *
+ * @param dcb   Either connection of the splice
+ */
+void
+dcb_splice_stop(DCB *dcb)
+{
+    DCB_SPLICE *sp = dcb->splice;
+    GWBUF *data[2] = {NULL, NULL};
+    DCB *dcbs[2];
+    bool was_active;
+
+    if (sp == NULL)
+    {
+        return;
+    }
+
+    spinlock_acquire(&sp->lock);
+    was_active = sp->active;
+    if (was_active)
+    {
+        dcb_splice_deactivate(sp, data);
+    }
+    dcbs[0] = sp->dcbs[0];
+    dcbs[1] = sp->dcbs[1];
+    spinlock_release(&sp->lock);
+
+    if (was_active)
+    {
+        dcb_splice_requeue(dcbs, data);
+    }
+}
 
-wrap_up:
+/**
+ * Drop the reference of a DCB to its splice, freeing the splice when both
+ * connections have dropped theirs. The splice must no longer be active.
+ *
+ * @param dcb   The DCB
+ */
+static void
+dcb_splice_release(DCB *dcb)
+{
+    DCB_SPLICE *sp = dcb->splice;
+    bool last;
 
-    /*
-     * If nothing has been written, the callback events cannot have occurred
-     * and there is no need to adjust the length of the write queue.
-     */
-    if (total_written)
+    if (sp == NULL)
     {
-        atomic_add(&dcb->writeqlen, -total_written);
+        return;
+    }
 
-        /* Check if the draining has taken us from above water to below water */
-        if (above_water && dcb->writeqlen < dcb->low_water)
+    dcb->splice = NULL;
+
+    spinlock_acquire(&sp->lock);
+    ss_dassert(!sp->active);
+    sp->dcbs[sp->dcbs[0] == dcb ? 0 : 1] = NULL;
+    last = --sp->refs == 0;
+    spinlock_release(&sp->lock);
+
+    if (last)
+    {
+        for (int i = 0; i < 2; i++)
         {
-            atomic_add(&dcb->stats.n_low_water, 1);
-            dcb_call_callback(dcb, DCB_REASON_LOW_WATER);
+            close(sp->pipes[i][0]);
+            close(sp->pipes[i][1]);
         }
+        free(sp);
+    }
+}
+
+/**
+ * Handle a read event of a spliced connection
+ *
+ * When the peer closes the connection or an error occurs, the splice is
+ * stopped and the event is left to the normal read path, which then sees
+ * the closed connection.
+ *
+ * @param dcb   The DCB with a read event
+ * @return True if the event was handled, false if the normal read path must
+ *         handle it
+ */
+bool
+dcb_splice_read(DCB *dcb)
+{
+    DCB_SPLICE *sp = dcb->splice;
+    GWBUF *data[2] = {NULL, NULL};
+    DCB *dcbs[2];
+    splice_result_t res;
 
+    if (sp == NULL || !sp->active)
+    {
+        return false;
+    }
+
+    spinlock_acquire(&sp->lock);
+    if (!sp->active)
+    {
+        spinlock_release(&sp->lock);
+        return false;
+    }
+
+    res = dcb_splice_move(sp, sp->dcbs[0] == dcb ? 0 : 1);
+
+    if (res >= SPLICE_EOF)
+    {
+        dcb_splice_deactivate(sp, data);
+    }
+    dcbs[0] = sp->dcbs[0];
+    dcbs[1] = sp->dcbs[1];
+    spinlock_release(&sp->lock);
+
+    if (res >= SPLICE_EOF)
+    {
+        dcb_splice_requeue(dcbs, data);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Continue a splice towards a connection whose write queue has drained
+ *
+ * @param dcb   The connection that can be written to
+ */
+static void
+dcb_splice_write_ready(DCB *dcb)
+{
+    DCB_SPLICE *sp = dcb->splice;
+    GWBUF *data[2] = {NULL, NULL};
+    DCB *dcbs[2];
+    splice_result_t res;
+    DCB *src;
+
+    if (sp == NULL || !sp->active)
+    {
+        return;
+    }
+
+    spinlock_acquire(&sp->lock);
+    if (!sp->active)
+    {
+        spinlock_release(&sp->lock);
+        return;
+    }
+
+    src = sp->dcbs[sp->dcbs[0] == dcb ? 1 : 0];
+    res = dcb_splice_move(sp, sp->dcbs[0] == dcb ? 1 : 0);
+
+    if (res >= SPLICE_EOF)
+    {
+        dcb_splice_deactivate(sp, data);
+    }
+    dcbs[0] = sp->dcbs[0];
+    dcbs[1] = sp->dcbs[1];
+    spinlock_release(&sp->lock);
+
+    if (res >= SPLICE_EOF)
+    {
+        dcb_splice_requeue(dcbs, data);
+        /** The source has no new read event coming, let the normal path see its state */
+        poll_fake_read_event(src);
     }
-    return total_written;
 }
 
 /**
@@ -1813,16 +2833,34 @@ dcb_close(DCB *dcb)
     }
 
     /*
-     * If DCB is in persistent pool, mark it as an error and exit
+     * If DCB is in persistent pool, mark it as an error and let the timer
+     * remove it from the pool
      */
     if (dcb->persistentstart > 0)
     {
         dcb->dcb_errhandle_called = true;
+        poll_timer_add(&dcb->timer, dcb_persistent_expire, dcb, 0);
         return;
     }
 
-    spinlock_acquire(&zombiespin);
-    if (!dcb->dcb_is_zombie)
+    /** A timer that fires after this would find a zombie DCB */
+    poll_timer_cancel(&dcb->timer);
+    dcb->flags &= ~DCBF_CONNECTING;
+
+    /** The data that is still in the pipes goes to the write queues */
+    dcb_splice_stop(dcb);
+
+    /** The replies written in the current batch are sent before the socket is closed */
+    if (dcb->batched)
+    {
+        dcb_drain_writeq(dcb);
+    }
+
+    /** A closed client no longer holds back the backends and vice versa */
+    dcb_throttle_release(dcb);
+    dcb_throttle_cancel(dcb);
+
+    if (!__sync_lock_test_and_set(&dcb->dcb_is_zombie, true))
     {
         if (DCB_ROLE_BACKEND_HANDLER == dcb->dcb_role && 0 == dcb->persistentstart
             && dcb->server && DCB_STATE_POLLING == dcb->state)
@@ -1836,25 +2874,29 @@ dcb_close(DCB *dcb)
             }
         }
         /*<
-         * Add closing dcb to the top of the list, setting zombie marker
+         * Add closing dcb to the zombies of this thread. The epoch is taken
+         * before the state is changed, so as to protect the DCB from premature
+         * destruction.
          */
-        dcb->dcb_is_zombie = true;
-        dcb->memdata.next = zombies;
-        zombies = dcb;
-        nzombies++;
-        if (nzombies > maxzombies)
-        {
-            maxzombies = nzombies;
-        }
-        /*< Set bit for each maxscale thread. This should be done before
-         * the state is changed, so as to protect the DCB from premature
-         * destruction. */
-        if (dcb->server)
-        {
-            bitmask_copy(&dcb->memdata.bitmask, poll_bitmask());
-        }
+        dcb_retire(dcb);
     }
-    spinlock_release(&zombiespin);
+}
+
+/**
+ * Return the polling thread whose persistent pool a DCB belongs to
+ *
+ * A DCB owned by a worker thread goes to the pool of that thread. In the
+ * other poll modes no thread owns the DCB and it goes to the pool of the
+ * thread that opened or last reused it, so that each thread still keeps
+ * its own pool.
+ *
+ * @param dcb   The backend DCB
+ * @return The thread ID, -1 for the pool of the DCBs opened by other threads
+ */
+static inline int
+dcb_pool_id(DCB *dcb)
+{
+    return dcb->owner >= 0 ? dcb->owner : dcb->persistpool;
 }
 
 /**
@@ -1875,7 +2917,7 @@ dcb_maybe_add_persistent(DCB *dcb)
         && (dcb->server->status & SERVER_RUNNING)
         && !dcb->dcb_errhandle_called
         && !(dcb->flags & DCBF_HUNG)
-        && (poolcount = dcb_persistent_clean_count(dcb, false)) < dcb->server->persistpoolmax)
+        && (poolcount = dcb->server->stats.n_persistent) < dcb->server->persistpoolmax)
     {
         DCB_CALLBACK *loopcallback;
         MXS_DEBUG("%lu [dcb_maybe_add_persistent] Adding DCB to persistent pool, user %s.\n",
@@ -1903,12 +2945,18 @@ dcb_maybe_add_persistent(DCB *dcb)
             free(loopcallback);
         }
         spinlock_release(&dcb->cb_lock);
-        spinlock_acquire(&dcb->server->persistlock);
-        dcb->nextpersistent = dcb->server->persistent;
-        dcb->server->persistent = dcb;
-        spinlock_release(&dcb->server->persistlock);
-        atomic_add(&dcb->server->stats.n_persistent, 1);
-        atomic_add(&dcb->server->stats.n_current, -1);
+        SERVER_POOL *pool = server_get_pool(dcb->server, dcb_pool_id(dcb));
+        mutex_acquire(&pool->lock);
+        dcb->nextpersistent = pool->head;
+        pool->head = dcb;
+        pool->count++;
+        poolcount = atomic_add(&dcb->server->stats.n_persistent, 1) + 1;
+        dcb->server->persistmax = MAX(dcb->server->persistmax, poolcount);
+        /** The timer is armed before another thread can take the DCB */
+        poll_timer_add(&dcb->timer, dcb_persistent_expire, dcb,
+                       dcb_persistent_check_ms(dcb->server));
+        mutex_release(&pool->lock);
+        ts_stats_add(dcb->server->stats.n_current, -1);
         return true;
     }
     else
@@ -1984,6 +3032,8 @@ printDCB(DCB *dcb)
            dcb->stats.n_high_water);
     printf("\t\tNo. of Low Water Events:    %d\n",
            dcb->stats.n_low_water);
+    printf("\t\tNo. of Paused Reads:        %d\n",
+           dcb->stats.n_throttled);
 }
 /**
  * Display an entry from the spinlock statistics data
@@ -2005,16 +3055,12 @@ spin_reporter(void *dcb, char *desc, int value)
  */
 void printAllDCBs()
 {
-    DCB *dcb;
-
-    spinlock_acquire(&dcbspin);
-    dcb = allDCBs;
-    while (dcb)
+    spinlock_acquire(&dcb_registry_lock);
+    for (int i = 0; i < dcb_registry_count; i++)
     {
-        printDCB(dcb);
-        dcb = dcb->next;
+        printDCB(dcb_registry[i]);
     }
-    spinlock_release(&dcbspin);
+    spinlock_release(&dcb_registry_lock);
 }
 
 /**
@@ -2083,14 +3129,9 @@ dprintOneDCB(DCB *pdcb, DCB *dcb)
         dcb_printf(pdcb, "\tRole:                     %s\n", rolename);
         free(rolename);
     }
-    if (!bitmask_isallclear(&dcb->memdata.bitmask))
+    if (dcb->dcb_is_zombie)
     {
-        char *bitmasktext = bitmask_render_readable(&dcb->memdata.bitmask);
-        if (bitmasktext)
-        {
-            dcb_printf(pdcb, "\tBitMask:                %s\n", bitmasktext);
-            free(bitmasktext);
-        }
+        dcb_printf(pdcb, "\tClosed in epoch:          %lu\n", (unsigned long)dcb->memdata.epoch);
     }
     dcb_printf(pdcb, "\tStatistics:\n");
     dcb_printf(pdcb, "\t\tNo. of Reads:             %d\n", dcb->stats.n_reads);
@@ -2099,6 +3140,14 @@ dprintOneDCB(DCB *pdcb, DCB *dcb)
     dcb_printf(pdcb, "\t\tNo. of Accepts:           %d\n", dcb->stats.n_accepts);
     dcb_printf(pdcb, "\t\tNo. of High Water Events: %d\n", dcb->stats.n_high_water);
     dcb_printf(pdcb, "\t\tNo. of Low Water Events:  %d\n", dcb->stats.n_low_water);
+    dcb_printf(pdcb, "\t\tNo. of Paused Reads:      %d\n", dcb->stats.n_throttled);
+    if (dcb->splice)
+    {
+        DCB_SPLICE *sp = dcb->splice;
+        dcb_printf(pdcb, "\t\tBytes spliced to the peer: %lu (%s)\n",
+                   (unsigned long)sp->bytes[sp->dcbs[0] == dcb ? 0 : 1],
+                   sp->active ? "active" : "stopped");
+    }
     if (dcb->flags & DCBF_CLONE)
     {
         dcb_printf(pdcb, "\t\tDCB is a clone.\n");
@@ -2120,22 +3169,16 @@ dprintOneDCB(DCB *pdcb, DCB *dcb)
 void
 dprintAllDCBs(DCB *pdcb)
 {
-    DCB *dcb;
-
-    spinlock_acquire(&dcbspin);
+    spinlock_acquire(&dcb_registry_lock);
 #if SPINLOCK_PROFILE
-    dcb_printf(pdcb, "DCB List Spinlock Statistics:\n");
-    spinlock_stats(&dcbspin, spin_reporter, pdcb);
-    dcb_printf(pdcb, "Zombie Queue Lock Statistics:\n");
-    spinlock_stats(&zombiespin, spin_reporter, pdcb);
+    dcb_printf(pdcb, "DCB Registry Spinlock Statistics:\n");
+    spinlock_stats(&dcb_registry_lock, spin_reporter, pdcb);
 #endif
-    dcb = allDCBs;
-    while (dcb)
+    for (int i = 0; i < dcb_registry_count; i++)
     {
-        dprintOneDCB(pdcb, dcb);
-        dcb = dcb->next;
+        dprintOneDCB(pdcb, dcb_registry[i]);
     }
-    spinlock_release(&dcbspin);
+    spinlock_release(&dcb_registry_lock);
 }
 
 /**
@@ -2146,17 +3189,16 @@ dprintAllDCBs(DCB *pdcb)
 void
 dListDCBs(DCB *pdcb)
 {
-    DCB *dcb;
-
-    spinlock_acquire(&dcbspin);
-    dcb = allDCBs;
+    spinlock_acquire(&dcb_registry_lock);
     dcb_printf(pdcb, "Descriptor Control Blocks\n");
     dcb_printf(pdcb, "------------------+----------------------------+--------------------+----------\n");
     dcb_printf(pdcb, " %-16s | %-26s | %-18s | %s\n",
                "DCB", "State", "Service", "Remote");
     dcb_printf(pdcb, "------------------+----------------------------+--------------------+----------\n");
-    while (dcb)
+    for (int i = 0; i < dcb_registry_count; i++)
     {
+        DCB *dcb = dcb_registry[i];
+
         if (dcb->dcb_is_in_use && dcb->state == DCB_STATE_POLLING)
         {
             dcb_printf(pdcb, " %-16p | %-26s | %-18s | %s\n",
@@ -2164,10 +3206,9 @@ dListDCBs(DCB *pdcb)
                        ((dcb->session && dcb->session->service) ? dcb->session->service->name : ""),
                        (dcb->remote ? dcb->remote : ""));
         }
-        dcb = dcb->next;
     }
     dcb_printf(pdcb, "------------------+----------------------------+--------------------+----------\n\n");
-    spinlock_release(&dcbspin);
+    spinlock_release(&dcb_registry_lock);
 }
 
 /**
@@ -2178,17 +3219,16 @@ dListDCBs(DCB *pdcb)
 void
 dListClients(DCB *pdcb)
 {
-    DCB *dcb;
-
-    spinlock_acquire(&dcbspin);
-    dcb = allDCBs;
+    spinlock_acquire(&dcb_registry_lock);
     dcb_printf(pdcb, "Client Connections\n");
     dcb_printf(pdcb, "-----------------+------------------+----------------------+------------\n");
     dcb_printf(pdcb, " %-15s | %-16s | %-20s | %s\n",
                "Client", "DCB", "Service", "Session");
     dcb_printf(pdcb, "-----------------+------------------+----------------------+------------\n");
-    while (dcb)
+    for (int i = 0; i < dcb_registry_count; i++)
     {
+        DCB *dcb = dcb_registry[i];
+
         if (dcb->dcb_is_in_use && dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER &&
             dcb->state == DCB_STATE_POLLING)
         {
@@ -2198,10 +3238,9 @@ dListClients(DCB *pdcb)
                              dcb->session->service->name : ""),
                        dcb->session);
         }
-        dcb = dcb->next;
     }
     dcb_printf(pdcb, "-----------------+------------------+----------------------+------------\n\n");
-    spinlock_release(&dcbspin);
+    spinlock_release(&dcb_registry_lock);
 }
 
 
@@ -2273,6 +3312,15 @@ dprintDCB(DCB *pdcb, DCB *dcb)
                dcb->stats.n_high_water);
     dcb_printf(pdcb, "\t\tNo. of Low Water Events:  %d\n",
                dcb->stats.n_low_water);
+    dcb_printf(pdcb, "\t\tNo. of Paused Reads:      %d\n",
+               dcb->stats.n_throttled);
+    if (dcb->splice)
+    {
+        DCB_SPLICE *sp = dcb->splice;
+        dcb_printf(pdcb, "\t\tBytes spliced to the peer:        %lu (%s)\n",
+                   (unsigned long)sp->bytes[sp->dcbs[0] == dcb ? 0 : 1],
+                   sp->active ? "active" : "stopped");
+    }
     if (DCB_POLL_BUSY(dcb))
     {
         dcb_printf(pdcb, "\t\tPending events in the queue:      %x %s\n",
@@ -2407,9 +3455,34 @@ void dcb_hashtable_stats(
 static int
 gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing)
 {
+    static thread_local unsigned char record[DCB_SSL_RECORD_SIZE];
     int written;
 
-    written = SSL_write(dcb->ssl, GWBUF_DATA(writeq), GWBUF_LENGTH(writeq));
+    if (writeq->next == NULL || GWBUF_LENGTH(writeq) >= DCB_SSL_RECORD_SIZE)
+    {
+        written = SSL_write(dcb->ssl, GWBUF_DATA(writeq), GWBUF_LENGTH(writeq));
+    }
+    else
+    {
+        /**
+         * Coalesce small buffers into one TLS record. A write that has to
+         * be retried must be repeated with the same data, so the length of
+         * the first attempt is used even if more data has been queued since.
+         */
+        int len = dcb->ssl_write_len;
+
+        if (len == 0)
+        {
+            len = gwbuf_copy_data(writeq, 0, DCB_SSL_RECORD_SIZE, record);
+        }
+        else
+        {
+            gwbuf_copy_data(writeq, 0, len, record);
+        }
+
+        written = SSL_write(dcb->ssl, record, len);
+        dcb->ssl_write_len = written > 0 ? 0 : len;
+    }
 
     *stop_writing = false;
     switch ((SSL_get_error(dcb->ssl, written)))
@@ -2461,6 +3534,40 @@ gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing)
     return written > 0 ? written : 0;
 }
 
+/**
+ * Write a vector to a socket
+ *
+ * If more data follows the vector, the write is done with MSG_MORE so that
+ * the kernel holds back a partial segment until the rest of the queue is
+ * written. The last write of the queue sends it.
+ *
+ * @param fd        The socket
+ * @param iov       The data
+ * @param iovcnt    Number of elements in iov
+ * @param more      True if more data is written right after this
+ * @return Number of bytes written or -1 on error
+ */
+static ssize_t
+dcb_writev(int fd, struct iovec *iov, int iovcnt, bool more)
+{
+    if (more)
+    {
+        struct msghdr msg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t rc = sendmsg(fd, &msg, MSG_MORE);
+
+        if (rc >= 0 || errno != ENOTSOCK)
+        {
+            return rc;
+        }
+    }
+    return writev(fd, iov, iovcnt);
+}
+
 /**
  * Write data to a DCB. The data is taken from the DCB's write queue.
  *
@@ -2472,11 +3579,27 @@ gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing)
 static int
 gw_write(DCB *dcb, GWBUF *writeq, bool *stop_writing)
 {
+    struct iovec iov[DCB_WRITEV_MAX];
+    int iovcnt = 0;
     int written = 0;
     int fd = dcb->fd;
+#if defined(FAKE_CODE) || defined(SS_DEBUG_MYSQL)
     size_t nbytes = GWBUF_LENGTH(writeq);
     void *buf = GWBUF_DATA(writeq);
+#endif
     int saved_errno;
+    GWBUF *rest = writeq;
+
+    /** Send as much of the chain as fits into one writev */
+    for (; rest && iovcnt < DCB_WRITEV_MAX; rest = rest->next)
+    {
+        if (GWBUF_LENGTH(rest) > 0)
+        {
+            iov[iovcnt].iov_base = GWBUF_DATA(rest);
+            iov[iovcnt].iov_len = GWBUF_LENGTH(rest);
+            iovcnt++;
+        }
+    }
 
     errno = 0;
 
@@ -2494,12 +3617,12 @@ gw_write(DCB *dcb, GWBUF *writeq, bool *stop_writing)
     }
     else if (fd > 0)
     {
-        written = write(fd, buf, nbytes);
+        written = dcb_writev(fd, iov, iovcnt, rest != NULL);
     }
 #else
     if (fd > 0)
     {
-        written = write(fd, buf, nbytes);
+        written = dcb_writev(fd, iov, iovcnt, rest != NULL);
     }
 #endif /* FAKE_CODE */
 
@@ -2738,10 +3861,10 @@ dcb_call_callback(DCB *dcb, DCB_REASON reason)
 }
 
 /**
- * Check the passed DCB to ensure it is in the list of allDCBS
+ * Check the passed DCB to ensure it is a DCB in use in the registry
  *
  * @param       dcb     The DCB to check
- * @return      1 if the DCB is in the list, otherwise 0
+ * @return      1 if the DCB is in the registry, otherwise 0
  */
 int
 dcb_isvalid(DCB *dcb)
@@ -2750,38 +3873,39 @@ dcb_isvalid(DCB *dcb)
 
     if (dcb)
     {
-        spinlock_acquire(&dcbspin);
+        spinlock_acquire(&dcb_registry_lock);
         rval = dcb_isvalid_nolock(dcb);
-        spinlock_release(&dcbspin);
+        spinlock_release(&dcb_registry_lock);
     }
 
     return rval;
 }
 
 /**
- * Find a DCB in the list of all DCB's
+ * Find a DCB in the registry of all DCB's
  *
  * @param dcb       The DCB to find
- * @return          A pointer to the DCB or NULL if not in the list
+ * @return          A pointer to the DCB or NULL if not in the registry or not in use
  */
 static inline DCB *
 dcb_find_in_list (DCB *dcb)
 {
-    DCB *ptr = NULL;
     if (dcb)
     {
-        ptr = allDCBs;
-        while (ptr && (false == ptr->dcb_is_in_use || ptr != dcb))
+        for (int i = 0; i < dcb_registry_count; i++)
         {
-            ptr = ptr->next;
+            if (dcb_registry[i] == dcb)
+            {
+                return dcb->dcb_is_in_use ? dcb : NULL;
+            }
         }
     }
-    return ptr;
+    return NULL;
 }
 
 /**
- * Check the passed DCB to ensure it is in the list of allDCBS.
- * Requires that the DCB list is already locked before call.
+ * Check the passed DCB to ensure it is a DCB in use in the registry.
+ * Requires that the registry is already locked before call.
  *
  * @param       dcb     The DCB to check
  * @return      1 if the DCB is in the list, otherwise 0
@@ -2810,15 +3934,14 @@ dcb_call_foreach(struct server* server, DCB_REASON reason)
     case DCB_REASON_HUP:
     case DCB_REASON_NOT_RESPONDING:
     {
-        DCB *dcb;
-        spinlock_acquire(&dcbspin);
-        dcb = allDCBs;
+        spinlock_acquire(&dcb_registry_lock);
 
-        while (dcb != NULL)
+        for (int i = 0; i < dcb_registry_count; i++)
         {
+            DCB *dcb = dcb_registry[i];
+
             if (false == dcb->dcb_is_in_use)
             {
-                dcb = dcb->next;
                 continue;
             }
             spinlock_acquire(&dcb->dcb_initlock);
@@ -2828,9 +3951,8 @@ dcb_call_foreach(struct server* server, DCB_REASON reason)
                 dcb_call_callback(dcb, DCB_REASON_NOT_RESPONDING);
             }
             spinlock_release(&dcb->dcb_initlock);
-            dcb = dcb->next;
         }
-        spinlock_release(&dcbspin);
+        spinlock_release(&dcb_registry_lock);
         break;
     }
 
@@ -2850,15 +3972,14 @@ dcb_hangup_foreach(struct server* server)
 {
     MXS_DEBUG("%lu [dcb_hangup_foreach]", pthread_self());
 
-    DCB *dcb;
-    spinlock_acquire(&dcbspin);
-    dcb = allDCBs;
+    spinlock_acquire(&dcb_registry_lock);
 
-    while (dcb != NULL)
+    for (int i = 0; i < dcb_registry_count; i++)
     {
+        DCB *dcb = dcb_registry[i];
+
         if (false == dcb->dcb_is_in_use)
         {
-            dcb = dcb->next;
             continue;
         }
         spinlock_acquire(&dcb->dcb_initlock);
@@ -2868,9 +3989,8 @@ dcb_hangup_foreach(struct server* server)
             poll_fake_hangup_event(dcb);
         }
         spinlock_release(&dcb->dcb_initlock);
-        dcb = dcb->next;
     }
-    spinlock_release(&dcbspin);
+    spinlock_release(&dcb_registry_lock);
 }
 
 
@@ -2910,75 +4030,251 @@ dcb_null_auth(DCB *dcb, SERVER *server, SESSION *session, GWBUF *buf)
 }
 
 /**
- * Check persistent pool for expiry or excess size and count
+ * Check whether a DCB in a persistent pool can still be reused
  *
- * @param dcb           The DCB being closed.
+ * A connection that the server has closed, for example because of its
+ * wait_timeout, is readable without anything having been sent to it. The
+ * socket is peeked so that an idle connection is validated without a round
+ * trip to the server.
+ *
+ * @param dcb   The DCB in the pool
+ * @param now   The current time
+ * @return      True if the DCB is usable
+ */
+static bool
+dcb_persistent_valid(DCB *dcb, time_t now)
+{
+    char c;
+
+    if (dcb->dcb_errhandle_called
+        || (dcb->flags & DCBF_HUNG)
+        || dcb->server == NULL
+        || !(dcb->server->status & SERVER_RUNNING)
+        || now - dcb->persistentstart > dcb->server->persistmaxtime)
+    {
+        return false;
+    }
+
+    if (dcb->fd > 0 && dcb->ssl == NULL)
+    {
+        /** Nothing is expected from an idle connection, not even data */
+        if (recv(dcb->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) >= 0
+            || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            errno = 0;
+            return false;
+        }
+        errno = 0;
+    }
+
+    return true;
+}
+
+/**
+ * Return the interval of the idle checks of the pooled DCBs of a server
+ *
+ * @param server    The server
+ * @return          The interval in milliseconds
+ */
+static long
+dcb_persistent_check_ms(SERVER *server)
+{
+    return (MIN(server->persistmaxtime, DCB_PERSIST_CHECK_SECS) + 1) * 1000;
+}
+
+/**
+ * Close DCBs that were removed from a persistent pool
+ *
+ * @param disposals     A list of DCBs linked through nextpersistent
+ */
+void
+dcb_persistent_discard(DCB *disposals)
+{
+    DCB *nextdcb;
+
+    /** Call possible callback for this DCB in case of close */
+    while (disposals)
+    {
+        nextdcb = disposals->nextpersistent;
+        disposals->persistentstart = -1;
+        if (DCB_STATE_POLLING == disposals->state)
+        {
+            dcb_stop_polling_and_shutdown(disposals);
+        }
+        dcb_close(disposals);
+        disposals = nextdcb;
+    }
+}
+
+/**
+ * Check persistent pools for expiry or excess size and count
+ *
+ * @param server        The server whose pools are checked
  * @param cleanall      Boolean, if true the whole pool is cleared for the
- *                      server related to the given DCB
- * @return              A count of the DCBs remaining in the pool
+ *                      server
+ * @return              A count of the DCBs remaining in the pools
  */
 int
-dcb_persistent_clean_count(DCB *dcb, bool cleanall)
+dcb_persistent_clean_count(SERVER *server, bool cleanall)
 {
     int count = 0;
-    if (dcb && dcb->server)
+    if (server && server->persistent)
     {
-        SERVER *server = dcb->server;
-        DCB *previousdcb = NULL;
-        DCB *persistentdcb, *nextdcb;
         DCB *disposals = NULL;
+        time_t now = time(NULL);
 
         CHK_SERVER(server);
-        spinlock_acquire(&server->persistlock);
-        persistentdcb = server->persistent;
-        while (persistentdcb)
-        {
-            CHK_DCB(persistentdcb);
-            nextdcb = persistentdcb->nextpersistent;
-            if (cleanall
-                || persistentdcb-> dcb_errhandle_called
-                || count >= server->persistpoolmax
-                || persistentdcb->server == NULL
-                || !(persistentdcb->server->status & SERVER_RUNNING)
-                || (time(NULL) - persistentdcb->persistentstart) > server->persistmaxtime)
+        for (int i = 0; i < server->n_pools; i++)
+        {
+            SERVER_POOL *pool = &server->persistent[i];
+            DCB *previousdcb = NULL;
+            DCB *persistentdcb, *nextdcb;
+
+            mutex_acquire(&pool->lock);
+            persistentdcb = pool->head;
+            while (persistentdcb)
             {
-                /* Remove from persistent pool */
-                if (previousdcb)
+                CHK_DCB(persistentdcb);
+                nextdcb = persistentdcb->nextpersistent;
+                if (cleanall
+                    || count >= server->persistpoolmax
+                    || !dcb_persistent_valid(persistentdcb, now))
                 {
-                    previousdcb->nextpersistent = nextdcb;
+                    /* Remove from persistent pool */
+                    if (previousdcb)
+                    {
+                        previousdcb->nextpersistent = nextdcb;
+                    }
+                    else
+                    {
+                        pool->head = nextdcb;
+                    }
+                    pool->count--;
+                    /* Add removed DCBs to disposal list for processing outside spinlock */
+                    persistentdcb->nextpersistent = disposals;
+                    disposals = persistentdcb;
+                    atomic_add(&server->stats.n_persistent, -1);
                 }
                 else
                 {
-                    server->persistent = nextdcb;
+                    count++;
+                    previousdcb = persistentdcb;
                 }
-                /* Add removed DCBs to disposal list for processing outside spinlock */
-                persistentdcb->nextpersistent = disposals;
-                disposals = persistentdcb;
-                atomic_add(&server->stats.n_persistent, -1);
-            }
-            else
-            {
-                count++;
-                previousdcb = persistentdcb;
+                persistentdcb = nextdcb;
             }
-            persistentdcb = nextdcb;
+            mutex_release(&pool->lock);
         }
         server->persistmax = MAX(server->persistmax, count);
-        spinlock_release(&server->persistlock);
-        /** Call possible callback for this DCB in case of close */
-        while (disposals)
+        dcb_persistent_discard(disposals);
+    }
+    return count;
+}
+
+/**
+ * Timer function that validates an idle DCB in a persistent pool
+ *
+ * The DCB is removed from its pool and closed if it has expired or is no
+ * longer usable, otherwise the timer is re-armed for the next check.
+ *
+ * @param data  The DCB in the pool
+ */
+static void
+dcb_persistent_expire(void *data)
+{
+    DCB *dcb = (DCB *)data;
+    SERVER *server = dcb->server;
+
+    if (dcb->persistentstart > 0 && server)
+    {
+        SERVER_POOL *pool = server_get_pool(server, dcb_pool_id(dcb));
+        DCB *previous = NULL;
+        DCB *current;
+
+        mutex_acquire(&pool->lock);
+        for (current = pool->head; current && current != dcb; current = current->nextpersistent)
+        {
+            previous = current;
+        }
+
+        /** A DCB that has been taken from the pool is no longer checked */
+        if (current && !dcb_persistent_valid(dcb, time(NULL)))
         {
-            nextdcb = disposals->nextpersistent;
-            disposals->persistentstart = -1;
-            if (DCB_STATE_POLLING == disposals->state)
+            if (previous)
             {
-                dcb_stop_polling_and_shutdown(disposals);
+                previous->nextpersistent = dcb->nextpersistent;
             }
-            dcb_close(disposals);
-            disposals = nextdcb;
+            else
+            {
+                pool->head = dcb->nextpersistent;
+            }
+            pool->count--;
+            atomic_add(&server->stats.n_persistent, -1);
+            mutex_release(&pool->lock);
+            dcb->nextpersistent = NULL;
+            dcb_persistent_discard(dcb);
+            return;
+        }
+        else if (current)
+        {
+            poll_timer_add(&dcb->timer, dcb_persistent_expire, dcb,
+                           dcb_persistent_check_ms(server));
         }
+        mutex_release(&pool->lock);
+    }
+}
+
+/**
+ * Open a connection to fill the persistent pool of the calling thread
+ *
+ * When a session could not reuse a pooled connection and the pool holds fewer
+ * than persistpoolmin connections, one more connection is opened with the
+ * credentials of the session. It is closed into the pool as soon as it has
+ * been authenticated, so the next session of the same user does not have to
+ * wait for a connection.
+ *
+ * @param dcb   The backend DCB that was opened for the session
+ */
+static void
+dcb_persistent_prewarm(DCB *dcb)
+{
+    SERVER *server = dcb->server;
+    SERVER_POOL *pool = server_get_pool(server, dcb_pool_id(dcb));
+
+    if (server->persistpoolmin > 0
+        && server->persistpoolmax > 0
+        && server->stats.n_persistent + pool->warming < server->persistpoolmax
+        && pool->count + pool->warming < server->persistpoolmin)
+    {
+        atomic_add(&pool->warming, 1);
+        if (dcb_connect_new(server, dcb->session, dcb->protoname, DCBF_PREWARM) == NULL)
+        {
+            atomic_add(&pool->warming, -1);
+        }
+    }
+}
+
+/**
+ * Timer function for backend connections that were not established in time
+ *
+ * The connection is treated as if it was hung up so that the router
+ * can handle the failure.
+ *
+ * @param data  The backend DCB
+ */
+static void
+dcb_connect_timeout(void *data)
+{
+    DCB *dcb = (DCB *)data;
+
+    if ((dcb->flags & DCBF_CONNECTING) && dcb->state == DCB_STATE_POLLING)
+    {
+        dcb->flags &= ~DCBF_CONNECTING;
+        MXS_ERROR("Timed out connecting to server %s at %s:%d after %u seconds.",
+                  dcb->server ? dcb->server->unique_name : "<unknown>",
+                  dcb->server ? dcb->server->name : "<unknown>",
+                  dcb->dcb_port, config_backend_connect_timeout());
+        poll_fake_hangup_event(dcb);
     }
-    return count;
 }
 
 /**
@@ -2991,12 +4287,12 @@ int
 dcb_count_by_usage(DCB_USAGE usage)
 {
     int rval = 0;
-    DCB *dcb;
 
-    spinlock_acquire(&dcbspin);
-    dcb = allDCBs;
-    while (dcb)
+    spinlock_acquire(&dcb_registry_lock);
+    for (int i = 0; i < dcb_registry_count; i++)
     {
+        DCB *dcb = dcb_registry[i];
+
         if (dcb->dcb_is_in_use)
         {
             switch (usage)
@@ -3037,9 +4333,8 @@ dcb_count_by_usage(DCB_USAGE usage)
                 break;
             }
         }
-        dcb = dcb->next;
     }
-    spinlock_release(&dcbspin);
+    spinlock_release(&dcb_registry_lock);
     return rval;
 }
 
@@ -3059,6 +4354,9 @@ dcb_create_SSL(DCB* dcb, SSL_LISTENER *ssl)
         return -1;
     }
 
+    /** Retried writes of coalesced data come from a per-thread buffer */
+    SSL_set_mode(dcb->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
     if (SSL_set_fd(dcb->ssl, dcb->fd) == 0)
     {
         MXS_ERROR("Failed to set file descriptor for SSL connection.");
@@ -3296,6 +4594,9 @@ dcb_accept(DCB *listener, GWPROTOCOL *protocol_funcs)
             client_dcb->service = listener->session->service;
             client_dcb->session = session_set_dummy(client_dcb);
             client_dcb->fd = c_sock;
+            /** The backends of the session stop reading when the client falls behind */
+            client_dcb->high_water = config_writeq_high_water();
+            client_dcb->low_water = config_writeq_low_water();
 
             // get client address
             if (((struct sockaddr *)&client_conn)->sa_family == AF_UNIX)
@@ -3491,7 +4792,7 @@ dcb_listen(DCB *listener, const char *config, const char *protocol_name)
     }
     else
     {
-        listener_socket = dcb_listen_create_socket_inet(config);
+        listener_socket = dcb_listen_create_socket_inet(config, listener->flags & DCBF_REUSEPORT);
     }
     if (listener_socket < 0)
     {
@@ -3542,10 +4843,11 @@ dcb_listen(DCB *listener, const char *config, const char *protocol_name)
  * Set options, set non-blocking and bind to the socket.
  *
  * @param config_bind The configuration information
+ * @param reuseport Set SO_REUSEPORT so that several sockets can bind to the address
  * @return socket if successful, -1 otherwise
  */
 static int
-dcb_listen_create_socket_inet(const char *config_bind)
+dcb_listen_create_socket_inet(const char *config_bind, bool reuseport)
 {
     int listener_socket;
     struct sockaddr_in server_address;
@@ -3575,6 +4877,20 @@ dcb_listen_create_socket_inet(const char *config_bind)
         return -1;
     }
 
+    if (reuseport)
+    {
+#ifdef SO_REUSEPORT
+        if (dcb_set_socket_option(listener_socket, SOL_SOCKET, SO_REUSEPORT, (char *) &one, sizeof(one)) != 0)
+        {
+            return -1;
+        }
+#else
+        MXS_ERROR("SO_REUSEPORT is not supported on this system.");
+        close(listener_socket);
+        return -1;
+#endif
+    }
+
     // set NONBLOCKING mode
     if (setnonblocking(listener_socket) != 0)
     {
@@ -400,21 +400,16 @@ bool filter_load(FILTER_DEF* filter)
  * @param session       The client session
  * @param downstream    The filter downstream of this filter
  * @return              The downstream component for the next filter or NULL
- *                      if the filter could not be created
+ *                      if the filter could not be created. The component is
+ *                      allocated from the arena of the session.
  */
 DOWNSTREAM *
 filterApply(FILTER_DEF *filter, SESSION *session, DOWNSTREAM *downstream)
 {
     DOWNSTREAM *me;
 
-    if ((me = (DOWNSTREAM *)calloc(1, sizeof(DOWNSTREAM))) == NULL)
+    if ((me = (DOWNSTREAM *)session_arena_alloc(session, sizeof(DOWNSTREAM))) == NULL)
     {
-        char errbuf[STRERROR_BUFLEN];
-        MXS_ERROR("Memory allocation for filter session failed "
-                  "due to %d,%s.",
-                  errno,
-                  strerror_r(errno, errbuf, sizeof(errbuf)));
-
         return NULL;
     }
     me->instance = filter->filter;
@@ -422,7 +417,7 @@ filterApply(FILTER_DEF *filter, SESSION *session, DOWNSTREAM *downstream)
 
     if ((me->session = filter->obj->newSession(me->instance, session)) == NULL)
     {
-        free(me);
+        session_arena_free(session, me, sizeof(DOWNSTREAM));
         return NULL;
     }
     filter->obj->setDownstream(me->instance, me->session, downstream);
@@ -60,6 +60,7 @@
 #include <maxconfig.h>
 #include <maxscale/poll.h>
 #include <housekeeper.h>
+#include <affinity.h>
 #include <service.h>
 #include <memlog.h>
 
@@ -1918,6 +1919,12 @@ int main(int argc, char **argv)
         goto return_main;
     }
 
+    /** Plan the placement of the threads before any of them are started */
+    affinity_init();
+
+    /** Reserve the huge pages of the buffers, without them malloc is used */
+    gwbuf_arena_init(config_buffer_hugepages());
+
     /** Initialize statistics */
     ts_stats_init();
 
@@ -2086,6 +2093,7 @@ static void log_flush_cb(void* arg)
     ts1.tv_sec = timeout_ms / 1000;
     ts1.tv_nsec = (timeout_ms % 1000) * 1000000;
 
+    affinity_set_other_thread("log flusher");
     MXS_NOTICE("Started MaxScale log flusher.");
     while (!do_exit)
     {
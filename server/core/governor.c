@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file governor.c  - Adaptive spinning and blocking of the polling threads
+ *
+ * The governor keeps a moving average of the logarithm of the idle periods,
+ * i.e. their geometric mean, so that an occasional long pause does not hide
+ * a steady stream of short ones. The time a thread spins before it blocks
+ * is derived from this typical idle period:
+ *
+ * - In the efficiency mode the thread spins only if the next event is
+ *   expected sooner than blocking and waking up would take.
+ *
+ * - In the latency mode the thread spins for twice the typical idle period,
+ *   at least for the cost of a wakeup and at most GOVERNOR_MAX_SPIN_NS.
+ *
+ * The timeout of the blocking polls starts from a tenth of poll_sleep and is
+ * doubled each time the thread wakes up without work, up to poll_sleep.
+ */
+
+#include <governor.h>
+#include <stddef.h>
+
+#define GOVERNOR_FRAC_BITS 8
+#define GOVERNOR_WEIGHT    4   /*< New samples have a weight of 1/16 */
+
+/**
+ * Approximate log2 of a value in 24.8 fixed point
+ *
+ * @param value Value larger than zero
+ * @return log2(value) * 256
+ */
+static uint32_t
+governor_log2(uint64_t value)
+{
+    int msb = 63 - __builtin_clzll(value);
+    uint32_t frac = msb >= GOVERNOR_FRAC_BITS ?
+                    (value >> (msb - GOVERNOR_FRAC_BITS)) & 0xff :
+                    (value << (GOVERNOR_FRAC_BITS - msb)) & 0xff;
+
+    return (msb << GOVERNOR_FRAC_BITS) | frac;
+}
+
+/**
+ * Inverse of governor_log2
+ *
+ * @param log   log2 of the value in 24.8 fixed point
+ * @return The value
+ */
+static uint64_t
+governor_exp2(uint32_t log)
+{
+    int msb = log >> GOVERNOR_FRAC_BITS;
+    uint64_t mantissa = (1 << GOVERNOR_FRAC_BITS) | (log & 0xff);
+
+    return msb >= GOVERNOR_FRAC_BITS ?
+           mantissa << (msb - GOVERNOR_FRAC_BITS) :
+           mantissa >> (GOVERNOR_FRAC_BITS - msb);
+}
+
+/**
+ * Move to a new state and account the time spent in the old one
+ *
+ * @param gov   The governor
+ * @param state The new state
+ * @param now   Current time in nanoseconds
+ */
+static void
+governor_enter(POLL_GOVERNOR *gov, governor_state_t state, uint64_t now)
+{
+    uint64_t elapsed = now > gov->state_start ? now - gov->state_start : 0;
+
+    switch (gov->state)
+    {
+    case GOVERNOR_WORKING:
+        gov->work_ns += elapsed;
+        break;
+
+    case GOVERNOR_SPINNING:
+        gov->spin_ns += elapsed;
+        break;
+
+    case GOVERNOR_BLOCKED:
+        gov->block_ns += elapsed;
+        break;
+    }
+
+    gov->state = state;
+    gov->state_start = now;
+}
+
+/**
+ * Initialise a governor
+ *
+ * @param gov   The governor
+ * @param mode  The goal of the governor
+ * @param now   Current time in nanoseconds
+ */
+void
+governor_init(POLL_GOVERNOR *gov, governor_mode_t mode, uint64_t now)
+{
+    gov->mode = mode;
+    gov->state = GOVERNOR_WORKING;
+    gov->state_start = now;
+    gov->idle_start = 0;
+    /** Assume long idle periods until something has been measured */
+    gov->log_gap = governor_log2(GOVERNOR_MAX_GAP_NS);
+    gov->spins = 0;
+    gov->timeout = 0;
+    gov->spin_ns = 0;
+    gov->block_ns = 0;
+    gov->work_ns = 0;
+    gov->n_spin_wakeups = 0;
+    gov->n_block_wakeups = 0;
+}
+
+/**
+ * Return the typical idle period of the thread
+ *
+ * @param gov   The governor
+ * @return The geometric mean of the recent idle periods in nanoseconds
+ */
+uint64_t
+governor_gap(const POLL_GOVERNOR *gov)
+{
+    return governor_exp2(gov->log_gap);
+}
+
+/**
+ * Return how long the thread should spin before it blocks
+ *
+ * @param gov   The governor
+ * @return Time in nanoseconds
+ */
+uint64_t
+governor_spin_budget(const POLL_GOVERNOR *gov)
+{
+    uint64_t gap = governor_gap(gov);
+    uint64_t budget = 2 * gap;
+
+    if (gov->mode == GOVERNOR_EFFICIENCY)
+    {
+        return gap < GOVERNOR_WAKEUP_NS ? budget : 0;
+    }
+
+    if (budget < GOVERNOR_WAKEUP_NS)
+    {
+        budget = GOVERNOR_WAKEUP_NS;
+    }
+    return budget < GOVERNOR_MAX_SPIN_NS ? budget : GOVERNOR_MAX_SPIN_NS;
+}
+
+/**
+ * Called after a non-blocking poll found no work
+ *
+ * @param gov       The governor
+ * @param now       Current time in nanoseconds
+ * @param min_spins Number of non-blocking polls to do before blocking
+ *                  regardless of the measurements
+ * @return True if the thread should poll again without blocking
+ */
+bool
+governor_spin(POLL_GOVERNOR *gov, uint64_t now, int min_spins)
+{
+    if (gov->idle_start == 0)
+    {
+        gov->idle_start = now;
+    }
+
+    governor_enter(gov, GOVERNOR_SPINNING, now);
+
+    return gov->spins++ < min_spins || now - gov->idle_start < governor_spin_budget(gov);
+}
+
+/**
+ * Called before a blocking poll
+ *
+ * @param gov       The governor
+ * @param now       Current time in nanoseconds
+ * @param max_sleep The longest allowed timeout in milliseconds
+ * @return The timeout for the poll in milliseconds
+ */
+int
+governor_block(POLL_GOVERNOR *gov, uint64_t now, int max_sleep)
+{
+    if (gov->idle_start == 0)
+    {
+        gov->idle_start = now;
+    }
+
+    governor_enter(gov, GOVERNOR_BLOCKED, now);
+
+    if (gov->timeout <= 0 || gov->timeout > max_sleep)
+    {
+        gov->timeout = max_sleep >= 10 ? max_sleep / 10 : max_sleep;
+    }
+
+    return gov->timeout;
+}
+
+/**
+ * Called when a blocking poll returned without work. The next blocking poll
+ * waits longer.
+ *
+ * @param gov       The governor
+ * @param max_sleep The longest allowed timeout in milliseconds
+ */
+void
+governor_timed_out(POLL_GOVERNOR *gov, int max_sleep)
+{
+    gov->timeout = gov->timeout <= max_sleep / 2 ? gov->timeout * 2 : max_sleep;
+}
+
+/**
+ * Called when the thread found work
+ *
+ * @param gov   The governor
+ * @param now   Current time in nanoseconds
+ */
+void
+governor_wake(POLL_GOVERNOR *gov, uint64_t now)
+{
+    if (gov->idle_start)
+    {
+        uint64_t gap = now > gov->idle_start ? now - gov->idle_start : 1;
+
+        if (gap > GOVERNOR_MAX_GAP_NS)
+        {
+            gap = GOVERNOR_MAX_GAP_NS;
+        }
+
+        gov->log_gap = gov->log_gap - (gov->log_gap >> GOVERNOR_WEIGHT) +
+                       (governor_log2(gap) >> GOVERNOR_WEIGHT);
+
+        if (gov->state == GOVERNOR_SPINNING)
+        {
+            gov->n_spin_wakeups++;
+        }
+        else if (gov->state == GOVERNOR_BLOCKED)
+        {
+            gov->n_block_wakeups++;
+        }
+
+        gov->idle_start = 0;
+        gov->spins = 0;
+        gov->timeout = 0;
+    }
+
+    governor_enter(gov, GOVERNOR_WORKING, now);
+}
+
+/**
+ * Return the name of a governor mode
+ *
+ * @param mode  The mode
+ * @return The name used in the configuration
+ */
+const char *
+governor_mode_to_string(governor_mode_t mode)
+{
+    return mode == GOVERNOR_LATENCY ? "latency" : "efficiency";
+}
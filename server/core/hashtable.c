@@ -40,10 +40,9 @@
  * the key and the value, if the actions required are different the called functions
  * must understand how to differenate the key and value.
  *
- * The hash table implements a single write, multiple reader locking policy by
- * using a pair of counters and a spinlock. The spinlock is used to protect the
- * number of readers and writers counters when taking out locks. Releasing of
- * locks uses pure atomic actions and thus does not require spinlock protection.
+ * The hash table implements a single write, multiple reader locking policy with
+ * a RWLOCK. A waiting writer blocks new readers and the threads that wait for
+ * the lock sleep instead of spinning if the lock is held for long.
  *
  * @verbatim
  * Revision History
@@ -141,10 +140,8 @@ hashtable_alloc_real(HASHTABLE* target,
     rval->vcopyfn = nullfn;
     rval->kfreefn = nullfn;
     rval->vfreefn = nullfn;
-    rval->n_readers = 0;
-    rval->writelock = 0;
     rval->n_elements = 0;
-    spinlock_init(&rval->spin);
+    rwlock_init(&rval->lock);
     if ((rval->entries = (HASHENTRIES **)calloc(rval->hashsize, sizeof(HASHENTRIES *))) == NULL)
     {
         free(rval);
@@ -530,87 +527,40 @@ void hashtable_get_stats(void* table,
 /**
  * Take a read lock on the hashtable.
  *
- * The hashtable support multiple readers and a single writer,
- * we have a spinlock to protect the two counts, n_readers and
- * writelock.
- *
- * We take the hashtable spinlock and then check that writelock
- * is set to zero. If not we release the spinlock and do dirty
- * reads of writelock until it goes to 0. Once it is zero we
- * acquire the spinlock again and test that writelock is still
- * 0.
- *
- * With writelock set to zero we increment n_readers with the
- * spinlock still held.
+ * The hashtable supports multiple readers and a single writer. New readers
+ * wait while a writer holds the lock or waits for it.
  *
  * @param table         The hashtable to lock.
  */
 static void
 hashtable_read_lock(HASHTABLE *table)
 {
-    spinlock_acquire(&table->spin);
-    while (table->writelock)
-    {
-        spinlock_release(&table->spin);
-        while (table->writelock)
-        {
-            ;
-        }
-        spinlock_acquire(&table->spin);
-    }
-    atomic_add(&table->n_readers, 1);
-    spinlock_release(&table->spin);
+    rwlock_read_acquire(&table->lock);
 }
 
 /**
  * Release a previously obtained readlock.
  *
- * Simply decrement the n_readers value for the hash table
- *
  * @param table         The hash table to unlock
  */
 static void
 hashtable_read_unlock(HASHTABLE *table)
 {
-    atomic_add(&table->n_readers, -1);
+    rwlock_read_release(&table->lock);
 }
 
 /**
  * Obtain an exclusive write lock for the hash table.
  *
- * We acquire the hashtable spinlock, check for the number of
- * readers beign zero. If it is not we hold the spinlock and
- * loop waiting for the n_readers to reach zero. This will prevent
- * any new readers beign granted access but will not prevent current
- * readers releasing the read lock.
- *
- * Once we have no readers we increment writelock and test if we are
- * the only writelock holder, if not we repeat the process. We hold
- * the spinlock throughout the process since both read and write
- * locks do not require the spinlock to be acquired.
+ * The writer stops new readers from taking the lock and waits for the
+ * current readers to release it.
  *
  * @param table The table to lock for updates
  */
 static void
 hashtable_write_lock(HASHTABLE *table)
 {
-    int available;
-
-    spinlock_acquire(&table->spin);
-    do
-    {
-        while (table->n_readers)
-        {
-            ;
-        }
-        available = atomic_add(&table->writelock, 1);
-        if (available != 0)
-        {
-            atomic_add(&table->writelock, -1);
-        }
-    }
-    while (available != 0);
-    spinlock_release(&table->spin);
+    rwlock_write_acquire(&table->lock);
 }
 
 /**
@@ -621,7 +571,7 @@ hashtable_write_lock(HASHTABLE *table)
 static void
 hashtable_write_unlock(HASHTABLE *table)
 {
-    atomic_add(&table->writelock, -1);
+    rwlock_write_release(&table->lock);
 }
 
 /**
@@ -821,8 +771,8 @@ hashtable_load(HASHTABLE *table, const char *filename,
 int hashtable_size(HASHTABLE *table)
 {
     assert(table);
-    spinlock_acquire(&table->spin);
+    hashtable_read_lock(table);
     int rval = table->n_elements;
-    spinlock_release(&table->spin);
+    hashtable_read_unlock(table);
     return rval;
 }
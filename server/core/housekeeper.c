@@ -16,6 +16,7 @@
 #include <thread.h>
 #include <spinlock.h>
 #include <log_manager.h>
+#include <affinity.h>
 
 /**
  * @file housekeeper.c  Provide a mechanism to run periodic tasks
@@ -29,6 +30,9 @@
  * The housekeeper also maintains a global variable, hkheartbeat, that
  * is incremented every 100ms.
  *
+ * The one-shot tasks are kept in a timer wheel that is advanced on every
+ * heartbeat so that they do not need to be searched for.
+ *
  * @verbatim
  * Revision History
  *
@@ -47,12 +51,19 @@ static HKTASK *tasks = NULL;
  * Spinlock to protect the tasks list
  */
 static SPINLOCK tasklock = SPINLOCK_INIT;
+/**
+ * The timers of the one-shot tasks, one tick is one heartbeat. Protected
+ * by the tasklock.
+ */
+static TIMERWHEEL hk_wheel;
+static bool hk_wheel_init = false;
 
 static int do_shutdown = 0;
 long hkheartbeat = 0; /*< One heartbeat is 100 milliseconds */
 static THREAD hk_thr_handle;
 
 static void hkthread(void *);
+static void hkrun_oneshot(void *);
 
 /**
  * Initialise the housekeeper thread
@@ -169,7 +180,15 @@ hktask_oneshot(const char *name, void (*taskfn)(void *), void *data, int when)
     task->type = HK_ONESHOT;
     task->nextdue = time(0) + when;
     task->next = NULL;
+    timer_init(&task->timer, hkrun_oneshot, task);
     spinlock_acquire(&tasklock);
+    if (!hk_wheel_init)
+    {
+        /** One-shot tasks can be added before the housekeeper is started */
+        timerwheel_init(&hk_wheel, hkheartbeat);
+        hk_wheel_init = true;
+    }
+    timerwheel_add(&hk_wheel, &task->timer, hkheartbeat + when * 10);
     ptr = tasks;
     while (ptr && ptr->next)
     {
@@ -215,6 +234,10 @@ hktask_remove(const char *name)
     {
         tasks = ptr->next;
     }
+    if (ptr && ptr->type == HK_ONESHOT)
+    {
+        timerwheel_cancel(&ptr->timer);
+    }
     spinlock_release(&tasklock);
 
     if (ptr)
@@ -230,6 +253,41 @@ hktask_remove(const char *name)
 }
 
 
+/**
+ * Run an expired one-shot task and remove it from the task list
+ *
+ * Called with the tasklock held, the lock is released while the task runs.
+ *
+ * @param data  The task to run
+ */
+static void
+hkrun_oneshot(void *data)
+{
+    HKTASK *task = (HKTASK *)data;
+    HKTASK *ptr = tasks, *lptr = NULL;
+
+    while (ptr && ptr != task)
+    {
+        lptr = ptr;
+        ptr = ptr->next;
+    }
+    if (lptr)
+    {
+        lptr->next = task->next;
+    }
+    else
+    {
+        tasks = task->next;
+    }
+    spinlock_release(&tasklock);
+
+    (*task->task)(task->data);
+    free(task->name);
+    free(task);
+
+    spinlock_acquire(&tasklock);
+}
+
 /**
  * The housekeeper thread implementation.
  *
@@ -241,7 +299,8 @@ hktask_remove(const char *name)
  * one of the tasks. The resutl is that upon completion of a task the
  * search for tasks to run must restart from the start of the queue.
  * It is vital that the task->nextdue tiem is updated before the task
- * is run.
+ * is run. The one-shot tasks are run from the timer wheel on the next
+ * heartbeat after they are due.
  *
  * @param       data            Unused, here to satisfy the thread system
  */
@@ -249,11 +308,14 @@ void
 hkthread(void *data)
 {
     HKTASK *ptr;
+    TIMER *timer;
     time_t now;
     void (*taskfn)(void *);
     void *taskdata;
     int i;
 
+    affinity_set_other_thread("housekeeper");
+
     for (;;)
     {
         for (i = 0; i < 10; i++)
@@ -264,28 +326,30 @@ hkthread(void *data)
             }
             thread_millisleep(100);
             hkheartbeat++;
+
+            spinlock_acquire(&tasklock);
+            if (hk_wheel_init)
+            {
+                timerwheel_advance(&hk_wheel, hkheartbeat);
+                while ((timer = timerwheel_pop_expired(&hk_wheel)) != NULL)
+                {
+                    timer->fn(timer->data);
+                }
+            }
+            spinlock_release(&tasklock);
         }
         now = time(0);
         spinlock_acquire(&tasklock);
         ptr = tasks;
         while (ptr)
         {
-            if (ptr->nextdue <= now)
+            if (ptr->type == HK_REPEATED && ptr->nextdue <= now)
             {
                 ptr->nextdue = now + ptr->frequency;
                 taskfn = ptr->task;
                 taskdata = ptr->data;
-                // We need to copy type and name, in case hktask_remove is called from
-                // the callback. Otherwise we will access freed data.
-                HKTASK_TYPE type = ptr->type;
-                char name[strlen(ptr->name) + 1];
-                strcpy(name, ptr->name);
                 spinlock_release(&tasklock);
                 (*taskfn)(taskdata);
-                if (type == HK_ONESHOT)
-                {
-                    hktask_remove(name);
-                }
                 spinlock_acquire(&tasklock);
                 ptr = tasks;
             }
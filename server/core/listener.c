@@ -57,6 +57,8 @@ listener_alloc(char *protocol, char *address, unsigned short port, char *authent
     if ((proto = (SERV_LISTENER *)malloc(sizeof(SERV_LISTENER))) != NULL)
     {
         proto->listener = NULL;
+        proto->shards = NULL;
+        proto->n_shards = 0;
         proto->protocol = strdup(protocol);
         proto->address = address ? strdup(address) : NULL;
         proto->port = port;
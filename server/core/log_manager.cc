@@ -2497,6 +2497,34 @@ int mxs_log_flush()
     return err;
 }
 
+/**
+ * Get the thread that writes the log messages to the log file.
+ *
+ * @param thread The thread is stored here.
+ *
+ * @return True if the log manager has been initialized and the thread
+ *         is running, false otherwise.
+ */
+bool mxs_log_get_writer_thread(pthread_t* thread)
+{
+    bool rval = false;
+
+    if (logmanager_register(false))
+    {
+        CHK_LOGMANAGER(lm);
+
+        if (lm->lm_filewriter.fwr_thread)
+        {
+            *thread = skygw_thread_gettid(lm->lm_filewriter.fwr_thread);
+            rval = true;
+        }
+
+        logmanager_unregister();
+    }
+
+    return rval;
+}
+
 /**
  * Explicitly ensure that all pending log messages are flushed.
  *
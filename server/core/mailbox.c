@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file mailbox.c  - Lock-free multi-producer, single-consumer queues
+ *
+ * The producers only swap the head of the queue and then link the previous
+ * head to the new node. The consumer follows the links from the tail. A
+ * producer that has swapped the head but not yet linked the node is seen
+ * by the consumer as an empty queue; the node is popped on a later call
+ * once the producer has finished.
+ */
+
+#include <mailbox.h>
+#include <atomic.h>
+
+/**
+ * Initialise a mailbox
+ *
+ * @param mailbox The mailbox
+ */
+void
+mailbox_init(MAILBOX *mailbox)
+{
+    mailbox->stub.next = NULL;
+    mailbox->stub.handler = NULL;
+    mailbox->head = &mailbox->stub;
+    mailbox->tail = &mailbox->stub;
+    mailbox->length = 0;
+}
+
+/**
+ * Link a node to the head of the queue
+ *
+ * @param mailbox The mailbox
+ * @param node    The node to add
+ */
+static void
+mailbox_link(MAILBOX *mailbox, MAILBOX_NODE *node)
+{
+    node->next = NULL;
+    MAILBOX_NODE *prev = __sync_lock_test_and_set(&mailbox->head, node);
+    __sync_synchronize();
+    prev->next = node;
+}
+
+/**
+ * Push a node into a mailbox. Can be called by any thread.
+ *
+ * @param mailbox The mailbox
+ * @param node    The node to push, the handler must be set
+ */
+void
+mailbox_push(MAILBOX *mailbox, MAILBOX_NODE *node)
+{
+    atomic_add((int *)&mailbox->length, 1);
+    mailbox_link(mailbox, node);
+}
+
+/**
+ * Pop the oldest node from a mailbox. Must only be called by the owner.
+ *
+ * @param mailbox The mailbox
+ * @return The oldest node or NULL if the mailbox is empty
+ */
+MAILBOX_NODE *
+mailbox_pop(MAILBOX *mailbox)
+{
+    MAILBOX_NODE *tail = mailbox->tail;
+    MAILBOX_NODE *next = tail->next;
+
+    if (tail == &mailbox->stub)
+    {
+        if (next == NULL)
+        {
+            return NULL;
+        }
+        mailbox->tail = next;
+        tail = next;
+        next = next->next;
+    }
+
+    if (next == NULL)
+    {
+        if (tail != mailbox->head)
+        {
+            /** A producer is between swapping the head and linking the node */
+            return NULL;
+        }
+
+        /** The tail is the only node, push the stub behind it so that the
+         * tail can be taken without racing with the producers */
+        mailbox_link(mailbox, &mailbox->stub);
+        next = tail->next;
+
+        if (next == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    mailbox->tail = next;
+    atomic_add((int *)&mailbox->length, -1);
+    return tail;
+}
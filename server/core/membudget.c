@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file membudget.c  - Accounting of the data buffered by MaxScale
+ *
+ * Each polling thread adds its charges to its own slot without atomic
+ * operations. The threads that do not poll share one more slot that is
+ * updated atomically. The totals are the sums over the slots, a charge made
+ * in one thread and released in another leaves the slots unbalanced but the
+ * sum correct.
+ */
+
+#include <membudget.h>
+#include <stdlib.h>
+#include <service.h>
+#include <maxscale/poll.h>
+#include <log_manager.h>
+
+#define MEMBUDGET_CACHE_LINE 64
+
+/** The charges of one thread, padded to a cache line */
+typedef struct
+{
+    int64_t bytes[MEMBUDGET_N_KINDS];
+    char    pad[MEMBUDGET_CACHE_LINE - sizeof(int64_t) * MEMBUDGET_N_KINDS];
+} MEMBUDGET_SLOT;
+
+/** The charges of the threads that do not poll */
+static MEMBUDGET_SLOT shared_slot;
+/** The charges of the polling threads */
+static MEMBUDGET_SLOT *thread_slots = NULL;
+static int n_thread_slots = 0;
+/** The budget in bytes, 0 for no budget */
+static uint64_t budget = 0;
+
+static const char *kind_names[MEMBUDGET_N_KINDS] =
+{
+    "Write queues",
+    "Delay queues",
+    "Session commands",
+    "Tee queues"
+};
+
+/**
+ * Set up the counters of the polling threads
+ *
+ * Must be called before the polling threads are started.
+ *
+ * @param n_threads Number of polling threads
+ * @param bytes     The budget in bytes, 0 for no budget
+ */
+void
+membudget_init(int n_threads, uint64_t bytes)
+{
+    MEMBUDGET_SLOT *slots = calloc(n_threads, sizeof(MEMBUDGET_SLOT));
+
+    budget = bytes;
+
+    if (slots == NULL)
+    {
+        MXS_ERROR("Failed to allocate the buffered data counters of the polling threads.");
+        return;
+    }
+    free(thread_slots);
+    thread_slots = slots;
+    n_thread_slots = n_threads;
+}
+
+/**
+ * Charge buffered data to a subsystem
+ *
+ * @param kind      The subsystem that holds the data
+ * @param service   The service the data belongs to or NULL
+ * @param bytes     Number of bytes added, negative when the data is released
+ */
+void
+membudget_add(membudget_kind_t kind, SERVICE *service, int64_t bytes)
+{
+    int id = poll_thread_id();
+
+    if (id >= 0 && id < n_thread_slots)
+    {
+        thread_slots[id].bytes[kind] += bytes;
+    }
+    else
+    {
+        __sync_fetch_and_add(&shared_slot.bytes[kind], bytes);
+    }
+
+    if (service)
+    {
+        __sync_fetch_and_add(&service->buffered[kind], bytes);
+    }
+}
+
+/**
+ * Return the data held by a subsystem
+ *
+ * @param kind  The subsystem
+ * @return The buffered data in bytes
+ */
+int64_t
+membudget_kind_total(membudget_kind_t kind)
+{
+    int64_t total = *(volatile int64_t *)&shared_slot.bytes[kind];
+
+    for (int i = 0; i < n_thread_slots; i++)
+    {
+        total += *(volatile int64_t *)&thread_slots[i].bytes[kind];
+    }
+
+    return total;
+}
+
+/**
+ * Return the data held by all subsystems
+ *
+ * @return The buffered data in bytes
+ */
+int64_t
+membudget_total()
+{
+    int64_t total = 0;
+
+    for (int kind = 0; kind < MEMBUDGET_N_KINDS; kind++)
+    {
+        total += membudget_kind_total(kind);
+    }
+
+    return total;
+}
+
+/**
+ * Return the configured budget
+ *
+ * @return The budget in bytes, 0 if there is no budget
+ */
+uint64_t
+membudget_budget()
+{
+    return budget;
+}
+
+/**
+ * Check whether the buffered data has grown over the budget
+ *
+ * @return True if there is a budget and the data exceeds it
+ */
+bool
+membudget_exceeded()
+{
+    return budget && membudget_total() > (int64_t)budget;
+}
+
+/**
+ * Check whether the data of a subsystem takes more than its share of the budget
+ *
+ * The share is what the other subsystems leave of the budget but at least an
+ * equal part of it. Data that the other subsystems hold, e.g. the session
+ * command history, does not make a subsystem exceed its share alone.
+ *
+ * @param kind  The subsystem
+ * @return True if there is a budget and the data of the subsystem exceeds
+ * its share of it
+ */
+bool
+membudget_kind_exceeded(membudget_kind_t kind)
+{
+    if (budget == 0)
+    {
+        return false;
+    }
+
+    int64_t bytes = membudget_kind_total(kind);
+    int64_t share = (int64_t)budget - (membudget_total() - bytes);
+    int64_t min_share = budget / MEMBUDGET_N_KINDS;
+
+    return membudget_exceeded() && bytes > (share > min_share ? share : min_share);
+}
+
+/**
+ * Return the name of a subsystem
+ *
+ * @param kind  The subsystem
+ * @return The name shown in the diagnostics
+ */
+const char *
+membudget_kind_name(membudget_kind_t kind)
+{
+    return kind_names[kind];
+}
@@ -480,128 +480,356 @@ int modutil_send_mysql_err_packet(DCB        *dcb,
 }
 
 /**
- * Buffer contains at least one of the following:
- * complete [complete] [partial] mysql packet
+ * @brief Initialise a packet iterator
  *
- * return pointer to gwbuf containing a complete packet or
- *   NULL if no complete packet was found.
+ * The iterator is placed before the first packet of the chain, call
+ * modutil_iter_next to move to it.
+ *
+ * @param iter The iterator
+ * @param buf  Buffer chain to iterate over, may be NULL
  */
-GWBUF* modutil_get_next_MySQL_packet(GWBUF** p_readbuf)
+void modutil_iter_init(PACKET_ITER* iter, GWBUF* buf)
 {
-    GWBUF*   packetbuf;
-    GWBUF*   readbuf;
-    size_t   buflen;
-    size_t   packetlen;
-    size_t   totalbuflen;
-    uint8_t* data;
-    size_t   nbytes_copied = 0;
-    uint8_t* target;
+    gwbuf_cursor_init(&iter->pos, buf);
+    iter->end = iter->pos;
+    iter->offset = 0;
+    iter->len = 0;
+    iter->seq = 0;
+    iter->cmd = 0;
+    iter->complete = false;
+    iter->partial = false;
+}
 
-    readbuf = *p_readbuf;
+/**
+ * @brief Move to the next packet
+ *
+ * If the next packet is incomplete, the iterator stays at it and the header
+ * fields are filled as far as they are in the chain. If the iterator stopped
+ * at a partial packet, calling this again after more data has been appended
+ * to the chain continues from it.
+ *
+ * @param iter The iterator
+ * @return True if the iterator is at a complete packet
+ */
+bool modutil_iter_next(PACKET_ITER* iter)
+{
+    uint8_t buf[MYSQL_HEADER_LEN + 1];
+    uint8_t* header = buf;
+    size_t n = sizeof(buf);
 
-    if (readbuf == NULL)
+    if (iter->complete)
     {
-        packetbuf = NULL;
-        goto return_packetbuf;
+        iter->offset += MYSQL_HEADER_LEN + iter->len;
+        iter->pos.buf = iter->end.buf;
+        iter->pos.ptr = iter->end.ptr;
     }
-    CHK_GWBUF(readbuf);
 
-    if (GWBUF_EMPTY(readbuf))
+    GWBUF_CURSOR pos = iter->pos;
+    size_t avail = GWBUF_CURSOR_AVAIL(&pos);
+
+    if (avail >= sizeof(buf))
+    {
+        header = pos.ptr;
+    }
+    else
     {
-        packetbuf = NULL;
-        goto return_packetbuf;
+        n = gwbuf_cursor_peek(&pos, 0, sizeof(buf), buf);
     }
-    totalbuflen = gwbuf_length(readbuf);
-    data        = (uint8_t *)GWBUF_DATA((readbuf));
-    packetlen   = MYSQL_GET_PACKET_LEN(data) + 4;
 
-    /** packet is incomplete */
-    if (packetlen > totalbuflen)
+    iter->complete = false;
+    iter->partial = false;
+    iter->len = 0;
+    iter->seq = 0;
+    iter->cmd = 0;
+
+    /** The length is known as soon as its three bytes are in the chain */
+    if (n >= MYSQL_HEADER_LEN - 1)
     {
-        packetbuf = NULL;
-        goto return_packetbuf;
+        uint32_t len = gw_mysql_get_byte3(header);
+        size_t total = MYSQL_HEADER_LEN + len;
+
+        iter->len = len;
+        iter->seq = n >= MYSQL_HEADER_LEN ? header[3] : 0;
+        iter->cmd = len > 0 && n > MYSQL_HEADER_LEN ? header[4] : 0;
+
+        /** Find the end of the packet so that the buffers are walked only once */
+        if (avail > total)
+        {
+            pos.ptr += total;
+            iter->complete = true;
+        }
+        else
+        {
+            iter->complete = gwbuf_cursor_skip(&pos, total) == total;
+        }
+
+        iter->end.buf = pos.buf;
+        iter->end.ptr = pos.ptr;
+        iter->partial = !iter->complete;
     }
 
-    packetbuf = gwbuf_alloc(packetlen);
-    target    = GWBUF_DATA(packetbuf);
-    packetbuf->gwbuf_type = readbuf->gwbuf_type; /*< Copy the type too */
-    /**
-     * Copy first MySQL packet to packetbuf and leave posible other
-     * packets to read buffer.
-     */
-    while (nbytes_copied < packetlen && totalbuflen > 0)
+    return iter->complete;
+}
+
+/**
+ * @brief Get a pointer to the current packet
+ *
+ * @param iter The iterator
+ * @return Pointer to the header of the packet if the whole packet is in one
+ * buffer, NULL if it is spread over several buffers or incomplete
+ */
+uint8_t* modutil_iter_data(const PACKET_ITER* iter)
+{
+    return iter->complete && GWBUF_CURSOR_AVAIL(&iter->pos) >= MYSQL_HEADER_LEN + iter->len ?
+           iter->pos.ptr : NULL;
+}
+
+/**
+ * @brief Copy bytes from the payload of the current packet
+ *
+ * @param iter  The iterator
+ * @param pos   Offset into the payload
+ * @param bytes Number of bytes to copy
+ * @param dest  Destination where the bytes are copied
+ * @return Number of bytes copied, never more than what is left of the payload
+ */
+size_t modutil_iter_copy(const PACKET_ITER* iter, size_t pos, size_t bytes, uint8_t* dest)
+{
+    if ((!iter->complete && !iter->partial) || pos >= iter->len)
+    {
+        return 0;
+    }
+
+    return gwbuf_cursor_peek(&iter->pos, MYSQL_HEADER_LEN + pos,
+                             MIN(bytes, iter->len - pos), dest);
+}
+
+/**
+ * @brief Read a length-encoded integer from the payload of the current packet
+ *
+ * @param iter  The iterator
+ * @param pos   Offset into the payload, moved past the integer
+ * @param value Where the value is stored
+ * @return True if an integer was read, false if the packet ended or the
+ * field is a NULL or not an integer
+ */
+bool modutil_iter_lenenc(const PACKET_ITER* iter, size_t* pos, uint64_t* value)
+{
+    uint8_t data[8];
+    size_t bytes;
+
+    if (modutil_iter_copy(iter, *pos, 1, data) != 1)
     {
-        uint8_t* src = GWBUF_DATA((*p_readbuf));
-        size_t   bytestocopy;
+        return false;
+    }
 
-        buflen = GWBUF_LENGTH((*p_readbuf));
-        bytestocopy = MIN(buflen, packetlen - nbytes_copied);
+    switch (data[0])
+    {
+    case 0xfb:
+    case 0xff:
+        return false;
+
+    case 0xfc:
+        bytes = 2;
+        break;
+
+    case 0xfd:
+        bytes = 3;
+        break;
 
-        memcpy(target + nbytes_copied, src, bytestocopy);
-        *p_readbuf = gwbuf_consume((*p_readbuf), bytestocopy);
-        totalbuflen = gwbuf_length((*p_readbuf));
-        nbytes_copied += bytestocopy;
+    case 0xfe:
+        bytes = 8;
+        break;
+
+    default:
+        *value = data[0];
+        *pos += 1;
+        return true;
     }
-    ss_dassert(buflen == 0 || nbytes_copied == packetlen);
 
-return_packetbuf:
-    return packetbuf;
+    if (modutil_iter_copy(iter, *pos + 1, bytes, data) != bytes)
+    {
+        return false;
+    }
+
+    uint64_t rval = 0;
+
+    for (size_t i = bytes; i > 0; i--)
+    {
+        rval = (rval << 8) | data[i - 1];
+    }
+
+    *value = rval;
+    *pos += 1 + bytes;
+    return true;
 }
 
 /**
- * @brief Calculate the length of the complete MySQL packets in the buffer
+ * @brief Start tracking the reply to a command sent to a backend
  *
- * @param buffer Buffer to inspect
- * @return Length of the complete MySQL packets in bytes
+ * @param tracker The reply tracker of the backend
+ * @param command The command that was sent
+ * @return True if the backend replies to the command, false if no reply is
+ * expected and the tracker is left in the done state
  */
-static size_t get_complete_packets_length(GWBUF *buffer)
+bool modutil_reply_start(REPLY_TRACKER* tracker, uint8_t command)
 {
-    uint8_t packet_len[3];
-    uint32_t buflen = GWBUF_LENGTH(buffer);
-    size_t offset = 0;
-    size_t total = 0;
+    /** A result set ends with two EOF packets, a field list with one and the
+     * other commands are answered with a single packet */
+    switch (command)
+    {
+    case MYSQL_COM_QUIT:
+    case MYSQL_COM_STMT_SEND_LONG_DATA:
+    case MYSQL_COM_STMT_CLOSE:
+        tracker->state = REPLY_STATE_DONE;
+        return false;
+
+    case MYSQL_COM_QUERY:
+        tracker->n_eof = 2;
+        break;
 
-    while (buffer && gwbuf_copy_data(buffer, offset, 3, packet_len) == 3)
+    case MYSQL_COM_FIELD_LIST:
+        tracker->n_eof = 1;
+        break;
+
+    default:
+        tracker->n_eof = 0;
+        break;
+    }
+
+    tracker->state = REPLY_STATE_START;
+    return true;
+}
+
+/**
+ * @brief Follow the reply to a command to find where it ends
+ *
+ * The buffer must contain only complete packets. An OK or an ERR packet ends
+ * the reply, a result set ends with its last EOF packet. If the server has
+ * more results to send, the next one is tracked the same way.
+ *
+ * @param tracker The reply tracker of the backend
+ * @param buf     Part of the reply
+ * @return True if the reply is complete
+ */
+bool modutil_reply_track(REPLY_TRACKER* tracker, GWBUF* buf)
+{
+    PACKET_ITER iter;
+
+    modutil_iter_init(&iter, buf);
+
+    while (tracker->state != REPLY_STATE_DONE && modutil_iter_next(&iter))
     {
-        uint32_t len = gw_mysql_get_byte3(packet_len) + MYSQL_HEADER_LEN;
+        bool is_eof = iter.len == 5 && iter.cmd == 0xfe;
+        bool more = false;
 
-        if (len < buflen)
+        if (tracker->n_eof == 0 || iter.cmd == 0xff)
         {
-            offset += len;
-            total += len;
-            buflen -= len;
+            tracker->state = REPLY_STATE_DONE;
+        }
+        else if (tracker->state == REPLY_STATE_START && iter.cmd == 0x00)
+        {
+            size_t pos = 1;
+            uint64_t value;
+            uint8_t status;
+
+            /** The status flags follow the affected rows and the insert id */
+            more = modutil_iter_lenenc(&iter, &pos, &value) &&
+                   modutil_iter_lenenc(&iter, &pos, &value) &&
+                   modutil_iter_copy(&iter, pos, 1, &status) == 1 &&
+                   (status & 0x08);
+            tracker->state = REPLY_STATE_DONE;
         }
-        /** The packet is spread across multiple buffers or a buffer ends with
-         * a complete packet. */
         else
         {
-            uint32_t read_len = len;
+            tracker->state = REPLY_STATE_RSET;
 
-            while (read_len >= buflen && buffer)
+            if (is_eof && --tracker->n_eof == 0)
             {
-                read_len -= buflen;
-                buffer = buffer->next;
-                buflen = buffer ? GWBUF_LENGTH(buffer) : 0;
-            }
+                uint8_t status;
 
-            /** Either the buffer ended with a complete packet or the buffer
-             * contains more data than is required. */
-            if (read_len == 0 || (buffer && read_len < buflen))
-            {
-                total += len;
-                offset = read_len;
-                buflen -= read_len;
-            }
-            /** The buffer chain contains at least one incomplete packet */
-            else
-            {
-                ss_dassert(!buffer);
-                break;
+                /** The low byte of the status flags follows the warning count */
+                more = modutil_iter_copy(&iter, 3, 1, &status) == 1 && (status & 0x08);
+                tracker->state = REPLY_STATE_DONE;
             }
         }
+
+        if (more)
+        {
+            modutil_reply_start(tracker, MYSQL_COM_QUERY);
+        }
     }
 
-    return total;
+    return tracker->state == REPLY_STATE_DONE;
+}
+
+/**
+ * Buffer contains at least one of the following:
+ * complete [complete] [partial] mysql packet
+ *
+ * A packet that is in one buffer is split from the chain without copying,
+ * a packet that spans several buffers is copied into a contiguous buffer.
+ *
+ * return pointer to gwbuf containing a complete packet or
+ *   NULL if no complete packet was found.
+ */
+GWBUF* modutil_get_next_MySQL_packet(GWBUF** p_readbuf)
+{
+    GWBUF* packetbuf = NULL;
+    GWBUF* readbuf = *p_readbuf;
+    PACKET_ITER iter;
+
+    if (readbuf == NULL)
+    {
+        return NULL;
+    }
+    CHK_GWBUF(readbuf);
+
+    modutil_iter_init(&iter, readbuf);
+
+    if (modutil_iter_next(&iter))
+    {
+        gwbuf_type_t type = readbuf->gwbuf_type;
+        size_t packetlen = MYSQL_HEADER_LEN + iter.len;
+
+        if (iter.pos.buf == readbuf && modutil_iter_data(&iter))
+        {
+            packetbuf = gwbuf_split(p_readbuf, packetlen);
+        }
+        else if ((packetbuf = gwbuf_alloc(packetlen)) != NULL)
+        {
+            gwbuf_copy_data(readbuf, 0, packetlen, GWBUF_DATA(packetbuf));
+            *p_readbuf = gwbuf_consume(readbuf, packetlen);
+        }
+
+        if (packetbuf)
+        {
+            packetbuf->gwbuf_type = type; /*< Copy the type too */
+        }
+    }
+
+    return packetbuf;
+}
+
+/**
+ * @brief Calculate the length of the complete MySQL packets in the buffer
+ *
+ * @param buffer Buffer to inspect
+ * @return Length of the complete MySQL packets in bytes
+ */
+static size_t get_complete_packets_length(GWBUF *buffer)
+{
+    PACKET_ITER iter;
+
+    modutil_iter_init(&iter, buffer);
+
+    while (modutil_iter_next(&iter))
+    {
+        ;
+    }
+
+    /** The iterator stops at the first incomplete packet */
+    return iter.offset;
 }
 
 /**
@@ -646,7 +874,8 @@ GWBUF* modutil_get_complete_packets(GWBUF **p_readbuf)
  * Count the number of EOF, OK or ERR packets in the buffer. Only complete
  * packets are inspected and the buffer is assumed to only contain whole packets.
  * If partial packets are in the buffer, they are ignored. The caller must handle the
- * detection of partial packets in buffers.
+ * detection of partial packets in buffers. The packets may be spread over a
+ * chain of buffers.
  * @param reply Buffer to use
  * @param use_ok Whether the DEPRECATE_EOF flag is set
  * @param n_found If there were previous packets found
@@ -655,43 +884,37 @@ GWBUF* modutil_get_complete_packets(GWBUF **p_readbuf)
 int
 modutil_count_signal_packets(GWBUF *reply, int use_ok,  int n_found, int* more)
 {
-    unsigned char* ptr = (unsigned char*) reply->start;
-    unsigned char* end = (unsigned char*) reply->end;
-    unsigned char* prev = ptr;
-    int pktlen, eof = 0, err = 0;
-    int errlen = 0, eoflen = 0;
-    int iserr = 0, iseof = 0;
+    PACKET_ITER iter;
+    int eof = 0, err = 0;
+    bool iserr = false, iseof = false;
     bool moreresults = false;
-    while (ptr < end)
+
+    modutil_iter_init(&iter, reply);
+
+    while (modutil_iter_next(&iter))
     {
-        pktlen = MYSQL_GET_PACKET_LEN(ptr) + 4;
+        iserr = iter.cmd == 0xff;
+        iseof = iter.len == 5 && iter.cmd == 0xfe;
 
-        if ((iserr = PTR_IS_ERR(ptr)) || (iseof = PTR_IS_EOF(ptr)))
+        if (iserr)
         {
-            if (iserr)
-            {
-                err++;
-                errlen = pktlen;
-            }
-            else if (iseof)
-            {
-                eof++;
-                eoflen = pktlen;
-            }
+            err++;
+        }
+        else if (iseof)
+        {
+            eof++;
         }
 
-        if ((ptr + pktlen) > end || (eof + n_found) >= 2)
+        if ((eof + n_found) >= 2)
         {
-            moreresults = PTR_EOF_MORE_RESULTS(ptr);
-            ptr = prev;
+            uint8_t status;
+            /** The low byte of the status flags follows the warning count */
+            moreresults = iseof && modutil_iter_copy(&iter, 3, 1, &status) == 1 &&
+                          (status & 0x08);
             break;
         }
-
-        prev = ptr;
-        ptr += pktlen;
     }
 
-
     /*
      * If there were new EOF/ERR packets found, make sure that they are the last
      * packet in the buffer.
@@ -700,19 +923,14 @@ modutil_count_signal_packets(GWBUF *reply, int use_ok,  int n_found, int* more)
     {
         if (err)
         {
-            ptr -= errlen;
-            if (!PTR_IS_ERR(ptr))
+            if (!iserr)
             {
                 err = 0;
             }
         }
-        else
+        else if (!iseof)
         {
-            ptr -= eoflen;
-            if (!PTR_IS_EOF(ptr))
-            {
-                eof = 0;
-            }
+            eof = 0;
         }
     }
 
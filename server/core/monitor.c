@@ -96,6 +96,27 @@ monitor_alloc(char *name, char *module)
     mon->connect_timeout = DEFAULT_CONNECT_TIMEOUT;
     mon->interval = MONITOR_INTERVAL;
     mon->parameters = NULL;
+
+    char labels[TS_LABEL_SIZE("monitor", name)];
+    ts_metric_label(labels, sizeof(labels), "monitor", name);
+    mon->n_checks = ts_stats_register("maxscale_monitor_checks_total", labels,
+                                      "Number of connection checks to the monitored servers",
+                                      TS_METRIC_COUNTER);
+    mon->n_failures = ts_stats_register("maxscale_monitor_check_failures_total", labels,
+                                        "Number of failed connection checks",
+                                        TS_METRIC_COUNTER);
+    mon->h_check = ts_hist_register("maxscale_monitor_check_ns", labels,
+                                    "Time spent in the connection checks in nanoseconds");
+    if (mon->name == NULL || mon->n_checks == NULL || mon->n_failures == NULL || mon->h_check == NULL)
+    {
+        ts_stats_free(mon->n_checks);
+        ts_stats_free(mon->n_failures);
+        ts_hist_free(mon->h_check);
+        free(mon->name);
+        free(mon);
+        return NULL;
+    }
+
     spinlock_init(&mon->lock);
     spinlock_acquire(&monLock);
     mon->next = allMonitors;
@@ -138,6 +159,9 @@ monitor_free(MONITOR *mon)
     spinlock_release(&monLock);
     free_config_parameter(mon->parameters);
     monitor_servers_free(mon->databases);
+    ts_stats_free(mon->n_checks);
+    ts_stats_free(mon->n_failures);
+    ts_hist_free(mon->h_check);
     free(mon->name);
     free(mon);
 }
@@ -976,10 +1000,14 @@ connect_result_t
 mon_connect_to_db(MONITOR* mon, MONITOR_SERVERS *database)
 {
     connect_result_t rval = MONITOR_CONN_OK;
+    uint64_t start_ns = ts_clock_ns();
+
+    ts_stats_add(mon->n_checks, 1);
 
     /** Return if the connection is OK */
     if (database->con && mysql_ping(database->con) == 0)
     {
+        ts_hist_add(mon->h_check, ts_clock_ns() - start_ns);
         return rval;
     }
 
@@ -1021,6 +1049,12 @@ mon_connect_to_db(MONITOR* mon, MONITOR_SERVERS *database)
         rval = MONITOR_CONN_REFUSED;
     }
 
+    if (rval != MONITOR_CONN_OK)
+    {
+        ts_stats_add(mon->n_failures, 1);
+    }
+    ts_hist_add(mon->h_check, ts_clock_ns() - start_ns);
+
     return rval;
 }
 
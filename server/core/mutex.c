@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file mutex.c  -  Adaptive mutex and reader-writer lock
+ *
+ * Both locks first poll the lock word like a spinlock. If the lock is not
+ * released within MUTEX_SPIN_COUNT polls the thread sleeps on a futex and
+ * the thread that releases the lock wakes it up. A lock that is released
+ * quickly costs no more than a spinlock and a lock whose holder has been
+ * preempted no longer keeps the waiting threads busy.
+ *
+ * The mutex is the three state futex mutex: the releasing thread makes a
+ * system call only when the lock word says that someone may be sleeping.
+ */
+
+#include <mutex.h>
+#include <atomic.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <skygw_debug.h>
+
+/** Read a lock field that other threads are changing */
+#define LOCK_READ(v) (*(volatile int *)&(v))
+
+/**
+ * Tell the processor that the thread is polling a lock
+ */
+static inline void
+cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+}
+
+/**
+ * Sleep until the futex is woken up, unless its value is no longer the
+ * expected one
+ *
+ * @param addr  The futex word
+ * @param value The value the futex word is expected to have
+ */
+static inline void
+futex_wait(int *addr, int value)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+/**
+ * Wake up threads sleeping on a futex
+ *
+ * @param addr  The futex word
+ * @param count Maximum number of threads to wake up
+ */
+static inline void
+futex_wake(int *addr, int count)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/**
+ * Initialise a mutex.
+ *
+ * @param lock The mutex to initialise.
+ */
+void
+mutex_init(MUTEX *lock)
+{
+    lock->lock = 0;
+#if SPINLOCK_PROFILE
+    lock->spins = 0;
+    lock->maxspins = 0;
+    lock->acquired = 0;
+    lock->waiting = 0;
+    lock->max_waiting = 0;
+    lock->contended = 0;
+    lock->sleeps = 0;
+#endif
+}
+
+/**
+ * Acquire a mutex.
+ *
+ * The lock is polled MUTEX_SPIN_COUNT times before the thread goes to
+ * sleep. A sleeping thread marks the lock with the value 2 so that the
+ * thread that releases it knows to wake it up.
+ *
+ * @param lock The mutex to acquire
+ */
+void
+mutex_acquire(MUTEX *lock)
+{
+    int c;
+#if SPINLOCK_PROFILE
+    int spins = 0;
+
+    atomic_add(&(lock->waiting), 1);
+#endif
+
+    c = __sync_val_compare_and_swap(&lock->lock, 0, 1);
+
+    for (int i = 0; c != 0 && i < MUTEX_SPIN_COUNT; i++)
+    {
+        cpu_relax();
+#if SPINLOCK_PROFILE
+        atomic_add(&(lock->spins), 1);
+        spins++;
+#endif
+        if (LOCK_READ(lock->lock) == 0)
+        {
+            c = __sync_val_compare_and_swap(&lock->lock, 0, 1);
+        }
+    }
+
+    if (c != 0)
+    {
+        if (c != 2)
+        {
+            c = __sync_lock_test_and_set(&lock->lock, 2);
+        }
+
+        while (c != 0)
+        {
+#if SPINLOCK_PROFILE
+            atomic_add(&(lock->sleeps), 1);
+#endif
+            futex_wait(&lock->lock, 2);
+            c = __sync_lock_test_and_set(&lock->lock, 2);
+        }
+    }
+
+#if SPINLOCK_PROFILE
+    if (spins)
+    {
+        lock->contended++;
+        if (lock->maxspins < spins)
+        {
+            lock->maxspins = spins;
+        }
+    }
+    lock->acquired++;
+    lock->owner = thread_self();
+    atomic_add(&(lock->waiting), -1);
+#endif
+}
+
+/**
+ * Acquire a mutex if it is not already locked.
+ *
+ * @param lock The mutex to acquire
+ * @return True if the mutex was acquired, otherwise false
+ */
+int
+mutex_acquire_nowait(MUTEX *lock)
+{
+    if (__sync_val_compare_and_swap(&lock->lock, 0, 1) != 0)
+    {
+        return FALSE;
+    }
+#if SPINLOCK_PROFILE
+    lock->acquired++;
+    lock->owner = thread_self();
+#endif
+    return TRUE;
+}
+
+/**
+ * Release a mutex.
+ *
+ * @param lock The mutex to release
+ */
+void
+mutex_release(MUTEX *lock)
+{
+    ss_dassert(lock->lock != 0);
+#if SPINLOCK_PROFILE
+    if (lock->waiting > lock->max_waiting)
+    {
+        lock->max_waiting = lock->waiting;
+    }
+#endif
+    if (__sync_fetch_and_sub(&lock->lock, 1) != 1)
+    {
+        /** Someone may be sleeping on the lock */
+        __sync_lock_release(&lock->lock);
+        futex_wake(&lock->lock, 1);
+    }
+}
+
+/**
+ * Report statistics on a mutex. This only has an effect if the
+ * code has been compiled with the SPINLOCK_PROFILE option set.
+ *
+ * @param lock          The mutex to report on
+ * @param reporter      The callback function to pass the statistics to
+ * @param hdl           A handle that is passed to the reporter function
+ */
+void
+mutex_stats(MUTEX *lock, void (*reporter)(void *, char *, int), void *hdl)
+{
+#if SPINLOCK_PROFILE
+    reporter(hdl, "Spinlock acquired", lock->acquired);
+    if (lock->acquired)
+    {
+        reporter(hdl, "Total no. of spins", lock->spins);
+        reporter(hdl, "Average no. of spins (overall)",
+                 lock->spins / lock->acquired);
+        if (lock->contended)
+        {
+            reporter(hdl, "Average no. of spins (when contended)",
+                     lock->spins / lock->contended);
+        }
+        reporter(hdl, "Maximum no. of spins", lock->maxspins);
+        reporter(hdl, "Maximim no. of blocked threads",
+                 lock->max_waiting);
+        reporter(hdl, "Contended locks", lock->contended);
+        reporter(hdl, "Contention percentage",
+                 (lock->contended * 100) / lock->acquired);
+        reporter(hdl, "No. of sleeps", lock->sleeps);
+    }
+#endif
+}
+
+/**
+ * Initialise a reader-writer lock.
+ *
+ * @param lock The lock to initialise.
+ */
+void
+rwlock_init(RWLOCK *lock)
+{
+    lock->state = 0;
+    lock->writers = 0;
+    lock->rseq = 0;
+    lock->wseq = 0;
+    lock->rsleepers = 0;
+    lock->wsleepers = 0;
+#if SPINLOCK_PROFILE
+    lock->acquired = 0;
+    lock->contended = 0;
+    lock->sleeps = 0;
+#endif
+}
+
+/**
+ * Acquire a reader-writer lock for reading.
+ *
+ * A reader waits while a writer holds the lock or is waiting for it. The
+ * lock does not support recursion: a thread that holds a read lock must not
+ * take it again as a waiting writer would block it.
+ *
+ * @param lock The lock to acquire
+ */
+void
+rwlock_read_acquire(RWLOCK *lock)
+{
+    for (int spins = 0;; spins++)
+    {
+        int state = LOCK_READ(lock->state);
+
+        if (LOCK_READ(lock->writers) == 0 && (state & RWLOCK_WRITER) == 0)
+        {
+            if (__sync_bool_compare_and_swap(&lock->state, state, state + 1))
+            {
+#if SPINLOCK_PROFILE
+                atomic_add(&lock->acquired, 1);
+                if (spins)
+                {
+                    atomic_add(&lock->contended, 1);
+                }
+#endif
+                return;
+            }
+        }
+        else if (spins < MUTEX_SPIN_COUNT)
+        {
+            cpu_relax();
+        }
+        else
+        {
+            /** The sleeper count is raised before the writers are checked so
+             * that a writer that releases the lock sees it */
+            atomic_add(&lock->rsleepers, 1);
+            int seq = LOCK_READ(lock->rseq);
+
+            if (LOCK_READ(lock->writers) != 0 || (LOCK_READ(lock->state) & RWLOCK_WRITER))
+            {
+#if SPINLOCK_PROFILE
+                atomic_add(&lock->sleeps, 1);
+#endif
+                futex_wait(&lock->rseq, seq);
+            }
+            atomic_add(&lock->rsleepers, -1);
+        }
+    }
+}
+
+/**
+ * Release a read lock.
+ *
+ * The last reader wakes up a sleeping writer.
+ *
+ * @param lock The lock to release
+ */
+void
+rwlock_read_release(RWLOCK *lock)
+{
+    ss_dassert(lock->state > 0 && (lock->state & RWLOCK_WRITER) == 0);
+
+    if (atomic_add(&lock->state, -1) == 1 && LOCK_READ(lock->writers) != 0 &&
+        LOCK_READ(lock->wsleepers) != 0)
+    {
+        atomic_add(&lock->wseq, 1);
+        futex_wake(&lock->wseq, 1);
+    }
+}
+
+/**
+ * Acquire a reader-writer lock for writing.
+ *
+ * A waiting writer stops new readers from taking the lock and waits for the
+ * current readers to release it.
+ *
+ * @param lock The lock to acquire
+ */
+void
+rwlock_write_acquire(RWLOCK *lock)
+{
+    atomic_add(&lock->writers, 1);
+
+    for (int spins = 0;; spins++)
+    {
+        if (LOCK_READ(lock->state) == 0 &&
+            __sync_bool_compare_and_swap(&lock->state, 0, RWLOCK_WRITER))
+        {
+#if SPINLOCK_PROFILE
+            atomic_add(&lock->acquired, 1);
+            if (spins)
+            {
+                atomic_add(&lock->contended, 1);
+            }
+#endif
+            return;
+        }
+        else if (spins < MUTEX_SPIN_COUNT)
+        {
+            cpu_relax();
+        }
+        else
+        {
+            atomic_add(&lock->wsleepers, 1);
+            int seq = LOCK_READ(lock->wseq);
+
+            if (LOCK_READ(lock->state) != 0)
+            {
+#if SPINLOCK_PROFILE
+                atomic_add(&lock->sleeps, 1);
+#endif
+                futex_wait(&lock->wseq, seq);
+            }
+            atomic_add(&lock->wsleepers, -1);
+        }
+    }
+}
+
+/**
+ * Release a write lock.
+ *
+ * If more writers are waiting, one of them is woken up. Otherwise all
+ * sleeping readers are woken up.
+ *
+ * @param lock The lock to release
+ */
+void
+rwlock_write_release(RWLOCK *lock)
+{
+    ss_dassert(lock->state == RWLOCK_WRITER);
+
+    atomic_add(&lock->state, -RWLOCK_WRITER);
+
+    if (atomic_add(&lock->writers, -1) > 1)
+    {
+        if (LOCK_READ(lock->wsleepers) != 0)
+        {
+            atomic_add(&lock->wseq, 1);
+            futex_wake(&lock->wseq, 1);
+        }
+    }
+    else if (LOCK_READ(lock->rsleepers) != 0)
+    {
+        atomic_add(&lock->rseq, 1);
+        futex_wake(&lock->rseq, INT_MAX);
+    }
+}
+
+/**
+ * Report statistics on a reader-writer lock. This only has an effect if
+ * the code has been compiled with the SPINLOCK_PROFILE option set.
+ *
+ * @param lock          The lock to report on
+ * @param reporter      The callback function to pass the statistics to
+ * @param hdl           A handle that is passed to the reporter function
+ */
+void
+rwlock_stats(RWLOCK *lock, void (*reporter)(void *, char *, int), void *hdl)
+{
+#if SPINLOCK_PROFILE
+    reporter(hdl, "Lock acquired", lock->acquired);
+    if (lock->acquired)
+    {
+        reporter(hdl, "Contended locks", lock->contended);
+        reporter(hdl, "Contention percentage",
+                 (lock->contended * 100) / lock->acquired);
+        reporter(hdl, "No. of sleeps", lock->sleeps);
+    }
+#endif
+}
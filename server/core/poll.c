@@ -12,11 +12,15 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <limits.h>
+#include <inttypes.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <errno.h>
 #include <maxscale/poll.h>
 #include <dcb.h>
@@ -32,7 +36,17 @@
 #include <resultset.h>
 #include <session.h>
 #include <statistics.h>
+#include <timerwheel.h>
+#include <mailbox.h>
+#include <affinity.h>
+#include <governor.h>
+#include <membudget.h>
+#include <uring.h>
+#include <listener.h>
+#include <server.h>
+#include <hk_heartbeat.h>
 #include <query_classifier.h>
+#include <platform.h>
 
 #define         PROFILE_POLL    0
 
@@ -87,13 +101,154 @@ static GWBITMASK poll_mask;
 static simple_mutex_t epoll_wait_mutex; /*< serializes calls to epoll_wait */
 #endif
 static int n_waiting = 0;    /*< No. of threads in epoll_wait */
+static poll_mode_t poll_mode = POLL_MODE_GLOBAL; /*< How the threads share the DCBs */
+static thread_local int poll_thread = -1; /*< ID of the polling thread, -1 for other threads */
+
+/**
+ * A queue of DCBs that have events waiting to be processed. The DCB's own
+ * evq fields are protected by the lock of the queue the DCB is in.
+ */
+typedef struct
+{
+    SPINLOCK lock;      /*< Protects the queue */
+    DCB      *head;     /*< The first DCB in the queue */
+    int      length;    /*< Event queue length */
+    int      pending;   /*< Number of pending descriptors in event queue */
+    int      max;       /*< Maximum event queue length */
+} POLL_EVENTQ;
+
+/**
+ * The per-thread data used in the worker polling mode. Each thread has an
+ * epoll set of its own that contains the DCBs it owns, the shared epoll set
+ * and an eventfd that other threads use to wake the thread up when they
+ * add events to its queue.
+ */
+typedef struct
+{
+    int         epoll_fd;   /*< The epoll set of the thread */
+    int         wakeup_fd;  /*< Wakes the thread up from epoll_wait */
+    POLL_EVENTQ queue;      /*< Events of the DCBs owned by the thread */
+} POLL_WORKER;
+
+#define POLL_RUNQ_SIZE   4096   /*< Capacity of a run queue, must be a power of two */
+#define POLL_CACHE_LINE  64
+
+/**
+ * A bounded lock-free run queue of DCBs used in the work-stealing mode.
+ * Only the owning thread adds DCBs to the bottom of the queue but all
+ * threads take DCBs from the top: the owner to process its own work in
+ * FIFO order and the other threads to steal work when they have none.
+ * The indices only grow and are kept on separate cache lines.
+ */
+typedef struct
+{
+    volatile long top;          /*< Index of the next DCB to take */
+    char          pad1[POLL_CACHE_LINE - sizeof(long)];
+    volatile long bottom;       /*< Index of the next free slot */
+    char          pad2[POLL_CACHE_LINE - sizeof(long)];
+    DCB * volatile items[POLL_RUNQ_SIZE];
+} POLL_RUNQ;
+
+/** The queue for DCBs in the shared epoll set, this is the only queue in the global mode */
+static POLL_EVENTQ shared_queue = { SPINLOCK_INIT, NULL, 0, 0, 0 };
+static POLL_WORKER *workers = NULL;   /*< Worker data, only used in the worker mode */
+static int next_owner = 0;            /*< Round-robin owner for DCBs added by other threads */
+static POLL_RUNQ *runqs = NULL;       /*< Run queues, only used in the stealing mode */
+
+/**
+ * DCBs scheduled by threads that have no run queue or whose run queue is
+ * full. Linked through evq.next and taken by the polling threads before
+ * they try to steal work.
+ */
+static SPINLOCK inject_lock = SPINLOCK_INIT;
+static DCB *inject_head = NULL;
+static DCB *inject_tail = NULL;
+static int inject_length = 0;
+
+#define POLL_TIMER_TICK_MS 10   /*< Resolution of the timer wheels */
+
+/**
+ * The timer wheel of a polling thread. The timers are fired by the owning
+ * thread but the lock allows the other threads to cancel them and the
+ * non-polling threads to arm timers in the wheel of the first thread.
+ */
+typedef struct
+{
+    SPINLOCK   lock;    /*< Protects the wheel */
+    TIMERWHEEL wheel;   /*< The timers of the thread */
+} POLL_TIMERS;
+
+static POLL_TIMERS *timers = NULL;
+
+/**
+ * The mailbox of a polling thread. Any thread can post DCB events and
+ * closures to it without taking locks and the owning thread handles them
+ * before it processes its event queue.
+ */
+typedef struct
+{
+    MAILBOX box;        /*< The posted DCBs and closures */
+    int     notified;   /*< Set when the thread has been woken up for the posts */
+    int     wakeup_fd;  /*< Wakes the thread up, -1 if the thread can't be woken */
+} POLL_MAILBOX;
+
+/** A function posted to a polling thread */
+typedef struct
+{
+    MAILBOX_NODE node;
+    void         (*fn)(void *data);
+    void         *data;
+} POLL_CLOSURE;
+
+static POLL_MAILBOX *mailboxes = NULL;
+
+/** The busy-poll governor of a polling thread, padded to a cache line */
+typedef struct
+{
+    POLL_GOVERNOR gov;
+    char          pad[POLL_CACHE_LINE - sizeof(POLL_GOVERNOR) % POLL_CACHE_LINE];
+} POLL_THREAD_GOVERNOR;
+
+static POLL_THREAD_GOVERNOR *governors = NULL;
+
+/**
+ * The io_uring of a polling thread, only used with the io_uring I/O backend.
+ * The completions are handled and the requests are submitted only by the
+ * owning thread.
+ */
+typedef struct
+{
+    URING    *ring;     /*< The ring of the thread */
+    uint64_t n_recv;    /*< Receive completions */
+    uint64_t n_send;    /*< Send completions */
+    uint64_t n_nobufs;  /*< Receives stopped because the provided buffers ran out */
+    char     pad[POLL_CACHE_LINE - sizeof(void *) - 3 * sizeof(uint64_t)];
+} POLL_URING;
+
+static POLL_URING *rings = NULL;
 
 static int process_pollq(int thread_id);
+static uint64_t poll_timer_now();
+static void poll_fire_timers(int thread_id);
+static int process_eventq(int thread_id, POLL_EVENTQ *queue);
 static void poll_add_event_to_dcb(DCB* dcb, GWBUF* buf, __uint32_t ev);
 static bool poll_dcb_session_check(DCB *dcb, const char *);
-
-DCB *eventq = NULL;
-SPINLOCK pollqlock = SPINLOCK_INIT;
+static void poll_eventq_add(POLL_EVENTQ *queue, DCB *dcb, uint32_t ev);
+static void poll_queue_events(int thread_id, struct epoll_event *events, int nfds);
+static void poll_add_event(DCB *dcb, uint32_t ev);
+static void poll_drain_mailbox(int thread_id);
+static void poll_evq_totals(int *length, int *pending, int *max);
+static void poll_sched_event(DCB *dcb, uint32_t ev);
+static int process_runq(int thread_id);
+static int poll_runq_pending(int thread_id);
+static void poll_uring_init();
+static bool poll_uring_attach(DCB *dcb);
+static void poll_uring_start(DCB *dcb);
+static void poll_uring_stop(DCB *dcb);
+static void poll_uring_pause(DCB *dcb);
+static int poll_uring_reap(int thread_id);
+static void poll_uring_flush(int thread_id);
+static void poll_uring_stats(DCB *dcb);
 
 /**
  * Thread load average, this is the average number of descriptors in each
@@ -153,21 +308,28 @@ static THREAD_DATA *thread_data = NULL;    /*< Status of each thread */
  */
 static struct
 {
-    ts_stats_t *n_read;         /*< Number of read events   */
-    ts_stats_t *n_write;        /*< Number of write events  */
-    ts_stats_t *n_error;        /*< Number of error events  */
-    ts_stats_t *n_hup;          /*< Number of hangup events */
-    ts_stats_t *n_accept;       /*< Number of accept events */
-    ts_stats_t *n_polls;        /*< Number of poll cycles   */
-    ts_stats_t *n_pollev;       /*< Number of polls returning events */
-    ts_stats_t *n_nbpollev;     /*< Number of polls returning events */
-    ts_stats_t *n_nothreads;    /*< Number of times no threads are polling */
+    ts_stats_t n_read;          /*< Number of read events   */
+    ts_stats_t n_write;         /*< Number of write events  */
+    ts_stats_t n_error;         /*< Number of error events  */
+    ts_stats_t n_hup;           /*< Number of hangup events */
+    ts_stats_t n_accept;        /*< Number of accept events */
+    ts_stats_t n_polls;         /*< Number of poll cycles   */
+    ts_stats_t n_pollev;        /*< Number of polls returning events */
+    ts_stats_t n_nbpollev;      /*< Number of polls returning events */
+    ts_stats_t n_nothreads;     /*< Number of times no threads are polling */
+    ts_stats_t n_steals;        /*< Number of DCBs stolen from other threads */
+    ts_stats_t n_posted;        /*< Number of events posted to other threads */
+    ts_stats_t n_timers;        /*< Number of timers fired */
+    ts_hist_t  h_qwait;         /*< Time events wait in the queue */
+    ts_hist_t  h_read;          /*< Time spent in read handlers */
+    ts_hist_t  h_write;         /*< Time spent in write handlers */
+    ts_hist_t  h_error;         /*< Time spent in error handlers */
+    ts_hist_t  h_hangup;        /*< Time spent in hangup handlers */
+    ts_hist_t  h_accept;        /*< Time spent in accept handlers */
+    ts_hist_t  h_batch;         /*< Number of events returned by epoll_wait */
     int n_fds[MAXNFDS];         /*< Number of wakeups with particular n_fds value */
-    int evq_length;             /*< Event queue length */
-    int evq_pending;            /*< Number of pending descriptors in event queue */
-    int evq_max;                /*< Maximum event queue length */
     int wake_evqpending;        /*< Woken from epoll_wait with pending events in queue */
-    ts_stats_t *blockingpolls;  /*< Number of epoll_waits with a timeout specified */
+    ts_stats_t blockingpolls;   /*< Number of epoll_waits with a timeout specified */
 } pollStats;
 
 #define N_QUEUE_TIMES   30
@@ -197,6 +359,76 @@ static void poll_loadav(void *);
  */
 static int poll_resolve_error(DCB *, int, bool);
 
+/**
+ * Return the queue where the events of a DCB are placed
+ *
+ * @param dcb   The DCB
+ * @return      The queue of the owning thread or the shared queue
+ */
+static inline POLL_EVENTQ *
+poll_dcb_queue(DCB *dcb)
+{
+    return dcb->owner >= 0 ? &workers[dcb->owner].queue : &shared_queue;
+}
+
+/**
+ * Check whether there are events that the thread could process
+ *
+ * @param thread_id The thread ID of the calling thread
+ * @return          True if the queues the thread processes have pending events
+ */
+static inline bool
+poll_has_pending(int thread_id)
+{
+    return shared_queue.pending > 0 ||
+           (workers && workers[thread_id].queue.pending > 0) ||
+           (mailboxes && mailbox_length(&mailboxes[thread_id].box) > 0) ||
+           (runqs && poll_runq_pending(thread_id) > 0);
+}
+
+/**
+ * Initialise the epoll set, the wakeup descriptor and the event queue of
+ * a worker thread. The shared epoll set is added into the epoll set of
+ * the worker so that all workers receive the events of the shared DCBs.
+ *
+ * @param worker The worker to initialise
+ */
+static void
+poll_worker_init(POLL_WORKER *worker)
+{
+    struct epoll_event ev;
+
+    spinlock_init(&worker->queue.lock);
+    worker->queue.head = NULL;
+
+    if ((worker->epoll_fd = epoll_create(MAX_EVENTS)) == -1)
+    {
+        perror("epoll_create");
+        exit(-1);
+    }
+    if ((worker->wakeup_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        perror("eventfd");
+        exit(-1);
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &shared_queue;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, epoll_fd, &ev) == -1)
+    {
+        perror("epoll_ctl");
+        exit(-1);
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = worker;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wakeup_fd, &ev) == -1)
+    {
+        perror("epoll_ctl");
+        exit(-1);
+    }
+}
+
 /**
  * Initialise the polling system we are using for the gateway.
  *
@@ -220,6 +452,8 @@ poll_init()
     memset(&queueStats, 0, sizeof(queueStats));
     bitmask_init(&poll_mask);
     n_threads = config_threadcount();
+    dcb_epoch_init(n_threads);
+    membudget_init(n_threads, (uint64_t)config_buffer_budget() * 1024 * 1024);
     if ((thread_data = (THREAD_DATA *)malloc(n_threads * sizeof(THREAD_DATA))) != NULL)
     {
         for (i = 0; i < n_threads; i++)
@@ -228,16 +462,59 @@ poll_init()
         }
     }
 
-    if ((pollStats.n_read = ts_stats_alloc()) == NULL ||
-        (pollStats.n_write = ts_stats_alloc()) == NULL ||
-        (pollStats.n_error = ts_stats_alloc()) == NULL ||
-        (pollStats.n_hup = ts_stats_alloc()) == NULL ||
-        (pollStats.n_accept = ts_stats_alloc()) == NULL ||
-        (pollStats.n_polls = ts_stats_alloc()) == NULL ||
-        (pollStats.n_pollev = ts_stats_alloc()) == NULL ||
-        (pollStats.n_nbpollev = ts_stats_alloc()) == NULL ||
-        (pollStats.n_nothreads = ts_stats_alloc()) == NULL ||
-        (pollStats.blockingpolls = ts_stats_alloc()) == NULL)
+    if ((pollStats.n_read = ts_stats_register("maxscale_poll_reads_total", NULL,
+                                              "Number of read events",
+                                              TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_write = ts_stats_register("maxscale_poll_writes_total", NULL,
+                                               "Number of write events",
+                                               TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_error = ts_stats_register("maxscale_poll_errors_total", NULL,
+                                               "Number of error events",
+                                               TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_hup = ts_stats_register("maxscale_poll_hangups_total", NULL,
+                                             "Number of hangup events",
+                                             TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_accept = ts_stats_register("maxscale_poll_accepts_total", NULL,
+                                                "Number of accept events",
+                                                TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_polls = ts_stats_register("maxscale_poll_cycles_total", NULL,
+                                               "Number of epoll cycles",
+                                               TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_pollev = ts_stats_register("maxscale_poll_cycles_with_events_total", NULL,
+                                                "Number of epoll calls returning events",
+                                                TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_nbpollev = ts_stats_register("maxscale_poll_nonblocking_with_events_total", NULL,
+                                                  "Number of non-blocking epoll calls returning events",
+                                                  TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_nothreads = ts_stats_register("maxscale_poll_no_threads_total", NULL,
+                                                   "Number of times no threads were polling",
+                                                   TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_steals = ts_stats_register("maxscale_poll_steals_total", NULL,
+                                                "Number of DCBs stolen from other threads",
+                                                TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_posted = ts_stats_register("maxscale_poll_posted_total", NULL,
+                                                "Number of events posted to other threads",
+                                                TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.n_timers = ts_stats_register("maxscale_poll_timers_total", NULL,
+                                                "Number of timers fired",
+                                                TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.blockingpolls = ts_stats_register("maxscale_poll_blocking_cycles_total", NULL,
+                                                     "Number of epoll cycles with a wait",
+                                                     TS_METRIC_COUNTER)) == NULL ||
+        (pollStats.h_qwait = ts_hist_register("maxscale_poll_queue_wait_ns", NULL,
+                                              "Time events wait in the queue in nanoseconds")) == NULL ||
+        (pollStats.h_read = ts_hist_register("maxscale_poll_read_handler_ns", NULL,
+                                             "Time spent in read handlers in nanoseconds")) == NULL ||
+        (pollStats.h_write = ts_hist_register("maxscale_poll_write_handler_ns", NULL,
+                                              "Time spent in write handlers in nanoseconds")) == NULL ||
+        (pollStats.h_error = ts_hist_register("maxscale_poll_error_handler_ns", NULL,
+                                              "Time spent in error handlers in nanoseconds")) == NULL ||
+        (pollStats.h_hangup = ts_hist_register("maxscale_poll_hangup_handler_ns", NULL,
+                                               "Time spent in hangup handlers in nanoseconds")) == NULL ||
+        (pollStats.h_accept = ts_hist_register("maxscale_poll_accept_handler_ns", NULL,
+                                               "Time spent in accept handlers in nanoseconds")) == NULL ||
+        (pollStats.h_batch = ts_hist_register("maxscale_poll_batch_size", NULL,
+                                              "Number of events returned by epoll_wait")) == NULL)
     {
         perror("Fatal error: Memory allocation failed.");
         exit(-1);
@@ -263,11 +540,121 @@ poll_init()
     number_poll_spins = config_nbpolls();
     max_poll_sleep = config_pollsleep();
 
+    if ((timers = (POLL_TIMERS *)calloc(n_threads, sizeof(POLL_TIMERS))) == NULL)
+    {
+        perror("Fatal error: Memory allocation failed.");
+        exit(-1);
+    }
+    affinity_bind_array(timers, sizeof(POLL_TIMERS), n_threads);
+    for (i = 0; i < n_threads; i++)
+    {
+        spinlock_init(&timers[i].lock);
+        timerwheel_init(&timers[i].wheel, poll_timer_now());
+    }
+
+    poll_mode = config_poll_mode();
+    if (poll_mode == POLL_MODE_WORKER)
+    {
+        if ((workers = (POLL_WORKER *)calloc(n_threads, sizeof(POLL_WORKER))) == NULL)
+        {
+            perror("Fatal error: Memory allocation failed.");
+            exit(-1);
+        }
+        for (i = 0; i < n_threads; i++)
+        {
+            poll_worker_init(&workers[i]);
+        }
+    }
+    else if (poll_mode == POLL_MODE_STEALING)
+    {
+        if ((runqs = (POLL_RUNQ *)calloc(n_threads, sizeof(POLL_RUNQ))) == NULL)
+        {
+            perror("Fatal error: Memory allocation failed.");
+            exit(-1);
+        }
+        affinity_bind_array(runqs, sizeof(POLL_RUNQ), n_threads);
+    }
+
+    poll_uring_init();
+
+    if ((governors = (POLL_THREAD_GOVERNOR *)calloc(n_threads, sizeof(POLL_THREAD_GOVERNOR))) == NULL)
+    {
+        perror("Fatal error: Memory allocation failed.");
+        exit(-1);
+    }
+    for (i = 0; i < n_threads; i++)
+    {
+        governor_init(&governors[i].gov, config_poll_governor(), ts_clock_ns());
+    }
+
+    if ((mailboxes = (POLL_MAILBOX *)calloc(n_threads, sizeof(POLL_MAILBOX))) == NULL)
+    {
+        perror("Fatal error: Memory allocation failed.");
+        exit(-1);
+    }
+    for (i = 0; i < n_threads; i++)
+    {
+        mailbox_init(&mailboxes[i].box);
+        mailboxes[i].wakeup_fd = workers ? workers[i].wakeup_fd : -1;
+    }
+
 #if PROFILE_POLL
     plog = memlog_create("EventQueueWaitTime", ML_LONG, 10000);
 #endif
 }
 
+/**
+ * Return the ID of the calling polling thread
+ *
+ * @return The thread ID or -1 if the caller is not a polling thread
+ */
+int
+poll_thread_id()
+{
+    return poll_thread;
+}
+
+/**
+ * Select the polling thread that owns a DCB
+ *
+ * In the worker mode the client DCBs are owned by the thread that accepted
+ * them and the backend DCBs by the owner of the session's client DCB, so
+ * that all DCBs of a session are processed by the same thread. Listeners
+ * stay in the shared epoll set unless they are per-thread SO_REUSEPORT
+ * listeners and DCBs added by non-polling threads are distributed in
+ * round-robin order.
+ *
+ * @param dcb   The DCB being added to the poll set
+ * @return      The owning thread or -1 if the DCB is shared
+ */
+static int
+poll_select_owner(DCB *dcb)
+{
+    if (poll_mode != POLL_MODE_WORKER)
+    {
+        return -1;
+    }
+    if (dcb->owner >= 0)
+    {
+        /** Re-added DCBs and listener shards stay on the same thread */
+        return dcb->owner;
+    }
+    if (dcb->dcb_role == DCB_ROLE_SERVICE_LISTENER)
+    {
+        return -1;
+    }
+    if (dcb->dcb_role == DCB_ROLE_BACKEND_HANDLER && dcb->session &&
+        dcb->session->client_dcb && dcb->session->client_dcb->owner >= 0)
+    {
+        return dcb->session->client_dcb->owner;
+    }
+    if (poll_thread >= 0)
+    {
+        return poll_thread;
+    }
+    return (atomic_add(&next_owner, 1) & INT_MAX) % n_threads;
+}
+
 /**
  * Add a DCB to the set of descriptors within the polling
  * environment.
@@ -282,6 +669,8 @@ poll_add_dcb(DCB *dcb)
     dcb_state_t old_state = dcb->state;
     dcb_state_t new_state;
     struct epoll_event ev;
+    int owner;
+    bool uring;
 
     CHK_DCB(dcb);
 
@@ -329,12 +718,21 @@ poll_add_dcb(DCB *dcb)
                   STRDCBSTATE(dcb->state));
     }
     dcb->state = new_state;
+    owner = poll_select_owner(dcb);
+    dcb->owner = owner;
     spinlock_release(&dcb->dcb_initlock);
+
+    /** With io_uring the reads and hangups come from the completions of the receives */
+    if ((uring = poll_uring_attach(dcb)))
+    {
+        ev.events &= ~(EPOLLIN | EPOLLRDHUP);
+    }
     /*
      * The only possible failure that will not cause a crash is
      * running out of system resources.
      */
-    rc = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dcb->fd, &ev);
+    rc = epoll_ctl(owner >= 0 ? workers[owner].epoll_fd : epoll_fd,
+                   EPOLL_CTL_ADD, dcb->fd, &ev);
     if (rc)
     {
         /* Some errors are actually considered acceptable */
@@ -346,6 +744,10 @@ poll_add_dcb(DCB *dcb)
                   pthread_self(),
                   dcb,
                   STRDCBSTATE(dcb->state));
+        if (uring)
+        {
+            poll_uring_start(dcb);
+        }
     }
     else
     {
@@ -365,6 +767,7 @@ int
 poll_remove_dcb(DCB *dcb)
 {
     int dcbfd, rc = -1;
+    int owner;
     struct  epoll_event ev;
     CHK_DCB(dcb);
 
@@ -398,10 +801,12 @@ poll_remove_dcb(DCB *dcb)
      * DCB_STATE_NOPOLLING.
      */
     dcbfd = dcb->fd;
+    owner = dcb->owner;
     spinlock_release(&dcb->dcb_initlock);
     if (dcbfd > 0)
     {
-        rc = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, dcbfd, &ev);
+        rc = epoll_ctl(owner >= 0 ? workers[owner].epoll_fd : epoll_fd,
+                       EPOLL_CTL_DEL, dcbfd, &ev);
         /**
          * The poll_resolve_error function will always
          * return 0 or crash.  So if it returns non-zero result,
@@ -415,10 +820,90 @@ poll_remove_dcb(DCB *dcb)
         {
             raise(SIGABRT);
         }
+        if (dcb->uring)
+        {
+            poll_uring_stop(dcb);
+        }
     }
     return rc;
 }
 
+/**
+ * Change the events that are polled for a DCB
+ *
+ * A DCB whose reads are paused still polls for the hangup of the peer, as
+ * the closing of the session would otherwise wait for the reads to resume.
+ * The io_uring backend reads and sees the hangups through its receives, so
+ * epoll only reports the hangups of a DCB that uses it while it is paused.
+ *
+ * @param dcb       The DCB in the poll set
+ * @param reading   Whether read events are wanted
+ */
+static void
+poll_modify_dcb(DCB *dcb, bool reading)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLOUT | EPOLLHUP | EPOLLET;
+    if (reading && dcb->uring == NULL)
+    {
+        ev.events |= EPOLLIN;
+    }
+#ifdef EPOLLRDHUP
+    if (!reading || dcb->uring == NULL)
+    {
+        ev.events |= EPOLLRDHUP;
+    }
+#endif
+    ev.data.ptr = dcb;
+
+    /** A DCB that is being closed may already have been removed from the poll set */
+    if (dcb->state == DCB_STATE_POLLING && dcb->fd > 0 &&
+        epoll_ctl(dcb->owner >= 0 ? workers[dcb->owner].epoll_fd : epoll_fd,
+                  EPOLL_CTL_MOD, dcb->fd, &ev) == -1 && errno != ENOENT)
+    {
+        char errbuf[STRERROR_BUFLEN];
+        MXS_ERROR("Failed to change the polled events of DCB %p fd %d: %d, %s",
+                  dcb, dcb->fd, errno, strerror_r(errno, errbuf, sizeof(errbuf)));
+    }
+}
+
+/**
+ * Stop reading from a DCB. The DCB stays in the poll set for the other
+ * events and the unread data is left in the socket.
+ *
+ * @param dcb   The DCB
+ */
+void
+poll_pause_reads(DCB *dcb)
+{
+    if (dcb->uring)
+    {
+        poll_uring_pause(dcb);
+    }
+    poll_modify_dcb(dcb, false);
+}
+
+/**
+ * Resume the reads of a DCB paused with poll_pause_reads. Modifying the
+ * events reports the data that arrived meanwhile.
+ *
+ * @param dcb   The DCB
+ */
+void
+poll_resume_reads(DCB *dcb)
+{
+    poll_modify_dcb(dcb, true);
+    if (dcb->uring)
+    {
+        poll_uring_start(dcb);
+        if (dcb->dcb_readqueue)
+        {
+            poll_fake_read_event(dcb);
+        }
+    }
+}
+
 /**
  * Check error returns from epoll_ctl. Most result in a crash since they
  * are "impossible". Adding when already present is assumed non-fatal.
@@ -552,11 +1037,14 @@ void
 poll_waitevents(void *arg)
 {
     struct epoll_event events[MAX_EVENTS];
-    int i, nfds, timeout_bias = 1;
+    int nfds;
     intptr_t thread_id = (intptr_t)arg;
-    int poll_spins = 0;
+    int poll_fd = workers ? workers[thread_id].epoll_fd : epoll_fd;
+    POLL_GOVERNOR *gov = &governors[thread_id].gov;
 
     ts_stats_set_thread_id(thread_id);
+    poll_thread = thread_id;
+    affinity_set_poll_thread(thread_id);
 
     /** Add this thread to the bitmask of running polling threads */
     bitmask_set(&poll_mask, thread_id);
@@ -567,14 +1055,9 @@ poll_waitevents(void *arg)
 
     while (1)
     {
-        if (pollStats.evq_pending == 0 && timeout_bias < 10)
-        {
-            timeout_bias++;
-        }
-
         atomic_add(&n_waiting, 1);
 #if BLOCKINGPOLL
-        nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        nfds = epoll_wait(poll_fd, events, MAX_EVENTS, -1);
         atomic_add(&n_waiting, -1);
 #else /* BLOCKINGPOLL */
 #if MUTEX_EPOLL
@@ -586,7 +1069,7 @@ poll_waitevents(void *arg)
         }
 
         ts_stats_add(pollStats.n_polls, 1);
-        if ((nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 0)) == -1)
+        if ((nfds = epoll_wait(poll_fd, events, MAX_EVENTS, 0)) == -1)
         {
             atomic_add(&n_waiting, -1);
             int eno = errno;
@@ -600,23 +1083,28 @@ poll_waitevents(void *arg)
         }
         /*
          * If there are no new descriptors from the non-blocking call
-         * and nothing to process on the event queue then for do a
-         * blocking call to epoll_wait.
-         *
-         * We calculate a timeout bias to alter the length of the blocking
-         * call based on the time since we last received an event to process
+         * and nothing to process on the event queue then the governor
+         * decides whether to poll again or to do a blocking call to
+         * epoll_wait, based on how long the thread usually stays idle.
          */
-        else if (nfds == 0 && pollStats.evq_pending == 0 && poll_spins++ > number_poll_spins)
+        else if (nfds == 0 && !poll_has_pending(thread_id) &&
+                 !governor_spin(gov, ts_clock_ns(), number_poll_spins))
         {
             ts_stats_add(pollStats.blockingpolls, 1);
-            nfds = epoll_wait(epoll_fd,
+            nfds = epoll_wait(poll_fd,
                               events,
                               MAX_EVENTS,
-                              (max_poll_sleep * timeout_bias) / 10);
-            if (nfds == 0 && pollStats.evq_pending)
+                              governor_block(gov, ts_clock_ns(), max_poll_sleep));
+            if (nfds == 0)
             {
-                atomic_add(&pollStats.wake_evqpending, 1);
-                poll_spins = 0;
+                if (poll_has_pending(thread_id))
+                {
+                    atomic_add(&pollStats.wake_evqpending, 1);
+                }
+                else
+                {
+                    governor_timed_out(gov, max_poll_sleep);
+                }
             }
         }
         else
@@ -634,12 +1122,11 @@ poll_waitevents(void *arg)
 #endif /* BLOCKINGPOLL */
         if (nfds > 0)
         {
-            timeout_bias = 1;
-            if (poll_spins <= number_poll_spins + 1)
+            if (gov->state != GOVERNOR_BLOCKED)
             {
                 ts_stats_add(pollStats.n_nbpollev, 1);
             }
-            poll_spins = 0;
+            governor_wake(gov, ts_clock_ns());
             MXS_DEBUG("%lu [poll_waitevents] epoll_wait found %d fds",
                       pthread_self(),
                       nfds);
@@ -653,6 +1140,7 @@ poll_waitevents(void *arg)
             }
 
             pollStats.n_fds[(nfds < MAXNFDS ? (nfds - 1) : MAXNFDS - 1)]++;
+            ts_hist_add(pollStats.h_batch, nfds);
 
             load_average = (load_average * load_samples + nfds) / (load_samples + 1);
             atomic_add(&load_samples, 1);
@@ -668,47 +1156,12 @@ poll_waitevents(void *arg)
              * idle and is added to the queue to process after
              * setting the event bits.
              */
-            for (i = 0; i < nfds; i++)
-            {
-                DCB *dcb = (DCB *)events[i].data.ptr;
-                __uint32_t ev = events[i].events;
+            poll_queue_events(thread_id, events, nfds);
+        }
 
-                spinlock_acquire(&pollqlock);
-                if (DCB_POLL_BUSY(dcb))
-                {
-                    if (dcb->evq.pending_events == 0)
-                    {
-                        pollStats.evq_pending++;
-                        dcb->evq.inserted = hkheartbeat;
-                    }
-                    dcb->evq.pending_events |= ev;
-                }
-                else
-                {
-                    dcb->evq.pending_events = ev;
-                    if (eventq)
-                    {
-                        dcb->evq.prev = eventq->evq.prev;
-                        eventq->evq.prev->evq.next = dcb;
-                        eventq->evq.prev = dcb;
-                        dcb->evq.next = eventq;
-                    }
-                    else
-                    {
-                        eventq = dcb;
-                        dcb->evq.prev = dcb;
-                        dcb->evq.next = dcb;
-                    }
-                    pollStats.evq_length++;
-                    pollStats.evq_pending++;
-                    dcb->evq.inserted = hkheartbeat;
-                    if (pollStats.evq_length > pollStats.evq_max)
-                    {
-                        pollStats.evq_max = pollStats.evq_length;
-                    }
-                }
-                spinlock_release(&pollqlock);
-            }
+        if (poll_uring_reap(thread_id))
+        {
+            governor_wake(gov, ts_clock_ns());
         }
 
         /*
@@ -717,15 +1170,14 @@ poll_waitevents(void *arg)
          * precautionary measure to avoid issues if the house keeping
          * of the count goes wrong.
          */
+        poll_drain_mailbox(thread_id);
+
         if (process_pollq(thread_id))
         {
-            timeout_bias = 1;
+            governor_wake(gov, ts_clock_ns());
         }
 
-        if (check_timeouts && hkheartbeat >= next_timeout_check)
-        {
-            process_idle_sessions();
-        }
+        poll_fire_timers(thread_id);
 
         if (thread_data)
         {
@@ -737,6 +1189,9 @@ poll_waitevents(void *arg)
             thread_data[thread_id].state = THREAD_IDLE;
         }
 
+        /** The sends and receives prepared during the cycle are submitted together */
+        poll_uring_flush(thread_id);
+
         if (do_shutdown)
         {
             /*<
@@ -758,11 +1213,12 @@ poll_waitevents(void *arg)
 }
 
 /**
- * Set the number of non-blocking poll cycles that will be done before
+ * Set the minimum number of non-blocking poll cycles that will be done before
  * a blocking poll will take place. Whenever an event arrives on a thread
  * or the thread sees a pending event to execute it will reset it's
- * poll_spin coutn to zero and will then poll with a 0 timeout until the
- * poll_spin value is greater than the value set here.
+ * spin count to zero and will then poll with a 0 timeout at least until the
+ * spin count is greater than the value set here. The governor of the thread
+ * may keep spinning longer if events are expected soon.
  *
  * @param nbpolls       Number of non-block polls to perform before blocking
  */
@@ -786,89 +1242,170 @@ poll_set_maxwait(unsigned int maxwait)
 }
 
 /**
- * Process of the queue of DCB's that have outstanding events
+ * Add an event to a DCB in an event queue
  *
- * The first event on the queue will be chosen to be executed by this thread,
- * all other events will be left on the queue and may be picked up by other
- * threads. When the processing is complete the thread will take the DCB off the
- * queue if there are no pending events that have arrived since the thread started
- * to process the DCB. If there are pending events the DCB will be moved to the
- * back of the queue so that other DCB's will have a share of the threads to
- * execute events for them.
+ * If the DCB is currently being processed then the new event bits are
+ * or'ed to the pending event bits and the DCB is left in the queue. If
+ * the DCB was not already in the queue then it was idle and is added to
+ * the end of the queue after setting the event bits.
  *
- * Including session id to log entries depends on this function. Assumption is
- * that when maxscale thread starts processing of an event it processes one
- * and only one session until it returns from this function. Session id is
- * read to thread's local storage if LOG_MAY_BE_ENABLED(LOGFILE_TRACE) returns true
- * reset back to zero just before returning in LOG_IS_ENABLED(LOGFILE_TRACE) returns true.
- * Thread local storage (tls_log_info_t) follows thread and is accessed every
- * time log is written to particular log.
+ * The caller must hold the lock of the queue.
  *
- * @param thread_id     The thread ID of the calling thread
- * @return              0 if no DCB's have been processed
+ * @param queue The event queue of the DCB
+ * @param dcb   The DCB to add the events to
+ * @param ev    The event bits
  */
-static int
-process_pollq(int thread_id)
+static void
+poll_eventq_add(POLL_EVENTQ *queue, DCB *dcb, uint32_t ev)
 {
-    DCB *dcb;
-    int found = 0;
-    uint32_t ev;
-    unsigned long qtime;
-
-    spinlock_acquire(&pollqlock);
-    if (eventq == NULL)
+    if (dcb->evq.next != NULL)
     {
-        /* Nothing to process */
-        spinlock_release(&pollqlock);
-        return 0;
-    }
-    dcb = eventq;
-    if (dcb->evq.next == dcb->evq.prev && dcb->evq.processing == 0)
-    {
-        found = 1;
-        dcb->evq.processing = 1;
-    }
-    else if (dcb->evq.next == dcb->evq.prev)
-    {
-        /* Only item in queue is being processed */
-        spinlock_release(&pollqlock);
-        return 0;
+        if (dcb->evq.pending_events == 0)
+        {
+            queue->pending++;
+            dcb->evq.inserted = hkheartbeat;
+            dcb->evq.inserted_ns = ts_clock_ns();
+        }
+        dcb->evq.pending_events |= ev;
     }
     else
     {
-        do
+        dcb->evq.pending_events = ev;
+        if (queue->head)
         {
-            dcb = dcb->evq.next;
+            dcb->evq.prev = queue->head->evq.prev;
+            queue->head->evq.prev->evq.next = dcb;
+            queue->head->evq.prev = dcb;
+            dcb->evq.next = queue->head;
         }
-        while (dcb != eventq && dcb->evq.processing == 1);
-
-        if (dcb->evq.processing == 0)
+        else
         {
-            /* Found DCB to process */
-            dcb->evq.processing = 1;
-            found = 1;
+            queue->head = dcb;
+            dcb->evq.prev = dcb;
+            dcb->evq.next = dcb;
+        }
+        queue->length++;
+        queue->pending++;
+        dcb->evq.inserted = hkheartbeat;
+        dcb->evq.inserted_ns = ts_clock_ns();
+        if (queue->length > queue->max)
+        {
+            queue->max = queue->length;
         }
     }
-    if (found)
+}
+
+/**
+ * Move the ready events of the shared epoll set to the shared event queue.
+ * Only used in the worker mode where the shared set is polled through the
+ * epoll sets of the workers.
+ */
+static void
+poll_collect_shared_events()
+{
+    struct epoll_event events[MAX_EVENTS];
+    int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 0);
+
+    for (int i = 0; i < nfds; i++)
     {
-        ev = dcb->evq.pending_events;
-        dcb->evq.processing_events = ev;
-        dcb->evq.pending_events = 0;
-        pollStats.evq_pending--;
-        ss_dassert(pollStats.evq_pending >= 0);
+        spinlock_acquire(&shared_queue.lock);
+        poll_eventq_add(&shared_queue, (DCB *)events[i].data.ptr, events[i].events);
+        spinlock_release(&shared_queue.lock);
     }
-    spinlock_release(&pollqlock);
+}
 
-    if (found == 0)
+/**
+ * Add the events returned by epoll_wait to the event queues
+ *
+ * In the worker mode the epoll set of the thread also contains the
+ * shared epoll set and the wakeup descriptor of the thread which are
+ * recognised by their data pointers.
+ *
+ * @param thread_id The thread ID of the calling thread
+ * @param events    The events returned by epoll_wait
+ * @param nfds      Number of events
+ */
+static void
+poll_queue_events(int thread_id, struct epoll_event *events, int nfds)
+{
+    POLL_WORKER *worker = workers ? &workers[thread_id] : NULL;
+
+    for (int i = 0; i < nfds; i++)
     {
-        return 0;
+        void *ptr = events[i].data.ptr;
+
+        if (worker && ptr == &shared_queue)
+        {
+            poll_collect_shared_events();
+        }
+        else if (rings && ptr == &rings[thread_id])
+        {
+            /** The completions of the ring are handled after the events are queued */
+        }
+        else if (worker && ptr == worker)
+        {
+            uint64_t count;
+            /** Reading the eventfd resets it, the events are already in the queue */
+            if (read(worker->wakeup_fd, &count, sizeof(count)) != sizeof(count))
+            {
+                ss_dassert(errno == EAGAIN);
+            }
+        }
+        else if (runqs)
+        {
+            poll_sched_event((DCB *)ptr, events[i].events);
+        }
+        else
+        {
+            DCB *dcb = (DCB *)ptr;
+            POLL_EVENTQ *queue = poll_dcb_queue(dcb);
+
+            spinlock_acquire(&queue->lock);
+            poll_eventq_add(queue, dcb, events[i].events);
+            spinlock_release(&queue->lock);
+        }
     }
+}
+
+/**
+ * Record the time spent since a starting time in a histogram
+ *
+ * @param hist  The histogram
+ * @param start The starting time in nanoseconds
+ * @return      The current time in nanoseconds
+ */
+static inline uint64_t
+poll_hist_time(ts_hist_t hist, uint64_t start)
+{
+    uint64_t now = ts_clock_ns();
+    ts_hist_add(hist, now - start);
+    return now;
+}
+
+/**
+ * Process the events of a DCB
+ *
+ * Calls the handlers of the DCB for the events and records the queue and
+ * execution times of the events. The caller must guarantee that no other
+ * thread processes the events of the DCB at the same time.
+ *
+ * @param thread_id     The thread ID of the calling thread
+ * @param dcb           The DCB to process
+ * @param ev            The events to process
+ * @return              False if the DCB was already disconnected
+ */
+static bool
+poll_process_dcb(int thread_id, DCB *dcb, uint32_t ev)
+{
+    unsigned long qtime;
+    uint64_t now = ts_clock_ns();
 
 #if PROFILE_POLL
     memlog_log(plog, hkheartbeat - dcb->evq.inserted);
 #endif
     qtime = hkheartbeat - dcb->evq.inserted;
     dcb->evq.started = hkheartbeat;
+    ts_hist_add(pollStats.h_qwait, now - dcb->evq.inserted_ns);
 
     if (qtime > N_QUEUE_TIMES)
     {
@@ -910,10 +1447,13 @@ process_pollq(int thread_id)
     /* ss_dassert(dcb->state != DCB_STATE_DISCONNECTED); */
     if (DCB_STATE_DISCONNECTED == dcb->state)
     {
-        return 0;
+        return false;
     }
     ss_debug(spinlock_release(&dcb->dcb_initlock));
 
+    /** The replies written by the handlers are sent when the event is done */
+    dcb_batch_begin();
+
     MXS_DEBUG("%lu [poll_waitevents] event %d dcb %p "
               "role %s",
               pthread_self(),
@@ -929,6 +1469,13 @@ process_pollq(int thread_id)
         if (eno == 0)
         {
             ts_stats_add(pollStats.n_write, 1);
+
+            if (dcb->flags & DCBF_CONNECTING)
+            {
+                /** The backend connection is established */
+                dcb->flags &= ~DCBF_CONNECTING;
+                poll_timer_cancel(&dcb->timer);
+            }
             /** Read session id to thread's local storage */
             dcb_get_ses_log_info(dcb,
                                  &mxs_log_tls.li_sesid,
@@ -951,6 +1498,7 @@ process_pollq(int thread_id)
                       dcb,
                       dcb->fd);
         }
+        now = poll_hist_time(pollStats.h_write, now);
     }
     if (ev & EPOLLIN)
     {
@@ -969,6 +1517,7 @@ process_pollq(int thread_id)
             {
                 dcb->func.accept(dcb);
             }
+            now = poll_hist_time(pollStats.h_accept, now);
         }
         else
         {
@@ -994,11 +1543,12 @@ process_pollq(int thread_id)
                                   dcb_accept_SSL(dcb) :
                                   dcb_connect_SSL(dcb);
                 }
-                if (1 == return_code)
+                if (1 == return_code && !dcb_throttle_reads(dcb) && !dcb_splice_read(dcb))
                 {
                     dcb->func.read(dcb);
                 }
             }
+            now = poll_hist_time(pollStats.h_read, now);
         }
     }
     if (ev & EPOLLERR)
@@ -1037,6 +1587,7 @@ process_pollq(int thread_id)
         {
             dcb->func.error(dcb);
         }
+        now = poll_hist_time(pollStats.h_error, now);
     }
 
     if (ev & EPOLLHUP)
@@ -1072,6 +1623,7 @@ process_pollq(int thread_id)
         {
             spinlock_release(&dcb->dcb_initlock);
         }
+        now = poll_hist_time(pollStats.h_hangup, now);
     }
 
 #ifdef EPOLLRDHUP
@@ -1108,8 +1660,11 @@ process_pollq(int thread_id)
         {
             spinlock_release(&dcb->dcb_initlock);
         }
+        now = poll_hist_time(pollStats.h_hangup, now);
     }
 #endif
+    dcb_batch_end();
+
     qtime = hkheartbeat - dcb->evq.started;
 
     if (qtime > N_QUEUE_TIMES)
@@ -1125,7 +1680,124 @@ process_pollq(int thread_id)
         queueStats.maxexectime = qtime;
     }
 
-    spinlock_acquire(&pollqlock);
+    return true;
+}
+
+/**
+ * Process one DCB from the event queues of the thread
+ *
+ * In the worker mode the queue of the DCBs owned by the thread is processed
+ * first and the shared queue only when the thread has no events of its own.
+ *
+ * @param thread_id     The thread ID of the calling thread
+ * @return              0 if no DCB's have been processed
+ */
+static int
+process_pollq(int thread_id)
+{
+    if (runqs)
+    {
+        return process_runq(thread_id);
+    }
+    if (workers && process_eventq(thread_id, &workers[thread_id].queue))
+    {
+        return 1;
+    }
+    return process_eventq(thread_id, &shared_queue);
+}
+
+/**
+ * Process of the queue of DCB's that have outstanding events
+ *
+ * The first event on the queue will be chosen to be executed by this thread,
+ * all other events will be left on the queue and may be picked up by other
+ * threads. When the processing is complete the thread will take the DCB off the
+ * queue if there are no pending events that have arrived since the thread started
+ * to process the DCB. If there are pending events the DCB will be moved to the
+ * back of the queue so that other DCB's will have a share of the threads to
+ * execute events for them.
+ *
+ * Including session id to log entries depends on this function. Assumption is
+ * that when maxscale thread starts processing of an event it processes one
+ * and only one session until it returns from this function. Session id is
+ * read to thread's local storage if LOG_MAY_BE_ENABLED(LOGFILE_TRACE) returns true
+ * reset back to zero just before returning in LOG_IS_ENABLED(LOGFILE_TRACE) returns true.
+ * Thread local storage (tls_log_info_t) follows thread and is accessed every
+ * time log is written to particular log.
+ *
+ * @param thread_id     The thread ID of the calling thread
+ * @param queue         The event queue to process
+ * @return              0 if no DCB's have been processed
+ */
+static int
+process_eventq(int thread_id, POLL_EVENTQ *queue)
+{
+    DCB *dcb;
+    int found = 0;
+    uint32_t ev;
+
+    if (queue->head == NULL)
+    {
+        /* Nothing to process, checked without the lock to keep idle queues cheap */
+        return 0;
+    }
+
+    spinlock_acquire(&queue->lock);
+    if (queue->head == NULL)
+    {
+        /* Nothing to process */
+        spinlock_release(&queue->lock);
+        return 0;
+    }
+    dcb = queue->head;
+    if (dcb->evq.next == dcb->evq.prev && dcb->evq.processing == 0)
+    {
+        found = 1;
+        dcb->evq.processing = 1;
+    }
+    else if (dcb->evq.next == dcb->evq.prev)
+    {
+        /* Only item in queue is being processed */
+        spinlock_release(&queue->lock);
+        return 0;
+    }
+    else
+    {
+        do
+        {
+            dcb = dcb->evq.next;
+        }
+        while (dcb != queue->head && dcb->evq.processing == 1);
+
+        if (dcb->evq.processing == 0)
+        {
+            /* Found DCB to process */
+            dcb->evq.processing = 1;
+            found = 1;
+        }
+    }
+    if (found)
+    {
+        ev = dcb->evq.pending_events;
+        dcb->evq.processing_events = ev;
+        dcb->evq.pending_events = 0;
+        queue->pending--;
+        ss_dassert(queue->pending >= 0);
+    }
+    spinlock_release(&queue->lock);
+
+    if (found == 0)
+    {
+        return 0;
+    }
+
+    if (!poll_process_dcb(thread_id, dcb, ev))
+    {
+        return 0;
+    }
+
+
+    spinlock_acquire(&queue->lock);
     dcb->evq.processing_events = 0;
 
     if (dcb->evq.pending_events == 0)
@@ -1135,18 +1807,18 @@ process_pollq(int thread_id)
         {
             dcb->evq.prev->evq.next = dcb->evq.next;
             dcb->evq.next->evq.prev = dcb->evq.prev;
-            if (eventq == dcb)
+            if (queue->head == dcb)
             {
-                eventq = dcb->evq.next;
+                queue->head = dcb->evq.next;
             }
         }
         else
         {
-            eventq = NULL;
+            queue->head = NULL;
         }
         dcb->evq.next = NULL;
         dcb->evq.prev = NULL;
-        pollStats.evq_length--;
+        queue->length--;
     }
     else
     {
@@ -1159,17 +1831,17 @@ process_pollq(int thread_id)
          */
         if (dcb->evq.prev != dcb)
         {
-            if (eventq == dcb)
+            if (queue->head == dcb)
             {
-                eventq = dcb->evq.next;
+                queue->head = dcb->evq.next;
             }
             else
             {
                 dcb->evq.prev->evq.next = dcb->evq.next;
                 dcb->evq.next->evq.prev = dcb->evq.prev;
-                dcb->evq.prev = eventq->evq.prev;
-                dcb->evq.next = eventq;
-                eventq->evq.prev = dcb;
+                dcb->evq.prev = queue->head->evq.prev;
+                dcb->evq.next = queue->head;
+                queue->head->evq.prev = dcb;
                 dcb->evq.prev->evq.next = dcb;
             }
         }
@@ -1177,7 +1849,7 @@ process_pollq(int thread_id)
     dcb->evq.processing = 0;
     /** Reset session id from thread's local storage */
     mxs_log_tls.li_sesid = 0;
-    spinlock_release(&pollqlock);
+    spinlock_release(&queue->lock);
 
     return 1;
 }
@@ -1254,35 +1926,64 @@ dprintPollStats(DCB *dcb)
     int i;
 
     dcb_printf(dcb, "\nPoll Statistics.\n\n");
-    dcb_printf(dcb, "No. of epoll cycles:                           %d\n",
+    dcb_printf(dcb, "Polling mode:                                  %s\n",
+               poll_mode == POLL_MODE_WORKER ? "worker" :
+               poll_mode == POLL_MODE_STEALING ? "stealing" : "global");
+    dcb_printf(dcb, "Poll governor:                                 %s\n",
+               governor_mode_to_string(config_poll_governor()));
+    dcb_printf(dcb, "I/O backend:                                   %s\n",
+               rings ? "io_uring" : "epoll");
+    dcb_printf(dcb, "No. of epoll cycles:                           %" PRId64 "\n",
                ts_stats_sum(pollStats.n_polls));
-    dcb_printf(dcb, "No. of epoll cycles with wait:                         %d\n",
+    dcb_printf(dcb, "No. of epoll cycles with wait:                         %" PRId64 "\n",
                ts_stats_sum(pollStats.blockingpolls));
-    dcb_printf(dcb, "No. of epoll calls returning events:           %d\n",
+    dcb_printf(dcb, "No. of epoll calls returning events:           %" PRId64 "\n",
                ts_stats_sum(pollStats.n_pollev));
-    dcb_printf(dcb, "No. of non-blocking calls returning events:    %d\n",
+    dcb_printf(dcb, "No. of non-blocking calls returning events:    %" PRId64 "\n",
                ts_stats_sum(pollStats.n_nbpollev));
-    dcb_printf(dcb, "No. of read events:                            %d\n",
+    dcb_printf(dcb, "No. of read events:                            %" PRId64 "\n",
                ts_stats_sum(pollStats.n_read));
-    dcb_printf(dcb, "No. of write events:                           %d\n",
+    dcb_printf(dcb, "No. of write events:                           %" PRId64 "\n",
                ts_stats_sum(pollStats.n_write));
-    dcb_printf(dcb, "No. of error events:                           %d\n",
+    dcb_printf(dcb, "No. of error events:                           %" PRId64 "\n",
                ts_stats_sum(pollStats.n_error));
-    dcb_printf(dcb, "No. of hangup events:                          %d\n",
+    dcb_printf(dcb, "No. of hangup events:                          %" PRId64 "\n",
                ts_stats_sum(pollStats.n_hup));
-    dcb_printf(dcb, "No. of accept events:                          %d\n",
+    dcb_printf(dcb, "No. of accept events:                          %" PRId64 "\n",
                ts_stats_sum(pollStats.n_accept));
-    dcb_printf(dcb, "No. of times no threads polling:               %d\n",
+    dcb_printf(dcb, "No. of times no threads polling:               %" PRId64 "\n",
                ts_stats_sum(pollStats.n_nothreads));
+    dcb_printf(dcb, "No. of DCBs stolen from other threads:         %" PRId64 "\n",
+               ts_stats_sum(pollStats.n_steals));
+    dcb_printf(dcb, "No. of events posted to other threads:         %" PRId64 "\n",
+               ts_stats_sum(pollStats.n_posted));
+    dcb_printf(dcb, "No. of timers fired:                           %" PRId64 "\n",
+               ts_stats_sum(pollStats.n_timers));
     dcb_printf(dcb, "Current event queue length:                    %d\n",
-               pollStats.evq_length);
+               poll_get_stat(POLL_STAT_EVQ_LEN));
     dcb_printf(dcb, "Maximum event queue length:                    %d\n",
-               pollStats.evq_max);
+               poll_get_stat(POLL_STAT_EVQ_MAX));
     dcb_printf(dcb, "No. of DCBs with pending events:               %d\n",
-               pollStats.evq_pending);
+               poll_get_stat(POLL_STAT_EVQ_PENDING));
     dcb_printf(dcb, "No. of wakeups with pending queue:             %d\n",
                pollStats.wake_evqpending);
 
+    if (governors)
+    {
+        dcb_printf(dcb, "Polling thread time usage\n");
+        dcb_printf(dcb, " ID | Working (ms) | Spinning (ms) | Blocked (ms) | Spin wakeups | Block wakeups | Idle period (us)\n");
+        dcb_printf(dcb, "----+--------------+---------------+--------------+--------------+---------------+-----------------\n");
+        for (i = 0; i < n_threads; i++)
+        {
+            POLL_GOVERNOR *gov = &governors[i].gov;
+            dcb_printf(dcb, " %2d | %12lu | %13lu | %12lu | %12lu | %13lu | %16lu\n", i,
+                       gov->work_ns / 1000000, gov->spin_ns / 1000000, gov->block_ns / 1000000,
+                       gov->n_spin_wakeups, gov->n_block_wakeups, governor_gap(gov) / 1000);
+        }
+    }
+
+    poll_uring_stats(dcb);
+
     dcb_printf(dcb, "No of poll completions with descriptors\n");
     dcb_printf(dcb, "\tNo. of descriptors\tNo. of poll completions.\n");
     for (i = 0; i < MAXNFDS - 1; i++)
@@ -1294,7 +1995,7 @@ dprintPollStats(DCB *dcb)
 
 #if SPINLOCK_PROFILE
     dcb_printf(dcb, "Event queue lock statistics:\n");
-    spinlock_stats(&pollqlock, spin_reporter, dcb);
+    spinlock_stats(&shared_queue.lock, spin_reporter, dcb);
 #endif
 }
 
@@ -1419,6 +2120,8 @@ dShowThreads(DCB *dcb)
     dcb_printf(dcb, "15 Minute Average: %.2f, 5 Minute Average: %.2f, "
                "1 Minute Average: %.2f\n\n", qavg15, qavg5, qavg1);
 
+    affinity_show(dcb);
+
     if (thread_data == NULL)
     {
         return;
@@ -1512,7 +2215,7 @@ poll_loadav(void *data)
         current_avg = 0.0;
     }
     avg_samples[next_sample] = current_avg;
-    evqp_samples[next_sample] = pollStats.evq_pending;
+    evqp_samples[next_sample] = poll_get_stat(POLL_STAT_EVQ_PENDING);
     next_sample++;
     if (next_sample >= n_avg_samples)
     {
@@ -1549,43 +2252,7 @@ static void poll_add_event_to_dcb(DCB*       dcb,
     dcb->dcb_readqueue = gwbuf_append(dcb->dcb_readqueue, buf);
     spinlock_release(&dcb->authlock);
 
-    spinlock_acquire(&pollqlock);
-
-    /** Set event to DCB */
-    if (DCB_POLL_BUSY(dcb))
-    {
-        if (dcb->evq.pending_events == 0)
-        {
-            pollStats.evq_pending++;
-        }
-        dcb->evq.pending_events |= ev;
-    }
-    else
-    {
-        dcb->evq.pending_events = ev;
-        /** Add DCB to eventqueue if it isn't already there */
-        if (eventq)
-        {
-            dcb->evq.prev = eventq->evq.prev;
-            eventq->evq.prev->evq.next = dcb;
-            eventq->evq.prev = dcb;
-            dcb->evq.next = eventq;
-        }
-        else
-        {
-            eventq = dcb;
-            dcb->evq.prev = dcb;
-            dcb->evq.next = dcb;
-        }
-        pollStats.evq_length++;
-        pollStats.evq_pending++;
-
-        if (pollStats.evq_length > pollStats.evq_max)
-        {
-            pollStats.evq_max = pollStats.evq_length;
-        }
-    }
-    spinlock_release(&pollqlock);
+    poll_add_event(dcb, ev);
 }
 
 /*
@@ -1642,60 +2309,7 @@ poll_fake_read_event(DCB *dcb)
 void
 poll_fake_event(DCB *dcb, enum EPOLL_EVENTS ev)
 {
-
-    spinlock_acquire(&pollqlock);
-    /*
-     * If the DCB is already on the queue, there are no pending events and
-     * there are other events on the queue, then
-     * take it off the queue. This stops the DCB hogging the threads.
-     */
-    if (DCB_POLL_BUSY(dcb) && dcb->evq.pending_events == 0 && dcb->evq.prev != dcb)
-    {
-        dcb->evq.prev->evq.next = dcb->evq.next;
-        dcb->evq.next->evq.prev = dcb->evq.prev;
-        if (eventq == dcb)
-        {
-            eventq = dcb->evq.next;
-        }
-        dcb->evq.next = NULL;
-        dcb->evq.prev = NULL;
-        pollStats.evq_length--;
-    }
-
-    if (DCB_POLL_BUSY(dcb))
-    {
-        if (dcb->evq.pending_events == 0)
-        {
-            pollStats.evq_pending++;
-        }
-        dcb->evq.pending_events |= ev;
-    }
-    else
-    {
-        dcb->evq.pending_events = ev;
-        dcb->evq.inserted = hkheartbeat;
-        if (eventq)
-        {
-            dcb->evq.prev = eventq->evq.prev;
-            eventq->evq.prev->evq.next = dcb;
-            eventq->evq.prev = dcb;
-            dcb->evq.next = eventq;
-        }
-        else
-        {
-            eventq = dcb;
-            dcb->evq.prev = dcb;
-            dcb->evq.next = dcb;
-        }
-        pollStats.evq_length++;
-        pollStats.evq_pending++;
-        dcb->evq.inserted = hkheartbeat;
-        if (pollStats.evq_length > pollStats.evq_max)
-        {
-            pollStats.evq_max = pollStats.evq_length;
-        }
-    }
-    spinlock_release(&pollqlock);
+    poll_add_event(dcb, ev);
 }
 
 /*
@@ -1714,63 +2328,31 @@ poll_fake_hangup_event(DCB *dcb)
     uint32_t ev = EPOLLHUP;
 #endif
 
-    spinlock_acquire(&pollqlock);
-    if (DCB_POLL_BUSY(dcb))
-    {
-        if (dcb->evq.pending_events == 0)
-        {
-            pollStats.evq_pending++;
-        }
-        dcb->evq.pending_events |= ev;
-    }
-    else
-    {
-        dcb->evq.pending_events = ev;
-        dcb->evq.inserted = hkheartbeat;
-        if (eventq)
-        {
-            dcb->evq.prev = eventq->evq.prev;
-            eventq->evq.prev->evq.next = dcb;
-            eventq->evq.prev = dcb;
-            dcb->evq.next = eventq;
-        }
-        else
-        {
-            eventq = dcb;
-            dcb->evq.prev = dcb;
-            dcb->evq.next = dcb;
-        }
-        pollStats.evq_length++;
-        pollStats.evq_pending++;
-        dcb->evq.inserted = hkheartbeat;
-        if (pollStats.evq_length > pollStats.evq_max)
-        {
-            pollStats.evq_max = pollStats.evq_length;
-        }
-    }
-    spinlock_release(&pollqlock);
+    poll_add_event(dcb, ev);
 }
 
 /**
- * Print the event queue contents
+ * Print the contents of one event queue
  *
  * @param pdcb          The DCB to print the event queue to
+ * @param queue         The queue to print
+ * @param name          Name of the queue
  */
-void
-dShowEventQ(DCB *pdcb)
+static void
+dShowEventQueue(DCB *pdcb, POLL_EVENTQ *queue, const char *name)
 {
     DCB *dcb;
     char *tmp1, *tmp2;
 
-    spinlock_acquire(&pollqlock);
-    if (eventq == NULL)
+    spinlock_acquire(&queue->lock);
+    if (queue->head == NULL)
     {
         /* Nothing to process */
-        spinlock_release(&pollqlock);
+        spinlock_release(&queue->lock);
         return;
     }
-    dcb = eventq;
-    dcb_printf(pdcb, "\nEvent Queue.\n");
+    dcb = queue->head;
+    dcb_printf(pdcb, "\n%s.\n", name);
     dcb_printf(pdcb, "%-16s | %-10s | %-18s | %s\n", "DCB", "Status", "Processing Events",
                "Pending Events");
     dcb_printf(pdcb, "-----------------+------------+--------------------+-------------------\n");
@@ -1784,11 +2366,86 @@ dShowEventQ(DCB *pdcb)
         free(tmp2);
         dcb = dcb->evq.next;
     }
-    while (dcb != eventq);
-    spinlock_release(&pollqlock);
+    while (dcb != queue->head);
+    spinlock_release(&queue->lock);
+}
+
+/**
+ * Print the event queue contents
+ *
+ * @param pdcb          The DCB to print the event queue to
+ */
+void
+dShowEventQ(DCB *pdcb)
+{
+    dShowEventQueue(pdcb, &shared_queue, "Event Queue");
+
+    if (workers)
+    {
+        for (int i = 0; i < n_threads; i++)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "Event Queue of Thread %d", i);
+            dShowEventQueue(pdcb, &workers[i].queue, name);
+        }
+    }
+
+    if (runqs)
+    {
+        /** The run queues are lock-free, only their lengths can be shown */
+        dcb_printf(pdcb, "\nRun Queues.\n");
+        dcb_printf(pdcb, "%-10s | %s\n", "Thread", "Queued DCBs");
+        dcb_printf(pdcb, "-----------+------------\n");
+        for (int i = 0; i < n_threads; i++)
+        {
+            dcb_printf(pdcb, "%-10d | %ld\n", i, runqs[i].bottom - runqs[i].top);
+        }
+        dcb_printf(pdcb, "%-10s | %d\n", "Injected", inject_length);
+    }
+}
+
+
+/**
+ * The event latency histograms in the order they are displayed
+ */
+static struct
+{
+    char       *name;   /*< Name of the statistic */
+    ts_hist_t  *hist;   /*< The histogram */
+    bool       time;    /*< Whether the values are times in nanoseconds */
+} latency_stats[] =
+{
+    { "Queue wait",        &pollStats.h_qwait,  true },
+    { "Read handler",      &pollStats.h_read,   true },
+    { "Write handler",     &pollStats.h_write,  true },
+    { "Error handler",     &pollStats.h_error,  true },
+    { "Hangup handler",    &pollStats.h_hangup, true },
+    { "Accept handler",    &pollStats.h_accept, true },
+    { "Epoll batch size",  &pollStats.h_batch,  false },
+    { NULL, NULL, false }
+};
+
+/**
+ * Format a histogram value, times are converted to microseconds
+ *
+ * @param buf   Buffer where the value is written
+ * @param len   Length of the buffer
+ * @param value The value
+ * @param time  Whether the value is a time in nanoseconds
+ */
+static void
+latency_format(char *buf, size_t len, uint64_t value, bool time)
+{
+    if (time)
+    {
+        snprintf(buf, len, "%.1f", value / 1000.0);
+    }
+    else
+    {
+        snprintf(buf, len, "%lu", (unsigned long)value);
+    }
 }
 
-
 /**
  * Print the event queue statistics
  *
@@ -1802,8 +2459,8 @@ dShowEventStats(DCB *pdcb)
     dcb_printf(pdcb, "\nEvent statistics.\n");
     dcb_printf(pdcb, "Maximum queue time:           %3lu00ms\n", queueStats.maxqtime);
     dcb_printf(pdcb, "Maximum execution time:       %3lu00ms\n", queueStats.maxexectime);
-    dcb_printf(pdcb, "Maximum event queue length:   %3d\n", pollStats.evq_max);
-    dcb_printf(pdcb, "Current event queue length:   %3d\n", pollStats.evq_length);
+    dcb_printf(pdcb, "Maximum event queue length:   %3d\n", poll_get_stat(POLL_STAT_EVQ_MAX));
+    dcb_printf(pdcb, "Current event queue length:   %3d\n", poll_get_stat(POLL_STAT_EVQ_LEN));
     dcb_printf(pdcb, "\n");
     dcb_printf(pdcb, "               |    Number of events\n");
     dcb_printf(pdcb, "Duration       | Queued     | Executed\n");
@@ -1817,6 +2474,26 @@ dShowEventStats(DCB *pdcb)
     }
     dcb_printf(pdcb, " > %2d00ms      | %-10d | %-10d\n", N_QUEUE_TIMES,
                queueStats.qtimes[N_QUEUE_TIMES], queueStats.exectimes[N_QUEUE_TIMES]);
+
+    dcb_printf(pdcb, "\nEvent latency, times in microseconds.\n");
+    dcb_printf(pdcb, "%-17s | %-10s | %-10s | %-10s | %-10s | %s\n",
+               "Statistic", "Count", "p50", "p99", "p999", "Max");
+    dcb_printf(pdcb, "------------------+------------+------------+------------+"
+               "------------+-----------\n");
+    for (i = 0; latency_stats[i].name; i++)
+    {
+        ts_hist_summary_t sum;
+        char p50[32], p99[32], p999[32], max[32];
+        bool time = latency_stats[i].time;
+
+        ts_hist_summary(*latency_stats[i].hist, &sum);
+        latency_format(p50, sizeof(p50), sum.p50, time);
+        latency_format(p99, sizeof(p99), sum.p99, time);
+        latency_format(p999, sizeof(p999), sum.p999, time);
+        latency_format(max, sizeof(max), sum.max, time);
+        dcb_printf(pdcb, "%-17s | %-10lu | %-10s | %-10s | %-10s | %s\n",
+                   latency_stats[i].name, (unsigned long)sum.count, p50, p99, p999, max);
+    }
 }
 
 /**
@@ -1828,24 +2505,29 @@ dShowEventStats(DCB *pdcb)
 int
 poll_get_stat(POLL_STAT stat)
 {
+    int length, pending, max;
+
     switch (stat)
     {
     case POLL_STAT_READ:
-        return ts_stats_sum(pollStats.n_read);
+        return (int)ts_stats_sum(pollStats.n_read);
     case POLL_STAT_WRITE:
-        return ts_stats_sum(pollStats.n_write);
+        return (int)ts_stats_sum(pollStats.n_write);
     case POLL_STAT_ERROR:
-        return ts_stats_sum(pollStats.n_error);
+        return (int)ts_stats_sum(pollStats.n_error);
     case POLL_STAT_HANGUP:
-        return ts_stats_sum(pollStats.n_hup);
+        return (int)ts_stats_sum(pollStats.n_hup);
     case POLL_STAT_ACCEPT:
-        return ts_stats_sum(pollStats.n_accept);
+        return (int)ts_stats_sum(pollStats.n_accept);
     case POLL_STAT_EVQ_LEN:
-        return pollStats.evq_length;
+        poll_evq_totals(&length, &pending, &max);
+        return length;
     case POLL_STAT_EVQ_PENDING:
-        return pollStats.evq_pending;
+        poll_evq_totals(&length, &pending, &max);
+        return pending;
     case POLL_STAT_EVQ_MAX:
-        return pollStats.evq_max;
+        poll_evq_totals(&length, &pending, &max);
+        return max;
     case POLL_STAT_MAX_QTIME:
         return (int)queueStats.maxqtime;
     case POLL_STAT_MAX_EXECTIME:
@@ -1927,3 +2609,1285 @@ eventTimesGetList()
 
     return set;
 }
+
+/**
+ * Provide a row to the result set that defines the event latency statistics
+ *
+ * @param set   The result set
+ * @param data  The index of the row to send
+ * @return The next row or NULL
+ */
+static RESULT_ROW *
+eventLatencyRowCallback(RESULTSET *set, void *data)
+{
+    int *rowno = (int *)data;
+    char buf[40];
+    RESULT_ROW *row;
+    ts_hist_summary_t sum;
+    bool time;
+
+    if (latency_stats[*rowno].name == NULL)
+    {
+        free(data);
+        return NULL;
+    }
+    time = latency_stats[*rowno].time;
+    ts_hist_summary(*latency_stats[*rowno].hist, &sum);
+
+    row = resultset_make_row(set);
+    resultset_row_set(row, 0, latency_stats[*rowno].name);
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)sum.count);
+    resultset_row_set(row, 1, buf);
+    latency_format(buf, sizeof(buf), sum.p50, time);
+    resultset_row_set(row, 2, buf);
+    latency_format(buf, sizeof(buf), sum.p99, time);
+    resultset_row_set(row, 3, buf);
+    latency_format(buf, sizeof(buf), sum.p999, time);
+    resultset_row_set(row, 4, buf);
+    latency_format(buf, sizeof(buf), sum.max, time);
+    resultset_row_set(row, 5, buf);
+    (*rowno)++;
+    return row;
+}
+
+/**
+ * Return a result set with the percentiles of the event latency histograms.
+ * Times are in microseconds.
+ *
+ * @return A Result set
+ */
+RESULTSET *
+eventLatencyGetList()
+{
+    RESULTSET *set;
+    int *data;
+
+    if ((data = (int *)malloc(sizeof(int))) == NULL)
+    {
+        return NULL;
+    }
+    *data = 0;
+    if ((set = resultset_create(eventLatencyRowCallback, data)) == NULL)
+    {
+        free(data);
+        return NULL;
+    }
+    resultset_add_column(set, "Statistic", 20, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "Count", 12, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "p50", 12, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "p99", 12, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "p999", 12, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "Max", 12, COL_TYPE_VARCHAR);
+
+    return set;
+}
+
+/**
+ * Calculate the event queue statistics over all event queues
+ *
+ * @param length    Total length of the queues
+ * @param pending   Total number of DCBs with pending events
+ * @param max       Sum of the maximum lengths of the queues
+ */
+static void
+poll_evq_totals(int *length, int *pending, int *max)
+{
+    *length = shared_queue.length;
+    *pending = shared_queue.pending;
+    *max = shared_queue.max;
+
+    if (workers)
+    {
+        for (int i = 0; i < n_threads; i++)
+        {
+            *length += workers[i].queue.length;
+            *pending += workers[i].queue.pending;
+            *max += workers[i].queue.max;
+        }
+    }
+
+    if (runqs)
+    {
+        /** Every DCB in a run queue has pending events */
+        int queued = poll_runq_pending(-1);
+        *length += queued;
+        *pending += queued;
+    }
+}
+
+/**
+ * Add a DCB to the bottom of a run queue. Only called by the owner of the queue.
+ *
+ * @param runq  The run queue of the calling thread
+ * @param dcb   The DCB to add
+ * @return      False if the queue is full
+ */
+static bool
+poll_runq_push(POLL_RUNQ *runq, DCB *dcb)
+{
+    long bottom = runq->bottom;
+
+    if (bottom - runq->top >= POLL_RUNQ_SIZE)
+    {
+        return false;
+    }
+
+    runq->items[bottom & (POLL_RUNQ_SIZE - 1)] = dcb;
+    /** The DCB must be visible before the new bottom is */
+    __sync_synchronize();
+    runq->bottom = bottom + 1;
+    return true;
+}
+
+/**
+ * Take a DCB from the top of a run queue. Can be called by any thread.
+ *
+ * @param runq  The run queue
+ * @return      The DCB or NULL if the queue is empty
+ */
+static DCB *
+poll_runq_take(POLL_RUNQ *runq)
+{
+    while (true)
+    {
+        long top = runq->top;
+        __sync_synchronize();
+
+        if (top >= runq->bottom)
+        {
+            return NULL;
+        }
+
+        DCB *dcb = runq->items[top & (POLL_RUNQ_SIZE - 1)];
+
+        /** The slot can't be reused before the top is advanced past it */
+        if (__sync_bool_compare_and_swap(&runq->top, top, top + 1))
+        {
+            return dcb;
+        }
+    }
+}
+
+/**
+ * Count the DCBs waiting in the run queues
+ *
+ * @param thread_id The calling thread whose queue is checked first or -1
+ * @return          Number of queued DCBs, for a polling thread the count
+ *                  is only guaranteed to be non-zero when work is available
+ */
+static int
+poll_runq_pending(int thread_id)
+{
+    int count = inject_length;
+
+    if (thread_id >= 0)
+    {
+        count += runqs[thread_id].bottom - runqs[thread_id].top;
+        if (count > 0)
+        {
+            return count;
+        }
+    }
+
+    for (int i = 0; i < n_threads; i++)
+    {
+        if (i != thread_id)
+        {
+            count += runqs[i].bottom - runqs[i].top;
+        }
+    }
+    return count;
+}
+
+/**
+ * Add a scheduled DCB to a run queue. The DCB goes to the queue of the
+ * calling thread and to the shared injection list if the caller is not a
+ * polling thread or its queue is full.
+ *
+ * @param dcb   A DCB in the DCB_SCHED_QUEUED state
+ */
+static void
+poll_runq_add(DCB *dcb)
+{
+    dcb->evq.inserted = hkheartbeat;
+    dcb->evq.inserted_ns = ts_clock_ns();
+
+    if (poll_thread < 0 || !poll_runq_push(&runqs[poll_thread], dcb))
+    {
+        spinlock_acquire(&inject_lock);
+        dcb->evq.next = NULL;
+        if (inject_tail)
+        {
+            inject_tail->evq.next = dcb;
+        }
+        else
+        {
+            inject_head = dcb;
+        }
+        inject_tail = dcb;
+        inject_length++;
+        spinlock_release(&inject_lock);
+    }
+}
+
+/**
+ * Take a DCB from the injection list
+ *
+ * @return The first DCB or NULL if the list is empty
+ */
+static DCB *
+poll_inject_take()
+{
+    DCB *dcb = NULL;
+
+    if (inject_head)
+    {
+        spinlock_acquire(&inject_lock);
+        if ((dcb = inject_head))
+        {
+            inject_head = dcb->evq.next;
+            if (inject_head == NULL)
+            {
+                inject_tail = NULL;
+            }
+            dcb->evq.next = NULL;
+            inject_length--;
+        }
+        spinlock_release(&inject_lock);
+    }
+    return dcb;
+}
+
+/**
+ * Add events to a DCB in the work-stealing mode
+ *
+ * The events are merged into the pending events of the DCB. An idle DCB
+ * is added to a run queue and a DCB that is being processed is marked to
+ * be queued again once the processing is done. DCBs already in a queue
+ * need nothing more so a DCB is never in two queues at the same time.
+ *
+ * @param dcb   The DCB
+ * @param ev    The events
+ */
+static void
+poll_sched_event(DCB *dcb, uint32_t ev)
+{
+    __sync_fetch_and_or(&dcb->evq.pending_events, ev);
+
+    while (true)
+    {
+        int state = dcb->evq.sched;
+
+        if (state == DCB_SCHED_IDLE)
+        {
+            if (__sync_bool_compare_and_swap(&dcb->evq.sched, DCB_SCHED_IDLE, DCB_SCHED_QUEUED))
+            {
+                poll_runq_add(dcb);
+                return;
+            }
+        }
+        else if (state == DCB_SCHED_RUNNING)
+        {
+            if (__sync_bool_compare_and_swap(&dcb->evq.sched, DCB_SCHED_RUNNING, DCB_SCHED_RERUN))
+            {
+                return;
+            }
+        }
+        else
+        {
+            /** Already queued or already marked to be queued again */
+            return;
+        }
+    }
+}
+
+/**
+ * Steal a DCB from the run queue of another thread
+ *
+ * @param thread_id The thread ID of the calling thread
+ * @return          The stolen DCB or NULL if all other queues are empty
+ */
+static DCB *
+poll_steal(int thread_id)
+{
+    for (int i = 1; i < n_threads; i++)
+    {
+        DCB *dcb = poll_runq_take(&runqs[(thread_id + i) % n_threads]);
+
+        if (dcb)
+        {
+            ts_stats_add(pollStats.n_steals, 1);
+            return dcb;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Process one DCB in the work-stealing mode
+ *
+ * The DCB is taken from the thread's own run queue, from the injection list
+ * or stolen from another thread, in that order. Only the thread that takes
+ * the DCB from a queue processes it and if new events arrived while it was
+ * being processed, it is added to the back of the thread's run queue so that
+ * the other DCBs get their share of the processing time.
+ *
+ * @param thread_id     The thread ID of the calling thread
+ * @return              0 if no DCB's have been processed
+ */
+static int
+process_runq(int thread_id)
+{
+    DCB *dcb = poll_runq_take(&runqs[thread_id]);
+
+    if (dcb == NULL && (dcb = poll_inject_take()) == NULL &&
+        (dcb = poll_steal(thread_id)) == NULL)
+    {
+        return 0;
+    }
+
+    /** Setting the state before taking the events guarantees that events
+     * added after this are either taken now or cause the DCB to be queued again */
+    __sync_bool_compare_and_swap(&dcb->evq.sched, DCB_SCHED_QUEUED, DCB_SCHED_RUNNING);
+    ss_dassert(dcb->evq.sched == DCB_SCHED_RUNNING || dcb->evq.sched == DCB_SCHED_RERUN);
+
+    uint32_t ev = __sync_fetch_and_and(&dcb->evq.pending_events, 0);
+    dcb->evq.processing = 1;
+    dcb->evq.processing_events = ev;
+
+    poll_process_dcb(thread_id, dcb, ev);
+
+    dcb->evq.processing_events = 0;
+    dcb->evq.processing = 0;
+    /** Reset session id from thread's local storage */
+    mxs_log_tls.li_sesid = 0;
+
+    if (!__sync_bool_compare_and_swap(&dcb->evq.sched, DCB_SCHED_RUNNING, DCB_SCHED_IDLE))
+    {
+        /** New events arrived during the processing */
+        ss_dassert(dcb->evq.sched == DCB_SCHED_RERUN);
+        __sync_bool_compare_and_swap(&dcb->evq.sched, DCB_SCHED_RERUN, DCB_SCHED_QUEUED);
+        poll_runq_add(dcb);
+    }
+
+    return 1;
+}
+
+/**
+ * Return the current tick of the timer wheels
+ *
+ * @return The time in POLL_TIMER_TICK_MS units
+ */
+static uint64_t
+poll_timer_now()
+{
+    return ts_clock_ns() / (POLL_TIMER_TICK_MS * 1000000);
+}
+
+/**
+ * Arm a timer in the wheel of the calling polling thread
+ *
+ * The function is called by the polling thread that armed the timer once
+ * the timer expires. Timers armed by non-polling threads are fired by the
+ * first polling thread. If the timer is already armed, it is re-armed.
+ *
+ * @param timer The timer to arm
+ * @param fn    The function to call when the timer expires
+ * @param data  The data passed to the function
+ * @param ms    The delay in milliseconds
+ */
+void
+poll_timer_add(TIMER *timer, void (*fn)(void *), void *data, long ms)
+{
+    if (timers == NULL)
+    {
+        return;
+    }
+
+    POLL_TIMERS *pt = &timers[poll_thread >= 0 ? poll_thread : 0];
+
+    poll_timer_cancel(timer);
+
+    spinlock_acquire(&pt->lock);
+    timer->fn = fn;
+    timer->data = data;
+    /** Round up and add a tick so that the timer never fires early and a
+     * timer re-armed from its own function is not fired again immediately */
+    timerwheel_add(&pt->wheel, timer,
+                   poll_timer_now() + (ms > 0 ? ms / POLL_TIMER_TICK_MS : 0) + 1);
+    spinlock_release(&pt->lock);
+}
+
+/**
+ * Cancel a timer armed with poll_timer_add
+ *
+ * The timer can be cancelled by any thread. A timer whose function is
+ * already being called can not be cancelled.
+ *
+ * @param timer The timer to cancel
+ * @return True if the timer was armed and is now cancelled
+ */
+bool
+poll_timer_cancel(TIMER *timer)
+{
+    TIMERWHEEL *wheel;
+
+    while ((wheel = timer->wheel) != NULL)
+    {
+        POLL_TIMERS *pt = (POLL_TIMERS *)((char *)wheel - offsetof(POLL_TIMERS, wheel));
+
+        spinlock_acquire(&pt->lock);
+        if (timer->wheel == wheel)
+        {
+            timerwheel_cancel(timer);
+            spinlock_release(&pt->lock);
+            return true;
+        }
+        /** The timer was fired or moved to another wheel, check again */
+        spinlock_release(&pt->lock);
+    }
+
+    return false;
+}
+
+/**
+ * Fire the expired timers of a polling thread
+ *
+ * The timer functions are called without holding the lock of the wheel so
+ * that they can arm and cancel timers.
+ *
+ * @param thread_id The ID of the polling thread
+ */
+static void
+poll_fire_timers(int thread_id)
+{
+    POLL_TIMERS *pt = &timers[thread_id];
+    TIMER *timer;
+
+    spinlock_acquire(&pt->lock);
+    timerwheel_advance(&pt->wheel, poll_timer_now());
+
+    while ((timer = timerwheel_pop_expired(&pt->wheel)) != NULL)
+    {
+        void (*fn)(void *) = timer->fn;
+        void *data = timer->data;
+
+        spinlock_release(&pt->lock);
+        fn(data);
+        ts_stats_add(pollStats.n_timers, 1);
+        spinlock_acquire(&pt->lock);
+    }
+
+    spinlock_release(&pt->lock);
+}
+
+/**
+ * Add an event to the end of the event queue of a DCB
+ *
+ * If the DCB is already in the queue with no pending events and there are
+ * other DCBs in the queue, it is moved to the end of the queue. This stops
+ * a DCB that keeps adding events to itself from hogging the thread.
+ *
+ * The caller must hold the lock of the queue.
+ *
+ * @param queue The event queue of the DCB
+ * @param dcb   The DCB
+ * @param ev    The event bits
+ */
+static void
+poll_eventq_requeue(POLL_EVENTQ *queue, DCB *dcb, uint32_t ev)
+{
+    if (dcb->evq.next && dcb->evq.pending_events == 0 && dcb->evq.prev != dcb)
+    {
+        dcb->evq.prev->evq.next = dcb->evq.next;
+        dcb->evq.next->evq.prev = dcb->evq.prev;
+        if (queue->head == dcb)
+        {
+            queue->head = dcb->evq.next;
+        }
+        dcb->evq.next = NULL;
+        dcb->evq.prev = NULL;
+        queue->length--;
+    }
+
+    poll_eventq_add(queue, dcb, ev);
+}
+
+/**
+ * Wake up a polling thread after something was posted to its mailbox
+ *
+ * The thread is only woken up once for all the posts made before it
+ * starts to handle its mailbox.
+ *
+ * @param thread_id The thread to wake up
+ */
+static void
+poll_mailbox_notify(int thread_id)
+{
+    POLL_MAILBOX *mb = &mailboxes[thread_id];
+
+    if (thread_id != poll_thread && mb->wakeup_fd >= 0 &&
+        __sync_lock_test_and_set(&mb->notified, 1) == 0)
+    {
+        uint64_t one = 1;
+        if (write(mb->wakeup_fd, &one, sizeof(one)) != sizeof(one))
+        {
+            char errbuf[STRERROR_BUFLEN];
+            MXS_ERROR("Failed to wake up polling thread %d: %d, %s", thread_id,
+                      errno, strerror_r(errno, errbuf, sizeof(errbuf)));
+        }
+    }
+}
+
+/**
+ * Mailbox handler that moves the posted events of a DCB to the event queue
+ * of the thread
+ *
+ * @param node The mailbox node of the DCB
+ */
+static void
+poll_mailbox_dcb(MAILBOX_NODE *node)
+{
+    DCB *dcb = (DCB *)((char *)node - offsetof(DCB, evq.mbox));
+    POLL_EVENTQ *queue = poll_dcb_queue(dcb);
+    uint32_t ev = dcb->evq.posted_events;
+
+    spinlock_acquire(&queue->lock);
+    /** The posted events are cleared only after the DCB is in the queue so
+     * that it always looks busy to the zombie processing. Events posted
+     * meanwhile did not post the DCB again and are added here. */
+    while (ev)
+    {
+        poll_eventq_requeue(queue, dcb, ev);
+        ev = __sync_and_and_fetch(&dcb->evq.posted_events, ~ev);
+    }
+    spinlock_release(&queue->lock);
+}
+
+/**
+ * Mailbox handler that calls a posted function
+ *
+ * @param node The closure
+ */
+static void
+poll_mailbox_closure(MAILBOX_NODE *node)
+{
+    POLL_CLOSURE *closure = (POLL_CLOSURE *)node;
+
+    closure->fn(closure->data);
+    free(closure);
+}
+
+/**
+ * Handle the DCBs and closures posted to the mailbox of a thread
+ *
+ * Only the posts that were in the mailbox when the call was made are
+ * handled so that a closure that posts itself again can't starve the
+ * event processing.
+ *
+ * @param thread_id The thread ID of the calling thread
+ */
+static void
+poll_drain_mailbox(int thread_id)
+{
+    POLL_MAILBOX *mb = &mailboxes[thread_id];
+    int n = mailbox_length(&mb->box);
+    MAILBOX_NODE *node;
+
+    /** Posts made after this wake the thread up again */
+    __sync_fetch_and_and(&mb->notified, 0);
+
+    while (n-- > 0 && (node = mailbox_pop(&mb->box)) != NULL)
+    {
+        node->handler(node);
+    }
+}
+
+/**
+ * Add an event to a DCB from outside the polling of the DCB
+ *
+ * DCBs owned by another polling thread are posted to the mailbox of the
+ * owner so that the thread adding the event never takes the lock of the
+ * owner's queue.
+ *
+ * @param dcb   The DCB
+ * @param ev    The event bits
+ */
+static void
+poll_add_event(DCB *dcb, uint32_t ev)
+{
+    if (runqs)
+    {
+        poll_sched_event(dcb, ev);
+    }
+    else if (dcb->owner >= 0 && dcb->owner != poll_thread)
+    {
+        ts_stats_add(pollStats.n_posted, 1);
+        /** Only the first post pushes the DCB, the others add their events */
+        if (__sync_fetch_and_or(&dcb->evq.posted_events, ev) == 0)
+        {
+            dcb->evq.mbox.handler = poll_mailbox_dcb;
+            mailbox_push(&mailboxes[dcb->owner].box, &dcb->evq.mbox);
+            poll_mailbox_notify(dcb->owner);
+        }
+    }
+    else
+    {
+        POLL_EVENTQ *queue = poll_dcb_queue(dcb);
+
+        spinlock_acquire(&queue->lock);
+        poll_eventq_requeue(queue, dcb, ev);
+        spinlock_release(&queue->lock);
+    }
+}
+
+/**
+ * Post a function to be called by a polling thread
+ *
+ * The function is called by the thread when it next handles its mailbox.
+ * In the worker mode the thread is woken up if it is waiting for events,
+ * in the other modes the thread handles its mailbox when it returns from
+ * epoll_wait.
+ *
+ * @param thread_id The polling thread
+ * @param fn        The function to call
+ * @param data      Data passed to the function
+ * @return          True if the function was posted
+ */
+bool
+poll_post(int thread_id, void (*fn)(void *), void *data)
+{
+    POLL_CLOSURE *closure;
+
+    if (mailboxes == NULL || thread_id < 0 || thread_id >= n_threads ||
+        (closure = (POLL_CLOSURE *)malloc(sizeof(POLL_CLOSURE))) == NULL)
+    {
+        return false;
+    }
+
+    closure->node.handler = poll_mailbox_closure;
+    closure->fn = fn;
+    closure->data = data;
+    mailbox_push(&mailboxes[thread_id].box, &closure->node);
+    poll_mailbox_notify(thread_id);
+    return true;
+}
+
+#ifdef HAVE_IO_URING
+
+/** The request of a completion is tagged in the low bits of the DCB pointer */
+#define POLL_URING_RECV     0
+#define POLL_URING_SEND     1
+#define POLL_URING_CANCEL   2
+#define POLL_URING_TAG_MASK 3
+
+/**
+ * Check whether the network I/O of a DCB can be done with io_uring
+ *
+ * Only the client and backend connections owned by a worker thread use
+ * io_uring. SSL connections are read and written by OpenSSL and stay on
+ * epoll.
+ *
+ * @param dcb   The DCB being added to the poll set
+ * @return      True if the DCB can use io_uring
+ */
+static bool
+poll_uring_eligible(DCB *dcb)
+{
+    return rings && dcb->owner >= 0 && dcb->fd > 0 &&
+           (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER || dcb->dcb_role == DCB_ROLE_BACKEND_HANDLER) &&
+           (dcb->listener == NULL || dcb->listener->ssl == NULL) &&
+           (dcb->server == NULL || dcb->server->server_ssl == NULL);
+}
+
+/**
+ * Create the rings of the polling threads if the io_uring backend is
+ * configured and usable. Otherwise epoll is used for all DCBs.
+ */
+static void
+poll_uring_init()
+{
+    struct epoll_event ev;
+    int i;
+
+    if (config_io_backend() != IO_BACKEND_URING)
+    {
+        return;
+    }
+    if (poll_mode != POLL_MODE_WORKER)
+    {
+        MXS_WARNING("The io_uring I/O backend requires 'poll_mode=worker', using epoll.");
+        return;
+    }
+    if (!uring_supported())
+    {
+        MXS_WARNING("The kernel does not support multishot receives with io_uring, using epoll.");
+        return;
+    }
+
+    if ((rings = (POLL_URING *)calloc(n_threads, sizeof(POLL_URING))) == NULL)
+    {
+        perror("Fatal error: Memory allocation failed.");
+        exit(-1);
+    }
+    for (i = 0; i < n_threads; i++)
+    {
+        if ((rings[i].ring = uring_create()) == NULL)
+        {
+            break;
+        }
+
+        /** The ring descriptor is readable when there are completions */
+        ev.events = EPOLLIN;
+        ev.data.ptr = &rings[i];
+        if (epoll_ctl(workers[i].epoll_fd, EPOLL_CTL_ADD, rings[i].ring->fd, &ev) == -1)
+        {
+            perror("epoll_ctl");
+            exit(-1);
+        }
+    }
+
+    if (i < n_threads)
+    {
+        while (i-- > 0)
+        {
+            uring_destroy(rings[i].ring);
+        }
+        free(rings);
+        rings = NULL;
+        MXS_WARNING("Failed to create the io_uring instances, using epoll.");
+        return;
+    }
+
+    MXS_NOTICE("Using io_uring for the network I/O of the client and backend connections.");
+}
+
+/**
+ * Prepare a DCB for io_uring before it is added to the epoll set
+ *
+ * @param dcb   The DCB
+ * @return      True if the reads and writes of the DCB are done with io_uring
+ */
+static bool
+poll_uring_attach(DCB *dcb)
+{
+    if (!poll_uring_eligible(dcb))
+    {
+        return false;
+    }
+    if (dcb->uring == NULL && (dcb->uring = (DCB_URING *)calloc(1, sizeof(DCB_URING))) == NULL)
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Take a reference to a DCB and post a function to its owner. The function
+ * must release the reference.
+ *
+ * @param dcb   The DCB
+ * @param fn    The function to call with the DCB
+ */
+static void
+poll_uring_post(DCB *dcb, void (*fn)(void *))
+{
+    atomic_add(&dcb->uring->refs, 1);
+    if (!poll_post(dcb->owner, fn, dcb))
+    {
+        atomic_add(&dcb->uring->refs, -1);
+        MXS_ERROR("Failed to post an io_uring request of DCB %p to thread %d.",
+                  dcb, dcb->owner);
+    }
+}
+
+/**
+ * Get a submission queue entry of the owner of a DCB
+ *
+ * @param dcb   The DCB
+ * @return      The entry or NULL if the queue is full, the DCB is then hung up
+ */
+static struct io_uring_sqe *
+poll_uring_sqe(DCB *dcb)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(rings[dcb->owner].ring);
+
+    if (sqe == NULL)
+    {
+        MXS_ERROR("The io_uring submission queue of thread %d is full, "
+                  "hanging up DCB %p.", dcb->owner, dcb);
+        poll_fake_hangup_event(dcb);
+    }
+    return sqe;
+}
+
+/**
+ * Arm the multishot receive of a DCB. Called by the owner of the DCB.
+ *
+ * @param dcb   The DCB
+ */
+static void
+poll_uring_recv(DCB *dcb)
+{
+    DCB_URING *du = dcb->uring;
+    struct io_uring_sqe *sqe;
+
+    if (dcb->state != DCB_STATE_POLLING || (du->flags & DCB_URING_RECV) ||
+        (sqe = poll_uring_sqe(dcb)) == NULL)
+    {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = dcb->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = (uintptr_t)dcb | POLL_URING_RECV;
+    du->flags |= DCB_URING_RECV;
+    atomic_add(&du->refs, 1);
+}
+
+/**
+ * Send the buffers at the head of the write queue of a DCB. Called by the
+ * owner of the DCB. The buffers stay in the queue until the send completes.
+ *
+ * @param dcb   The DCB
+ */
+static void
+poll_uring_sendmsg(DCB *dcb)
+{
+    DCB_URING *du = dcb->uring;
+    struct io_uring_sqe *sqe;
+    GWBUF *buf;
+    int n = 0;
+
+    if (dcb->state != DCB_STATE_POLLING || (du->flags & DCB_URING_SEND))
+    {
+        return;
+    }
+
+    spinlock_acquire(&dcb->writeqlock);
+    for (buf = dcb->writeq; buf && n < DCB_URING_IOV; buf = buf->next)
+    {
+        if (GWBUF_LENGTH(buf) > 0)
+        {
+            du->iov[n].iov_base = GWBUF_DATA(buf);
+            du->iov[n].iov_len = GWBUF_LENGTH(buf);
+            n++;
+        }
+    }
+    spinlock_release(&dcb->writeqlock);
+
+    if (n == 0 || (sqe = poll_uring_sqe(dcb)) == NULL)
+    {
+        return;
+    }
+
+    memset(&du->msg, 0, sizeof(du->msg));
+    du->msg.msg_iov = du->iov;
+    du->msg.msg_iovlen = n;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = dcb->fd;
+    sqe->addr = (uintptr_t)&du->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uintptr_t)dcb | POLL_URING_SEND;
+    du->flags |= DCB_URING_SEND;
+    atomic_add(&du->refs, 1);
+}
+
+/**
+ * Cancel the requests of a DCB that has been removed from the poll set.
+ * Called by the owner of the DCB.
+ *
+ * @param dcb   The DCB
+ */
+static void
+poll_uring_cancel(DCB *dcb)
+{
+    DCB_URING *du = dcb->uring;
+    struct io_uring_sqe *sqe;
+
+    if ((du->flags & (DCB_URING_RECV | DCB_URING_SEND)) == 0 ||
+        (sqe = uring_get_sqe(rings[dcb->owner].ring)) == NULL)
+    {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = dcb->fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = (uintptr_t)dcb | POLL_URING_CANCEL;
+    atomic_add(&du->refs, 1);
+}
+
+/**
+ * Cancel the multishot receive of a DCB whose reads are paused. Called by
+ * the owner of the DCB.
+ *
+ * @param dcb   The DCB
+ */
+static void
+poll_uring_cancel_recv(DCB *dcb)
+{
+    DCB_URING *du = dcb->uring;
+    struct io_uring_sqe *sqe;
+
+    if ((du->flags & DCB_URING_RECV) == 0 ||
+        (sqe = uring_get_sqe(rings[dcb->owner].ring)) == NULL)
+    {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uintptr_t)dcb | POLL_URING_RECV;
+    sqe->user_data = (uintptr_t)dcb | POLL_URING_CANCEL;
+    atomic_add(&du->refs, 1);
+}
+
+static void
+poll_uring_posted_cancel_recv(void *data)
+{
+    DCB *dcb = (DCB *)data;
+
+    poll_uring_cancel_recv(dcb);
+    atomic_add(&dcb->uring->refs, -1);
+}
+
+static void
+poll_uring_posted_recv(void *data)
+{
+    DCB *dcb = (DCB *)data;
+
+    poll_uring_recv(dcb);
+    atomic_add(&dcb->uring->refs, -1);
+}
+
+static void
+poll_uring_posted_send(void *data)
+{
+    DCB *dcb = (DCB *)data;
+
+    poll_uring_sendmsg(dcb);
+    atomic_add(&dcb->uring->refs, -1);
+}
+
+static void
+poll_uring_posted_cancel(void *data)
+{
+    DCB *dcb = (DCB *)data;
+
+    poll_uring_cancel(dcb);
+    atomic_add(&dcb->uring->refs, -1);
+}
+
+/**
+ * Start the receives of a DCB that was added to the poll set
+ *
+ * @param dcb   The DCB
+ */
+static void
+poll_uring_start(DCB *dcb)
+{
+    if (dcb->owner == poll_thread)
+    {
+        poll_uring_recv(dcb);
+    }
+    else
+    {
+        poll_uring_post(dcb, poll_uring_posted_recv);
+    }
+}
+
+/**
+ * Stop the I/O of a DCB that was removed from the poll set. The DCB is not
+ * freed before the kernel has completed the cancelled requests.
+ *
+ * @param dcb   The DCB
+ */
+static void
+poll_uring_stop(DCB *dcb)
+{
+    if (dcb->owner == poll_thread)
+    {
+        poll_uring_cancel(dcb);
+    }
+    else
+    {
+        poll_uring_post(dcb, poll_uring_posted_cancel);
+    }
+}
+
+/**
+ * Stop the receives of a DCB whose reads are paused
+ *
+ * @param dcb   The DCB
+ */
+static void
+poll_uring_pause(DCB *dcb)
+{
+    if (dcb->owner == poll_thread)
+    {
+        poll_uring_cancel_recv(dcb);
+    }
+    else
+    {
+        poll_uring_post(dcb, poll_uring_posted_cancel_recv);
+    }
+}
+
+/**
+ * Send the write queue of a DCB that uses io_uring
+ *
+ * The send is submitted with the other requests of the owning thread at the
+ * end of its polling cycle. Only one send is in flight at a time, the rest
+ * of the queue is sent when it completes.
+ *
+ * @param dcb   The DCB
+ * @return      Always 0, the data is accounted for when the send completes
+ */
+int
+poll_uring_send(DCB *dcb)
+{
+    if (dcb->owner == poll_thread)
+    {
+        poll_uring_sendmsg(dcb);
+    }
+    else
+    {
+        poll_uring_post(dcb, poll_uring_posted_send);
+    }
+    return 0;
+}
+
+/**
+ * Handle the completion of a receive
+ *
+ * The data is copied from the provided buffer into the read queue of the DCB
+ * and a read event is queued for the DCB so that the protocol module reads it
+ * with dcb_read as usual.
+ *
+ * @param pu    The ring of the thread
+ * @param dcb   The DCB
+ * @param cqe   The completion
+ */
+static void
+poll_uring_received(POLL_URING *pu, DCB *dcb, struct io_uring_cqe *cqe)
+{
+    bool polling = dcb->state == DCB_STATE_POLLING;
+
+    if (cqe->res > 0)
+    {
+        GWBUF *buf = polling ? gwbuf_alloc(cqe->res) : NULL;
+
+        if (buf)
+        {
+            memcpy(GWBUF_DATA(buf), uring_buffer(pu->ring, cqe), cqe->res);
+        }
+        uring_recycle_buffer(pu->ring, cqe);
+
+        if (buf)
+        {
+            dcb->stats.n_reads++;
+            dcb->last_read = hkheartbeat;
+            dcb_append_readqueue(dcb, buf);
+            poll_fake_event(dcb, EPOLLIN);
+        }
+        else if (polling)
+        {
+            MXS_ERROR("Failed to allocate a buffer for %d bytes received by DCB %p, "
+                      "hanging up the DCB.", cqe->res, dcb);
+            poll_fake_hangup_event(dcb);
+        }
+    }
+    else if (cqe->res == -ENOBUFS)
+    {
+        pu->n_nobufs++;
+    }
+    else if (polling && cqe->res == 0)
+    {
+        poll_fake_hangup_event(dcb);
+    }
+    else if (polling && cqe->res != -ECANCELED)
+    {
+        poll_fake_event(dcb, EPOLLERR);
+    }
+}
+
+/**
+ * Handle a completion of the ring of a thread
+ *
+ * @param pu    The ring of the thread
+ * @param cqe   The completion
+ */
+static void
+poll_uring_complete(POLL_URING *pu, struct io_uring_cqe *cqe)
+{
+    DCB *dcb = (DCB *)(uintptr_t)(cqe->user_data & ~(uint64_t)POLL_URING_TAG_MASK);
+    DCB_URING *du = dcb->uring;
+
+    switch (cqe->user_data & POLL_URING_TAG_MASK)
+    {
+    case POLL_URING_RECV:
+        pu->n_recv++;
+        poll_uring_received(pu, dcb, cqe);
+        if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+        {
+            du->flags &= ~DCB_URING_RECV;
+            if (cqe->res == -ENOBUFS ||
+                (cqe->res == -ECANCELED && dcb->throttled_by == NULL))
+            {
+                /**
+                 * The buffers have been recycled when the receive is submitted.
+                 * A receive cancelled for paused reads that have already been
+                 * resumed is also submitted again.
+                 */
+                poll_uring_recv(dcb);
+            }
+            atomic_add(&du->refs, -1);
+        }
+        break;
+
+    case POLL_URING_SEND:
+        pu->n_send++;
+        du->flags &= ~DCB_URING_SEND;
+        if (cqe->res > 0)
+        {
+            dcb_uring_sent(dcb, cqe->res);
+            poll_uring_sendmsg(dcb);
+        }
+        else if (cqe->res < 0 && cqe->res != -ECANCELED)
+        {
+            /** The error or hangup is also reported by epoll */
+            MXS_DEBUG("%lu [poll_uring_complete] Send of DCB %p failed: %d",
+                      pthread_self(), dcb, -cqe->res);
+        }
+        atomic_add(&du->refs, -1);
+        break;
+
+    default:
+        atomic_add(&du->refs, -1);
+        break;
+    }
+}
+
+/**
+ * Handle the completions of the ring of a thread
+ *
+ * @param thread_id The thread ID of the calling thread
+ * @return          Number of completions
+ */
+static int
+poll_uring_reap(int thread_id)
+{
+    struct io_uring_cqe *cqe;
+    int n = 0;
+
+    if (rings)
+    {
+        POLL_URING *pu = &rings[thread_id];
+
+        while ((cqe = uring_peek_cqe(pu->ring)) != NULL)
+        {
+            poll_uring_complete(pu, cqe);
+            uring_cqe_seen(pu->ring);
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * Submit the requests the thread prepared during its polling cycle
+ *
+ * @param thread_id The thread ID of the calling thread
+ */
+static void
+poll_uring_flush(int thread_id)
+{
+    if (rings && uring_pending(rings[thread_id].ring) > 0)
+    {
+        uring_submit(rings[thread_id].ring, 0);
+    }
+}
+
+/**
+ * Print the io_uring statistics of the polling threads
+ *
+ * @param dcb   DCB to print to
+ */
+static void
+poll_uring_stats(DCB *dcb)
+{
+    if (rings)
+    {
+        dcb_printf(dcb, "io_uring usage\n");
+        dcb_printf(dcb, " ID | System calls | Submitted    | Completed    | Receives     | Sends        | Out of buffers\n");
+        dcb_printf(dcb, "----+--------------+--------------+--------------+--------------+--------------+---------------\n");
+        for (int i = 0; i < n_threads; i++)
+        {
+            URING *ring = rings[i].ring;
+            dcb_printf(dcb, " %2d | %12lu | %12lu | %12lu | %12lu | %12lu | %14lu\n", i,
+                       ring->n_enter, ring->n_sqes, ring->n_cqes,
+                       rings[i].n_recv, rings[i].n_send, rings[i].n_nobufs);
+        }
+    }
+}
+
+#else
+
+static void
+poll_uring_init()
+{
+    if (config_io_backend() == IO_BACKEND_URING)
+    {
+        MXS_WARNING("MaxScale was built without io_uring support, using epoll.");
+    }
+}
+
+static bool
+poll_uring_attach(DCB *dcb)
+{
+    return false;
+}
+
+static void
+poll_uring_start(DCB *dcb)
+{
+}
+
+static void
+poll_uring_stop(DCB *dcb)
+{
+}
+
+static void
+poll_uring_pause(DCB *dcb)
+{
+}
+
+int
+poll_uring_send(DCB *dcb)
+{
+    return 0;
+}
+
+static int
+poll_uring_reap(int thread_id)
+{
+    return 0;
+}
+
+static void
+poll_uring_flush(int thread_id)
+{
+}
+
+static void
+poll_uring_stats(DCB *dcb)
+{
+}
+
+#endif
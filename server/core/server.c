@@ -35,11 +35,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <session.h>
 #include <server.h>
+#include <service.h>
 #include <spinlock.h>
 #include <dcb.h>
 #include <maxscale/poll.h>
+#include <maxconfig.h>
 #include <skygw_utils.h>
 #include <log_manager.h>
 #include <gw_ssl.h>
@@ -53,6 +56,67 @@ static SERVER *allServers = NULL;
 static void spin_reporter(void *, char *, int);
 static void server_parameter_free(SERVER_PARAM *tofree);
 
+/**
+ * Format the metric labels of a server
+ *
+ * @param name  Name of the server
+ * @param buf   Buffer where the labels are stored
+ * @param size  Size of the buffer
+ * @return The buffer
+ */
+static char *
+server_stats_labels(const char *name, char *buf, size_t size)
+{
+    return ts_metric_label(buf, size, "server", name);
+}
+
+/**
+ * Create the statistics of a server
+ *
+ * @param server    The server
+ * @return True if the statistics were created
+ */
+static bool
+server_stats_alloc(SERVER *server)
+{
+    char labels[TS_LABEL_SIZE("server", server->name)];
+
+    server_stats_labels(server->name, labels, sizeof(labels));
+    server->stats.n_connections = ts_stats_register("maxscale_server_connections_total", labels,
+                                                    "Number of connections created to the server",
+                                                    TS_METRIC_COUNTER);
+    server->stats.n_current = ts_stats_register("maxscale_server_connections", labels,
+                                                "Current connections to the server",
+                                                TS_METRIC_GAUGE);
+    server->stats.n_current_ops = ts_stats_register("maxscale_server_active_operations", labels,
+                                                    "Current active operations on the server",
+                                                    TS_METRIC_GAUGE);
+    server->stats.h_first_byte = ts_hist_register("maxscale_server_first_byte_ns", labels,
+                                                  "Nanoseconds from a request to the first "
+                                                  "reply packet from the server");
+    server->stats.h_response = ts_hist_register("maxscale_server_response_ns", labels,
+                                                "Nanoseconds from a request to the complete "
+                                                "reply from the server");
+
+    return server->stats.n_connections && server->stats.n_current && server->stats.n_current_ops &&
+        server->stats.h_first_byte && server->stats.h_response;
+}
+
+/**
+ * Free the statistics of a server
+ *
+ * @param server    The server
+ */
+static void
+server_stats_free(SERVER *server)
+{
+    ts_stats_free(server->stats.n_connections);
+    ts_stats_free(server->stats.n_current);
+    ts_stats_free(server->stats.n_current_ops);
+    ts_hist_free(server->stats.h_first_byte);
+    ts_hist_free(server->stats.h_response);
+}
+
 /**
  * Allocate a new server withn the gateway
  *
@@ -72,12 +136,32 @@ server_alloc(char *servname, char *protocol, unsigned short port)
     {
         return NULL;
     }
+    /** One pool for each polling thread and one for the DCBs no thread owns */
+    server->n_pools = config_threadcount() + 1;
+    if ((server->persistent = (SERVER_POOL *)calloc(server->n_pools, sizeof(SERVER_POOL))) == NULL)
+    {
+        free(server);
+        return NULL;
+    }
+    for (int i = 0; i < server->n_pools; i++)
+    {
+        mutex_init(&server->persistent[i].lock);
+    }
 #if defined(SS_DEBUG)
     server->server_chk_top = CHK_NUM_SERVER;
     server->server_chk_tail = CHK_NUM_SERVER;
 #endif
     server->name = strndup(servname, MAX_SERVER_NAME_LEN);
     server->protocol = strdup(protocol);
+    if (!server_stats_alloc(server))
+    {
+        server_stats_free(server);
+        free(server->name);
+        free(server->protocol);
+        free(server->persistent);
+        free(server);
+        return NULL;
+    }
     server->port = port;
     server->status = SERVER_RUNNING;
     server->node_id = -1;
@@ -87,13 +171,12 @@ server_alloc(char *servname, char *protocol, unsigned short port)
     server->parameters = NULL;
     server->server_string = NULL;
     spinlock_init(&server->lock);
-    server->persistent = NULL;
     server->persistmax = 0;
     server->persistmaxtime = 0;
     server->persistpoolmax = 0;
+    server->persistpoolmin = 0;
     server->slave_configured = false;
     server->charset = SERVER_DEFAULT_CHARSET;
-    spinlock_init(&server->persistlock);
 
     spinlock_acquire(&server_spin);
     server->next = allServers;
@@ -142,17 +225,130 @@ server_free(SERVER *tofreeserver)
     free(tofreeserver->server_string);
     server_parameter_free(tofreeserver->parameters);
 
-    if (tofreeserver->persistent)
-    {
-        dcb_persistent_clean_count(tofreeserver->persistent, true);
-    }
+    dcb_persistent_clean_count(tofreeserver, true);
+    server_stats_free(tofreeserver);
+    free(tofreeserver->persistent);
     free(tofreeserver);
     return 1;
 }
 
+/**
+ * Return the persistent connection pool of a polling thread
+ *
+ * @param server    The server
+ * @param thread_id The ID of the polling thread, or -1 for the pool of the
+ *                  DCBs that no thread owns
+ * @return The pool
+ */
+SERVER_POOL *
+server_get_pool(SERVER *server, int thread_id)
+{
+    if (thread_id < 0 || thread_id >= server->n_pools - 1)
+    {
+        thread_id = server->n_pools - 1;
+    }
+    return &server->persistent[thread_id];
+}
+
+/**
+ * Take a matching DCB from a persistent connection pool
+ *
+ * The pool is searched from the most recently added DCB. DCBs found to be
+ * broken or expired on the way are removed and closed.
+ *
+ * @param server    The server
+ * @param pool      The pool to search
+ * @param user      The name of the user needing the connection
+ * @param protocol  The name of the protocol needed for the connection
+ * @return The DCB or NULL if the pool has no usable DCB
+ */
+static DCB *
+server_pool_take(SERVER *server, SERVER_POOL *pool, char *user, const char *protocol)
+{
+    DCB *dcb, *next, *previous = NULL;
+    DCB *found = NULL;
+    DCB *disposals = NULL;
+    time_t now = time(NULL);
+
+    mutex_acquire(&pool->lock);
+    dcb = pool->head;
+    while (dcb && found == NULL)
+    {
+        next = dcb->nextpersistent;
+        if (dcb->dcb_errhandle_called
+            || (dcb->flags & DCBF_HUNG)
+            || now - dcb->persistentstart > server->persistmaxtime)
+        {
+            /** Broken or expired, closed once the lock is released */
+            if (previous)
+            {
+                previous->nextpersistent = next;
+            }
+            else
+            {
+                pool->head = next;
+            }
+            pool->count--;
+            atomic_add(&server->stats.n_persistent, -1);
+            dcb->nextpersistent = disposals;
+            disposals = dcb;
+        }
+        else if (dcb->user
+                 && dcb->protoname
+                 && 0 == strcmp(dcb->user, user)
+                 && 0 == strcmp(dcb->protoname, protocol))
+        {
+            if (previous)
+            {
+                previous->nextpersistent = next;
+            }
+            else
+            {
+                pool->head = next;
+            }
+            pool->count--;
+            found = dcb;
+        }
+        else
+        {
+            MXS_DEBUG("%lu [server_get_persistent] Rejected dcb "
+                      "%p from pool, user %s looking for %s, protocol %s "
+                      "looking for %s.",
+                      pthread_self(),
+                      dcb,
+                      dcb->user ? dcb->user : "NULL",
+                      user,
+                      dcb->protoname ? dcb->protoname : "NULL",
+                      protocol);
+            previous = dcb;
+        }
+        dcb = next;
+    }
+    mutex_release(&pool->lock);
+
+    dcb_persistent_discard(disposals);
+
+    if (found)
+    {
+        free(found->user);
+        found->user = NULL;
+        /** The connection is no longer subject to the pool's timer */
+        poll_timer_cancel(&found->timer);
+        atomic_add(&server->stats.n_persistent, -1);
+        ts_stats_add(server->stats.n_current, 1);
+    }
+    return found;
+}
+
 /**
  * Get a DCB from the persistent connection pool, if possible
  *
+ * The pool of the calling thread is searched first and then the pool of the
+ * DCBs opened outside the polling threads. In the worker mode the DCBs in
+ * the pools of the other threads are owned by them and can't be used by
+ * this session. In the other modes no thread owns the DCBs and the pools of
+ * the other threads are searched last.
+ *
  * @param       server      The server to set the name on
  * @param       user        The name of the user needing the connection
  * @param       protocol    The name of the protocol needed for the connection
@@ -160,59 +356,33 @@ server_free(SERVER *tofreeserver)
 DCB *
 server_get_persistent(SERVER *server, char *user, const char *protocol)
 {
-    DCB *dcb, *previous = NULL;
+    DCB *dcb = NULL;
 
-    if (server->persistent
-        && dcb_persistent_clean_count(server->persistent, false)
-        && server->persistent
-        && (server->status & SERVER_RUNNING))
+    if (server->stats.n_persistent > 0 && (server->status & SERVER_RUNNING))
     {
-        spinlock_acquire(&server->persistlock);
-        dcb = server->persistent;
-        while (dcb)
+        SERVER_POOL *own = server_get_pool(server, poll_thread_id());
+        SERVER_POOL *shared = server_get_pool(server, -1);
+
+        if (own->head)
         {
-            if (dcb->user
-                && dcb->protoname
-                && !dcb-> dcb_errhandle_called
-                && !(dcb->flags & DCBF_HUNG)
-                && 0 == strcmp(dcb->user, user)
-                && 0 == strcmp(dcb->protoname, protocol))
-            {
-                if (NULL == previous)
-                {
-                    server->persistent = dcb->nextpersistent;
-                }
-                else
-                {
-                    previous->nextpersistent = dcb->nextpersistent;
-                }
-                free(dcb->user);
-                dcb->user = NULL;
-                spinlock_release(&server->persistlock);
-                atomic_add(&server->stats.n_persistent, -1);
-                atomic_add(&server->stats.n_current, 1);
-                return dcb;
-            }
-            else
+            dcb = server_pool_take(server, own, user, protocol);
+        }
+        if (dcb == NULL && own != shared && shared->head)
+        {
+            dcb = server_pool_take(server, shared, user, protocol);
+        }
+        for (int i = 0; dcb == NULL && i < server->n_pools - 1 &&
+             config_poll_mode() != POLL_MODE_WORKER; i++)
+        {
+            SERVER_POOL *pool = server_get_pool(server, i);
+
+            if (pool != own && pool->head)
             {
-                MXS_DEBUG("%lu [server_get_persistent] Rejected dcb "
-                          "%p from pool, user %s looking for %s, protocol %s "
-                          "looking for %s, hung flag %s, error handle called %s.",
-                          pthread_self(),
-                          dcb,
-                          dcb->user ? dcb->user : "NULL",
-                          user,
-                          dcb->protoname ? dcb->protoname : "NULL",
-                          protocol,
-                          (dcb->flags & DCBF_HUNG) ? "true" : "false",
-                          dcb-> dcb_errhandle_called ? "true" : "false");
+                dcb = server_pool_take(server, pool, user, protocol);
             }
-            previous = dcb;
-            dcb = dcb->nextpersistent;
         }
-        spinlock_release(&server->persistlock);
     }
-    return NULL;
+    return dcb;
 }
 
 /**
@@ -224,7 +394,16 @@ server_get_persistent(SERVER *server, char *user, const char *protocol)
 void
 server_set_unique_name(SERVER *server, char *name)
 {
+    char labels[TS_LABEL_SIZE("server", name)];
+
     server->unique_name = strdup(name);
+    /** The metrics are labeled with the section name instead of the address */
+    server_stats_labels(name, labels, sizeof(labels));
+    ts_metric_set_labels(server->stats.n_connections, labels);
+    ts_metric_set_labels(server->stats.n_current, labels);
+    ts_metric_set_labels(server->stats.n_current_ops, labels);
+    ts_metric_set_labels(server->stats.h_first_byte, labels);
+    ts_metric_set_labels(server->stats.h_response, labels);
 }
 
 /**
@@ -292,8 +471,8 @@ printServer(SERVER *server)
     printf("\tServer:                       %s\n", server->name);
     printf("\tProtocol:             %s\n", server->protocol);
     printf("\tPort:                 %d\n", server->port);
-    printf("\tTotal connections:    %d\n", server->stats.n_connections);
-    printf("\tCurrent connections:  %d\n", server->stats.n_current);
+    printf("\tTotal connections:    %" PRId64 "\n", ts_stats_sum(server->stats.n_connections));
+    printf("\tCurrent connections:  %" PRId64 "\n", ts_stats_sum(server->stats.n_current));
     printf("\tPersistent connections:       %d\n", server->stats.n_persistent);
     printf("\tPersistent actual max:        %d\n", server->persistmax);
 }
@@ -414,12 +593,12 @@ dprintAllServersJson(DCB *dcb)
         {
             dcb_printf(dcb, "    \"lastReplHeartbeat\": \"%lu\",\n", server->node_ts);
         }
-        dcb_printf(dcb, "    \"totalConnections\": \"%d\",\n",
-                   server->stats.n_connections);
-        dcb_printf(dcb, "    \"currentConnections\": \"%d\",\n",
-                   server->stats.n_current);
-        dcb_printf(dcb, "    \"currentOps\": \"%d\"\n",
-                   server->stats.n_current_ops);
+        dcb_printf(dcb, "    \"totalConnections\": \"%" PRId64 "\",\n",
+                   ts_stats_sum(server->stats.n_connections));
+        dcb_printf(dcb, "    \"currentConnections\": \"%" PRId64 "\",\n",
+                   ts_stats_sum(server->stats.n_current));
+        dcb_printf(dcb, "    \"currentOps\": \"%" PRId64 "\"\n",
+                   ts_stats_sum(server->stats.n_current_ops));
         if (el < len)
         {
             dcb_printf(dcb, "  },\n");
@@ -500,16 +679,22 @@ dprintServer(DCB *dcb, SERVER *server)
             param = param->next;
         }
     }
-    dcb_printf(dcb, "\tNumber of connections:               %d\n", server->stats.n_connections);
-    dcb_printf(dcb, "\tCurrent no. of conns:                %d\n", server->stats.n_current);
-    dcb_printf(dcb, "\tCurrent no. of operations:           %d\n", server->stats.n_current_ops);
+    dcb_printf(dcb, "\tNumber of connections:               %" PRId64 "\n",
+               ts_stats_sum(server->stats.n_connections));
+    dcb_printf(dcb, "\tCurrent no. of conns:                %" PRId64 "\n",
+               ts_stats_sum(server->stats.n_current));
+    dcb_printf(dcb, "\tCurrent no. of operations:           %" PRId64 "\n",
+               ts_stats_sum(server->stats.n_current_ops));
+    dprintLatency(dcb, "Time to first reply packet", server->stats.h_first_byte);
+    dprintLatency(dcb, "Time to complete reply", server->stats.h_response);
     if (server->persistpoolmax)
     {
         dcb_printf(dcb, "\tPersistent pool size:                %d\n", server->stats.n_persistent);
         dcb_printf(dcb, "\tPersistent measured pool size:       %d\n",
-                   dcb_persistent_clean_count(server->persistent, false));
+                   dcb_persistent_clean_count(server, false));
         dcb_printf(dcb, "\tPersistent actual size max:          %d\n", server->persistmax);
         dcb_printf(dcb, "\tPersistent pool size limit:          %ld\n", server->persistpoolmax);
+        dcb_printf(dcb, "\tPersistent pool minimum per thread:  %ld\n", server->persistpoolmin);
         dcb_printf(dcb, "\tPersistent max time (secs):          %ld\n", server->persistmaxtime);
     }
     if (server->server_ssl)
@@ -529,6 +714,102 @@ dprintServer(DCB *dcb, SERVER *server)
     }
 }
 
+/**
+ * Print a summary of a response time histogram to a DCB
+ *
+ * The values are printed in microseconds.
+ *
+ * @param dcb   The DCB to print to
+ * @param desc  Description of the histogram
+ * @param hist  The histogram
+ */
+void
+dprintLatency(DCB *dcb, const char *desc, ts_hist_t hist)
+{
+    ts_hist_summary_t sum;
+    char title[80];
+
+    ts_hist_summary(hist, &sum);
+    snprintf(title, sizeof(title), "%s:", desc);
+    dcb_printf(dcb, "\t%-37s%" PRIu64 " replies, p50 %.1f us, p99 %.1f us, "
+               "p99.9 %.1f us, max %.1f us\n", title, sum.count, sum.p50 / 1000.0,
+               sum.p99 / 1000.0, sum.p999 / 1000.0, sum.max / 1000.0);
+}
+
+/**
+ * Print the response times of a server as one row of a table
+ *
+ * The columns are described by SERVER_LATENCY_HEADER.
+ *
+ * @param dcb       The DCB to print to
+ * @param server    The server
+ */
+void
+dprintServerLatency(DCB *dcb, SERVER *server)
+{
+    ts_hist_summary_t first, response;
+
+    ts_hist_summary(server->stats.h_first_byte, &first);
+    ts_hist_summary(server->stats.h_response, &response);
+    dcb_printf(dcb, "\t\t%-20s %-11" PRIu64 " %-15.1f %-13.1f %.1f\n", server->unique_name,
+               response.count, first.p99 / 1000.0, response.p50 / 1000.0, response.p99 / 1000.0);
+}
+
+/**
+ * Start the response time measurement of a request
+ *
+ * @param latency   The measurement of the backend the request is sent to
+ */
+void
+server_latency_start(SERVER_LATENCY *latency)
+{
+    latency->sent_ns = ts_clock_ns();
+    latency->first_byte = false;
+}
+
+/**
+ * Record a reply to a request into the response time histograms
+ *
+ * The first call after server_latency_start records the time to the first
+ * reply packet. The call that completes the reply records the response time
+ * and ends the measurement, replies that arrive after that are ignored.
+ *
+ * @param latency   The measurement of the backend
+ * @param server    The server that replied
+ * @param service   The service of the session, may be NULL
+ * @param complete  True if the reply is complete
+ */
+void
+server_latency_reply(SERVER_LATENCY *latency, SERVER *server, SERVICE *service, bool complete)
+{
+    if (latency->sent_ns == 0)
+    {
+        return;
+    }
+
+    uint64_t elapsed = ts_clock_ns() - latency->sent_ns;
+
+    if (!latency->first_byte)
+    {
+        latency->first_byte = true;
+        ts_hist_add(server->stats.h_first_byte, elapsed);
+        if (service)
+        {
+            ts_hist_add(service->stats.h_first_byte, elapsed);
+        }
+    }
+
+    if (complete)
+    {
+        latency->sent_ns = 0;
+        ts_hist_add(server->stats.h_response, elapsed);
+        if (service)
+        {
+            ts_hist_add(service->stats.h_response, elapsed);
+        }
+    }
+}
+
 /**
  * Display an entry from the spinlock statistics data
  *
@@ -553,18 +834,23 @@ dprintPersistentDCBs(DCB *pdcb, SERVER *server)
 {
     DCB *dcb;
 
-    spinlock_acquire(&server->persistlock);
+    for (int i = 0; i < server->n_pools; i++)
+    {
+        SERVER_POOL *pool = &server->persistent[i];
+
+        mutex_acquire(&pool->lock);
 #if SPINLOCK_PROFILE
-    dcb_printf(pdcb, "DCB List Spinlock Statistics:\n");
-    spinlock_stats(&server->persistlock, spin_reporter, pdcb);
+        dcb_printf(pdcb, "DCB List Spinlock Statistics:\n");
+        mutex_stats(&pool->lock, spin_reporter, pdcb);
 #endif
-    dcb = server->persistent;
-    while (dcb)
-    {
-        dprintOneDCB(pdcb, dcb);
-        dcb = dcb->nextpersistent;
+        dcb = pool->head;
+        while (dcb)
+        {
+            dprintOneDCB(pdcb, dcb);
+            dcb = dcb->nextpersistent;
+        }
+        mutex_release(&pool->lock);
     }
-    spinlock_release(&server->persistlock);
 }
 
 /**
@@ -590,10 +876,10 @@ dListServers(DCB *dcb)
     while (server)
     {
         stat = server_status(server);
-        dcb_printf(dcb, "%-18s | %-15s | %5d | %11d | %s\n",
+        dcb_printf(dcb, "%-18s | %-15s | %5d | %11" PRId64 " | %s\n",
                    server->unique_name, server->name,
                    server->port,
-                   server->stats.n_current, stat);
+                   ts_stats_sum(server->stats.n_current), stat);
         free(stat);
         server = server->next;
     }
@@ -898,7 +1184,7 @@ serverRowCallback(RESULTSET *set, void *data)
     resultset_row_set(row, 1, server->name);
     sprintf(buf, "%d", server->port);
     resultset_row_set(row, 2, buf);
-    sprintf(buf, "%d", server->stats.n_current);
+    sprintf(buf, "%" PRId64, ts_stats_sum(server->stats.n_current));
     resultset_row_set(row, 3, buf);
     stat = server_status(server);
     resultset_row_set(row, 4, stat);
@@ -937,6 +1223,94 @@ serverGetList()
     return set;
 }
 
+/**
+ * Provide a row to the result set that defines the response times of the servers
+ *
+ * @param set   The result set
+ * @param data  The index of the row to send
+ * @return The next row or NULL
+ */
+static RESULT_ROW *
+serverLatencyRowCallback(RESULTSET *set, void *data)
+{
+    int *rowno = (int *)data;
+    int i = 0;
+    char buf[40];
+    RESULT_ROW *row;
+    SERVER *server;
+    ts_hist_summary_t first, response;
+
+    spinlock_acquire(&server_spin);
+    server = allServers;
+    while (i < *rowno && server)
+    {
+        i++;
+        server = server->next;
+    }
+    if (server == NULL)
+    {
+        spinlock_release(&server_spin);
+        free(data);
+        return NULL;
+    }
+    (*rowno)++;
+    ts_hist_summary(server->stats.h_first_byte, &first);
+    ts_hist_summary(server->stats.h_response, &response);
+    row = resultset_make_row(set);
+    resultset_row_set(row, 0, server->unique_name);
+    sprintf(buf, "%" PRIu64, response.count);
+    resultset_row_set(row, 1, buf);
+    sprintf(buf, "%.1f", first.p50 / 1000.0);
+    resultset_row_set(row, 2, buf);
+    sprintf(buf, "%.1f", first.p99 / 1000.0);
+    resultset_row_set(row, 3, buf);
+    sprintf(buf, "%.1f", response.p50 / 1000.0);
+    resultset_row_set(row, 4, buf);
+    sprintf(buf, "%.1f", response.p99 / 1000.0);
+    resultset_row_set(row, 5, buf);
+    sprintf(buf, "%.1f", response.p999 / 1000.0);
+    resultset_row_set(row, 6, buf);
+    sprintf(buf, "%.1f", response.max / 1000.0);
+    resultset_row_set(row, 7, buf);
+    spinlock_release(&server_spin);
+    return row;
+}
+
+/**
+ * Return a resultset that has the response times of the servers in it
+ *
+ * The times are in microseconds.
+ *
+ * @return A Result set
+ */
+RESULTSET *
+serverLatencyGetList()
+{
+    RESULTSET *set;
+    int *data;
+
+    if ((data = (int *)malloc(sizeof(int))) == NULL)
+    {
+        return NULL;
+    }
+    *data = 0;
+    if ((set = resultset_create(serverLatencyRowCallback, data)) == NULL)
+    {
+        free(data);
+        return NULL;
+    }
+    resultset_add_column(set, "Server", 20, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "Replies", 10, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "First Byte p50", 14, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "First Byte p99", 14, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "Response p50", 12, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "Response p99", 12, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "Response p99.9", 14, COL_TYPE_VARCHAR);
+    resultset_add_column(set, "Response Max", 12, COL_TYPE_VARCHAR);
+
+    return set;
+}
+
 /*
  * Update the address value of a specific server
  *
@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <ctype.h>
 #include <errno.h>
 #include <session.h>
@@ -151,12 +152,34 @@ service_alloc(const char *servname, const char *router)
     service->routerOptions = NULL;
     service->log_auth_warnings = true;
     service->strip_db_esc = true;
-    if (service->name == NULL || service->routerModule == NULL)
-    {
-        if (service->name)
-        {
-            free(service->name);
-        }
+    if (service->name)
+    {
+        char labels[TS_LABEL_SIZE("service", service->name)];
+
+        ts_metric_label(labels, sizeof(labels), "service", service->name);
+        service->stats.n_sessions = ts_stats_register("maxscale_service_sessions_total", labels,
+                                                      "Number of sessions created on the service",
+                                                      TS_METRIC_COUNTER);
+        service->stats.n_current = ts_stats_register("maxscale_service_sessions", labels,
+                                                     "Current sessions of the service",
+                                                     TS_METRIC_GAUGE);
+        service->stats.h_first_byte = ts_hist_register("maxscale_service_first_byte_ns", labels,
+                                                       "Nanoseconds from a request to the first "
+                                                       "reply packet from a backend");
+        service->stats.h_response = ts_hist_register("maxscale_service_response_ns", labels,
+                                                     "Nanoseconds from a request to the complete "
+                                                     "reply from a backend");
+    }
+    if (service->name == NULL || service->routerModule == NULL ||
+        service->stats.n_sessions == NULL || service->stats.n_current == NULL ||
+        service->stats.h_first_byte == NULL || service->stats.h_response == NULL)
+    {
+        ts_stats_free(service->stats.n_sessions);
+        ts_stats_free(service->stats.n_current);
+        ts_hist_free(service->stats.h_first_byte);
+        ts_hist_free(service->stats.h_response);
+        free(service->name);
+        free(service->routerModule);
         free(service);
         return NULL;
     }
@@ -164,7 +187,7 @@ service_alloc(const char *servname, const char *router)
     service->stats.n_failed_starts = 0;
     service->state = SERVICE_STATE_ALLOC;
     spinlock_init(&service->spin);
-    spinlock_init(&service->users_table_spin);
+    mutex_init(&service->users_table_lock);
 
     spinlock_acquire(&service_spin);
     service->next = allServices;
@@ -201,6 +224,90 @@ service_isvalid(SERVICE *service)
     return rval;
 }
 
+/**
+ * Check whether the port should have one SO_REUSEPORT listener per thread
+ *
+ * The listeners can only be sharded when each polling thread has its own
+ * epoll set as otherwise the accepted connections could not stay on the
+ * thread that accepted them.
+ *
+ * @param port  The port
+ * @return      True if the port is sharded
+ */
+static bool
+serviceUseShards(SERV_LISTENER *port)
+{
+    return config_reuseport() && config_poll_mode() == POLL_MODE_WORKER &&
+           (port->address == NULL || strchr(port->address, '/') == NULL);
+}
+
+/**
+ * Start the listener shards of a port
+ *
+ * Every polling thread other than the first one gets a listener DCB of its
+ * own that is bound to the same address with SO_REUSEPORT. The first thread
+ * owns the listener DCB of the port. The kernel distributes the connections
+ * between the sockets so the accept load is spread over all threads. A shard
+ * that fails to start does not stop the others from starting, the threads
+ * that have no shard still process the connections given to them by the
+ * other threads.
+ *
+ * @param service       The service
+ * @param port          The port whose listener DCB is already listening
+ * @param funcs         The protocol module functions
+ * @param config_bind   The address to bind to
+ */
+static void
+serviceStartShards(SERVICE *service, SERV_LISTENER *port, GWPROTOCOL *funcs, char *config_bind)
+{
+    int n_threads = config_threadcount();
+    int n_failed = 0;
+
+    if (n_threads < 2 ||
+        (port->shards = (DCB **)calloc(n_threads - 1, sizeof(DCB *))) == NULL)
+    {
+        return;
+    }
+
+    for (int i = 1; i < n_threads; i++)
+    {
+        DCB *shard = dcb_alloc(DCB_ROLE_SERVICE_LISTENER, port);
+
+        if (shard == NULL)
+        {
+            MXS_ERROR("Failed to create listener shard %d for service %s.", i, service->name);
+            n_failed++;
+            continue;
+        }
+
+        memcpy(&shard->func, funcs, sizeof(GWPROTOCOL));
+        shard->flags |= DCBF_REUSEPORT;
+        shard->owner = i;
+
+        if (!shard->func.listen(shard, config_bind) ||
+            (shard->session = session_alloc(service, shard)) == NULL)
+        {
+            MXS_ERROR("Failed to start listener shard %d for service %s.", i, service->name);
+            dcb_close(shard);
+            n_failed++;
+            continue;
+        }
+
+        shard->session->state = SESSION_STATE_LISTENER;
+        port->shards[port->n_shards++] = shard;
+    }
+
+    if (n_failed)
+    {
+        MXS_ERROR("%d of the %d listener shards of service %s failed to start, "
+                  "the other threads accept their connections.",
+                  n_failed, n_threads - 1, service->name);
+    }
+
+    MXS_NOTICE("Service %s listens at %s with %d SO_REUSEPORT sockets.",
+               service->name, config_bind, port->n_shards + 1);
+}
+
 /**
  * Start an individual port/protocol pair
  *
@@ -370,6 +477,12 @@ serviceStartPort(SERVICE *service, SERV_LISTENER *port)
         sprintf(config_bind, "0.0.0.0:%d", port->port);
     }
 
+    if (serviceUseShards(port))
+    {
+        port->listener->flags |= DCBF_REUSEPORT;
+        port->listener->owner = 0;
+    }
+
     if (port->listener->func.listen(port->listener, config_bind))
     {
         port->listener->session = session_alloc(service, port->listener);
@@ -378,6 +491,11 @@ serviceStartPort(SERVICE *service, SERV_LISTENER *port)
         {
             port->listener->session->state = SESSION_STATE_LISTENER;
             listeners += 1;
+
+            if (port->listener->flags & DCBF_REUSEPORT)
+            {
+                serviceStartShards(service, port, funcs, config_bind);
+            }
         }
         else
         {
@@ -617,6 +735,14 @@ serviceStop(SERVICE *service)
                 listeners++;
             }
         }
+        for (int i = 0; i < port->n_shards; i++)
+        {
+            if (port->shards[i]->session->state == SESSION_STATE_LISTENER &&
+                poll_remove_dcb(port->shards[i]) == 0)
+            {
+                port->shards[i]->session->state = SESSION_STATE_LISTENER_STOPPED;
+            }
+        }
         port = port->next;
     }
     service->state = SERVICE_STATE_STOPPED;
@@ -649,6 +775,14 @@ serviceRestart(SERVICE *service)
                 listeners++;
             }
         }
+        for (int i = 0; i < port->n_shards; i++)
+        {
+            if (port->shards[i]->session->state == SESSION_STATE_LISTENER_STOPPED &&
+                poll_add_dcb(port->shards[i]) == 0)
+            {
+                port->shards[i]->session->state = SESSION_STATE_LISTENER;
+            }
+        }
         port = port->next;
     }
     service->state = SERVICE_STATE_STARTED;
@@ -667,7 +801,7 @@ service_free(SERVICE *service)
 {
     SERVICE *ptr;
     SERVER_REF *srv;
-    if (service->stats.n_current)
+    if (ts_stats_sum(service->stats.n_current))
     {
         return 0;
     }
@@ -710,6 +844,10 @@ service_free(SERVICE *service)
     users_free(service->users);
     hashtable_free(service->resources);
     serviceClearRouterOptions(service);
+    ts_stats_free(service->stats.n_sessions);
+    ts_stats_free(service->stats.n_current);
+    ts_hist_free(service->stats.h_first_byte);
+    ts_hist_free(service->stats.h_response);
 
     free(service);
     return 1;
@@ -1016,11 +1154,11 @@ serviceSetTimeout(SERVICE *service, int val)
         return 0;
     }
 
-    /** Enable the session timeout checks if and only if at least one service is
-     * configured with a idle timeout. */
-    if ((service->conn_idle_timeout = val))
+    if (service->conn_idle_timeout != val)
     {
-        enable_session_timeouts();
+        service->conn_idle_timeout = val;
+        /** The sessions created before the change use the new timeout */
+        session_timeout_changed(service);
     }
 
     return 1;
@@ -1197,8 +1335,8 @@ printService(SERVICE *service)
         printf("\n");
     }
     printf("\tUsers data:           %p\n", (void *)service->users);
-    printf("\tTotal connections:    %d\n", service->stats.n_sessions);
-    printf("\tCurrently connected:  %d\n", service->stats.n_current);
+    printf("\tTotal connections:    %" PRId64 "\n", ts_stats_sum(service->stats.n_sessions));
+    printf("\tCurrently connected:  %" PRId64 "\n", ts_stats_sum(service->stats.n_current));
 }
 
 /**
@@ -1308,10 +1446,18 @@ void dprintService(DCB *dcb, SERVICE *service)
     }
     dcb_printf(dcb, "\tUsers data:                          %p\n",
                service->users);
-    dcb_printf(dcb, "\tTotal connections:                   %d\n",
-               service->stats.n_sessions);
-    dcb_printf(dcb, "\tCurrently connected:                 %d\n",
-               service->stats.n_current);
+    dcb_printf(dcb, "\tTotal connections:                   %" PRId64 "\n",
+               ts_stats_sum(service->stats.n_sessions));
+    dcb_printf(dcb, "\tCurrently connected:                 %" PRId64 "\n",
+               ts_stats_sum(service->stats.n_current));
+    dprintLatency(dcb, "Time to first reply packet", service->stats.h_first_byte);
+    dprintLatency(dcb, "Time to complete reply", service->stats.h_response);
+    dcb_printf(dcb, "\tBuffered data:\n");
+    for (int kind = 0; kind < MEMBUDGET_N_KINDS; kind++)
+    {
+        dcb_printf(dcb, "\t\t%-20s %lld bytes\n", membudget_kind_name(kind),
+                   (long long)service->buffered[kind]);
+    }
 }
 
 /**
@@ -1336,10 +1482,10 @@ dListServices(DCB *dcb)
     }
     while (service)
     {
-        ss_dassert(service->stats.n_current >= 0);
-        dcb_printf(dcb, "%-25s | %-20s | %6d | %5d\n",
+        dcb_printf(dcb, "%-25s | %-20s | %6" PRId64 " | %5" PRId64 "\n",
                    service->name, service->routerModule,
-                   service->stats.n_current, service->stats.n_sessions);
+                   ts_stats_sum(service->stats.n_current),
+                   ts_stats_sum(service->stats.n_sessions));
         service = service->next;
     }
     if (allServices)
@@ -1448,7 +1594,7 @@ int service_refresh_users(SERVICE *service)
 {
     int ret = 1;
     /* check for another running getUsers request */
-    if (!spinlock_acquire_nowait(&service->users_table_spin))
+    if (!mutex_acquire_nowait(&service->users_table_lock))
     {
         MXS_DEBUG("%s: [service_refresh_users] failed to get get lock for "
                   "loading new users' table: another thread is loading users",
@@ -1461,7 +1607,7 @@ int service_refresh_users(SERVICE *service)
     if ((time(NULL) < (service->rate_limit.last + USERS_REFRESH_TIME)) ||
         (service->rate_limit.nloads > USERS_REFRESH_MAX_PER_TIME))
     {
-        spinlock_release(&service->users_table_spin);
+        mutex_release(&service->users_table_lock);
         MXS_ERROR("%s: Refresh rate limit exceeded for load of users' table.",
                   service->name);
 
@@ -1480,7 +1626,7 @@ int service_refresh_users(SERVICE *service)
     ret = replace_mysql_users(service);
 
     /* remove lock */
-    spinlock_release(&service->users_table_spin);
+    mutex_release(&service->users_table_lock);
 
     if (ret >= 0)
     {
@@ -1808,7 +1954,7 @@ serviceSessionCountAll()
     service = allServices;
     while (service)
     {
-        rval += service->stats.n_current;
+        rval += ts_stats_sum(service->stats.n_current);
         service = service->next;
     }
     spinlock_release(&service_spin);
@@ -1942,9 +2088,9 @@ serviceRowCallback(RESULTSET *set, void *data)
     row = resultset_make_row(set);
     resultset_row_set(row, 0, service->name);
     resultset_row_set(row, 1, service->routerModule);
-    sprintf(buf, "%d", service->stats.n_current);
+    sprintf(buf, "%" PRId64, ts_stats_sum(service->stats.n_current));
     resultset_row_set(row, 2, buf);
-    sprintf(buf, "%d", service->stats.n_sessions);
+    sprintf(buf, "%" PRId64, ts_stats_sum(service->stats.n_sessions));
     resultset_row_set(row, 3, buf);
     spinlock_release(&service_spin);
     return row;
@@ -1979,6 +2125,103 @@ serviceGetList()
     return set;
 }
 
+/**
+ * Provide a row to the result set of the buffered data. The first row has
+ * the totals of MaxScale and the rest have those of the services.
+ *
+ * @param set   The result set
+ * @param data  The index of the row to send
+ * @return The next row or NULL
+ */
+static RESULT_ROW *
+serviceBufferedRowCallback(RESULTSET *set, void *data)
+{
+    int *rowno = (int *)data;
+    int64_t bytes[MEMBUDGET_N_KINDS];
+    int64_t total = 0;
+    char buf[24];
+    RESULT_ROW *row;
+
+    if (*rowno == 0)
+    {
+        row = resultset_make_row(set);
+        resultset_row_set(row, 0, "MaxScale");
+        for (int kind = 0; kind < MEMBUDGET_N_KINDS; kind++)
+        {
+            bytes[kind] = membudget_kind_total(kind);
+        }
+    }
+    else
+    {
+        int i = 1;
+        SERVICE *service;
+
+        spinlock_acquire(&service_spin);
+        service = allServices;
+        while (i < *rowno && service)
+        {
+            i++;
+            service = service->next;
+        }
+        if (service == NULL)
+        {
+            spinlock_release(&service_spin);
+            free(data);
+            return NULL;
+        }
+        row = resultset_make_row(set);
+        resultset_row_set(row, 0, service->name);
+        for (int kind = 0; kind < MEMBUDGET_N_KINDS; kind++)
+        {
+            bytes[kind] = service->buffered[kind];
+        }
+        spinlock_release(&service_spin);
+    }
+
+    for (int kind = 0; kind < MEMBUDGET_N_KINDS; kind++)
+    {
+        snprintf(buf, sizeof(buf), "%lld", (long long)bytes[kind]);
+        resultset_row_set(row, kind + 1, buf);
+        total += bytes[kind];
+    }
+    snprintf(buf, sizeof(buf), "%lld", (long long)total);
+    resultset_row_set(row, MEMBUDGET_N_KINDS + 1, buf);
+    (*rowno)++;
+    return row;
+}
+
+/**
+ * Return a result set with the data buffered by MaxScale and by each
+ * service, broken down by the subsystem that holds it. The sizes are in bytes.
+ *
+ * @return A Result set
+ */
+RESULTSET *
+serviceGetBufferedList()
+{
+    RESULTSET *set;
+    int *data;
+
+    if ((data = (int *)malloc(sizeof(int))) == NULL)
+    {
+        return NULL;
+    }
+    *data = 0;
+    if ((set = resultset_create(serviceBufferedRowCallback, data)) == NULL)
+    {
+        free(data);
+        return NULL;
+    }
+    resultset_add_column(set, "Name", 25, COL_TYPE_VARCHAR);
+    for (int kind = 0; kind < MEMBUDGET_N_KINDS; kind++)
+    {
+        resultset_add_column(set, (char *)membudget_kind_name(kind), 16, COL_TYPE_VARCHAR);
+    }
+    resultset_add_column(set, "Total", 16, COL_TYPE_VARCHAR);
+
+    return set;
+}
+
 /**
  * Function called by the housekeeper thread to retry starting of a service
  * @param data Service to restart
@@ -36,15 +36,18 @@
 #include <router.h>
 #include <dcb.h>
 #include <spinlock.h>
+#include <mutex.h>
 #include <atomic.h>
 #include <skygw_utils.h>
 #include <log_manager.h>
 #include <housekeeper.h>
+#include <maxscale/poll.h>
 
-/** Global session id; updated safely by holding session_spin */
+/** Global session id; updated safely by holding session_lock */
 static size_t session_id;
 
-static SPINLOCK session_spin = SPINLOCK_INIT;
+/** Guards the list of all sessions, held while the list is walked */
+static MUTEX session_lock = MUTEX_INIT;
 static SESSION *allSessions = NULL;
 static SESSION *lastSession = NULL;
 static SESSION *wasfreeSession = NULL;
@@ -52,19 +55,25 @@ static int freeSessionCount = 0;
 
 static struct session session_dummy_struct;
 
-/**
- * These two are declared in session.h
- */
-bool check_timeouts = false;
-long next_timeout_check = 0;
+/** A block of a session arena, the allocations follow the header */
+typedef struct session_arena_block
+{
+    struct session_arena_block *next;
+    size_t size;    /*< Usable bytes in the block */
+    size_t offset;  /*< Offset of the first free byte */
+} SESSION_ARENA_BLOCK;
 
-static SPINLOCK timeout_lock = SPINLOCK_INIT;
+#define SESSION_ARENA_ROUND(n)  (((n) + SESSION_ARENA_ALIGN - 1) & ~((size_t)SESSION_ARENA_ALIGN - 1))
+#define SESSION_ARENA_HEADER    SESSION_ARENA_ROUND(sizeof(SESSION_ARENA_BLOCK))
+#define SESSION_ARENA_DATA(b)   ((char *)(b) + SESSION_ARENA_HEADER)
 
 static int session_setup_filters(SESSION *session);
+static void session_arena_release(SESSION_ARENA *arena);
 static void session_simple_free(SESSION *session, DCB *dcb);
 static void session_add_to_all_list(SESSION *session);
 static SESSION *session_find_free();
 static void session_final_free(SESSION *session);
+static void session_idle_timeout(void *data);
 
 /**
  * Allocate a new session for a new client of the specified service.
@@ -82,9 +91,9 @@ session_alloc(SERVICE *service, DCB *client_dcb)
 {
     SESSION *session;
 
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     session = session_find_free();
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
     ss_info_dassert(session != NULL, "Allocating memory for session failed.");
 
     if (session == NULL)
@@ -102,6 +111,7 @@ session_alloc(SERVICE *service, DCB *client_dcb)
 #endif
     session->ses_is_child = (bool) DCB_IS_CLONE(client_dcb);
     spinlock_init(&session->ses_lock);
+    spinlock_init(&session->arena.lock);
     session->service = service;
     session->client_dcb = client_dcb;
     session->n_filters = 0;
@@ -175,6 +185,17 @@ session_alloc(SERVICE *service, DCB *client_dcb)
     {
         session->state = SESSION_STATE_ROUTER_READY;
 
+        if (client_dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
+        {
+            spinlock_acquire(&session->ses_lock);
+            if (service->conn_idle_timeout > 0)
+            {
+                poll_timer_add(&client_dcb->timer, session_idle_timeout, client_dcb,
+                               service->conn_idle_timeout * 1000);
+            }
+            spinlock_release(&session->ses_lock);
+        }
+
         if (session->client_dcb->user == NULL)
         {
             MXS_INFO("Started session [%lu] for %s service ",
@@ -199,12 +220,12 @@ session_alloc(SERVICE *service, DCB *client_dcb)
                  session->client_dcb->user,
                  session->client_dcb->remote);
     }
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     /** Assign a session id and increase, insert session into list */
     session->ses_id = ++session_id;
-    spinlock_release(&session_spin);
-    atomic_add(&service->stats.n_sessions, 1);
-    atomic_add(&service->stats.n_current, 1);
+    mutex_release(&session_lock);
+    ts_stats_add(service->stats.n_sessions, 1);
+    ts_stats_add(service->stats.n_current, 1);
     CHK_SESSION(session);
 
     client_dcb->session = session;
@@ -291,10 +312,14 @@ session_find_free()
     }
     /* Dropping out of the loop means we have found a session that is not in use */
     freeSessionCount--;
-    /* Clear the old data, then reset the list forward link */
+    /* Clear the old data, then reset the list forward link and the kept arena block */
     nextsession = wasfreeSession->next;
+    struct session_arena_block *kept = wasfreeSession->arena.blocks;
+    size_t reserved = wasfreeSession->arena.reserved;
     memset(wasfreeSession, 0, sizeof(SESSION));
     wasfreeSession->next = nextsession;
+    wasfreeSession->arena.blocks = kept;
+    wasfreeSession->arena.reserved = reserved;
     wasfreeSession->ses_is_in_use = true;
     return wasfreeSession;
 }
@@ -364,6 +389,187 @@ void session_disable_log_priority(SESSION* session, int priority)
     }
 }
 
+/**
+ * Charge data that a router or a filter buffers for a session
+ *
+ * The data is charged to the service of the session and counts towards the
+ * weight of the session. The same amount must be released with a negative
+ * value while the session is still valid.
+ *
+ * @param session   The session
+ * @param kind      The subsystem that holds the data
+ * @param bytes     Number of bytes added, negative when the data is released
+ */
+void
+session_buffered_add(SESSION *session, membudget_kind_t kind, int bytes)
+{
+    membudget_add(kind, session->service, bytes);
+    session_add_weight(session, bytes);
+}
+
+/**
+ * Add to the buffered data that a session is responsible for
+ *
+ * Data that is released after the DCBs have left the session is not
+ * subtracted, the session is then being freed.
+ *
+ * @param session   The session
+ * @param bytes     Number of bytes added or, when negative, released
+ */
+void
+session_add_weight(SESSION *session, int bytes)
+{
+    if (session->state != SESSION_STATE_DUMMY)
+    {
+        __sync_fetch_and_add(&session->buffered, bytes);
+    }
+}
+
+/**
+ * Allocate memory that lives as long as the session
+ *
+ * The memory is zeroed. It is released when the session is freed and must
+ * not be passed to free(). Freeing it earlier with session_arena_free is
+ * optional, small allocations freed that way are reused by the session.
+ *
+ * @param session   The session
+ * @param size      Number of bytes
+ * @return Pointer to the memory or NULL if memory allocation failed
+ */
+void *
+session_arena_alloc(SESSION *session, size_t size)
+{
+    SESSION_ARENA *arena = &session->arena;
+    SESSION_ARENA_BLOCK *block;
+    size_t n = SESSION_ARENA_ROUND(size ? size : 1);
+    void *rval = NULL;
+
+    ss_dassert(session->state != SESSION_STATE_DUMMY);
+    spinlock_acquire(&arena->lock);
+
+    if (n <= SESSION_ARENA_MAX_RECYCLE && arena->free_lists[n / SESSION_ARENA_ALIGN - 1])
+    {
+        /** A freed allocation of the same size class, the first word links the list */
+        rval = arena->free_lists[n / SESSION_ARENA_ALIGN - 1];
+        arena->free_lists[n / SESSION_ARENA_ALIGN - 1] = *(void **)rval;
+    }
+    else if ((block = arena->blocks) && block->size - block->offset >= n)
+    {
+        rval = SESSION_ARENA_DATA(block) + block->offset;
+        block->offset += n;
+    }
+    else
+    {
+        /** Large allocations get a block of their own behind the current one */
+        bool own = n > SESSION_ARENA_BLOCK_SIZE / 4;
+        size_t bsize = own ? n : SESSION_ARENA_BLOCK_SIZE;
+
+        if ((block = malloc(SESSION_ARENA_HEADER + bsize)))
+        {
+            block->size = bsize;
+            block->offset = n;
+            arena->reserved += bsize;
+
+            if (own && arena->blocks)
+            {
+                block->next = arena->blocks->next;
+                arena->blocks->next = block;
+            }
+            else
+            {
+                block->next = arena->blocks;
+                arena->blocks = block;
+            }
+            rval = SESSION_ARENA_DATA(block);
+        }
+    }
+
+    if (rval)
+    {
+        arena->used += n;
+    }
+    spinlock_release(&arena->lock);
+
+    if (rval)
+    {
+        memset(rval, 0, n);
+    }
+    else
+    {
+        MXS_ERROR("Failed to allocate %lu bytes of session memory.", size);
+    }
+
+    return rval;
+}
+
+/**
+ * Return memory to the session arena before the session is freed
+ *
+ * Allocations of at most SESSION_ARENA_MAX_RECYCLE bytes are reused by the
+ * next allocations of the same size, the larger ones are kept until the
+ * session is freed.
+ *
+ * @param session   The session the memory was allocated from
+ * @param ptr       The memory, NULL is ignored
+ * @param size      The size that was allocated
+ */
+void
+session_arena_free(SESSION *session, void *ptr, size_t size)
+{
+    SESSION_ARENA *arena = &session->arena;
+    size_t n = SESSION_ARENA_ROUND(size ? size : 1);
+
+    if (ptr)
+    {
+        spinlock_acquire(&arena->lock);
+        arena->used -= n;
+
+        if (n <= SESSION_ARENA_MAX_RECYCLE)
+        {
+            *(void **)ptr = arena->free_lists[n / SESSION_ARENA_ALIGN - 1];
+            arena->free_lists[n / SESSION_ARENA_ALIGN - 1] = ptr;
+        }
+        spinlock_release(&arena->lock);
+    }
+}
+
+/**
+ * Release the memory of a session arena
+ *
+ * One block of the default size is kept for the next session that uses the
+ * session structure, the rest of the blocks are freed.
+ *
+ * @param arena The arena of a session that is being freed
+ */
+static void
+session_arena_release(SESSION_ARENA *arena)
+{
+    SESSION_ARENA_BLOCK *kept = NULL;
+    SESSION_ARENA_BLOCK *block = arena->blocks;
+
+    while (block)
+    {
+        SESSION_ARENA_BLOCK *next = block->next;
+
+        if (kept == NULL && block->size == SESSION_ARENA_BLOCK_SIZE)
+        {
+            kept = block;
+            kept->next = NULL;
+            kept->offset = 0;
+        }
+        else
+        {
+            free(block);
+        }
+        block = next;
+    }
+
+    arena->blocks = kept;
+    arena->reserved = kept ? kept->size : 0;
+    arena->used = 0;
+    memset(arena->free_lists, 0, sizeof(arena->free_lists));
+}
+
 /**
  * Link a session to a DCB.
  *
@@ -450,7 +656,7 @@ session_free(SESSION *session)
     }
     session->state = SESSION_STATE_TO_BE_FREED;
 
-    atomic_add(&session->service->stats.n_current, -1);
+    ts_stats_add(session->service->stats.n_current, -1);
 
     /***
      *
@@ -487,7 +693,6 @@ session_free(SESSION *session)
                                                              session->filters[i].session);
             }
         }
-        free(session->filters);
     }
 
     MXS_INFO("Stopped %s client session [%lu]",
@@ -509,11 +714,13 @@ session_free(SESSION *session)
 static void
 session_final_free(SESSION *session)
 {
+    session_arena_release(&session->arena);
+
     /* We never free the actual session, it is available for reuse*/
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     session->ses_is_in_use = false;
     freeSessionCount++;
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
 }
 
 /**
@@ -528,7 +735,7 @@ session_isvalid(SESSION *session)
     SESSION *list_session;
     int rval = 0;
 
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     list_session = allSessions;
     while (list_session)
     {
@@ -539,7 +746,7 @@ session_isvalid(SESSION *session)
         }
         list_session = list_session->next;
     }
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
 
     return rval;
 }
@@ -574,7 +781,7 @@ printAllSessions()
 {
     SESSION *list_session;
 
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     list_session = allSessions;
     while (list_session)
     {
@@ -584,7 +791,7 @@ printAllSessions()
         }
         list_session = list_session->next;
     }
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
 }
 
 
@@ -601,7 +808,7 @@ CheckSessions()
     int noclients = 0;
     int norouter = 0;
 
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     list_session = allSessions;
     while (list_session)
     {
@@ -626,12 +833,12 @@ CheckSessions()
         }
         list_session = list_session->next;
     }
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
     if (noclients)
     {
         printf("%d Sessions have no clients\n", noclients);
     }
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     list_session = allSessions;
     while (list_session)
     {
@@ -656,7 +863,7 @@ CheckSessions()
         }
         list_session = list_session->next;
     }
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
     if (norouter)
     {
         printf("%d Sessions have no router session\n", norouter);
@@ -676,7 +883,7 @@ dprintAllSessions(DCB *dcb)
 {
     SESSION *list_session;
 
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     list_session = allSessions;
     while (list_session)
     {
@@ -690,7 +897,7 @@ dprintAllSessions(DCB *dcb)
 
         list_session = list_session->next;
     }
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
 }
 
 /**
@@ -731,6 +938,9 @@ dprintSession(DCB *dcb, SESSION *print_session)
         dcb_printf(dcb, "\tIdle:                %.0f seconds\n", idle);
     }
 
+    dcb_printf(dcb, "\tSession memory:      %lu bytes used, %lu bytes reserved\n",
+               print_session->arena.used, print_session->arena.reserved);
+
     if (print_session->n_filters)
     {
         for (int i = 0; i < print_session->n_filters; i++)
@@ -757,7 +967,7 @@ dListSessions(DCB *dcb)
 {
     SESSION *list_session;
 
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     list_session = allSessions;
     if (list_session)
     {
@@ -784,7 +994,7 @@ dListSessions(DCB *dcb)
         dcb_printf(dcb,
                    "-----------------+-----------------+----------------+--------------------------\n\n");
     }
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
 }
 
 /**
@@ -858,8 +1068,8 @@ session_setup_filters(SESSION *session)
     UPSTREAM *tail;
     int i;
 
-    if ((session->filters = calloc(service->n_filters,
-                                   sizeof(SESSION_FILTER))) == NULL)
+    if ((session->filters = session_arena_alloc(session, service->n_filters *
+                                                sizeof(SESSION_FILTER))) == NULL)
     {
         MXS_ERROR("Insufficient memory to allocate session filter "
                   "tracking.\n");
@@ -886,7 +1096,7 @@ session_setup_filters(SESSION *session)
         session->filters[i].session = head->session;
         session->filters[i].instance = head->instance;
         session->head = *head;
-        free(head);
+        session_arena_free(session, head, sizeof(DOWNSTREAM));
     }
 
     for (i = 0; i < service->n_filters; i++)
@@ -994,48 +1204,109 @@ SESSION *get_all_sessions()
 }
 
 /**
- * Enable the timing out of idle connections.
+ * Close the client connection of a session that has been idle for too long.
+ *
+ * The timer of the client DCB is armed for the idle timeout of the service
+ * when the session is created. If the client has sent data since then, the
+ * timer is armed again for the remaining time. The connection timeout is
+ * disabled by default.
+ *
+ * The timeout is read from the service every time the timer fires. The timer
+ * is armed and cancelled only while the session lock is held so that it is
+ * never armed by two threads at the same time.
  *
- * This will prevent unnecessary acquisitions of the session spinlock if no
- * service is configured with a session idle timeout.
+ * @param data The client DCB
  */
-void enable_session_timeouts()
+static void
+session_idle_timeout(void *data)
 {
-    check_timeouts = true;
+    DCB *dcb = (DCB *)data;
+    SESSION *session = dcb->session;
+    bool expired = false;
+
+    if (dcb->state == DCB_STATE_POLLING && session && session->service)
+    {
+        spinlock_acquire(&session->ses_lock);
+        /** One heartbeat is 100 milliseconds */
+        long timeout = session->service->conn_idle_timeout * 10;
+        long idle = hkheartbeat - dcb->last_read;
+
+        if (timeout > 0 && idle > timeout)
+        {
+            expired = true;
+        }
+        else if (timeout > 0)
+        {
+            poll_timer_add(&dcb->timer, session_idle_timeout, dcb,
+                           (timeout - idle + 1) * 100);
+        }
+        spinlock_release(&session->ses_lock);
+
+        if (expired)
+        {
+            dcb_close(dcb);
+        }
+    }
 }
 
 /**
- * Close sessions that have been idle for too long.
+ * Apply a changed idle timeout to the sessions of a service that the calling
+ * polling thread handles.
+ *
+ * The timers of the client DCBs are fired at once so that they read the new
+ * timeout, or cancelled if the timeout was disabled. A polling thread only
+ * touches the DCBs it owns and the first thread handles the shared DCBs.
  *
- * If the time since a session last sent data is greater than the set value in the
- * service, it is disconnected. The connection timeout is disabled by default.
+ * @param data The service
  */
-void process_idle_sessions()
+static void
+session_timeout_rearm(void *data)
 {
-    if (spinlock_acquire_nowait(&timeout_lock))
+    SERVICE *service = (SERVICE *)data;
+    int thread_id = poll_thread_id();
+
+    mutex_acquire(&session_lock);
+    for (SESSION *session = allSessions; session; session = session->next)
     {
-        if (hkheartbeat >= next_timeout_check)
-        {
-            /** Because the resolution of the timeout is one second, we only need to
-             * check for it once per second. One heartbeat is 100 milliseconds. */
-            next_timeout_check = hkheartbeat + 10;
-            spinlock_acquire(&session_spin);
-            SESSION *all_session = allSessions;
+        DCB *dcb = session->client_dcb;
 
-            while (all_session)
+        if (session->ses_is_in_use && session->service == service && dcb &&
+            dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER &&
+            (dcb->owner == thread_id || (dcb->owner < 0 && thread_id == 0)))
+        {
+            spinlock_acquire(&session->ses_lock);
+            if (dcb->state == DCB_STATE_POLLING && dcb->session == session)
             {
-                if (all_session->ses_is_in_use &&
-                    all_session->service && all_session->client_dcb && all_session->client_dcb->state == DCB_STATE_POLLING &&
-                    hkheartbeat - all_session->client_dcb->last_read > all_session->service->conn_idle_timeout * 10)
+                if (service->conn_idle_timeout > 0)
                 {
-                    dcb_close(all_session->client_dcb);
+                    poll_timer_add(&dcb->timer, session_idle_timeout, dcb, 0);
+                }
+                else
+                {
+                    poll_timer_cancel(&dcb->timer);
                 }
-
-                all_session = all_session->next;
             }
-            spinlock_release(&session_spin);
+            spinlock_release(&session->ses_lock);
         }
-        spinlock_release(&timeout_lock);
+    }
+    mutex_release(&session_lock);
+}
+
+/**
+ * Apply a changed idle timeout of a service to its existing sessions
+ *
+ * Every polling thread updates the timers of the sessions it handles.
+ *
+ * @param service The service whose timeout was changed
+ */
+void
+session_timeout_changed(SERVICE *service)
+{
+    int n_threads = config_threadcount();
+
+    for (int i = 0; i < n_threads; i++)
+    {
+        poll_post(i, session_timeout_rearm, service);
     }
 }
 
@@ -1064,7 +1335,7 @@ sessionRowCallback(RESULTSET *set, void *data)
     RESULT_ROW *row;
     SESSION *list_session;
 
-    spinlock_acquire(&session_spin);
+    mutex_acquire(&session_lock);
     list_session = allSessions;
     /* Skip to the first non-listener if not showing listeners */
     while (false == list_session->ses_is_in_use ||
@@ -1098,7 +1369,7 @@ sessionRowCallback(RESULTSET *set, void *data)
     }
     if (list_session == NULL)
     {
-        spinlock_release(&session_spin);
+        mutex_release(&session_lock);
         free(data);
         return NULL;
     }
@@ -1112,7 +1383,7 @@ sessionRowCallback(RESULTSET *set, void *data)
     resultset_row_set(row, 2, (list_session->service && list_session->service->name
                                ? list_session->service->name : ""));
     resultset_row_set(row, 3, session_state(list_session->state));
-    spinlock_release(&session_spin);
+    mutex_release(&session_lock);
     return row;
 }
 
@@ -13,14 +13,79 @@
 
 #include <statistics.h>
 #include <maxconfig.h>
+#include <spinlock.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
 #include <string.h>
+#include <time.h>
 #include <platform.h>
 
-thread_local int current_thread_id = 0;
+/** Round a size up to a multiple of the cache line size */
+#define TS_CACHE_ALIGN(size) (((size) + TS_CACHE_LINE - 1) & ~((size_t)TS_CACHE_LINE - 1))
+
+/**
+ * A 64-bit value on a cache line of its own. The threads never write to the
+ * same cache line when they update their own slots.
+ */
+typedef struct
+{
+    int64_t value;
+    char    pad[TS_CACHE_LINE - sizeof(int64_t)];
+} TS_SLOT;
+
+/**
+ * The header of the statistics objects and histograms. The object is followed
+ * by a shared part and one part for each polling thread, each of them starting
+ * on a cache line of its own. The shared part is used with atomic operations by
+ * the threads that are not polling threads or that were started after the
+ * object was created.
+ */
+typedef struct
+{
+    int       n_threads;    /**< Number of per-thread parts */
+    TS_METRIC *metric;      /**< The registry entry or NULL */
+} TS_HEADER;
+
+/**
+ * The part of a histogram that belongs to one thread. Only the owning thread
+ * writes to it so no locking is needed, readers merge the parts of all threads.
+ */
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[TS_HIST_BUCKETS];
+} TS_HIST_THREAD;
+
+#define TS_HEADER_SIZE  TS_CACHE_ALIGN(sizeof(TS_HEADER))
+#define TS_HIST_STRIDE  TS_CACHE_ALIGN(sizeof(TS_HIST_THREAD))
+
+thread_local int current_thread_id = -1;
 
 static int thread_count = 0;
 static bool initialized = false;
 
+/**
+ * Memory freed while an export is reading the registry without the lock
+ */
+typedef struct ts_retired
+{
+    void              *ptr;
+    struct ts_retired *next;
+} TS_RETIRED;
+
+static TS_METRIC *metrics = NULL;
+static SPINLOCK metrics_lock = SPINLOCK_INIT;
+/** Number of running exports, the metrics they copied must not be freed */
+static int n_exports = 0;
+/** Metrics removed during the exports, freed by the last one to finish */
+static TS_METRIC *retired_metrics = NULL;
+/** Labels replaced during the exports, freed by the last one to finish */
+static TS_RETIRED *retired_labels = NULL;
+
 /**
  * Initialize the statistics gathering
  */
@@ -28,6 +93,11 @@ void ts_stats_init()
 {
     ss_dassert(!initialized);
     thread_count = config_threadcount();
+    if (thread_count < 1)
+    {
+        /** The thread count isn't configured in the unit tests */
+        thread_count = 1;
+    }
     initialized = true;
 }
 
@@ -39,6 +109,249 @@ void ts_stats_end()
     ss_dassert(initialized);
 }
 
+/**
+ * Allocate a cache line aligned object with a part for each polling thread
+ *
+ * The objects can be created before ts_stats_init is called, the servers
+ * are created while the configuration is read.
+ *
+ * @param part_size Size of the shared part and the per-thread parts
+ * @return New zeroed object or NULL if memory allocation failed
+ */
+static TS_HEADER* ts_object_alloc(size_t part_size)
+{
+    int n_threads = initialized ? thread_count : config_threadcount();
+    void *ptr;
+
+    if (n_threads < 0)
+    {
+        n_threads = 0;
+    }
+
+    size_t size = TS_HEADER_SIZE + (n_threads + 1) * part_size;
+
+    if (posix_memalign(&ptr, TS_CACHE_LINE, size) != 0)
+    {
+        return NULL;
+    }
+
+    memset(ptr, 0, size);
+    ((TS_HEADER*)ptr)->n_threads = n_threads;
+    return (TS_HEADER*)ptr;
+}
+
+/**
+ * Return the part of an object that the current thread updates
+ *
+ * @param header    The object
+ * @param part_size Size of the parts
+ * @param shared    Set to true if the part is the shared one
+ * @return The part of the current thread
+ */
+static inline void* ts_object_part(TS_HEADER *header, size_t part_size, bool *shared)
+{
+    int id = current_thread_id;
+    char *parts = (char*)header + TS_HEADER_SIZE;
+
+    *shared = id < 0 || id >= header->n_threads;
+    return parts + (*shared ? 0 : (id + 1) * part_size);
+}
+
+/**
+ * Add an object to the metric registry
+ *
+ * @param header    The object
+ * @param name      Name of the metric
+ * @param labels    Labels of the metric or NULL
+ * @param help      Description of the metric
+ * @param type      The kind of the metric
+ * @return True if the metric was added
+ */
+static bool ts_metric_add(TS_HEADER *header, const char *name, const char *labels,
+                          const char *help, ts_metric_type_t type)
+{
+    TS_METRIC *metric = calloc(1, sizeof(TS_METRIC));
+
+    if (metric == NULL ||
+        (metric->name = strdup(name)) == NULL ||
+        (labels && (metric->labels = strdup(labels)) == NULL) ||
+        (metric->help = strdup(help ? help : name)) == NULL)
+    {
+        if (metric)
+        {
+            free(metric->name);
+            free(metric->labels);
+            free(metric);
+        }
+        return false;
+    }
+
+    metric->type = type;
+    metric->data = header;
+    header->metric = metric;
+
+    spinlock_acquire(&metrics_lock);
+    metric->next = metrics;
+    metrics = metric;
+    spinlock_release(&metrics_lock);
+    return true;
+}
+
+/**
+ * Free a metric and the object it belongs to
+ *
+ * @param metric The metric
+ */
+static void ts_metric_free(TS_METRIC *metric)
+{
+    free(metric->name);
+    free(metric->labels);
+    free(metric->help);
+    free(metric->data);
+    free(metric);
+}
+
+/**
+ * Remove an object from the metric registry and free it
+ *
+ * If an export is running, the object is freed when the export finishes.
+ *
+ * @param header The object
+ */
+static void ts_object_free(TS_HEADER *header)
+{
+    TS_METRIC *metric = header->metric;
+
+    if (metric)
+    {
+        spinlock_acquire(&metrics_lock);
+        TS_METRIC **prev = &metrics;
+        while (*prev && *prev != metric)
+        {
+            prev = &(*prev)->next;
+        }
+        if (*prev)
+        {
+            *prev = metric->next;
+        }
+        if (n_exports > 0)
+        {
+            metric->next = retired_metrics;
+            retired_metrics = metric;
+            metric = NULL;
+        }
+        spinlock_release(&metrics_lock);
+
+        if (metric)
+        {
+            ts_metric_free(metric);
+        }
+    }
+    else
+    {
+        free(header);
+    }
+}
+
+/**
+ * Change the labels of a registered metric
+ *
+ * @param data      The statistics object or histogram
+ * @param labels    The new labels or NULL
+ */
+void ts_metric_set_labels(void *data, const char *labels)
+{
+    TS_METRIC *metric = ((TS_HEADER*)data)->metric;
+    char *copy = labels ? strdup(labels) : NULL;
+    TS_RETIRED *retired = malloc(sizeof(TS_RETIRED));
+
+    if (metric && retired && (copy || labels == NULL))
+    {
+        spinlock_acquire(&metrics_lock);
+        retired->ptr = metric->labels;
+        metric->labels = copy;
+        if (n_exports > 0)
+        {
+            retired->next = retired_labels;
+            retired_labels = retired;
+            retired = NULL;
+        }
+        spinlock_release(&metrics_lock);
+
+        if (retired)
+        {
+            free(retired->ptr);
+        }
+    }
+    else
+    {
+        free(copy);
+    }
+    free(retired);
+}
+
+/**
+ * Format a metric label. The backslashes, double quotes and line feeds of the
+ * value are escaped as the exposition format requires.
+ *
+ * @param buf   Buffer where the label is stored, at least TS_LABEL_SIZE(name, value) bytes
+ * @param size  Size of the buffer
+ * @param name  Name of the label
+ * @param value Value of the label
+ * @return The buffer
+ */
+char *ts_metric_label(char *buf, size_t size, const char *name, const char *value)
+{
+    size_t len = snprintf(buf, size, "%s=\"", name);
+
+    for (const char *c = value; *c && len + 3 < size; c++)
+    {
+        switch (*c)
+        {
+        case '\\':
+        case '"':
+            buf[len++] = '\\';
+            buf[len++] = *c;
+            break;
+
+        case '\n':
+            buf[len++] = '\\';
+            buf[len++] = 'n';
+            break;
+
+        default:
+            buf[len++] = *c;
+            break;
+        }
+    }
+
+    if (len + 1 < size)
+    {
+        buf[len++] = '"';
+        buf[len] = '\0';
+    }
+    return buf;
+}
+
+/**
+ * Call a function for each registered metric
+ *
+ * The registry is locked during the calls, the function must not create or
+ * free metrics.
+ *
+ * @param fn    Function to call
+ * @param data  User data passed to the function
+ */
+void ts_metric_foreach(void (*fn)(const TS_METRIC *metric, void *data), void *data)
+{
+    spinlock_acquire(&metrics_lock);
+    for (TS_METRIC *metric = metrics; metric; metric = metric->next)
+    {
+        fn(metric, data);
+    }
+    spinlock_release(&metrics_lock);
+}
+
 /**
  * Create a new statistics object
  *
@@ -46,8 +359,30 @@ void ts_stats_end()
  */
 ts_stats_t ts_stats_alloc()
 {
-    ss_dassert(initialized);
-    return calloc(thread_count, sizeof(int));
+    return ts_object_alloc(sizeof(TS_SLOT));
+}
+
+/**
+ * Create a new statistics object and add it to the metric registry
+ *
+ * @param name      Name of the metric
+ * @param labels    Labels of the metric, e.g. server="db1", or NULL
+ * @param help      Description of the metric
+ * @param type      TS_METRIC_COUNTER or TS_METRIC_GAUGE
+ * @return New stats_t object or NULL if memory allocation failed
+ */
+ts_stats_t ts_stats_register(const char *name, const char *labels, const char *help,
+                             ts_metric_type_t type)
+{
+    ss_dassert(type == TS_METRIC_COUNTER || type == TS_METRIC_GAUGE);
+    TS_HEADER *header = ts_stats_alloc();
+
+    if (header && !ts_metric_add(header, name, labels, help, type))
+    {
+        free(header);
+        header = NULL;
+    }
+    return header;
 }
 
 /**
@@ -57,8 +392,10 @@ ts_stats_t ts_stats_alloc()
  */
 void ts_stats_free(ts_stats_t stats)
 {
-    ss_dassert(initialized);
-    free(stats);
+    if (stats)
+    {
+        ts_object_free((TS_HEADER*)stats);
+    }
 }
 
 /**
@@ -79,10 +416,19 @@ void ts_stats_set_thread_id(int id)
  * @param stats Statistics to add to
  * @param value Value to add
  */
-void ts_stats_add(ts_stats_t stats, int value)
+void ts_stats_add(ts_stats_t stats, int64_t value)
 {
-    ss_dassert(initialized);
-    ((int*)stats)[current_thread_id] += value;
+    bool shared;
+    TS_SLOT *slot = ts_object_part((TS_HEADER*)stats, sizeof(TS_SLOT), &shared);
+
+    if (shared)
+    {
+        __sync_fetch_and_add(&slot->value, value);
+    }
+    else
+    {
+        slot->value += value;
+    }
 }
 
 /**
@@ -92,10 +438,19 @@ void ts_stats_add(ts_stats_t stats, int value)
  * @param stats Statistics to set
  * @param value Value to set to
  */
-void ts_stats_set(ts_stats_t stats, int value)
+void ts_stats_set(ts_stats_t stats, int64_t value)
 {
-    ss_dassert(initialized);
-    ((int*)stats)[current_thread_id] = value;
+    bool shared;
+    TS_SLOT *slot = ts_object_part((TS_HEADER*)stats, sizeof(TS_SLOT), &shared);
+
+    if (shared)
+    {
+        __sync_lock_test_and_set(&slot->value, value);
+    }
+    else
+    {
+        slot->value = value;
+    }
 }
 
 /**
@@ -104,13 +459,480 @@ void ts_stats_set(ts_stats_t stats, int value)
  * @param stats Statistics to read
  * @return Value of statistics
  */
-int ts_stats_sum(ts_stats_t stats)
+int64_t ts_stats_sum(ts_stats_t stats)
 {
-    ss_dassert(initialized);
-    int sum = 0;
-    for (int i = 0; i < thread_count; i++)
+    TS_HEADER *header = (TS_HEADER*)stats;
+    TS_SLOT *slots = (TS_SLOT*)((char*)header + TS_HEADER_SIZE);
+    int64_t sum = 0;
+
+    for (int i = 0; i <= header->n_threads; i++)
     {
-        sum += ((int*)stats)[i];
+        sum += slots[i].value;
     }
     return sum;
 }
+
+/**
+ * Return the current time of the monotonic clock
+ *
+ * @return Time in nanoseconds
+ */
+uint64_t ts_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Find the histogram bucket of a value
+ *
+ * @param value The value
+ * @return Index of the bucket
+ */
+static inline int ts_hist_bucket(uint64_t value)
+{
+    if (value < TS_HIST_SUB_BUCKETS)
+    {
+        return (int)value;
+    }
+
+    int shift = 63 - __builtin_clzll(value) - TS_HIST_SUB_BITS;
+    return (shift + 1) * TS_HIST_SUB_BUCKETS + (int)(value >> shift) - TS_HIST_SUB_BUCKETS;
+}
+
+/**
+ * Return the largest value that is counted in a bucket
+ *
+ * @param bucket Index of the bucket
+ * @return The largest value of the bucket
+ */
+static uint64_t ts_hist_bucket_value(int bucket)
+{
+    if (bucket < TS_HIST_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    int shift = bucket / TS_HIST_SUB_BUCKETS - 1;
+    uint64_t mantissa = bucket % TS_HIST_SUB_BUCKETS + TS_HIST_SUB_BUCKETS;
+    /** For the last bucket this wraps around to UINT64_MAX */
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/**
+ * Create a new histogram
+ *
+ * @return New histogram or NULL if memory allocation failed
+ */
+ts_hist_t ts_hist_alloc()
+{
+    return ts_object_alloc(TS_HIST_STRIDE);
+}
+
+/**
+ * Create a new histogram and add it to the metric registry
+ *
+ * @param name      Name of the metric
+ * @param labels    Labels of the metric or NULL
+ * @param help      Description of the metric
+ * @return New histogram or NULL if memory allocation failed
+ */
+ts_hist_t ts_hist_register(const char *name, const char *labels, const char *help)
+{
+    TS_HEADER *header = ts_hist_alloc();
+
+    if (header && !ts_metric_add(header, name, labels, help, TS_METRIC_HISTOGRAM))
+    {
+        free(header);
+        header = NULL;
+    }
+    return header;
+}
+
+/**
+ * Free a histogram
+ *
+ * @param hist Histogram to free
+ */
+void ts_hist_free(ts_hist_t hist)
+{
+    if (hist)
+    {
+        ts_object_free((TS_HEADER*)hist);
+    }
+}
+
+/**
+ * Add a value to the part of the histogram that belongs to the current thread
+ *
+ * @param hist  Histogram to add to
+ * @param value Value to add
+ */
+void ts_hist_add(ts_hist_t hist, uint64_t value)
+{
+    bool shared;
+    TS_HIST_THREAD *data = ts_object_part((TS_HEADER*)hist, TS_HIST_STRIDE, &shared);
+
+    if (shared)
+    {
+        __sync_fetch_and_add(&data->buckets[ts_hist_bucket(value)], 1);
+        __sync_fetch_and_add(&data->count, 1);
+        __sync_fetch_and_add(&data->sum, value);
+
+        uint64_t max = data->max;
+        while (value > max && !__sync_bool_compare_and_swap(&data->max, max, value))
+        {
+            max = data->max;
+        }
+    }
+    else
+    {
+        data->buckets[ts_hist_bucket(value)]++;
+        data->count++;
+        data->sum += value;
+        if (value > data->max)
+        {
+            data->max = value;
+        }
+    }
+}
+
+/**
+ * Merge the bucket counts of all threads
+ *
+ * @param hist      Histogram to merge
+ * @param buckets   Array of TS_HIST_BUCKETS counts where the result is stored
+ * @param summary   The count, sum and maximum are stored here
+ */
+static void ts_hist_merge(ts_hist_t hist, uint64_t *buckets, ts_hist_summary_t *summary)
+{
+    TS_HEADER *header = (TS_HEADER*)hist;
+    char *parts = (char*)header + TS_HEADER_SIZE;
+
+    memset(summary, 0, sizeof(*summary));
+    memset(buckets, 0, TS_HIST_BUCKETS * sizeof(uint64_t));
+
+    for (int i = 0; i <= header->n_threads; i++)
+    {
+        TS_HIST_THREAD *data = (TS_HIST_THREAD*)(parts + i * TS_HIST_STRIDE);
+
+        for (int j = 0; j < TS_HIST_BUCKETS; j++)
+        {
+            buckets[j] += data->buckets[j];
+        }
+        summary->sum += data->sum;
+        if (data->max > summary->max)
+        {
+            summary->max = data->max;
+        }
+    }
+
+    /** The per-thread counts may be updated while they are read, the
+     * bucket totals are used so that the percentiles are consistent */
+    for (int j = 0; j < TS_HIST_BUCKETS; j++)
+    {
+        summary->count += buckets[j];
+    }
+}
+
+/**
+ * Find a percentile from merged bucket counts
+ *
+ * @param buckets       Merged bucket counts
+ * @param count         Total count
+ * @param max           Largest value
+ * @param percentile    The percentile, between 0 and 100
+ * @return The value at the percentile
+ */
+static uint64_t ts_hist_find(uint64_t *buckets, uint64_t count, uint64_t max, double percentile)
+{
+    uint64_t target = (uint64_t)(count * percentile / 100.0 + 0.5);
+    uint64_t total = 0;
+
+    if (target == 0)
+    {
+        target = 1;
+    }
+
+    for (int i = 0; i < TS_HIST_BUCKETS; i++)
+    {
+        total += buckets[i];
+        if (total >= target)
+        {
+            uint64_t value = ts_hist_bucket_value(i);
+            return value < max ? value : max;
+        }
+    }
+    return max;
+}
+
+/**
+ * Read a percentile of the histogram
+ *
+ * @param hist          Histogram to read
+ * @param percentile    The percentile, between 0 and 100
+ * @return The value at the percentile or 0 if the histogram is empty
+ */
+uint64_t ts_hist_percentile(ts_hist_t hist, double percentile)
+{
+    uint64_t buckets[TS_HIST_BUCKETS];
+    ts_hist_summary_t summary;
+
+    ts_hist_merge(hist, buckets, &summary);
+    return summary.count ? ts_hist_find(buckets, summary.count, summary.max, percentile) : 0;
+}
+
+/**
+ * Read the merged values and the common percentiles of the histogram
+ *
+ * @param hist      Histogram to read
+ * @param summary   Where the values are stored
+ */
+void ts_hist_summary(ts_hist_t hist, ts_hist_summary_t *summary)
+{
+    uint64_t buckets[TS_HIST_BUCKETS];
+
+    ts_hist_merge(hist, buckets, summary);
+
+    if (summary->count)
+    {
+        summary->p50 = ts_hist_find(buckets, summary->count, summary->max, 50.0);
+        summary->p99 = ts_hist_find(buckets, summary->count, summary->max, 99.0);
+        summary->p999 = ts_hist_find(buckets, summary->count, summary->max, 99.9);
+    }
+}
+
+/**
+ * A growing text buffer for the metric export
+ */
+typedef struct
+{
+    char   *data;
+    size_t len;
+    size_t size;
+    bool   failed;  /**< Memory allocation failed */
+} TS_TEXT;
+
+/**
+ * Append formatted text to a buffer
+ *
+ * @param text  The buffer
+ * @param fmt   printf format
+ */
+static void ts_text_append(TS_TEXT *text, const char *fmt, ...)
+{
+    va_list args;
+
+    while (!text->failed)
+    {
+        size_t avail = text->size - text->len;
+        va_start(args, fmt);
+        int n = vsnprintf(text->data ? text->data + text->len : NULL, avail, fmt, args);
+        va_end(args);
+
+        if (n < 0)
+        {
+            text->failed = true;
+        }
+        else if ((size_t)n < avail)
+        {
+            text->len += n;
+            break;
+        }
+        else
+        {
+            size_t size = text->size ? text->size * 2 : 16384;
+            while (size - text->len <= (size_t)n)
+            {
+                size *= 2;
+            }
+            char *data = realloc(text->data, size);
+            if (data)
+            {
+                text->data = data;
+                text->size = size;
+            }
+            else
+            {
+                text->failed = true;
+            }
+        }
+    }
+}
+
+/**
+ * A metric copied from the registry by an export. The labels can change
+ * during the export so the pointer to them is copied as well.
+ */
+typedef struct
+{
+    const TS_METRIC *metric;
+    const char      *labels;
+} TS_SAMPLE;
+
+/**
+ * Order the metrics by name so that the samples of a metric are together
+ */
+static int ts_metric_cmp(const void *a, const void *b)
+{
+    const TS_SAMPLE *s1 = a;
+    const TS_SAMPLE *s2 = b;
+    int rval = strcmp(s1->metric->name, s2->metric->name);
+
+    if (rval == 0)
+    {
+        rval = strcmp(s1->labels ? s1->labels : "", s2->labels ? s2->labels : "");
+    }
+    return rval;
+}
+
+/**
+ * Append the samples of one metric
+ *
+ * @param text      The buffer
+ * @param sample    The metric
+ */
+static void ts_metric_append(TS_TEXT *text, const TS_SAMPLE *sample)
+{
+    const TS_METRIC *metric = sample->metric;
+    /** Metrics without labels are written without the braces */
+    const char *open = sample->labels ? "{" : "";
+    const char *labels = sample->labels ? sample->labels : "";
+    const char *close = sample->labels ? "}" : "";
+    const char *sep = sample->labels ? "," : "";
+
+    if (metric->type == TS_METRIC_HISTOGRAM)
+    {
+        ts_hist_summary_t sum;
+
+        ts_hist_summary(metric->data, &sum);
+        ts_text_append(text, "%s{%s%squantile=\"0.5\"} %" PRIu64 "\n",
+                       metric->name, labels, sep, sum.p50);
+        ts_text_append(text, "%s{%s%squantile=\"0.99\"} %" PRIu64 "\n",
+                       metric->name, labels, sep, sum.p99);
+        ts_text_append(text, "%s{%s%squantile=\"0.999\"} %" PRIu64 "\n",
+                       metric->name, labels, sep, sum.p999);
+        ts_text_append(text, "%s_sum%s%s%s %" PRIu64 "\n", metric->name, open, labels, close, sum.sum);
+        ts_text_append(text, "%s_count%s%s%s %" PRIu64 "\n", metric->name, open, labels, close, sum.count);
+    }
+    else
+    {
+        ts_text_append(text, "%s%s%s%s %" PRId64 "\n", metric->name, open, labels, close,
+                       ts_stats_sum(metric->data));
+    }
+}
+
+/**
+ * Format the registered metrics in the Prometheus text exposition format
+ *
+ * The registry is locked only while the metrics are copied. The values are
+ * read from the per-thread slots of the metrics and the text is formatted
+ * after the lock is released, the metrics freed meanwhile are kept until the
+ * export finishes. The histograms are exported as summaries of their 50th,
+ * 99th and 99.9th percentiles.
+ *
+ * @param len   The length of the text is stored here
+ * @return The text which must be freed by the caller or NULL if memory
+ * allocation failed
+ */
+char *ts_metric_export(size_t *len)
+{
+    static const char *type_names[] = {"counter", "gauge", "summary"};
+    TS_TEXT text = {NULL, 0, 0, false};
+    TS_SAMPLE *sorted = NULL;
+    TS_METRIC *metric;
+    int size = 0;
+    int n;
+
+    spinlock_acquire(&metrics_lock);
+    while (true)
+    {
+        n = 0;
+        for (metric = metrics; metric; metric = metric->next)
+        {
+            n++;
+        }
+        if (n <= size)
+        {
+            break;
+        }
+
+        /** The array is allocated without the lock, the registry can grow meanwhile */
+        spinlock_release(&metrics_lock);
+        free(sorted);
+        size = n;
+        sorted = malloc(size * sizeof(TS_SAMPLE));
+        spinlock_acquire(&metrics_lock);
+
+        if (sorted == NULL)
+        {
+            text.failed = true;
+            n = 0;
+            break;
+        }
+    }
+
+    n = 0;
+    for (metric = metrics; metric && !text.failed; metric = metric->next)
+    {
+        sorted[n].metric = metric;
+        sorted[n].labels = metric->labels;
+        n++;
+    }
+    n_exports++;
+    spinlock_release(&metrics_lock);
+
+    qsort(sorted, n, sizeof(TS_SAMPLE), ts_metric_cmp);
+
+    /** Even an empty export is a valid document */
+    ts_text_append(&text, "");
+    for (int i = 0; i < n; i++)
+    {
+        const TS_METRIC *m = sorted[i].metric;
+
+        if (i == 0 || strcmp(sorted[i - 1].metric->name, m->name))
+        {
+            ts_text_append(&text, "# HELP %s %s\n# TYPE %s %s\n", m->name,
+                           m->help, m->name, type_names[m->type]);
+        }
+        ts_metric_append(&text, &sorted[i]);
+    }
+
+    free(sorted);
+
+    spinlock_acquire(&metrics_lock);
+    TS_METRIC *retired = NULL;
+    TS_RETIRED *labels = NULL;
+    if (--n_exports == 0)
+    {
+        retired = retired_metrics;
+        labels = retired_labels;
+        retired_metrics = NULL;
+        retired_labels = NULL;
+    }
+    spinlock_release(&metrics_lock);
+
+    while (retired)
+    {
+        metric = retired;
+        retired = retired->next;
+        ts_metric_free(metric);
+    }
+    while (labels)
+    {
+        TS_RETIRED *next = labels->next;
+        free(labels->ptr);
+        free(labels);
+        labels = next;
+    }
+
+    if (text.failed)
+    {
+        free(text.data);
+        return NULL;
+    }
+
+    *len = text.len;
+    return text.data;
+}
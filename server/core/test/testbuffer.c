@@ -314,6 +314,62 @@ void test_consume()
     consume_buffer(n_buffers - 1, -1);
 }
 
+/**
+ * Test the pooling of the buffers
+ */
+void test_pools()
+{
+    GWBUF *buffers[500];
+    GWBUF *buffer, *clone;
+    void *header;
+
+    ss_dfprintf(stderr, "testbuffer : buffer pools");
+    ss_info_dassert(gwbuf_arena_init(1), "The arena should be created");
+
+    /** A freed block is reused by the next allocation of the same class */
+    buffer = gwbuf_alloc(100);
+    header = buffer;
+    ss_info_dassert(buffer->sbuf->data == (unsigned char *)(buffer->sbuf + 1),
+                    "Data should follow the shared buffer");
+    gwbuf_free(buffer);
+    buffer = gwbuf_alloc(150);
+    ss_info_dassert(buffer == header, "The freed block should be reused");
+
+    /** The data stays valid while a clone refers to it */
+    memset(GWBUF_DATA(buffer), 'a', 150);
+    clone = gwbuf_consume(gwbuf_clone(buffer), 50);
+    gwbuf_add_property(buffer, "name", "value");
+    gwbuf_free(buffer);
+    ss_info_dassert(clone->properties == NULL && clone->hint == NULL,
+                    "A clone should not have properties or hints");
+    ss_info_dassert(GWBUF_LENGTH(clone) == 100 && ((char *)GWBUF_DATA(clone))[99] == 'a',
+                    "The data should still be readable through the clone");
+    buffer = gwbuf_alloc(100);
+    ss_info_dassert(buffer != header, "The block should not be reused while it is referenced");
+    gwbuf_free(clone);
+    gwbuf_free(buffer);
+
+    /** Go past the thread cache so that blocks move through the depot */
+    for (int size = 10; size <= 200000; size *= 10)
+    {
+        for (int i = 0; i < 500; i++)
+        {
+            buffers[i] = gwbuf_alloc(size);
+            ss_info_dassert(buffers[i] && GWBUF_LENGTH(buffers[i]) == size,
+                            "Allocation should succeed");
+            memset(GWBUF_DATA(buffers[i]), i, size);
+        }
+        for (int i = 0; i < 500; i++)
+        {
+            ss_info_dassert(((uint8_t *)GWBUF_DATA(buffers[i]))[size - 1] == (uint8_t)i,
+                            "Buffers should not overlap");
+            gwbuf_free(buffers[i]);
+        }
+    }
+
+    ss_dfprintf(stderr, "	..done\n");
+}
+
 /**
  * test1    Allocate a buffer and do lots of things
  *
@@ -441,6 +497,7 @@ test1()
     test_split();
     test_load_and_copy();
     test_consume();
+    test_pools();
 
     return 0;
 }
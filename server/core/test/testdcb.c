@@ -32,8 +32,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
 #include <listener.h>
+#include <session.h>
 #include <dcb.h>
+#include <service.h>
+#include <membudget.h>
 
 /**
  * test1    Allocate a dcb and do lots of other things
@@ -77,11 +83,429 @@ test1()
     return 0;
 }
 
+/**
+ * test2    Drain a long chain of buffers through a socket that accepts only
+ *          part of it at a time
+ */
+static int
+test2()
+{
+    DCB     *dcb;
+    SERV_LISTENER dummy;
+    int     fds[2];
+    int     sndbuf = 4096;
+    int     n_buffers = 500;
+    int     bufsize = 1000;
+    int     total = n_buffers * bufsize;
+    int     received = 0;
+    int     drains = 0;
+    char    *data = malloc(total);
+
+    ss_dfprintf(stderr, "testdcb : draining %d buffers with partial writes", n_buffers);
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "Socket pair should be created");
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    dcb = dcb_alloc(DCB_ROLE_SERVICE_LISTENER, &dummy);
+    dcb->fd = fds[0];
+
+    for (int i = 0; i < n_buffers; i++)
+    {
+        GWBUF *buf = gwbuf_alloc(bufsize);
+
+        for (int j = 0; j < bufsize; j++)
+        {
+            ((char *)GWBUF_DATA(buf))[j] = (i * bufsize + j) % 251;
+        }
+        dcb->writeq = gwbuf_append(dcb->writeq, buf);
+    }
+    dcb->writeqlen = total;
+
+    while (received < total)
+    {
+        int n;
+
+        dcb_drain_writeq(dcb);
+        drains++;
+
+        while ((n = read(fds[1], data + received, total - received)) > 0)
+        {
+            received += n;
+        }
+        ss_info_dassert(drains < total, "Draining should make progress");
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        ss_info_dassert(data[i] == (char)(i % 251), "Data should arrive in order");
+    }
+    ss_info_dassert(dcb->writeq == NULL && dcb->writeqlen == 0, "The write queue should be empty");
+    ss_info_dassert(drains < n_buffers, "Several buffers should be sent with one write");
+    ss_dfprintf(stderr, "\t..done in %d drains\n", drains);
+
+    dcb->fd = DCBFD_CLOSED;
+    dcb_close(dcb);
+    close(fds[0]);
+    close(fds[1]);
+    free(data);
+
+    return 0;
+}
+
+/**
+ * test3    Splice data between two connections and fall back to the normal
+ *          path when one of them is closed
+ */
+static int
+test3()
+{
+    DCB     *client, *backend;
+    SERV_LISTENER dummy;
+    int     cfds[2], bfds[2];
+    char    buf[100];
+
+    ss_dfprintf(stderr, "testdcb : splicing two connections");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, cfds) == 0, "Socket pair should be created");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, bfds) == 0, "Socket pair should be created");
+    fcntl(cfds[0], F_SETFL, fcntl(cfds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(bfds[0], F_SETFL, fcntl(bfds[0], F_GETFL) | O_NONBLOCK);
+
+    client = dcb_alloc(DCB_ROLE_SERVICE_LISTENER, &dummy);
+    backend = dcb_alloc(DCB_ROLE_SERVICE_LISTENER, &dummy);
+    client->fd = cfds[0];
+    backend->fd = bfds[0];
+    client->state = DCB_STATE_POLLING;
+    backend->state = DCB_STATE_POLLING;
+
+    ss_info_dassert(dcb_splice_start(client, backend), "Splicing should start");
+    ss_info_dassert(!dcb_splice_start(client, backend), "A spliced DCB should not be spliced again");
+
+    ss_info_dassert(write(cfds[1], "query", 5) == 5, "Client should write");
+    ss_info_dassert(dcb_splice_read(client), "The splice should handle the read");
+    ss_info_dassert(read(bfds[1], buf, sizeof(buf)) == 5 && memcmp(buf, "query", 5) == 0,
+                    "The backend should receive the query");
+
+    ss_info_dassert(write(bfds[1], "result", 6) == 6, "Backend should write");
+    ss_info_dassert(dcb_splice_read(backend), "The splice should handle the read");
+    ss_info_dassert(read(cfds[1], buf, sizeof(buf)) == 6 && memcmp(buf, "result", 6) == 0,
+                    "The client should receive the result");
+    ss_info_dassert(client->splice->bytes[0] == 5 && client->splice->bytes[1] == 6,
+                    "The spliced bytes should be counted");
+
+    close(cfds[1]);
+    ss_info_dassert(!dcb_splice_read(client), "A closed connection should go to the normal path");
+    ss_info_dassert(!client->splice->active, "The splice should have stopped");
+    ss_info_dassert(!dcb_splice_read(backend), "A stopped splice should not handle reads");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    client->state = DCB_STATE_ALLOC;
+    backend->state = DCB_STATE_ALLOC;
+    client->fd = DCBFD_CLOSED;
+    backend->fd = DCBFD_CLOSED;
+    dcb_close(client);
+    dcb_close(backend);
+    close(cfds[0]);
+    close(bfds[0]);
+    close(bfds[1]);
+
+    return 0;
+}
+
+/**
+ * test4    Read into the receive region of a DCB
+ */
+static int
+test4()
+{
+    DCB     *dcb;
+    SERV_LISTENER dummy;
+    GWBUF   *head = NULL;
+    int     fds[2];
+    int     size = 100000;
+    char    *data = malloc(size);
+    char    *copy = malloc(size);
+    void    *first;
+
+    ss_dfprintf(stderr, "testdcb : reading into the receive region");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "Socket pair should be created");
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    dcb = dcb_alloc(DCB_ROLE_SERVICE_LISTENER, &dummy);
+    dcb->fd = fds[0];
+
+    /** Small reads are slices of the region and the region is reused */
+    ss_info_dassert(write(fds[1], "select 1", 8) == 8, "Write should work");
+    ss_info_dassert(dcb_read(dcb, &head, 0) == 8, "Eight bytes should be read");
+    ss_info_dassert(memcmp(GWBUF_DATA(head), "select 1", 8) == 0, "Data should be read");
+    ss_info_dassert(head->sbuf == dcb->recv_region->sbuf, "The data should be in the region");
+    first = GWBUF_DATA(head);
+
+    ss_info_dassert(write(fds[1], "select 2", 8) == 8, "Write should work");
+    ss_info_dassert(dcb_read(dcb, &head, 0) == 8, "Eight bytes should be read");
+    ss_info_dassert(gwbuf_length(head) == 16 && GWBUF_DATA(head->next) == (char *)first + 8,
+                    "A referenced region should not be reused");
+    gwbuf_free(head);
+    head = NULL;
+
+    ss_info_dassert(write(fds[1], "select 3", 8) == 8, "Write should work");
+    ss_info_dassert(dcb_read(dcb, &head, 0) == 8, "Eight bytes should be read");
+    ss_info_dassert(GWBUF_DATA(head) == first, "A free region should be reused from the start");
+    gwbuf_free(head);
+    head = NULL;
+
+    /** More data than fits in the region */
+    for (int i = 0; i < size; i++)
+    {
+        data[i] = i % 253;
+    }
+
+    int written = 0;
+    int received = 0;
+
+    while (received < size)
+    {
+        int n = write(fds[1], data + written, size - written);
+        if (n > 0)
+        {
+            written += n;
+        }
+        n = dcb_read(dcb, &head, 0);
+        ss_info_dassert(n >= 0, "Read should not fail");
+        received += n;
+    }
+
+    ss_info_dassert(gwbuf_length(head) == size, "All data should be read");
+    gwbuf_copy_data(head, 0, size, (uint8_t *)copy);
+    ss_info_dassert(memcmp(data, copy, size) == 0, "Data should be read in order");
+    gwbuf_free(head);
+    ss_dfprintf(stderr, "\t..done\n");
+
+    dcb->fd = DCBFD_CLOSED;
+    dcb_close(dcb);
+    close(fds[0]);
+    close(fds[1]);
+    free(data);
+    free(copy);
+
+    return 0;
+}
+
+/**
+ * test5    A closed DCB is freed only after every polling thread has passed
+ *          a quiescent point and its memory is then reused
+ */
+static int
+test5()
+{
+    DCB     *dcb;
+    SERV_LISTENER dummy;
+
+    ss_dfprintf(stderr, "testdcb : epoch based reclamation with two threads");
+    dcb_epoch_init(2);
+    dcb = dcb_alloc(DCB_ROLE_SERVICE_LISTENER, &dummy);
+    dcb->state = DCB_STATE_NOPOLLING;
+    dcb_close(dcb);
+    ss_info_dassert(dcb->dcb_is_zombie, "Closed DCB must be a zombie");
+
+    dcb_process_zombies(0);
+    ss_info_dassert(dcb_isvalid(dcb), "DCB must not be freed before thread 1 passes a quiescent point");
+    ss_info_dassert(dcb_get_zombies() == dcb, "DCB must still be a zombie");
+
+    dcb_process_zombies(1);
+    ss_info_dassert(!dcb_isvalid(dcb), "DCB must be freed when both threads have passed");
+    ss_info_dassert(dcb_get_zombies() == NULL, "No zombies must remain");
+
+    ss_info_dassert(dcb_alloc(DCB_ROLE_SERVICE_LISTENER, &dummy) == dcb, "Freed DCB must be reused");
+    ss_info_dassert(dcb_isvalid(dcb), "Reused DCB must be valid");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+/**
+ * test6    The reads of a backend DCB are paused while the write queue of the
+ *          client DCB is over the high water mark and resumed when it drains
+ */
+static int
+test6()
+{
+    DCB     *client, *backend;
+    SESSION session;
+    SERV_LISTENER dummy;
+    int     fds[2];
+    char    data[1000];
+
+    ss_dfprintf(stderr, "testdcb : pausing the backend reads of a slow client");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "Socket pair should be created");
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    memset(&session, 0, sizeof(session));
+    client = dcb_alloc(DCB_ROLE_CLIENT_HANDLER, &dummy);
+    client->fd = fds[0];
+    client->state = DCB_STATE_POLLING;
+    client->high_water = 500;
+    client->low_water = 100;
+    session.client_dcb = client;
+
+    backend = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, &dummy);
+    backend->session = &session;
+    backend->state = DCB_STATE_NOPOLLING;
+
+    client->writeq = gwbuf_alloc(sizeof(data));
+    client->writeqlen = sizeof(data);
+    ss_info_dassert(dcb_throttle_reads(backend), "Reads must be paused over the high water mark");
+    ss_info_dassert(client->throttled == backend && backend->throttled_by == client,
+                    "Backend must be paused by the client");
+    ss_info_dassert(dcb_throttle_reads(backend), "Reads must stay paused");
+
+    dcb_drain_writeq(client);
+    ss_info_dassert(client->writeqlen == 0, "The write queue should be drained");
+    ss_info_dassert(client->throttled == NULL && backend->throttled_by == NULL,
+                    "Reads must be resumed below the low water mark");
+    ss_info_dassert(!dcb_throttle_reads(backend), "Reads must not be paused below the high water mark");
+    ss_info_dassert(read(fds[1], data, sizeof(data)) == sizeof(data), "Data should be received");
+
+    client->writeq = gwbuf_alloc(sizeof(data));
+    client->writeqlen = sizeof(data);
+    ss_info_dassert(dcb_throttle_reads(backend), "Reads must be paused again");
+    dcb_close(backend);
+    ss_info_dassert(client->throttled == NULL, "A closed backend must not stay paused");
+    ss_info_dassert(backend->stats.n_throttled == 2, "Both pauses must be counted");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    gwbuf_free(client->writeq);
+    client->writeq = NULL;
+    client->writeqlen = 0;
+    client->state = DCB_STATE_NOPOLLING;
+    client->fd = DCBFD_CLOSED;
+    dcb_close(client);
+    dcb_process_zombies(0);
+    dcb_process_zombies(1);
+    close(fds[0]);
+    close(fds[1]);
+
+    return 0;
+}
+
+/**
+ * test7    Queued data is charged to the service and the session, the session
+ *          with the longest client write queue stops reading when the write
+ *          queues take more than their share of the budget until its client
+ *          has drained the queue and the charges of a freed DCB are released
+ */
+static int
+test7()
+{
+    DCB     *client, *backend;
+    SESSION session;
+    SERVICE service;
+    SERV_LISTENER dummy;
+    int     fds[2];
+    char    data[700];
+
+    ss_dfprintf(stderr, "testdcb : buffered data budget");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "Socket pair should be created");
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    membudget_init(2, 1000);
+    /** The earlier tests drained write queues that were not charged */
+    membudget_add(MEMBUDGET_WRITEQ, NULL, -membudget_kind_total(MEMBUDGET_WRITEQ));
+
+    memset(&session, 0, sizeof(session));
+    memset(&service, 0, sizeof(service));
+    session.state = SESSION_STATE_ROUTER_READY;
+    session.service = &service;
+    client = dcb_alloc(DCB_ROLE_CLIENT_HANDLER, &dummy);
+    client->session = &session;
+    client->fd = fds[0];
+    client->state = DCB_STATE_POLLING;
+    client->low_water = 100;
+    session.client_dcb = client;
+    backend = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, &dummy);
+    backend->session = &session;
+    backend->state = DCB_STATE_NOPOLLING;
+
+    /** Session command history that stays until the session is closed */
+    session_buffered_add(&session, MEMBUDGET_SESCMD, 1200);
+    ss_info_dassert(membudget_exceeded(), "The budget must be exceeded");
+    ss_info_dassert(session.buffered == 1200, "The history must be charged to the session");
+    ss_info_dassert(!membudget_kind_exceeded(MEMBUDGET_WRITEQ),
+                    "The history must not make the write queues exceed their share");
+    ss_info_dassert(!dcb_throttle_reads(client) && !dcb_throttle_reads(backend),
+                    "Data that draining the client does not free must not pause the reads");
+
+    client->writeq = gwbuf_alloc(sizeof(data));
+    client->writeqlen = sizeof(data);
+    dcb_buffered_add(client, MEMBUDGET_WRITEQ, sizeof(data));
+    dcb_buffered_add(backend, MEMBUDGET_DELAYQ, 500);
+    ss_info_dassert(membudget_total() == 2400 && membudget_kind_total(MEMBUDGET_DELAYQ) == 500,
+                    "The data must be counted per subsystem");
+    ss_info_dassert(service.buffered[MEMBUDGET_WRITEQ] == 700 && service.buffered[MEMBUDGET_DELAYQ] == 500,
+                    "The data must be charged to the service");
+    ss_info_dassert(session.buffered == 2400, "The data must be charged to the session");
+    ss_info_dassert(dcb_writeq_client_count() == 1, "Only the client write queue must be counted");
+    ss_info_dassert(membudget_kind_exceeded(MEMBUDGET_WRITEQ), "The write queues must exceed their share");
+
+    ss_info_dassert(dcb_throttle_reads(client), "The heaviest client must stop reading");
+    ss_info_dassert(dcb_throttle_reads(backend), "The backend must stop reading");
+    ss_info_dassert(client->throttled_by == client && backend->throttled_by == client,
+                    "The reads must be paused by the client");
+    ss_info_dassert(dcb_throttle_reads(client), "Reads must stay paused");
+
+    dcb_drain_writeq(client);
+    ss_info_dassert(client->writeqlen == 0, "The write queue should be drained");
+    ss_info_dassert(read(fds[1], data, sizeof(data)) == sizeof(data), "Data should be received");
+    ss_info_dassert(membudget_exceeded(), "The history must keep the budget exceeded");
+    ss_info_dassert(client->throttled == NULL && client->throttled_by == NULL &&
+                    backend->throttled_by == NULL,
+                    "Reads must be resumed when the client has drained its write queue");
+    ss_info_dassert(!dcb_throttle_reads(client), "An empty write queue must not pause the reads");
+    ss_info_dassert(dcb_writeq_client_count() == 0, "A drained client must not be counted");
+
+    /** Within the share of the write queues while the history keeps the budget exceeded */
+    client->writeq = gwbuf_alloc(200);
+    client->writeqlen = 200;
+    dcb_buffered_add(client, MEMBUDGET_WRITEQ, 200);
+    ss_info_dassert(membudget_exceeded() && !membudget_kind_exceeded(MEMBUDGET_WRITEQ),
+                    "A short write queue must stay within its share");
+    ss_info_dassert(!dcb_throttle_reads(client), "A short write queue must not pause the reads");
+    dcb_drain_writeq(client);
+    ss_info_dassert(read(fds[1], data, 200) == 200, "Data should be received");
+    ss_info_dassert(dcb_writeq_client_count() == 0, "A drained client must not be counted");
+    ss_info_dassert(client->stats.n_throttled == 1 && backend->stats.n_throttled == 1,
+                    "The pauses must be counted");
+
+    dcb_close(backend);
+    dcb_process_zombies(0);
+    dcb_process_zombies(1);
+    ss_info_dassert(membudget_kind_total(MEMBUDGET_DELAYQ) == 0 && service.buffered[MEMBUDGET_DELAYQ] == 0,
+                    "The charges of a freed DCB must be released");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    session_buffered_add(&session, MEMBUDGET_SESCMD, -1200);
+    client->state = DCB_STATE_NOPOLLING;
+    client->fd = DCBFD_CLOSED;
+    dcb_close(client);
+    dcb_process_zombies(0);
+    dcb_process_zombies(1);
+    close(fds[0]);
+    close(fds[1]);
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int result = 0;
 
     result += test1();
+    result += test2();
+    result += test3();
+    result += test4();
+    result += test5();
+    result += test6();
+    result += test7();
 
     exit(result);
 }
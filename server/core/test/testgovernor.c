@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testgovernor.c - Tests for the busy-poll governor
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <governor.h>
+#include <skygw_debug.h>
+
+/**
+ * Simulate idle periods of a fixed length that end while spinning
+ *
+ * @param gov   The governor
+ * @param now   Current time, advanced by the simulation
+ * @param gap   Length of the idle periods in nanoseconds
+ * @param n     Number of idle periods
+ */
+static void
+simulate(POLL_GOVERNOR *gov, uint64_t *now, uint64_t gap, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        *now += 1000;
+        governor_spin(gov, *now, 0);
+        *now += gap;
+        governor_wake(gov, *now);
+    }
+}
+
+/**
+ * Test the efficiency mode
+ *
+ * @return 0 on success
+ */
+static int
+test1()
+{
+    POLL_GOVERNOR gov;
+    uint64_t now = 1000000;
+
+    ss_dfprintf(stderr, "testgovernor : efficiency mode");
+    governor_init(&gov, GOVERNOR_EFFICIENCY, now);
+    ss_info_dassert(governor_spin_budget(&gov) == 0, "Should not spin before anything is measured");
+    ss_info_dassert(governor_spin(&gov, now, 3), "Minimum number of spins should be done");
+    ss_info_dassert(governor_spin(&gov, now, 3), "Minimum number of spins should be done");
+    ss_info_dassert(governor_spin(&gov, now, 3), "Minimum number of spins should be done");
+    ss_info_dassert(!governor_spin(&gov, now, 3), "Should block after the minimum spins");
+    governor_wake(&gov, now + 1000);
+
+    simulate(&gov, &now, 5000, 100);
+    ss_info_dassert(governor_gap(&gov) > 4000 && governor_gap(&gov) < 6000,
+                    "Typical gap should be close to 5us");
+    ss_info_dassert(governor_spin_budget(&gov) > 0, "Should spin through short gaps");
+    ss_info_dassert(governor_spin(&gov, now, 0), "Should spin at the start of an idle period");
+    ss_info_dassert(!governor_spin(&gov, now + GOVERNOR_WAKEUP_NS, 0),
+                    "Should block after the spin budget");
+    governor_wake(&gov, now + GOVERNOR_WAKEUP_NS);
+
+    /** One long pause must not stop the spinning */
+    simulate(&gov, &now, 1000000000, 1);
+    ss_info_dassert(governor_spin_budget(&gov) > 0, "A single long gap should not stop spinning");
+
+    simulate(&gov, &now, 1000000, 100);
+    ss_info_dassert(governor_spin_budget(&gov) == 0, "Should not spin through long gaps");
+    ss_dfprintf(stderr, "\t..done\n");
+    return 0;
+}
+
+/**
+ * Test the latency mode
+ *
+ * @return 0 on success
+ */
+static int
+test2()
+{
+    POLL_GOVERNOR gov;
+    uint64_t now = 1000000;
+
+    ss_dfprintf(stderr, "testgovernor : latency mode");
+    governor_init(&gov, GOVERNOR_LATENCY, now);
+    ss_info_dassert(governor_spin_budget(&gov) == GOVERNOR_MAX_SPIN_NS,
+                    "Spin budget should be capped");
+
+    simulate(&gov, &now, 100000, 100);
+    ss_info_dassert(governor_spin_budget(&gov) > 150000 && governor_spin_budget(&gov) < 250000,
+                    "Should spin for about twice the typical gap");
+    ss_info_dassert(governor_spin(&gov, now, 0), "Should spin at the start of an idle period");
+    ss_info_dassert(governor_spin(&gov, now + 100000, 0), "Should spin through a typical gap");
+    ss_info_dassert(!governor_spin(&gov, now + 300000, 0), "Should block after the spin budget");
+    governor_wake(&gov, now + 300000);
+
+    simulate(&gov, &now, 100, 100);
+    ss_info_dassert(governor_spin_budget(&gov) == GOVERNOR_WAKEUP_NS,
+                    "Should spin at least for the cost of a wakeup");
+    ss_dfprintf(stderr, "\t..done\n");
+    return 0;
+}
+
+/**
+ * Test the blocking timeouts and the time accounting
+ *
+ * @return 0 on success
+ */
+static int
+test3()
+{
+    POLL_GOVERNOR gov;
+    uint64_t now = 1000000;
+
+    ss_dfprintf(stderr, "testgovernor : timeouts and accounting");
+    governor_init(&gov, GOVERNOR_EFFICIENCY, now);
+
+    now += 1000;
+    governor_spin(&gov, now, 0);
+    now += 2000;
+    ss_info_dassert(governor_block(&gov, now, 1000) == 100, "First timeout should be a tenth");
+    governor_timed_out(&gov, 1000);
+    ss_info_dassert(governor_block(&gov, now, 1000) == 200, "Timeout should double");
+    governor_timed_out(&gov, 1000);
+    governor_timed_out(&gov, 1000);
+    governor_timed_out(&gov, 1000);
+    ss_info_dassert(governor_block(&gov, now, 1000) == 1000, "Timeout should be capped");
+    now += 4000;
+    governor_wake(&gov, now);
+    ss_info_dassert(governor_block(&gov, now, 1000) == 100, "Timeout should be reset by work");
+    governor_wake(&gov, now);
+    ss_info_dassert(governor_block(&gov, now, 5) == 5, "Short poll_sleep should be used as is");
+    governor_wake(&gov, now);
+
+    ss_info_dassert(gov.work_ns == 1000, "Work time should be accounted");
+    ss_info_dassert(gov.spin_ns == 2000, "Spin time should be accounted");
+    ss_info_dassert(gov.block_ns == 4000, "Block time should be accounted");
+    ss_info_dassert(gov.n_block_wakeups == 3, "Wakeups from blocking should be counted");
+    ss_info_dassert(gov.n_spin_wakeups == 0, "No wakeups from spinning");
+    ss_dfprintf(stderr, "\t..done\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    result += test1();
+    result += test2();
+    result += test3();
+
+    exit(result);
+}
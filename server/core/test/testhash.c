@@ -40,22 +40,13 @@
 static void
 read_lock(HASHTABLE *table)
 {
-    spinlock_acquire(&table->spin);
-    while (table->writelock)
-    {
-        spinlock_release(&table->spin);
-        while (table->writelock)
-            ;
-        spinlock_acquire(&table->spin);
-    }
-    table->n_readers++;
-    spinlock_release(&table->spin);
+    rwlock_read_acquire(&table->lock);
 }
 
 static void
 read_unlock(HASHTABLE *table)
 {
-    atomic_add(&table->n_readers, -1);
+    rwlock_read_release(&table->lock);
 }
 
 static int hfun(void* key);
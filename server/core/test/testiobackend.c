@@ -0,0 +1,615 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testiobackend.c - Loopback benchmark of the network I/O backends
+ *
+ * A client thread sends small requests over loopback TCP connections and a
+ * server answers each one with a larger reply. The server is run once with
+ * epoll, FIONREAD, read and write like dcb_read and dcb_drain_writeq do and
+ * once with multishot io_uring receives and batched sends. The replies are
+ * checked and the throughput and the system calls of the server per query
+ * are reported.
+ *
+ * The io_uring backend of the polling threads is then tested with a DCB that
+ * echoes what it reads: the data is read and written through the rings, a
+ * hangup of the peer closes the DCB and a DCB closed while a send is in
+ * flight is only freed when the kernel has completed the cancelled requests.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <uring.h>
+#include <statistics.h>
+#include <thread.h>
+#include <skygw_debug.h>
+#include <maxconfig.h>
+#include <maxscale/poll.h>
+#include <dcb.h>
+#include <session.h>
+#include <log_manager.h>
+#include <maxscale_test.h>
+
+#define CONNECTIONS 16
+#define ROUNDS      5000
+#define REQ_SIZE    64
+#define REPLY_SIZE  256
+#define QUERIES     (CONNECTIONS * ROUNDS)
+#define POLL_THREADS    2
+#define ECHO_SIZE       (1024 * 1024)
+#define INFLIGHT_SIZE   (8 * 1024 * 1024)
+#define WAIT_MS         10000
+
+static int client_fds[CONNECTIONS];
+static int server_fds[CONNECTIONS];
+static char reply[REPLY_SIZE];
+static int client_errors;
+
+/**
+ * Create the connected pairs of loopback sockets
+ */
+static void
+connect_pairs()
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int one = 1;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ss_info_dassert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0, "bind should work");
+    ss_info_dassert(listen(listener, CONNECTIONS) == 0, "listen should work");
+    getsockname(listener, (struct sockaddr *)&addr, &len);
+
+    for (int i = 0; i < CONNECTIONS; i++)
+    {
+        client_fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        ss_info_dassert(connect(client_fds[i], (struct sockaddr *)&addr, sizeof(addr)) == 0,
+                        "connect should work");
+        server_fds[i] = accept(listener, NULL, NULL);
+        ss_info_dassert(server_fds[i] >= 0, "accept should work");
+        setsockopt(client_fds[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(server_fds[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(server_fds[i], F_SETFL, fcntl(server_fds[i], F_GETFL) | O_NONBLOCK);
+    }
+    close(listener);
+}
+
+static void
+close_pairs()
+{
+    for (int i = 0; i < CONNECTIONS; i++)
+    {
+        close(client_fds[i]);
+        close(server_fds[i]);
+    }
+}
+
+/**
+ * The client: each round sends one request on every connection and then
+ * reads all the replies
+ */
+static void
+client(void *arg)
+{
+    char req[REQ_SIZE];
+    char buf[REPLY_SIZE];
+
+    memset(req, 'q', sizeof(req));
+
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        for (int i = 0; i < CONNECTIONS; i++)
+        {
+            if (write(client_fds[i], req, sizeof(req)) != sizeof(req))
+            {
+                client_errors++;
+            }
+        }
+        for (int i = 0; i < CONNECTIONS; i++)
+        {
+            int got = 0;
+
+            while (got < REPLY_SIZE)
+            {
+                int n = read(client_fds[i], buf + got, REPLY_SIZE - got);
+                if (n <= 0)
+                {
+                    client_errors++;
+                    return;
+                }
+                got += n;
+            }
+            if (memcmp(buf, reply, REPLY_SIZE) != 0)
+            {
+                client_errors++;
+            }
+        }
+    }
+}
+
+static void
+report(const char *name, uint64_t start, uint64_t syscalls)
+{
+    double secs = (ts_clock_ns() - start) / 1e9;
+
+    ss_dfprintf(stderr, "\n\t%-8s %10.0f queries/s %6.2f syscalls/query",
+                name, QUERIES / secs, (double)syscalls / QUERIES);
+}
+
+/**
+ * Serve the queries with epoll and read/write
+ *
+ * @return 0 on success
+ */
+static int
+test_epoll()
+{
+    struct epoll_event ev, events[CONNECTIONS];
+    int received[CONNECTIONS] = {0};
+    char buf[REQ_SIZE * 16];
+    uint64_t syscalls = 0;
+    int done = 0;
+    THREAD thr;
+    int epfd = epoll_create(CONNECTIONS);
+
+    for (int i = 0; i < CONNECTIONS; i++)
+    {
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, server_fds[i], &ev);
+    }
+
+    uint64_t start = ts_clock_ns();
+    thread_start(&thr, client, NULL);
+
+    while (done < QUERIES)
+    {
+        int nfds = epoll_wait(epfd, events, CONNECTIONS, -1);
+        syscalls++;
+
+        for (int e = 0; e < nfds; e++)
+        {
+            int i = events[e].data.u32;
+            int avail;
+
+            /** Read like dcb_read: ask for the amount of data until there is none */
+            while (syscalls++, ioctl(server_fds[i], FIONREAD, &avail) == 0 && avail > 0)
+            {
+                int n = read(server_fds[i], buf, avail < sizeof(buf) ? avail : sizeof(buf));
+                syscalls++;
+                if (n <= 0)
+                {
+                    break;
+                }
+                received[i] += n;
+            }
+
+            /** Each reply is written separately like dcb_write does */
+            for (; received[i] >= REQ_SIZE; received[i] -= REQ_SIZE)
+            {
+                ss_info_dassert(write(server_fds[i], reply, REPLY_SIZE) == REPLY_SIZE,
+                                "Reply should be written");
+                syscalls++;
+                done++;
+            }
+        }
+    }
+
+    thread_wait(thr);
+    report("epoll", start, syscalls);
+    close(epfd);
+    ss_info_dassert(client_errors == 0, "Client should receive the replies");
+    return 0;
+}
+
+#ifdef HAVE_IO_URING
+
+#define TAG_RECV 0
+#define TAG_SEND 1
+
+typedef struct
+{
+    int           received;   /*< Bytes of the current request */
+    int           pending;    /*< Requests waiting for a reply */
+    int           sending;    /*< Replies in flight */
+    struct msghdr msg;
+    struct iovec  iov[16];
+} URING_CONN;
+
+static void
+uring_conn_recv(URING *ring, int i)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = server_fds[i];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = ((uint64_t)i << 1) | TAG_RECV;
+}
+
+static void
+uring_conn_send(URING *ring, URING_CONN *conn, int i)
+{
+    if (conn->sending == 0 && conn->pending > 0)
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        int n = conn->pending < 16 ? conn->pending : 16;
+
+        for (int j = 0; j < n; j++)
+        {
+            conn->iov[j].iov_base = reply;
+            conn->iov[j].iov_len = REPLY_SIZE;
+        }
+        memset(&conn->msg, 0, sizeof(conn->msg));
+        conn->msg.msg_iov = conn->iov;
+        conn->msg.msg_iovlen = n;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = server_fds[i];
+        sqe->addr = (uintptr_t)&conn->msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = ((uint64_t)i << 1) | TAG_SEND;
+        conn->pending -= n;
+        conn->sending = n;
+    }
+}
+
+/**
+ * Serve the queries with io_uring
+ *
+ * @return 0 on success
+ */
+static int
+test_uring()
+{
+    URING_CONN conns[CONNECTIONS];
+    struct io_uring_cqe *cqe;
+    URING *ring = uring_create();
+    int done = 0;
+    THREAD thr;
+
+    ss_info_dassert(ring != NULL, "Ring should be created");
+    memset(conns, 0, sizeof(conns));
+
+    for (int i = 0; i < CONNECTIONS; i++)
+    {
+        uring_conn_recv(ring, i);
+    }
+
+    uint64_t start = ts_clock_ns();
+    thread_start(&thr, client, NULL);
+
+    while (done < QUERIES)
+    {
+        /** One system call submits the new requests and waits for completions */
+        uring_submit(ring, 1);
+
+        while ((cqe = uring_peek_cqe(ring)) != NULL)
+        {
+            int i = cqe->user_data >> 1;
+            URING_CONN *conn = &conns[i];
+
+            if ((cqe->user_data & 1) == TAG_RECV)
+            {
+                ss_info_dassert(cqe->res > 0 || cqe->res == -ENOBUFS, "Receive should succeed");
+                if (cqe->res > 0)
+                {
+                    conn->received += cqe->res;
+                    conn->pending += conn->received / REQ_SIZE;
+                    conn->received %= REQ_SIZE;
+                    uring_recycle_buffer(ring, cqe);
+                }
+                if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+                {
+                    uring_conn_recv(ring, i);
+                }
+            }
+            else
+            {
+                ss_info_dassert(cqe->res == conn->sending * REPLY_SIZE, "Replies should be sent");
+                done += conn->sending;
+                conn->sending = 0;
+            }
+
+            uring_cqe_seen(ring);
+            uring_conn_send(ring, conn, i);
+        }
+    }
+
+    thread_wait(thr);
+    report("io_uring", start, ring->n_enter);
+    uring_destroy(ring);
+    ss_info_dassert(client_errors == 0, "Client should receive the replies");
+    return 0;
+}
+
+static volatile int echo_hangups;
+static volatile int echo_closes;
+
+/**
+ * Write back what the DCB reads
+ */
+static int
+echo_read(DCB *dcb)
+{
+    GWBUF *buf = NULL;
+
+    dcb_read(dcb, &buf, 0);
+    if (buf)
+    {
+        dcb_write(dcb, buf);
+    }
+    return 0;
+}
+
+static int
+echo_write_ready(DCB *dcb)
+{
+    return dcb_drain_writeq(dcb);
+}
+
+static int
+echo_hangup(DCB *dcb)
+{
+    atomic_add((int *)&echo_hangups, 1);
+    dcb_close(dcb);
+    return 0;
+}
+
+static int
+echo_close(DCB *dcb)
+{
+    atomic_add((int *)&echo_closes, 1);
+    return 0;
+}
+
+/**
+ * Close a DCB in its owning thread
+ */
+static void
+echo_posted_close(void *data)
+{
+    dcb_close((DCB *)data);
+}
+
+/**
+ * Start the polling threads with the io_uring backend in the worker mode
+ *
+ * @param threads   The thread handles
+ * @return 0 on success
+ */
+static int
+start_polling(THREAD *threads)
+{
+    char cnf[] = "/tmp/testiobackend.XXXXXX";
+    const char *options = "[maxscale]\nthreads=2\npoll_mode=worker\nio_backend=io_uring\n";
+    int fd = mkstemp(cnf);
+
+    ss_info_dassert(fd >= 0 && write(fd, options, strlen(options)) == strlen(options),
+                    "Configuration file should be written");
+    close(fd);
+    ss_info_dassert(config_load(cnf), "Configuration should be loaded");
+    unlink(cnf);
+    ss_info_dassert(config_threadcount() == POLL_THREADS && config_poll_mode() == POLL_MODE_WORKER &&
+                    config_io_backend() == IO_BACKEND_URING, "The options should be set");
+
+    ts_stats_init();
+    mxs_log_init(NULL, TEST_LOG_DIR, MXS_LOG_TARGET_DEFAULT);
+    poll_init();
+    for (intptr_t i = 0; i < POLL_THREADS; i++)
+    {
+        thread_start(&threads[i], poll_waitevents, (void *)i);
+    }
+    return 0;
+}
+
+/**
+ * Add an echoing DCB for one end of a socket pair to the polling threads
+ *
+ * @param fd    The socket
+ * @return The DCB
+ */
+static DCB *
+echo_dcb(int fd)
+{
+    DCB *dcb = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL);
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    dcb->fd = fd;
+    session_set_dummy(dcb);
+    dcb->func.read = echo_read;
+    dcb->func.write_ready = echo_write_ready;
+    dcb->func.error = echo_hangup;
+    dcb->func.hangup = echo_hangup;
+    dcb->func.close = echo_close;
+    ss_info_dassert(poll_add_dcb(dcb) == 0, "DCB should be added to the poll set");
+    ss_info_dassert(dcb->owner >= 0 && dcb->owner < POLL_THREADS, "DCB should have an owner");
+    ss_info_dassert(dcb->uring != NULL, "DCB should use io_uring");
+    return dcb;
+}
+
+/**
+ * Wait until a DCB has been freed by its owner
+ *
+ * @param dcb   The DCB
+ * @return True if the DCB was freed in time
+ */
+static bool
+wait_freed(DCB *dcb)
+{
+    for (int ms = 0; ms < WAIT_MS && dcb_isvalid(dcb); ms += 10)
+    {
+        thread_millisleep(10);
+    }
+    return !dcb_isvalid(dcb);
+}
+
+/**
+ * Read until the socket is closed or a byte count is reached
+ *
+ * @param fd    The socket
+ * @param buf   Buffer for the data or NULL to discard it
+ * @param size  Number of bytes to read
+ * @return Number of bytes read
+ */
+static int
+read_all(int fd, char *buf, int size)
+{
+    char scratch[65536];
+    int got = 0;
+
+    while (got < size)
+    {
+        int n = read(fd, buf ? buf + got : scratch,
+                     buf || size - got < sizeof(scratch) ? size - got : sizeof(scratch));
+        if (n <= 0)
+        {
+            break;
+        }
+        got += n;
+    }
+    return got;
+}
+
+/**
+ * test_uring_dcb   A DCB read and written by the polling threads with io_uring
+ *
+ * @return 0 on success
+ */
+static int
+test_uring_dcb()
+{
+    THREAD threads[POLL_THREADS];
+    char *out = malloc(INFLIGHT_SIZE);
+    char *in = malloc(ECHO_SIZE);
+    struct timeval timeout = {WAIT_MS / 1000, 0};
+    int fds[2];
+    DCB *dcb;
+
+    ss_info_dassert(out && in, "Memory should be allocated");
+    ss_dfprintf(stderr, "\ntestiobackend : io_uring DCB in the polling threads");
+    start_polling(threads);
+
+    ss_dfprintf(stderr, "\n\tread and write");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "Socket pair should be created");
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    dcb = echo_dcb(fds[0]);
+
+    for (int i = 0; i < 100; i++)
+    {
+        char msg[32], echo[32];
+        int len = snprintf(msg, sizeof(msg), "message %d", i);
+
+        ss_info_dassert(write(fds[1], msg, len) == len, "Message should be sent");
+        ss_info_dassert(read_all(fds[1], echo, len) == len && memcmp(msg, echo, len) == 0,
+                        "Message should be echoed");
+    }
+
+    /** More than the socket buffers hold, the echo is sent in many parts */
+    for (int i = 0; i < ECHO_SIZE; i++)
+    {
+        out[i] = i % 251;
+    }
+    ss_info_dassert(write(fds[1], out, ECHO_SIZE) == ECHO_SIZE, "Data should be sent");
+    ss_info_dassert(read_all(fds[1], in, ECHO_SIZE) == ECHO_SIZE && memcmp(out, in, ECHO_SIZE) == 0,
+                    "Data should be echoed in order");
+
+    ss_dfprintf(stderr, "\n\thangup of the peer");
+    shutdown(fds[1], SHUT_WR);
+    ss_info_dassert(wait_freed(dcb), "DCB should be closed and freed");
+    ss_info_dassert(echo_hangups == 1 && echo_closes == 1, "Hangup should close the DCB once");
+    ss_info_dassert(read_all(fds[1], NULL, 1) == 0, "The socket should be closed");
+    close(fds[1]);
+
+    ss_dfprintf(stderr, "\n\tclose while a send is in flight");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "Socket pair should be created");
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    dcb = echo_dcb(fds[0]);
+
+    /** The peer does not read, so the send stays in flight */
+    GWBUF *buf = gwbuf_alloc(INFLIGHT_SIZE);
+    memset(GWBUF_DATA(buf), 'x', INFLIGHT_SIZE);
+    dcb_write(dcb, buf);
+    thread_millisleep(100);
+    ss_info_dassert(dcb->writeqlen > 0, "The send should not have completed");
+    ss_info_dassert(poll_post(dcb->owner, echo_posted_close, dcb), "Close should be posted");
+    ss_info_dassert(wait_freed(dcb), "DCB should be freed when the requests have completed");
+    ss_info_dassert(echo_hangups == 1 && echo_closes == 2, "DCB should be closed once");
+
+    int got = read_all(fds[1], NULL, INFLIGHT_SIZE);
+    ss_info_dassert(got < INFLIGHT_SIZE, "The cancelled send should not be completed");
+    ss_info_dassert(read_all(fds[1], NULL, 1) == 0, "The socket should be closed");
+    close(fds[1]);
+
+    poll_shutdown();
+    for (int i = 0; i < POLL_THREADS; i++)
+    {
+        thread_wait(threads[i]);
+    }
+    free(out);
+    free(in);
+    return 0;
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    memset(reply, 'r', sizeof(reply));
+
+    ss_dfprintf(stderr, "testiobackend : %d queries over %d connections", QUERIES, CONNECTIONS);
+    connect_pairs();
+    result += test_epoll();
+    close_pairs();
+
+#ifdef HAVE_IO_URING
+    if (uring_supported())
+    {
+        connect_pairs();
+        result += test_uring();
+        close_pairs();
+        result += test_uring_dcb();
+    }
+    else
+    {
+        ss_dfprintf(stderr, "\n\tio_uring is not supported by the kernel, skipping it");
+    }
+#endif
+
+    ss_dfprintf(stderr, "\n\t..done\n");
+    exit(result);
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testmailbox.c - Tests for the multi-producer, single-consumer mailboxes
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mailbox.h>
+#include <thread.h>
+#include <skygw_debug.h>
+
+#define PRODUCERS       4
+#define MSGS_PER_THREAD 100000
+
+typedef struct
+{
+    MAILBOX_NODE node;
+    int          producer;
+    int          seq;
+} TEST_MSG;
+
+static MAILBOX mailbox;
+static TEST_MSG messages[PRODUCERS][MSGS_PER_THREAD];
+static int last_seq[PRODUCERS];
+static int n_handled;
+static int n_errors;
+
+static void
+test_handler(MAILBOX_NODE *node)
+{
+    TEST_MSG *msg = (TEST_MSG *)node;
+
+    /** The messages of one producer must arrive in the order they were posted */
+    if (msg->seq != last_seq[msg->producer] + 1)
+    {
+        n_errors++;
+    }
+    last_seq[msg->producer] = msg->seq;
+    n_handled++;
+}
+
+static void
+producer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+
+    for (int i = 0; i < MSGS_PER_THREAD; i++)
+    {
+        messages[id][i].node.handler = test_handler;
+        messages[id][i].producer = id;
+        messages[id][i].seq = i;
+        mailbox_push(&mailbox, &messages[id][i].node);
+    }
+}
+
+/**
+ * Test pushing and popping from a single thread
+ *
+ * @return 0 on success
+ */
+static int
+test1()
+{
+    TEST_MSG a, b;
+
+    ss_dfprintf(stderr, "testmailbox : single thread");
+    mailbox_init(&mailbox);
+    ss_info_dassert(mailbox_pop(&mailbox) == NULL, "Empty mailbox should return NULL");
+
+    mailbox_push(&mailbox, &a.node);
+    ss_info_dassert(mailbox_length(&mailbox) == 1, "Mailbox should have one node");
+    ss_info_dassert(mailbox_pop(&mailbox) == &a.node, "Pushed node should be popped");
+    ss_info_dassert(mailbox_pop(&mailbox) == NULL, "Mailbox should be empty");
+
+    mailbox_push(&mailbox, &a.node);
+    mailbox_push(&mailbox, &b.node);
+    ss_info_dassert(mailbox_pop(&mailbox) == &a.node, "Nodes should be popped in order");
+    mailbox_push(&mailbox, &a.node);
+    ss_info_dassert(mailbox_pop(&mailbox) == &b.node, "Nodes should be popped in order");
+    ss_info_dassert(mailbox_pop(&mailbox) == &a.node, "Re-pushed node should be popped");
+    ss_info_dassert(mailbox_pop(&mailbox) == NULL, "Mailbox should be empty");
+    ss_info_dassert(mailbox_length(&mailbox) == 0, "Mailbox should have no nodes");
+    ss_dfprintf(stderr, "\t..done\n");
+    return 0;
+}
+
+/**
+ * Test concurrent producers with a consumer
+ *
+ * @return 0 on success
+ */
+static int
+test2()
+{
+    THREAD handles[PRODUCERS];
+
+    ss_dfprintf(stderr, "testmailbox : %d concurrent producers", PRODUCERS);
+    mailbox_init(&mailbox);
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        last_seq[i] = -1;
+        thread_start(&handles[i], producer, (void *)(intptr_t)i);
+    }
+
+    while (n_handled < PRODUCERS * MSGS_PER_THREAD)
+    {
+        MAILBOX_NODE *node = mailbox_pop(&mailbox);
+        if (node)
+        {
+            node->handler(node);
+        }
+    }
+
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        thread_wait(handles[i]);
+    }
+
+    ss_info_dassert(n_errors == 0, "Messages should arrive in order");
+    ss_info_dassert(mailbox_pop(&mailbox) == NULL, "Mailbox should be empty");
+    ss_info_dassert(mailbox_length(&mailbox) == 0, "Mailbox should have no nodes");
+    ss_dfprintf(stderr, "\t..done\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    result += test1();
+    result += test2();
+
+    exit(result);
+}
@@ -35,6 +35,8 @@
 
 #include <modutil.h>
 #include <buffer.h>
+#include <statistics.h>
+#include <mysql_client_server_protocol.h>
 
 /**
  * test1    Allocate a service and do lots of other things
@@ -383,6 +385,266 @@ void test_large_packets()
     }
 }
 
+/** Load data into a chain of buffers of at most chunk bytes each */
+static GWBUF* create_fragmented(const void* data, size_t len, size_t chunk)
+{
+    GWBUF* head = NULL;
+
+    for (size_t i = 0; i < len; i += chunk)
+    {
+        head = gwbuf_append(head, gwbuf_alloc_and_load(MIN(chunk, len - i), (char*)data + i));
+    }
+
+    return head;
+}
+
+void test_packet_iterator()
+{
+    static const uint32_t lengths[] = {1, 0x22, 5, 5, 5};
+    static const uint8_t cmds[] = {0x01, 0x03, 0xfe, 0x04, 0xfe};
+    PACKET_ITER iter;
+    int more;
+
+    /** Every possible fragmentation of the resultset */
+    for (size_t chunk = 1; chunk <= sizeof(resultset); chunk++)
+    {
+        GWBUF* buffer = create_fragmented(resultset, sizeof(resultset), chunk);
+        size_t offset = 0;
+        int n = 0;
+
+        modutil_iter_init(&iter, buffer);
+
+        while (modutil_iter_next(&iter))
+        {
+            ss_info_dassert(n < 5, "There should be five packets");
+            ss_info_dassert(iter.len == lengths[n], "Packet length should be correct");
+            ss_info_dassert(iter.cmd == cmds[n], "First payload byte should be correct");
+            ss_info_dassert(iter.seq == n + 1, "Sequence number should be correct");
+            ss_info_dassert(iter.offset == offset, "Packet offset should be correct");
+            ss_info_dassert((modutil_iter_data(&iter) != NULL) == (offset / chunk == (offset + 3 + iter.len) / chunk),
+                            "Only packets in one buffer should be contiguous");
+            offset += 4 + iter.len;
+            n++;
+        }
+
+        ss_info_dassert(n == 5 && iter.offset == sizeof(resultset), "All packets should be found");
+        ss_info_dassert(!iter.partial, "There should be no partial packet");
+        ss_info_dassert(modutil_count_signal_packets(buffer, 0, 0, &more) == 2 && !more,
+                        "Resultset should have two EOF packets");
+        gwbuf_free(buffer);
+
+        /** The last packet is incomplete */
+        buffer = create_fragmented(resultset, sizeof(resultset) - 1, chunk);
+        modutil_iter_init(&iter, buffer);
+
+        for (n = 0; modutil_iter_next(&iter); n++)
+        {
+            ;
+        }
+
+        ss_info_dassert(n == 4, "Four packets should be complete");
+        ss_info_dassert(iter.partial && iter.len == 5, "The length of the partial packet should be known");
+        ss_info_dassert(modutil_count_signal_packets(buffer, 0, 0, &more) == 1,
+                        "Partial EOF packet should not be counted");
+
+        /** Completing the packet continues from where the iterator stopped */
+        buffer = gwbuf_append(buffer, gwbuf_alloc_and_load(1, resultset + sizeof(resultset) - 1));
+        ss_info_dassert(modutil_iter_next(&iter) && iter.cmd == 0xfe, "Last packet should be complete");
+        ss_info_dassert(!modutil_iter_next(&iter) && !iter.partial, "There should be no more packets");
+        gwbuf_free(buffer);
+    }
+
+    /** Length-encoded integers spread over single byte buffers */
+    uint8_t lenenc[] =
+    {
+        0x14, 0x00, 0x00, 0x00, 0xfa, 0xfc, 0x34, 0x12, 0xfd, 0x56, 0x34, 0x12,
+        0xfe, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0xfb, 0xfc, 0x01
+    };
+    uint64_t value;
+    size_t pos = 0;
+    GWBUF* buffer = create_fragmented(lenenc, sizeof(lenenc), 1);
+
+    modutil_iter_init(&iter, buffer);
+    ss_info_dassert(modutil_iter_next(&iter), "Packet should be complete");
+    ss_info_dassert(modutil_iter_lenenc(&iter, &pos, &value) && value == 0xfa, "One byte integer");
+    ss_info_dassert(modutil_iter_lenenc(&iter, &pos, &value) && value == 0x1234, "Two byte integer");
+    ss_info_dassert(modutil_iter_lenenc(&iter, &pos, &value) && value == 0x123456, "Three byte integer");
+    ss_info_dassert(modutil_iter_lenenc(&iter, &pos, &value) && value == 0x0807060504030201,
+                    "Eight byte integer");
+    ss_info_dassert(pos == 17 && !modutil_iter_lenenc(&iter, &pos, &value), "NULL is not an integer");
+    pos++;
+    ss_info_dassert(!modutil_iter_lenenc(&iter, &pos, &value) && pos == 18,
+                    "Integer past the end of the packet should not be read");
+    gwbuf_free(buffer);
+
+    /** Packets in one buffer are split off without copying */
+    char two_ok[sizeof(ok) * 2];
+    memcpy(two_ok, ok, sizeof(ok));
+    memcpy(two_ok + sizeof(ok), ok, sizeof(ok));
+    buffer = gwbuf_alloc_and_load(sizeof(two_ok), two_ok);
+    void* data = GWBUF_DATA(buffer);
+    GWBUF* packet = modutil_get_next_MySQL_packet(&buffer);
+    ss_info_dassert(packet && GWBUF_DATA(packet) == data && gwbuf_length(packet) == sizeof(ok),
+                    "First packet should not be copied");
+    gwbuf_free(packet);
+    packet = modutil_get_next_MySQL_packet(&buffer);
+    ss_info_dassert(packet && buffer == NULL && GWBUF_DATA(packet) == (char*)data + sizeof(ok),
+                    "Second packet should not be copied");
+    gwbuf_free(packet);
+
+    /** Packets spread over several buffers are made contiguous */
+    buffer = create_fragmented(two_ok, sizeof(two_ok), 3);
+    for (int i = 0; i < 2; i++)
+    {
+        packet = modutil_get_next_MySQL_packet(&buffer);
+        ss_info_dassert(packet && packet->next == NULL && GWBUF_LENGTH(packet) == sizeof(ok) &&
+                        memcmp(GWBUF_DATA(packet), ok, sizeof(ok)) == 0, "Packet should be contiguous");
+        gwbuf_free(packet);
+    }
+    ss_info_dassert(buffer == NULL, "All data should be consumed");
+}
+
+void test_reply_tracker()
+{
+    /** An OK packet with SERVER_MORE_RESULTS_EXIST set in the status */
+    static char ok_more[] =
+    {
+        0x07, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00
+    };
+    static char err[] =
+    {
+        0x09, 0x00, 0x00, 0x01, 0xff, 0x15, 0x04, 0x23, 0x32, 0x38, 0x30, 0x30, 0x30
+    };
+    REPLY_TRACKER tracker;
+    GWBUF* buffer;
+
+    ss_dfprintf(stderr, "testmodutil : Track replies");
+    ss_info_dassert(!modutil_reply_start(&tracker, MYSQL_COM_STMT_CLOSE) &&
+                    tracker.state == REPLY_STATE_DONE, "COM_STMT_CLOSE has no reply");
+    ss_info_dassert(!modutil_reply_start(&tracker, MYSQL_COM_QUIT) &&
+                    tracker.state == REPLY_STATE_DONE, "COM_QUIT has no reply");
+
+    /** A single packet ends the reply to a command that is not a query */
+    ss_info_dassert(modutil_reply_start(&tracker, MYSQL_COM_PING), "COM_PING has a reply");
+    buffer = gwbuf_alloc_and_load(sizeof(ok), ok);
+    ss_info_dassert(modutil_reply_track(&tracker, buffer), "OK should end the reply");
+    gwbuf_free(buffer);
+
+    /** A result set ends with the second EOF packet */
+    ss_info_dassert(modutil_reply_start(&tracker, MYSQL_COM_QUERY), "COM_QUERY has a reply");
+    buffer = gwbuf_alloc_and_load(52, resultset);
+    ss_info_dassert(!modutil_reply_track(&tracker, buffer) && tracker.state == REPLY_STATE_RSET,
+                    "Result set should continue after the column definitions");
+    gwbuf_free(buffer);
+    buffer = gwbuf_alloc_and_load(sizeof(resultset) - 52, resultset + 52);
+    ss_info_dassert(modutil_reply_track(&tracker, buffer), "Last EOF should end the reply");
+    gwbuf_free(buffer);
+
+    /** An error ends the reply to a query */
+    modutil_reply_start(&tracker, MYSQL_COM_QUERY);
+    buffer = gwbuf_alloc_and_load(sizeof(err), err);
+    ss_info_dassert(modutil_reply_track(&tracker, buffer), "ERR should end the reply");
+    gwbuf_free(buffer);
+
+    /** More results follow an OK packet that says so */
+    modutil_reply_start(&tracker, MYSQL_COM_QUERY);
+    buffer = gwbuf_alloc_and_load(sizeof(ok_more), ok_more);
+    ss_info_dassert(!modutil_reply_track(&tracker, buffer) && tracker.state == REPLY_STATE_START,
+                    "More results should follow");
+    gwbuf_free(buffer);
+    buffer = create_fragmented(resultset, sizeof(resultset), 7);
+    ss_info_dassert(modutil_reply_track(&tracker, buffer), "The last result set should end the reply");
+    gwbuf_free(buffer);
+    ss_dfprintf(stderr, "\t..done\n");
+}
+
+#define BENCH_BYTES    (1024 * 1024)
+#define BENCH_ROUNDS   20
+
+/**
+ * Compare walking the packets of a fragmented buffer chain with the
+ * iterator to making the chain contiguous first
+ */
+void test_packet_iterator_benchmark()
+{
+    static uint8_t data[BENCH_BYTES];
+    static const size_t payloads[] = {40, 1000};
+    static const size_t chunks[] = {1460, 16384};
+    int more;
+
+    ss_dfprintf(stderr, "testmodutil : walking %d kB of packets", BENCH_BYTES / 1024);
+
+    for (int p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++)
+    {
+        int packets = BENCH_BYTES / (payloads[p] + 4);
+
+        for (int i = 0; i < packets; i++)
+        {
+            uint8_t* ptr = data + i * (payloads[p] + 4);
+            ptr[0] = payloads[p];
+            ptr[1] = payloads[p] >> 8;
+            ptr[2] = 0;
+            ptr[3] = i;
+            memset(ptr + 4, i % 0xfe, payloads[p]);
+        }
+
+        for (int c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+        {
+            GWBUF* buffer = create_fragmented(data, packets * (payloads[p] + 4), chunks[c]);
+            int npackets = 0;
+            int nsignal = 0;
+            uint64_t start = ts_clock_ns();
+
+            for (int r = 0; r < BENCH_ROUNDS; r++)
+            {
+                GWBUF* copy = gwbuf_make_contiguous(gwbuf_clone_all(buffer));
+                uint8_t* ptr = GWBUF_DATA(copy);
+                uint8_t* end = ptr + GWBUF_LENGTH(copy);
+
+                while (ptr + 4 <= end && ptr + 4 + gw_mysql_get_byte3(ptr) <= end)
+                {
+                    npackets++;
+                    ptr += 4 + gw_mysql_get_byte3(ptr);
+                }
+                nsignal += modutil_count_signal_packets(copy, 0, 0, &more);
+                gwbuf_free(copy);
+            }
+
+            double contiguous = (double)(ts_clock_ns() - start) / (BENCH_ROUNDS * packets);
+            ss_info_dassert(npackets == BENCH_ROUNDS * packets, "All packets should be walked");
+
+            npackets = 0;
+            start = ts_clock_ns();
+
+            for (int r = 0; r < BENCH_ROUNDS; r++)
+            {
+                GWBUF* copy = gwbuf_clone_all(buffer);
+                PACKET_ITER iter;
+
+                modutil_iter_init(&iter, copy);
+
+                while (modutil_iter_next(&iter))
+                {
+                    npackets++;
+                }
+                nsignal += modutil_count_signal_packets(copy, 0, 0, &more);
+                gwbuf_free(copy);
+            }
+
+            double iterated = (double)(ts_clock_ns() - start) / (BENCH_ROUNDS * packets);
+            ss_info_dassert(npackets == BENCH_ROUNDS * packets, "All packets should be iterated");
+            ss_info_dassert(nsignal == 0, "There should be no signal packets");
+
+            ss_dfprintf(stderr, "\n\t%4lu byte packets in %5lu byte buffers: "
+                        "contiguous %6.1f ns/packet, iterator %6.1f ns/packet",
+                        payloads[p] + 4, chunks[c], contiguous, iterated);
+            gwbuf_free(buffer);
+        }
+    }
+
+    ss_dfprintf(stderr, "\n\t..done\n");
+}
+
 int main(int argc, char **argv)
 {
     int result = 0;
@@ -394,5 +656,8 @@ int main(int argc, char **argv)
     test_strnchr_esc();
     test_strnchr_esc_mysql();
     test_large_packets();
+    test_packet_iterator();
+    test_reply_tracker();
+    test_packet_iterator_benchmark();
     exit(result);
 }
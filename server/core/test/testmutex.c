@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testmutex.c - Tests of the adaptive mutex and the reader-writer lock
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mutex.h>
+#include <atomic.h>
+#include <thread.h>
+#include <skygw_debug.h>
+
+#define THREADS     16
+#define ITERATIONS  20000
+#define HOLD_MS     300
+
+static MUTEX mutex;
+static RWLOCK rwlock;
+static volatile int counter;
+static volatile int readers;
+static volatile int writing;
+static int failures;
+static int order[2];
+static int n_order;
+
+/**
+ * Increment the counter without atomic operations inside the mutex
+ */
+static void
+count_helper(void *data)
+{
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        mutex_acquire(&mutex);
+        counter = counter + 1;
+        mutex_release(&mutex);
+    }
+}
+
+/**
+ * Take the mutex and release it at once
+ */
+static void
+wait_helper(void *data)
+{
+    mutex_acquire(&mutex);
+    mutex_release(&mutex);
+}
+
+/**
+ * test1    The mutex is exclusive and waiting threads sleep
+ */
+static int
+test1()
+{
+    THREAD handle[THREADS];
+
+    ss_dfprintf(stderr, "testmutex : mutex_acquire_nowait");
+    mutex_init(&mutex);
+    ss_info_dassert(mutex_acquire_nowait(&mutex), "A free mutex should be acquired");
+    ss_info_dassert(!mutex_acquire_nowait(&mutex), "A held mutex should not be acquired");
+    mutex_release(&mutex);
+    ss_info_dassert(!MUTEX_IS_LOCKED(&mutex), "The mutex should be free");
+
+    ss_dfprintf(stderr, "\t..done\nCount with %d threads", THREADS);
+    counter = 0;
+    for (int i = 0; i < THREADS; i++)
+    {
+        thread_start(&handle[i], count_helper, NULL);
+    }
+    for (int i = 0; i < THREADS; i++)
+    {
+        thread_wait(handle[i]);
+    }
+    ss_info_dassert(counter == THREADS * ITERATIONS, "No increment should be lost");
+    ss_info_dassert(!MUTEX_IS_LOCKED(&mutex), "The mutex should be free");
+
+    ss_dfprintf(stderr, "\t..done\nWait for a holder that sleeps");
+    clock_t start = clock();
+    mutex_acquire(&mutex);
+    for (int i = 0; i < THREADS; i++)
+    {
+        thread_start(&handle[i], wait_helper, NULL);
+    }
+    thread_millisleep(HOLD_MS);
+    mutex_release(&mutex);
+    for (int i = 0; i < THREADS; i++)
+    {
+        thread_wait(handle[i]);
+    }
+    double cpu_ms = (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+    ss_dfprintf(stderr, " (%.1f ms of CPU time)", cpu_ms);
+    ss_info_dassert(cpu_ms < HOLD_MS, "The waiting threads should sleep instead of spinning");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+/**
+ * Check that the readers and the writer never overlap
+ */
+static void
+rw_helper(void *data)
+{
+    int n = *(int *)data;
+
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        if ((i + n) % 8 == 0)
+        {
+            rwlock_write_acquire(&rwlock);
+            if (writing || readers)
+            {
+                atomic_add(&failures, 1);
+            }
+            writing = 1;
+            counter = counter + 1;
+            writing = 0;
+            rwlock_write_release(&rwlock);
+        }
+        else
+        {
+            rwlock_read_acquire(&rwlock);
+            atomic_add((int *)&readers, 1);
+            if (writing)
+            {
+                atomic_add(&failures, 1);
+            }
+            atomic_add((int *)&readers, -1);
+            rwlock_read_release(&rwlock);
+        }
+    }
+}
+
+/**
+ * Take the lock for writing and record the order
+ */
+static void
+writer_helper(void *data)
+{
+    rwlock_write_acquire(&rwlock);
+    order[n_order++] = 'w';
+    rwlock_write_release(&rwlock);
+}
+
+/**
+ * Take the lock for reading and record the order
+ */
+static void
+reader_helper(void *data)
+{
+    rwlock_read_acquire(&rwlock);
+    order[atomic_add(&n_order, 1)] = 'r';
+    rwlock_read_release(&rwlock);
+}
+
+/**
+ * test2    The reader-writer lock
+ */
+static int
+test2()
+{
+    THREAD handle[THREADS];
+    int tnum[THREADS];
+
+    ss_dfprintf(stderr, "testmutex : Many readers");
+    rwlock_init(&rwlock);
+    rwlock_read_acquire(&rwlock);
+    rwlock_read_acquire(&rwlock);
+    ss_info_dassert(rwlock.state == 2, "Two readers should hold the lock");
+    rwlock_read_release(&rwlock);
+    rwlock_read_release(&rwlock);
+    ss_info_dassert(rwlock.state == 0, "The lock should be free");
+
+    ss_dfprintf(stderr, "\t..done\nReaders and writers with %d threads", THREADS);
+    counter = 0;
+    failures = 0;
+    for (int i = 0; i < THREADS; i++)
+    {
+        tnum[i] = i;
+        thread_start(&handle[i], rw_helper, &tnum[i]);
+    }
+    for (int i = 0; i < THREADS; i++)
+    {
+        thread_wait(handle[i]);
+    }
+    ss_info_dassert(failures == 0, "Readers and writers should not overlap");
+    ss_info_dassert(counter == THREADS * ITERATIONS / 8, "No write should be lost");
+    ss_info_dassert(rwlock.state == 0 && rwlock.writers == 0, "The lock should be free");
+
+    ss_dfprintf(stderr, "\t..done\nA waiting writer goes before new readers");
+    n_order = 0;
+    rwlock_read_acquire(&rwlock);
+    thread_start(&handle[0], writer_helper, NULL);
+    thread_millisleep(HOLD_MS / 3);
+    ss_info_dassert(rwlock.writers == 1, "The writer should be waiting");
+    thread_start(&handle[1], reader_helper, NULL);
+    thread_millisleep(HOLD_MS / 3);
+    ss_info_dassert(n_order == 0, "The new reader should wait for the writer");
+    rwlock_read_release(&rwlock);
+    thread_wait(handle[0]);
+    thread_wait(handle[1]);
+    ss_info_dassert(n_order == 2 && order[0] == 'w' && order[1] == 'r',
+                    "The writer should get the lock first");
+    ss_info_dassert(rwlock.state == 0 && rwlock.writers == 0, "The lock should be free");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    result += test1();
+    result += test2();
+
+    exit(result);
+}
@@ -32,9 +32,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <server.h>
+#include <dcb.h>
 #include <log_manager.h>
+#include <maxconfig.h>
+#include <maxscale/poll.h>
+#include <statistics.h>
+#include <thread.h>
+
+#define WAIT_MS 10000
 /**
  * test1    Allocate a server and do lots of other things
  *
@@ -100,11 +109,221 @@ test1()
 
 }
 
+/**
+ * Put an idle connection of a user into the pool of the DCBs no thread owns
+ */
+static DCB *
+add_pooled_dcb(SERVER *server, char *user)
+{
+    DCB *dcb = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL);
+    SERVER_POOL *pool = server_get_pool(server, dcb->owner);
+
+    dcb->server = server;
+    dcb->user = strdup(user);
+    dcb->protoname = strdup("MySQLBackend");
+    dcb->persistentstart = time(NULL);
+    dcb->nextpersistent = pool->head;
+    pool->head = dcb;
+    pool->count++;
+    server->stats.n_persistent++;
+    return dcb;
+}
+
+/**
+ * Create an idle backend connection of a user that a polling thread closes
+ *
+ * @param server    The server of the connection
+ * @param user      The user of the connection
+ * @param owner     The polling thread owning the DCB or -1
+ * @param opener    The polling thread that opened the DCB
+ * @return The DCB
+ */
+static DCB *
+alloc_backend_dcb(SERVER *server, char *user, int owner, int opener)
+{
+    DCB *dcb = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL);
+
+    dcb->server = server;
+    dcb->user = strdup(user);
+    dcb->protoname = strdup("MySQLBackend");
+    dcb->state = DCB_STATE_POLLING;
+    dcb->owner = owner;
+    dcb->persistpool = opener;
+    return dcb;
+}
+
+static void
+close_in_thread(void *data)
+{
+    dcb_close((DCB *)data);
+}
+
+/**
+ * Close a DCB in the first polling thread and wait until the thread has
+ * put it into a persistent pool
+ *
+ * @param dcb   The DCB
+ * @param pool  The pool the DCB is expected in
+ * @return True if the DCB is at the head of the pool
+ */
+static bool
+close_into_pool(DCB *dcb, SERVER_POOL *pool)
+{
+    ss_info_dassert(poll_post(0, close_in_thread, dcb), "Close should be posted");
+    for (int ms = 0; ms < WAIT_MS && pool->head != dcb; ms += 10)
+    {
+        thread_millisleep(10);
+    }
+    return pool->head == dcb;
+}
+
+static DCB *reused[3];
+static volatile int reuse_done;
+
+/**
+ * Take the connections of a user from the pools in the first polling thread
+ */
+static void
+reuse_in_thread(void *data)
+{
+    SERVER *server = (SERVER *)data;
+
+    for (int i = 0; i < 3; i++)
+    {
+        reused[i] = server_get_persistent(server, "user", "MySQLBackend");
+    }
+    reuse_done = 1;
+}
+
+/**
+ * test2    Reuse connections from the persistent pools
+ */
+static int
+test2()
+{
+    SERVER *server;
+    DCB *first, *second, *broken, *other;
+    DCB *owned, *unowned, *shared, *warm;
+    SERVER_POOL *pool, *shared_pool;
+
+    ss_dfprintf(stderr, "testserver : persistent connection pools");
+    server = server_alloc("PoolServer", "MySQLBackend", 3306);
+    server->persistpoolmax = 10;
+    server->persistmaxtime = 60;
+
+    ss_info_dassert(server->n_pools >= 2, "Should have a pool per thread and a shared pool");
+    ss_info_dassert(server_get_pool(server, -1) == &server->persistent[server->n_pools - 1],
+                    "DCBs no thread owns should use the last pool");
+    ss_info_dassert(server_get_pool(server, 0) == &server->persistent[0],
+                    "The first thread should use the first pool");
+
+    first = add_pooled_dcb(server, "user");
+    other = add_pooled_dcb(server, "other");
+    second = add_pooled_dcb(server, "user");
+    broken = add_pooled_dcb(server, "user");
+    broken->dcb_errhandle_called = true;
+
+    ss_info_dassert(second == server_get_persistent(server, "user", "MySQLBackend"),
+                    "The most recently pooled usable connection should be reused first");
+    ss_info_dassert(server->stats.n_persistent == 2,
+                    "The broken connection should have been removed from the pool");
+    ss_info_dassert(first == server_get_persistent(server, "user", "MySQLBackend"),
+                    "The older connection should be reused next");
+    ss_info_dassert(NULL == server_get_persistent(server, "user", "MySQLBackend"),
+                    "Connections of other users should not be reused");
+    ss_info_dassert(server_get_pool(server, -1)->count == 1, "Only one connection should remain");
+    ss_info_dassert(server_get_pool(server, -1)->head == other,
+                    "The connection of the other user should remain in the pool");
+    ss_info_dassert(1 == dcb_persistent_clean_count(server, false), "The pool should count one connection");
+
+    server->status &= ~SERVER_RUNNING;
+    ss_info_dassert(NULL == server_get_persistent(server, "other", "MySQLBackend"),
+                    "Connections to a server that is down should not be reused");
+    ss_info_dassert(0 == dcb_persistent_clean_count(server, false),
+                    "Connections to a server that is down should be removed");
+    ss_info_dassert(server->stats.n_persistent == 0, "The pool should be empty");
+
+    dcb_close(first);
+    dcb_close(second);
+    ss_info_dassert(0 != server_free(server), "Free should succeed");
+
+    ss_dfprintf(stderr, "\t..done\nPools of the polling threads");
+    server = server_alloc("ThreadPoolServer", "MySQLBackend", 3306);
+    server->persistpoolmax = 10;
+    server->persistmaxtime = 60;
+    server->persistpoolmin = 1;
+    pool = server_get_pool(server, 0);
+    shared_pool = server_get_pool(server, -1);
+
+    owned = alloc_backend_dcb(server, "user", 0, -1);
+    ss_info_dassert(close_into_pool(owned, pool), "An owned DCB should go to the pool of its owner");
+    unowned = alloc_backend_dcb(server, "user", -1, 0);
+    ss_info_dassert(close_into_pool(unowned, pool),
+                    "An unowned DCB should go to the pool of the thread that opened it");
+    ss_info_dassert(pool->count == 2 && shared_pool->count == 0, "The shared pool should be empty");
+    shared = add_pooled_dcb(server, "user");
+
+    ss_info_dassert(poll_post(0, reuse_in_thread, server), "Reuse should be posted");
+    for (int ms = 0; ms < WAIT_MS && !reuse_done; ms += 10)
+    {
+        thread_millisleep(10);
+    }
+    ss_info_dassert(reuse_done, "The connections should be taken");
+    ss_info_dassert(reused[0] == unowned && reused[1] == owned,
+                    "The pool of the thread should be used first, the latest connection first");
+    ss_info_dassert(reused[2] == shared, "The shared pool should be used last");
+    ss_info_dassert(server->stats.n_persistent == 0, "The pools should be empty");
+
+    /** A connection opened to fill the pool of the thread */
+    warm = alloc_backend_dcb(server, "user", -1, 0);
+    warm->flags |= DCBF_PREWARM;
+    pool->warming = 1;
+    ss_info_dassert(close_into_pool(warm, pool), "A prewarmed DCB should go to the pool of its thread");
+    ss_info_dassert(pool->warming == 0 && shared_pool->warming == 0,
+                    "The pool that was filled should no longer be warming");
+    ss_info_dassert(pool->count == server->persistpoolmin,
+                    "The pool of the thread should hold persistpoolmin connections");
+
+    server->status &= ~SERVER_RUNNING;
+    ss_info_dassert(0 == dcb_persistent_clean_count(server, false), "The pools should be emptied");
+    ss_dfprintf(stderr, "\t..done\n");
+    return 0;
+}
+
+/**
+ * Load a configuration with one polling thread and start the thread
+ *
+ * @param thread    The thread handle
+ */
+static void
+start_polling(THREAD *thread)
+{
+    char cnf[] = "/tmp/testserver.XXXXXX";
+    const char *options = "[maxscale]\nthreads=1\n";
+    int fd = mkstemp(cnf);
+
+    ss_info_dassert(fd >= 0 && write(fd, options, strlen(options)) == strlen(options),
+                    "Configuration file should be written");
+    close(fd);
+    ss_info_dassert(config_load(cnf), "Configuration should be loaded");
+    unlink(cnf);
+    ss_info_dassert(config_threadcount() == 1, "There should be one polling thread");
+
+    ts_stats_init();
+    poll_init();
+    thread_start(thread, poll_waitevents, (void *)0);
+}
+
 int main(int argc, char **argv)
 {
     int result = 0;
+    THREAD thread;
 
+    start_polling(&thread);
     result += test1();
+    result += test2();
+    poll_shutdown();
+    thread_wait(thread);
 
     exit(result);
 }
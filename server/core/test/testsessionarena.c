@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testsessionarena.c - Tests of the session arena allocator
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <session.h>
+#include <service.h>
+#include <statistics.h>
+#include <skygw_debug.h>
+
+/**
+ * Create a session that is not linked to any DCB or router
+ */
+static SESSION *
+make_session(SERVICE *service)
+{
+    SESSION *session = calloc(1, sizeof(SESSION));
+#if defined(SS_DEBUG)
+    session->ses_chk_top = CHK_NUM_SESSION;
+    session->ses_chk_tail = CHK_NUM_SESSION;
+#endif
+    spinlock_init(&session->ses_lock);
+    spinlock_init(&session->arena.lock);
+    session->service = service;
+    session->state = SESSION_STATE_ROUTER_READY;
+    session->refcount = 1;
+    return session;
+}
+
+/**
+ * test1    Allocations are zeroed, aligned and accounted
+ */
+static int
+test1()
+{
+    SERVICE service;
+    SESSION *session;
+    char *ptr[100];
+
+    memset(&service, 0, sizeof(service));
+    service.name = "test";
+    service.stats.n_current = ts_stats_alloc();
+    session = make_session(&service);
+
+    ss_dfprintf(stderr, "testsessionarena : Allocate from the arena");
+    for (int i = 0; i < 100; i++)
+    {
+        ptr[i] = session_arena_alloc(session, i + 1);
+        ss_info_dassert(ptr[i] != NULL, "Allocation should succeed");
+        ss_info_dassert(((uintptr_t)ptr[i] % SESSION_ARENA_ALIGN) == 0,
+                        "Allocation should be aligned");
+        for (int j = 0; j <= i; j++)
+        {
+            ss_info_dassert(ptr[i][j] == 0, "Allocation should be zeroed");
+        }
+        memset(ptr[i], 'a', i + 1);
+    }
+    for (int i = 1; i < 100; i++)
+    {
+        ss_info_dassert(ptr[i - 1][i - 1] == 'a', "Allocations should not overlap");
+    }
+    ss_info_dassert(session->arena.used >= 100 * 101 / 2, "The allocations should be counted");
+    ss_info_dassert(session->arena.reserved >= session->arena.used,
+                    "The blocks should hold the allocations");
+
+    ss_dfprintf(stderr, "\t..done\nReuse a freed allocation");
+    size_t used = session->arena.used;
+    session_arena_free(session, ptr[40], 41);
+    ss_info_dassert(session->arena.used < used, "The freed memory should not be counted");
+    char *again = session_arena_alloc(session, 41);
+    ss_info_dassert(again == ptr[40], "A freed allocation should be reused");
+    ss_info_dassert(again[0] == 0 && again[40] == 0, "A reused allocation should be zeroed");
+    ss_info_dassert(session->arena.used == used, "The reused memory should be counted");
+
+    ss_dfprintf(stderr, "\t..done\nAllocate a large object");
+    size_t reserved = session->arena.reserved;
+    char *big = session_arena_alloc(session, SESSION_ARENA_BLOCK_SIZE * 4);
+    ss_info_dassert(big != NULL, "Allocation should succeed");
+    memset(big, 'b', SESSION_ARENA_BLOCK_SIZE * 4);
+    ss_info_dassert(session->arena.reserved >= reserved + SESSION_ARENA_BLOCK_SIZE * 4,
+                    "A large object should get a block of its own");
+    char *small = session_arena_alloc(session, 8);
+    ss_info_dassert(small != NULL && *small == 0, "Small allocations should continue");
+
+    ss_dfprintf(stderr, "\t..done\nFree the session");
+    session_free(session);
+    ss_info_dassert(session->arena.used == 0, "Nothing should be in use");
+    ss_info_dassert(session->arena.reserved == SESSION_ARENA_BLOCK_SIZE,
+                    "One block should be kept for the next session");
+    ss_info_dassert(session->arena.blocks != NULL, "One block should be kept");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    result += test1();
+
+    exit(result);
+}
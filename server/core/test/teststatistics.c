@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file teststatistics.c - Tests for the thread specific statistics and histograms
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <statistics.h>
+#include <skygw_debug.h>
+
+/**
+ * Check that a value read from a histogram is within the precision of the
+ * histogram from the expected value
+ */
+static int
+check_value(const char *name, uint64_t value, uint64_t expected)
+{
+    uint64_t error = expected / TS_HIST_SUB_BUCKETS;
+
+    if (value + error < expected || value > expected + error)
+    {
+        ss_dfprintf(stderr, "\t..%s is %lu, expected %lu\n", name,
+                    (unsigned long)value, (unsigned long)expected);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Test the histogram percentiles
+ *
+ * @return 0 on success
+ */
+static int
+test1()
+{
+    ts_hist_t hist;
+    ts_hist_summary_t sum;
+    int failures = 0;
+
+    ss_dfprintf(stderr, "testhistogram : small exact values");
+    hist = ts_hist_alloc();
+    ss_info_dassert(hist != NULL, "Histogram allocation should succeed");
+
+    ts_hist_summary(hist, &sum);
+    ss_info_dassert(sum.count == 0 && sum.p50 == 0 && sum.max == 0,
+                    "Empty histogram should have no values");
+
+    for (int i = 1; i <= 10; i++)
+    {
+        ts_hist_add(hist, i);
+    }
+    ts_hist_summary(hist, &sum);
+    ss_info_dassert(sum.count == 10, "Histogram should have 10 values");
+    ss_info_dassert(sum.sum == 55, "Sum of values should be 55");
+    ss_info_dassert(sum.max == 10, "Maximum should be 10");
+    ss_info_dassert(sum.p50 == 5, "Median of 1 - 10 should be 5");
+    ss_info_dassert(sum.p99 == 10, "99th percentile of 1 - 10 should be 10");
+    ss_dfprintf(stderr, "\t..done\n");
+    ts_hist_free(hist);
+
+    ss_dfprintf(stderr, "testhistogram : large values");
+    hist = ts_hist_alloc();
+
+    for (uint64_t i = 1; i <= 100000; i++)
+    {
+        ts_hist_add(hist, i * 1000);
+    }
+    ts_hist_summary(hist, &sum);
+    ss_info_dassert(sum.count == 100000, "Histogram should have 100000 values");
+    ss_info_dassert(sum.max == 100000000, "Maximum should be 100000000");
+    failures += check_value("p50", sum.p50, 50000000);
+    failures += check_value("p99", sum.p99, 99000000);
+    failures += check_value("p999", sum.p999, 99900000);
+    failures += check_value("p10", ts_hist_percentile(hist, 10.0), 10000000);
+    ss_info_dassert(failures == 0, "Percentiles should be within the histogram precision");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    ss_dfprintf(stderr, "testhistogram : extreme values");
+    ts_hist_add(hist, UINT64_MAX);
+    ts_hist_add(hist, 0);
+    ts_hist_summary(hist, &sum);
+    ss_info_dassert(sum.count == 100002, "Histogram should have 100002 values");
+    ss_info_dassert(sum.max == UINT64_MAX, "Maximum should be UINT64_MAX");
+    ss_info_dassert(ts_hist_percentile(hist, 100.0) == UINT64_MAX,
+                    "100th percentile should be the maximum");
+    ss_info_dassert(ts_hist_percentile(hist, 0.0) == 0, "0th percentile should be 0");
+    ss_dfprintf(stderr, "\t..done\n");
+    ts_hist_free(hist);
+
+    ss_dfprintf(stderr, "testhistogram : clock");
+    uint64_t start = ts_clock_ns();
+    uint64_t end = ts_clock_ns();
+    ss_info_dassert(start > 0 && end >= start, "Monotonic clock should not go backwards");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+#define N_ADDERS    4
+#define N_ADDS      100000
+
+static ts_stats_t counter;
+
+/**
+ * Add to the counter from a thread. Thread 0 uses its own slot and the
+ * others, which have no slot of their own, use the shared one.
+ */
+static void*
+adder(void *data)
+{
+    ts_stats_set_thread_id((int)(intptr_t)data);
+    for (int i = 0; i < N_ADDS; i++)
+    {
+        ts_stats_add(counter, 1);
+    }
+    return NULL;
+}
+
+/**
+ * Find the test counter in the registry
+ */
+static void
+find_metric(const TS_METRIC *metric, void *data)
+{
+    const TS_METRIC **found = (const TS_METRIC**)data;
+
+    if (strcmp(metric->name, "test_counter_total") == 0)
+    {
+        *found = metric;
+    }
+}
+
+/**
+ * Test the statistics objects and the metric registry
+ *
+ * @return 0 on success
+ */
+static int
+test2()
+{
+    pthread_t threads[N_ADDERS];
+    const TS_METRIC *found;
+
+    ss_dfprintf(stderr, "teststatistics : concurrent additions");
+    counter = ts_stats_register("test_counter_total", "test=\"yes\"", "Test counter",
+                                TS_METRIC_COUNTER);
+    ss_info_dassert(counter != NULL, "Registration should succeed");
+    ss_info_dassert(((uintptr_t)counter % TS_CACHE_LINE) == 0,
+                    "Statistics should start on a cache line");
+
+    for (int i = 0; i < N_ADDERS; i++)
+    {
+        pthread_create(&threads[i], NULL, adder, (void*)(intptr_t)(i * 100));
+    }
+    for (int i = 0; i < N_ADDERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    ss_info_dassert(ts_stats_sum(counter) == N_ADDERS * N_ADDS,
+                    "No additions should be lost");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    ss_dfprintf(stderr, "teststatistics : 64-bit values");
+    ts_stats_add(counter, INT64_C(1) << 40);
+    ts_stats_add(counter, -(N_ADDERS * N_ADDS));
+    ss_info_dassert(ts_stats_sum(counter) == INT64_C(1) << 40, "Counters should not wrap");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    ss_dfprintf(stderr, "teststatistics : registry");
+    found = NULL;
+    ts_metric_foreach(find_metric, &found);
+    ss_info_dassert(found != NULL && found->data == counter, "The metric should be registered");
+    ss_info_dassert(found->type == TS_METRIC_COUNTER, "The metric should be a counter");
+    ss_info_dassert(strcmp(found->labels, "test=\"yes\"") == 0, "The labels should be stored");
+    ts_metric_set_labels(counter, "test=\"no\"");
+    ss_info_dassert(strcmp(found->labels, "test=\"no\"") == 0, "The labels should be changed");
+
+    ts_stats_free(counter);
+    found = NULL;
+    ts_metric_foreach(find_metric, &found);
+    ss_info_dassert(found == NULL, "A freed metric should be removed");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+/**
+ * Test the Prometheus export of the registry
+ *
+ * @return 0 on success
+ */
+static int
+test3()
+{
+    ts_stats_t a, b, gauge, odd;
+    ts_hist_t hist;
+    size_t len;
+    char *text;
+    const char *help;
+    const char *name = "a\\b\"c\nd";
+    char label[TS_LABEL_SIZE("service", name)];
+
+    ss_dfprintf(stderr, "teststatistics : export");
+    a = ts_stats_register("test_queries_total", "service=\"a\"", "Test queries", TS_METRIC_COUNTER);
+    gauge = ts_stats_register("test_sessions", NULL, "Test sessions", TS_METRIC_GAUGE);
+    b = ts_stats_register("test_queries_total", "service=\"b\"", "Test queries", TS_METRIC_COUNTER);
+    hist = ts_hist_register("test_latency_ns", "service=\"a\"", "Test latency");
+    odd = ts_stats_register("test_odd_total", ts_metric_label(label, sizeof(label), "service", name),
+                            "Test label escapes", TS_METRIC_COUNTER);
+
+    ts_stats_add(a, 5000000000);
+    ts_stats_add(b, 2);
+    ts_stats_add(gauge, -3);
+    for (int i = 1; i <= 10; i++)
+    {
+        ts_hist_add(hist, i);
+    }
+
+    text = ts_metric_export(&len);
+    ss_info_dassert(text != NULL && strlen(text) == len, "The export should succeed");
+    ss_info_dassert(strstr(text, "# TYPE test_queries_total counter\n") != NULL,
+                    "The type should be declared");
+    help = strstr(text, "# HELP test_queries_total Test queries\n");
+    ss_info_dassert(help && strstr(help + 1, "# HELP test_queries_total") == NULL,
+                    "The metric should be declared once");
+    ss_info_dassert(strstr(text, "test_queries_total{service=\"a\"} 5000000000\n"
+                           "test_queries_total{service=\"b\"} 2\n") != NULL,
+                    "The samples of a metric should be together");
+    ss_info_dassert(strstr(text, "# TYPE test_sessions gauge\ntest_sessions -3\n") != NULL,
+                    "A metric without labels should have no braces");
+    ss_info_dassert(strstr(text, "# TYPE test_latency_ns summary\n") != NULL,
+                    "Histograms should be summaries");
+    ss_info_dassert(strstr(text, "test_latency_ns{service=\"a\",quantile=\"0.5\"} 5\n") != NULL,
+                    "The median should be exported");
+    ss_info_dassert(strstr(text, "test_latency_ns_sum{service=\"a\"} 55\n"
+                           "test_latency_ns_count{service=\"a\"} 10\n") != NULL,
+                    "The sum and count should be exported");
+    ss_info_dassert(strstr(text, "test_odd_total{service=\"a\\\\b\\\"c\\nd\"} 0\n") != NULL,
+                    "Backslashes, quotes and line feeds of label values should be escaped");
+    free(text);
+
+    ts_stats_free(a);
+    ts_stats_free(b);
+    ts_stats_free(gauge);
+    ts_hist_free(hist);
+    ts_stats_free(odd);
+    text = ts_metric_export(&len);
+    ss_info_dassert(text != NULL && strstr(text, "test_") == NULL, "Freed metrics should not be exported");
+    free(text);
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+#define N_CHANGES   1000
+
+static volatile bool changing = true;
+
+static void* exporter(void *data)
+{
+    int *failures = data;
+    size_t len;
+
+    while (changing)
+    {
+        char *text = ts_metric_export(&len);
+        if (text == NULL || strlen(text) != len)
+        {
+            (*failures)++;
+        }
+        free(text);
+    }
+    return NULL;
+}
+
+/**
+ * Test that the metrics can be freed and relabeled during an export
+ *
+ * @return 0 on success
+ */
+static int
+test4()
+{
+    pthread_t thread;
+    int failures = 0;
+    size_t len;
+    char *text;
+
+    ss_dfprintf(stderr, "teststatistics : changes during export");
+    pthread_create(&thread, NULL, exporter, &failures);
+    for (int i = 0; i < N_CHANGES; i++)
+    {
+        ts_stats_t stats = ts_stats_register("test_changes_total", "n=\"1\"", "Test changes",
+                                             TS_METRIC_COUNTER);
+        ts_hist_t hist = ts_hist_register("test_changes_ns", NULL, "Test changes");
+        ts_hist_add(hist, i);
+        ts_metric_set_labels(stats, "n=\"2\"");
+        ts_metric_set_labels(hist, "n=\"3\"");
+        ts_stats_free(stats);
+        ts_hist_free(hist);
+    }
+    changing = false;
+    pthread_join(thread, NULL);
+    ss_info_dassert(failures == 0, "The exports should succeed");
+
+    text = ts_metric_export(&len);
+    ss_info_dassert(text != NULL && strstr(text, "test_changes") == NULL,
+                    "Freed metrics should not be exported");
+    free(text);
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    ts_stats_init();
+    result += test1();
+    result += test2();
+    result += test3();
+    result += test4();
+
+    exit(result);
+}
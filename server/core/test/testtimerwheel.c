@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testtimerwheel.c - Tests for the hierarchical timer wheel
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <timerwheel.h>
+#include <skygw_debug.h>
+
+#define N_TIMERS 1000
+
+typedef struct
+{
+    TIMER    timer;
+    uint64_t fired;     /*< The tick when the timer was fired, 0 if not fired */
+} TEST_TIMER;
+
+static uint64_t current_tick;
+
+static void
+test_fire(void *data)
+{
+    TEST_TIMER *t = (TEST_TIMER *)data;
+    t->fired = current_tick;
+}
+
+/**
+ * Advance the wheel one tick at a time and fire the expired timers
+ *
+ * @return Number of timers fired
+ */
+static int
+advance(TIMERWHEEL *wheel, uint64_t to)
+{
+    TIMER *timer;
+    int n = 0;
+
+    while (current_tick < to)
+    {
+        current_tick++;
+        timerwheel_advance(wheel, current_tick);
+        while ((timer = timerwheel_pop_expired(wheel)) != NULL)
+        {
+            ss_info_dassert(!timer_is_armed(timer), "Expired timer should not be armed");
+            timer->fn(timer->data);
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * Test that timers on all levels of the wheel fire on the right tick
+ *
+ * @return 0 on success
+ */
+static int
+test1()
+{
+    static TIMERWHEEL wheel;
+    static TEST_TIMER timers[N_TIMERS];
+    uint64_t delays[N_TIMERS];
+    uint64_t start = 12345;
+
+    ss_dfprintf(stderr, "testtimerwheel : expiry on all levels");
+    current_tick = start;
+    timerwheel_init(&wheel, start);
+
+    for (int i = 0; i < N_TIMERS; i++)
+    {
+        /** Spread the delays over the levels, including slot boundaries */
+        delays[i] = (i % 4 == 0) ? i + 1 : ((uint64_t)i * i * 37) % 300000 + 1;
+        timers[i].fired = 0;
+        timer_init(&timers[i].timer, test_fire, &timers[i]);
+        timerwheel_add(&wheel, &timers[i].timer, start + delays[i]);
+    }
+    ss_info_dassert(wheel.n_timers == N_TIMERS, "All timers should be armed");
+
+    int n = advance(&wheel, start + 300001);
+    ss_info_dassert(n == N_TIMERS, "All timers should have fired");
+    ss_info_dassert(wheel.n_timers == 0, "No timers should be armed");
+
+    for (int i = 0; i < N_TIMERS; i++)
+    {
+        ss_info_dassert(timers[i].fired == start + delays[i],
+                        "Timer should fire on the tick it expires");
+    }
+    ss_dfprintf(stderr, "\t..done\n");
+    return 0;
+}
+
+/**
+ * Test cancelling and re-arming of timers
+ *
+ * @return 0 on success
+ */
+static int
+test2()
+{
+    static TIMERWHEEL wheel;
+    TEST_TIMER a, b, c;
+
+    ss_dfprintf(stderr, "testtimerwheel : cancel and re-arm");
+    current_tick = 0;
+    timerwheel_init(&wheel, 0);
+    a.fired = b.fired = c.fired = 0;
+    timer_init(&a.timer, test_fire, &a);
+    timer_init(&b.timer, test_fire, &b);
+    timer_init(&c.timer, test_fire, &c);
+
+    ss_info_dassert(!timerwheel_cancel(&a.timer), "Unarmed timer can't be cancelled");
+    timerwheel_add(&wheel, &a.timer, 100);
+    timerwheel_add(&wheel, &b.timer, 5000);
+    timerwheel_add(&wheel, &c.timer, 70);
+    ss_info_dassert(timer_is_armed(&a.timer), "Timer should be armed");
+    ss_info_dassert(timerwheel_cancel(&a.timer), "Armed timer should be cancelled");
+    ss_info_dassert(!timer_is_armed(&a.timer), "Cancelled timer should not be armed");
+
+    /** Re-arming moves the timer */
+    timerwheel_add(&wheel, &b.timer, 200);
+    timerwheel_add(&wheel, &c.timer, 300);
+    advance(&wheel, 250);
+    ss_info_dassert(a.fired == 0, "Cancelled timer should not fire");
+    ss_info_dassert(b.fired == 200, "Re-armed timer should fire at the new time");
+    ss_info_dassert(c.fired == 0, "Re-armed timer should not fire at the old time");
+
+    /** A timer that is already due fires on the next advance */
+    timerwheel_add(&wheel, &a.timer, 10);
+    advance(&wheel, 251);
+    ss_info_dassert(a.fired == 251, "Overdue timer should fire immediately");
+
+    advance(&wheel, 6000);
+    ss_info_dassert(c.fired == 300, "Timer should fire at its re-armed time");
+    ss_info_dassert(wheel.n_timers == 0, "No timers should be armed");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    ss_dfprintf(stderr, "testtimerwheel : delays longer than the wheel");
+    timerwheel_add(&wheel, &a.timer, current_tick + TW_MAX_DELAY + 1000);
+    timerwheel_advance(&wheel, current_tick + TW_MAX_DELAY + 999);
+    current_tick += TW_MAX_DELAY + 999;
+    ss_info_dassert(timerwheel_pop_expired(&wheel) == NULL, "Timer should not fire early");
+    advance(&wheel, current_tick + 1);
+    ss_info_dassert(a.fired == current_tick, "Long timer should fire on time");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    result += test1();
+    result += test2();
+
+    exit(result);
+}
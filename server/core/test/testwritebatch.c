@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testwritebatch.c - Loopback benchmark of the DCB write batches
+ *
+ * A reply made of many small packets, like a result set, is written to a
+ * DCB one packet at a time, once without a write batch and once inside one.
+ * The TCP segments the server sends per reply and the round trip time of
+ * the request and the reply are reported, and the batch is checked to send
+ * fewer segments.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <sys/socket.h>
+#include <listener.h>
+#include <dcb.h>
+#include <statistics.h>
+#include <skygw_debug.h>
+
+#define ROUNDS      2000
+#define PACKETS     40      /*< Packets per reply */
+#define PACKET_SIZE 64
+
+static int client_fd;
+static int server_fd;
+
+/**
+ * Create a connected pair of loopback sockets
+ */
+static void
+connect_pair()
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int one = 1;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ss_info_dassert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0, "bind should work");
+    ss_info_dassert(listen(listener, 1) == 0, "listen should work");
+    getsockname(listener, (struct sockaddr *)&addr, &len);
+
+    client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    ss_info_dassert(connect(client_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0,
+                    "connect should work");
+    server_fd = accept(listener, NULL, NULL);
+    ss_info_dassert(server_fd >= 0, "accept should work");
+    /** MaxScale disables Nagle's algorithm on its sockets */
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(server_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+    close(listener);
+}
+
+/**
+ * Return the number of data segments the server socket has sent
+ */
+static uint64_t
+segments_sent()
+{
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    getsockopt(server_fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    return info.tcpi_data_segs_out;
+}
+
+/**
+ * Send requests and write the replies packet by packet
+ *
+ * @param batch     Write the replies in a write batch
+ * @param segments  Set to the segments sent per reply
+ * @return The average round trip time in nanoseconds
+ */
+static uint64_t
+run(bool batch, double *segments)
+{
+    SERV_LISTENER dummy;
+    DCB *dcb = dcb_alloc(DCB_ROLE_CLIENT_HANDLER, &dummy);
+    char packet[PACKET_SIZE];
+    char reply[PACKET_SIZE * PACKETS];
+    uint64_t total_ns = 0;
+    uint64_t start_segs;
+
+    connect_pair();
+    dcb->fd = server_fd;
+    dcb->state = DCB_STATE_POLLING;
+    memset(packet, 'p', sizeof(packet));
+    start_segs = segments_sent();
+
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        char req = 'q';
+        uint64_t start = ts_clock_ns();
+        int got = 0;
+
+        ss_info_dassert(write(client_fd, &req, 1) == 1, "Request should be sent");
+        while (read(server_fd, &req, 1) != 1)
+        {
+        }
+
+        if (batch)
+        {
+            dcb_batch_begin();
+        }
+        for (int i = 0; i < PACKETS; i++)
+        {
+            GWBUF *buf = gwbuf_alloc(PACKET_SIZE);
+            memcpy(GWBUF_DATA(buf), packet, PACKET_SIZE);
+            dcb_write(dcb, buf);
+        }
+        if (batch)
+        {
+            dcb_batch_end();
+        }
+
+        while (got < sizeof(reply))
+        {
+            int n = read(client_fd, reply + got, sizeof(reply) - got);
+            ss_info_dassert(n > 0, "Reply should be received");
+            got += n;
+        }
+        total_ns += ts_clock_ns() - start;
+    }
+
+    *segments = (double)(segments_sent() - start_segs) / ROUNDS;
+    ss_info_dassert(dcb->writeq == NULL, "The write queue should be empty");
+
+    dcb->state = DCB_STATE_NOPOLLING;
+    dcb->fd = DCBFD_CLOSED;
+    dcb_close(dcb);
+    dcb_process_zombies(0);
+    close(client_fd);
+    close(server_fd);
+
+    return total_ns / ROUNDS;
+}
+
+int main(int argc, char **argv)
+{
+    double single, batched;
+    uint64_t single_ns, batched_ns;
+
+    ss_dfprintf(stderr, "testwritebatch : %d replies of %d packets", ROUNDS, PACKETS);
+    single_ns = run(false, &single);
+    batched_ns = run(true, &batched);
+
+    ss_dfprintf(stderr, "\n\t%-8s %6.2f segments/reply %8.1f us/round trip",
+                "single", single, single_ns / 1000.0);
+    ss_dfprintf(stderr, "\n\t%-8s %6.2f segments/reply %8.1f us/round trip",
+                "batched", batched, batched_ns / 1000.0);
+    ss_info_dassert(batched < single, "A batch should send fewer segments");
+    ss_info_dassert(batched < 2, "A batched reply should fit into one segment");
+    ss_dfprintf(stderr, "\n\t..done\n");
+    exit(0);
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file timerwheel.c  - Hierarchical timer wheels
+ *
+ * The slots are circular doubly linked lists with the list head stored in
+ * the wheel so that a timer can be unlinked without knowing which slot it
+ * is in.
+ */
+
+#include <timerwheel.h>
+
+static void
+timer_list_init(TIMER *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static void
+timer_list_append(TIMER *head, TIMER *timer)
+{
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void
+timer_list_unlink(TIMER *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/**
+ * Place a timer into the slot that matches its expiry time
+ *
+ * @param wheel The timer wheel
+ * @param timer The timer to place
+ */
+static void
+timerwheel_place(TIMERWHEEL *wheel, TIMER *timer)
+{
+    uint64_t expires = timer->expires;
+    TIMER *head;
+
+    if (expires <= wheel->now)
+    {
+        head = &wheel->expired;
+    }
+    else
+    {
+        if (expires - wheel->now > TW_MAX_DELAY)
+        {
+            /** Park the timer in the last reachable slot, it is placed again
+             * once that slot is cascaded */
+            expires = wheel->now + TW_MAX_DELAY;
+        }
+
+        uint64_t delta = expires - wheel->now;
+        int level = 0;
+
+        while (level < TW_LEVELS - 1 && delta >= (1ULL << (TW_BITS * (level + 1))))
+        {
+            level++;
+        }
+        head = &wheel->slots[level][(expires >> (TW_BITS * level)) & TW_MASK];
+    }
+
+    timer_list_append(head, timer);
+}
+
+/**
+ * Move the timers of a slot back into the wheel
+ *
+ * @param wheel The timer wheel
+ * @param level The level of the slot
+ * @param index The index of the slot
+ */
+static void
+timerwheel_cascade(TIMERWHEEL *wheel, int level, int index)
+{
+    TIMER *head = &wheel->slots[level][index];
+    TIMER list;
+
+    if (head->next == head)
+    {
+        return;
+    }
+
+    /** Detach the whole slot before placing the timers again */
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    timer_list_init(head);
+
+    while (list.next != &list)
+    {
+        TIMER *timer = list.next;
+        timer_list_unlink(timer);
+        timerwheel_place(wheel, timer);
+    }
+}
+
+/**
+ * Initialise a timer wheel
+ *
+ * @param wheel The timer wheel
+ * @param now   The current tick
+ */
+void
+timerwheel_init(TIMERWHEEL *wheel, uint64_t now)
+{
+    wheel->now = now;
+    wheel->n_timers = 0;
+
+    for (int level = 0; level < TW_LEVELS; level++)
+    {
+        for (int i = 0; i < TW_SLOTS; i++)
+        {
+            timer_list_init(&wheel->slots[level][i]);
+        }
+    }
+    timer_list_init(&wheel->expired);
+}
+
+/**
+ * Initialise a timer
+ *
+ * @param timer The timer
+ * @param fn    The function called when the timer expires
+ * @param data  The data passed to the function
+ */
+void
+timer_init(TIMER *timer, void (*fn)(void *), void *data)
+{
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->fn = fn;
+    timer->data = data;
+    timer->wheel = NULL;
+}
+
+/**
+ * Arm a timer
+ *
+ * If the timer is already armed in this wheel it is re-armed with the new
+ * expiry time. A timer armed in another wheel must be cancelled first.
+ *
+ * @param wheel   The timer wheel
+ * @param timer   The timer to arm
+ * @param expires The tick when the timer expires
+ */
+void
+timerwheel_add(TIMERWHEEL *wheel, TIMER *timer, uint64_t expires)
+{
+    if (timer->wheel)
+    {
+        timerwheel_cancel(timer);
+    }
+
+    timer->expires = expires;
+    timer->wheel = wheel;
+    wheel->n_timers++;
+    timerwheel_place(wheel, timer);
+}
+
+/**
+ * Cancel a timer
+ *
+ * @param timer The timer to cancel
+ * @return True if the timer was armed, false if it had already been fired
+ * or was never armed
+ */
+bool
+timerwheel_cancel(TIMER *timer)
+{
+    TIMERWHEEL *wheel = timer->wheel;
+
+    if (wheel == NULL)
+    {
+        return false;
+    }
+
+    timer_list_unlink(timer);
+    timer->wheel = NULL;
+    wheel->n_timers--;
+    return true;
+}
+
+/**
+ * Advance the wheel to the given tick
+ *
+ * The timers that expire on or before the tick are moved to the list of
+ * expired timers from where they can be taken with timerwheel_pop_expired.
+ *
+ * @param wheel The timer wheel
+ * @param now   The current tick
+ */
+void
+timerwheel_advance(TIMERWHEEL *wheel, uint64_t now)
+{
+    if (wheel->n_timers == 0 && now > wheel->now)
+    {
+        wheel->now = now;
+        return;
+    }
+
+    while (wheel->now < now)
+    {
+        wheel->now++;
+
+        int index = wheel->now & TW_MASK;
+
+        for (int level = 1; index == 0 && level < TW_LEVELS; level++)
+        {
+            index = (wheel->now >> (TW_BITS * level)) & TW_MASK;
+            timerwheel_cascade(wheel, level, index);
+        }
+
+        TIMER *head = &wheel->slots[0][wheel->now & TW_MASK];
+
+        while (head->next != head)
+        {
+            TIMER *timer = head->next;
+            timer_list_unlink(timer);
+            timer_list_append(&wheel->expired, timer);
+        }
+    }
+}
+
+/**
+ * Take the next expired timer from the wheel
+ *
+ * The returned timer is no longer armed and the caller is expected to call
+ * its function. The function may arm the timer again.
+ *
+ * @param wheel The timer wheel
+ * @return The next expired timer or NULL if no timers have expired
+ */
+TIMER *
+timerwheel_pop_expired(TIMERWHEEL *wheel)
+{
+    TIMER *timer = wheel->expired.next;
+
+    if (timer == &wheel->expired)
+    {
+        return NULL;
+    }
+
+    timerwheel_cancel(timer);
+    return timer;
+}
@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file uring.c  - A minimal io_uring interface
+ *
+ * The submission and completion rings are mapped into the process and used
+ * directly, the system calls are only needed to submit a batch of requests.
+ * The provided buffers are registered as a buffer ring which the kernel
+ * takes buffers from when a receive with IOSQE_BUFFER_SELECT completes.
+ */
+
+#include <uring.h>
+
+#ifdef HAVE_IO_URING
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <log_manager.h>
+
+static int
+uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int
+uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Give a provided buffer to the kernel
+ *
+ * @param ring  The ring
+ * @param bid   ID of the buffer
+ */
+static void
+uring_add_buffer(URING *ring, unsigned bid)
+{
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUF_COUNT - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, (uint16_t)ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Register the provided buffers of a ring
+ *
+ * @param ring  The ring
+ * @return True on success
+ */
+static bool
+uring_setup_buffers(URING *ring)
+{
+    struct io_uring_buf_reg reg;
+    size_t size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+
+    ring->buf_ring = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        return false;
+    }
+
+    if ((ring->buffers = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE)) == NULL)
+    {
+        return false;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+
+    if (uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        return false;
+    }
+
+    ring->buf_tail = 0;
+    for (unsigned bid = 0; bid < URING_BUF_COUNT; bid++)
+    {
+        uring_add_buffer(ring, bid);
+    }
+
+    return true;
+}
+
+/**
+ * Create a ring with provided buffers
+ *
+ * @return The new ring or NULL if io_uring is not available
+ */
+URING *
+uring_create()
+{
+    struct io_uring_params params;
+    URING *ring;
+    char *mem;
+
+    if ((ring = calloc(1, sizeof(URING))) == NULL)
+    {
+        return NULL;
+    }
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+
+    if ((ring->fd = uring_setup(URING_ENTRIES, &params)) == -1)
+    {
+        char errbuf[STRERROR_BUFLEN];
+        MXS_ERROR("Failed to create io_uring: %d, %s", errno,
+                  strerror_r(errno, errbuf, sizeof(errbuf)));
+        free(ring);
+        return NULL;
+    }
+
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0)
+    {
+        MXS_ERROR("The kernel does not support the features of io_uring that are needed.");
+        close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+
+    ring->ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    if (params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) > ring->ring_size)
+    {
+        ring->ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->ring_mem = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->ring_mem == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        char errbuf[STRERROR_BUFLEN];
+        MXS_ERROR("Failed to map io_uring: %d, %s", errno,
+                  strerror_r(errno, errbuf, sizeof(errbuf)));
+        ring->ring_mem = ring->ring_mem == MAP_FAILED ? NULL : ring->ring_mem;
+        ring->sqes = ring->sqes == MAP_FAILED ? NULL : ring->sqes;
+        uring_destroy(ring);
+        return NULL;
+    }
+
+    mem = ring->ring_mem;
+    ring->sq_head = (unsigned *)(mem + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(mem + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(mem + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(mem + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(mem + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(mem + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(mem + params.cq_off.cqes);
+
+    /** The submission queue entries are used in order */
+    unsigned *array = (unsigned *)(mem + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++)
+    {
+        array[i] = i;
+    }
+
+    if (!uring_setup_buffers(ring))
+    {
+        char errbuf[STRERROR_BUFLEN];
+        MXS_ERROR("Failed to register the io_uring buffer ring: %d, %s", errno,
+                  strerror_r(errno, errbuf, sizeof(errbuf)));
+        uring_destroy(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+/**
+ * Destroy a ring. The requests in flight are cancelled by the kernel.
+ *
+ * @param ring  The ring to destroy
+ */
+void
+uring_destroy(URING *ring)
+{
+    if (ring)
+    {
+        if (ring->sqes)
+        {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        if (ring->ring_mem)
+        {
+            munmap(ring->ring_mem, ring->ring_size);
+        }
+        close(ring->fd);
+        if (ring->buf_ring)
+        {
+            munmap(ring->buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+        }
+        free(ring->buffers);
+        free(ring);
+    }
+}
+
+/**
+ * Get a free submission queue entry. If the queue is full, the prepared
+ * requests are submitted first.
+ *
+ * @param ring  The ring
+ * @return A cleared entry or NULL if the kernel does not consume the queue
+ */
+struct io_uring_sqe *
+uring_get_sqe(URING *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (ring->sq_local_tail - head >= ring->sq_entries)
+    {
+        uring_submit(ring, 0);
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+        if (ring->sq_local_tail - head >= ring->sq_entries)
+        {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_local_tail++;
+
+    return sqe;
+}
+
+/**
+ * Submit the prepared requests with one system call
+ *
+ * @param ring  The ring
+ * @param wait  Number of completions to wait for
+ * @return Number of submitted requests or -1 on error
+ */
+int
+uring_submit(URING *ring, unsigned wait)
+{
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (to_submit == 0 && wait == 0)
+    {
+        return 0;
+    }
+
+    int rc = uring_enter(ring->fd, to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+    ring->n_enter++;
+
+    if (rc > 0)
+    {
+        ring->n_sqes += rc;
+    }
+    else if (rc == -1 && errno != EAGAIN && errno != EBUSY && errno != EINTR)
+    {
+        char errbuf[STRERROR_BUFLEN];
+        MXS_ERROR("Failed to submit io_uring requests: %d, %s", errno,
+                  strerror_r(errno, errbuf, sizeof(errbuf)));
+    }
+
+    return rc;
+}
+
+/**
+ * Get the next completion
+ *
+ * @param ring  The ring
+ * @return The oldest completion or NULL if there are none. It must be
+ *         released with uring_cqe_seen.
+ */
+struct io_uring_cqe *
+uring_peek_cqe(URING *ring)
+{
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+/**
+ * Release the completion returned by uring_peek_cqe
+ *
+ * @param ring  The ring
+ */
+void
+uring_cqe_seen(URING *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+    ring->n_cqes++;
+}
+
+/**
+ * Get the provided buffer that holds the data of a completion
+ *
+ * @param ring  The ring
+ * @param cqe   The completion
+ * @return The buffer or NULL if the completion has no buffer
+ */
+char *
+uring_buffer(URING *ring, const struct io_uring_cqe *cqe)
+{
+    if ((cqe->flags & IORING_CQE_F_BUFFER) == 0)
+    {
+        return NULL;
+    }
+
+    return ring->buffers + (size_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) * URING_BUF_SIZE;
+}
+
+/**
+ * Give the buffer of a completion back to the kernel
+ *
+ * @param ring  The ring
+ * @param cqe   The completion
+ */
+void
+uring_recycle_buffer(URING *ring, const struct io_uring_cqe *cqe)
+{
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        uring_add_buffer(ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+}
+
+/**
+ * Check that the kernel supports multishot receives with provided buffers
+ *
+ * A receive is started on a socket pair and one byte is sent. The receive
+ * must complete with the byte in a provided buffer and stay armed.
+ *
+ * @return True if the io_uring backend can be used
+ */
+bool
+uring_supported()
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        URING *ring = uring_create();
+        int sv[2];
+
+        supported = 0;
+
+        if (ring && socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0)
+        {
+            struct io_uring_sqe *sqe = uring_get_sqe(ring);
+            struct io_uring_cqe *cqe;
+
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = sv[0];
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUF_GROUP;
+
+            if (uring_submit(ring, 0) == 1 && write(sv[1], "x", 1) == 1 &&
+                uring_submit(ring, 1) >= 0 && (cqe = uring_peek_cqe(ring)))
+            {
+                supported = cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE) &&
+                            uring_buffer(ring, cqe) && *uring_buffer(ring, cqe) == 'x';
+                uring_cqe_seen(ring);
+            }
+
+            close(sv[0]);
+            close(sv[1]);
+        }
+
+        uring_destroy(ring);
+    }
+
+    return supported == 1;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _AFFINITY_H
+#define _AFFINITY_H
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file affinity.h  - CPU affinity and NUMA placement of the MaxScale threads
+ *
+ * The placement is planned once the configuration has been read. Each
+ * polling thread is then pinned to one CPU and the other threads of MaxScale
+ * (housekeeper, log writer and monitors) to the CPUs that are left over.
+ * Memory that belongs to a polling thread is preferably taken from the NUMA
+ * node of its CPU.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct dcb;
+
+extern bool affinity_valid(const char *spec);
+extern void affinity_init();
+extern void affinity_set_poll_thread(int thread_id);
+extern void affinity_set_other_thread(const char *name);
+extern int  affinity_thread_cpu(int thread_id);
+extern int  affinity_thread_node(int thread_id);
+extern void affinity_bind_array(void *array, size_t elem_size, int n_elems);
+extern void affinity_show(struct dcb *dcb);
+
+#endif
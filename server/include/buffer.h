@@ -43,6 +43,7 @@
  * @endverbatim
  */
 #include <string.h>
+#include <stdbool.h>
 #include <skygw_debug.h>
 #include <hint.h>
 #include <spinlock.h>
@@ -91,6 +92,7 @@ typedef struct
 {
     unsigned char   *data;                  /*< Physical memory that was allocated */
     int             refcount;               /*< Reference count on the buffer */
+    int             pool;                   /*< Size class of the block, -1 if not pooled */
 } SHARED_BUF;
 
 typedef enum
@@ -179,6 +181,20 @@ typedef struct gwbuf
      (void *)((char *)(b)->end - (bytes)));
 
 #define GWBUF_TYPE(b) (b)->gwbuf_type
+
+/**
+ * A read position in a chain of buffers. The position is always in a
+ * non-empty buffer, buf is NULL when the end of the chain has been reached.
+ */
+typedef struct gwbuf_cursor
+{
+    GWBUF   *buf;   /*< Buffer of the position */
+    uint8_t *ptr;   /*< The position in the buffer */
+} GWBUF_CURSOR;
+
+/*< Number of bytes from the cursor to the end of its buffer */
+#define GWBUF_CURSOR_AVAIL(c) ((c)->buf ? (size_t)((uint8_t *)(c)->buf->end - (c)->ptr) : 0)
+
 /*<
  * Function prototypes for the API to maniplate the buffers
  */
@@ -195,6 +211,10 @@ extern int              gwbuf_count(GWBUF *head);
 extern size_t           gwbuf_copy_data(GWBUF *buffer, size_t offset, size_t bytes,
                                         uint8_t* dest);
 extern GWBUF            *gwbuf_split(GWBUF **buf, size_t length);
+extern void             gwbuf_cursor_init(GWBUF_CURSOR *cur, GWBUF *buf);
+extern size_t           gwbuf_cursor_skip(GWBUF_CURSOR *cur, size_t bytes);
+extern size_t           gwbuf_cursor_peek(const GWBUF_CURSOR *cur, size_t offset, size_t bytes,
+                                          uint8_t* dest);
 extern GWBUF            *gwbuf_clone_transform(GWBUF *head, gwbuf_type_t type);
 extern GWBUF            *gwbuf_clone_all(GWBUF* head);
 extern void             gwbuf_set_type(GWBUF *head, gwbuf_type_t type);
@@ -208,6 +228,8 @@ void                    gwbuf_add_buffer_object(GWBUF* buf,
                                                 void*  data,
                                                 void (*donefun_fp)(void *));
 void*                   gwbuf_get_buffer_object_data(GWBUF* buf, bufobj_id_t id);
+extern bool             gwbuf_arena_init(size_t mb);
+extern void             dprintBufferPools(void *pdcb);
 #if defined(BUFFER_TRACE)
 extern void             dprintAllBuffers(void *pdcb);
 #endif
@@ -19,8 +19,13 @@
 #include <gw_ssl.h>
 #include <modinfo.h>
 #include <gwbitmask.h>
+#include <mailbox.h>
+#include <timerwheel.h>
+#include <membudget.h>
 #include <skygw_utils.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #define ERRHANDLE
 
@@ -63,6 +68,19 @@ struct servlistener;
 
 struct dcb;
 
+/**
+ * The scheduling states of a DCB in the work-stealing poll mode. A DCB is
+ * in at most one run queue and only the thread that moved it from
+ * DCB_SCHED_QUEUED to DCB_SCHED_RUNNING processes its events.
+ */
+typedef enum
+{
+    DCB_SCHED_IDLE,     /**< No events, not in a run queue */
+    DCB_SCHED_QUEUED,   /**< Waiting in a run queue */
+    DCB_SCHED_RUNNING,  /**< Events are being processed */
+    DCB_SCHED_RERUN     /**< Being processed and new events have arrived */
+} dcb_sched_t;
+
 /**
  * The event queue structure used in the polling loop to maintain a queue
  * of events that need to be processed for the DCB.
@@ -73,8 +91,12 @@ struct dcb;
  *      processing_events       The evets currently being processed
  *      processing              Flag to indicate the processing status of the DCB
  *      eventqlock              Spinlock to protect this structure
+ *      sched                   Scheduling state in the work-stealing poll mode
  *      inserted                Insertion time for logging purposes
  *      started                 Time that the processign started
+ *      inserted_ns             Insertion time in nanoseconds for the latency histograms
+ *      mbox                    Links the DCB into the mailbox of the owning thread
+ *      posted_events           Events posted to the mailbox but not yet queued
  */
 typedef struct
 {
@@ -84,12 +106,53 @@ typedef struct
     uint32_t        processing_events;
     int             processing;
     SPINLOCK        eventqlock;
+    int             sched;
     unsigned long   inserted;
     unsigned long   started;
+    uint64_t        inserted_ns;
+    MAILBOX_NODE    mbox;
+    uint32_t        posted_events;
 } DCBEVENTQ;
 
 #define DCBFD_CLOSED -1
 
+#define DCB_URING_IOV   32  /**< Buffers sent with one io_uring request */
+
+#define DCB_URING_RECV  0x01    /**< A multishot receive is armed */
+#define DCB_URING_SEND  0x02    /**< A send is in flight */
+
+/**
+ * The state of a DCB whose network I/O is done with io_uring. It is only
+ * changed by the owning polling thread, the reference count tells the zombie
+ * processing that the kernel or a posted function still refers to the DCB.
+ */
+typedef struct dcb_uring
+{
+    int             flags;                  /**< DCB_URING_RECV and DCB_URING_SEND */
+    int             refs;                   /**< Requests in flight and posted functions */
+    struct msghdr   msg;                    /**< The message of the send in flight */
+    struct iovec    iov[DCB_URING_IOV];     /**< The buffers of the send in flight */
+} DCB_URING;
+
+#define DCB_SPLICE_SIZE 65536   /**< Bytes moved with one splice call */
+
+/**
+ * Two connections whose data is moved between the sockets with splice
+ * without reading it into buffers. The data read from dcbs[i] goes through
+ * pipes[i] to the other connection. The structure is shared by the two DCBs
+ * and freed when both have been freed.
+ */
+typedef struct dcb_splice
+{
+    SPINLOCK        lock;
+    bool            active;         /**< False when the normal read path is used */
+    struct dcb      *dcbs[2];       /**< The two connections */
+    int             pipes[2][2];    /**< Pipe of the data read from each connection */
+    int             pending[2];     /**< Bytes in each pipe */
+    uint64_t        bytes[2];       /**< Bytes moved from each connection */
+    int             refs;           /**< Number of DCBs referring to this */
+} DCB_SPLICE;
+
 /**
  * The statistics gathered on a descriptor control block
  */
@@ -101,6 +164,7 @@ typedef struct dcbstats
     int     n_buffered;     /*< Number of buffered writes */
     int     n_high_water;   /*< Number of crosses of high water mark */
     int     n_low_water;    /*< Number of crosses of low water mark */
+    int     n_throttled;    /*< Number of times the reads were paused */
 } DCBSTATS;
 
 /**
@@ -114,17 +178,20 @@ typedef struct dcbstats
  * call, the is the only way we can be sure that no polling thread is pending a wakeup or
  * processing an event that will access the DCB.
  *
- * We solve this issue by making the dcb_free routine merely mark a DCB as a zombie and
- * place it on a special zombie list. Before placing the DCB on the zombie list we create
- * a bitmask with a bit set in it for each active polling thread. Each thread will call
- * a routine to process the zombie list at the end of the polling loop. This routine
- * will clear the bit value that corresponds to the calling thread. Once the bitmask
- * is completely cleared the DCB can finally be freed and removed from the zombie list.
+ * We solve this issue with epoch based reclamation. Closing a DCB merely marks it as a
+ * zombie, stamps it with the current value of a global epoch counter, which is then
+ * advanced, and places it on a list of the closing thread. Each polling thread publishes
+ * the epoch it has seen at the end of every iteration of the polling loop, a point where
+ * it holds no references to DCBs. Once every polling thread has published a later epoch
+ * than the one of the zombie, the DCB can no longer be referenced and it is finally freed
+ * by the thread that closed it. No lists are shared between the threads.
+ *
+ * The freed DCBs are kept in per-thread pools for reuse.
  */
 typedef struct
 {
-    GWBITMASK       bitmask;        /*< The bitmask of threads */
-    struct dcb      *next;          /*< Next pointer for the zombie list */
+    uint64_t        epoch;          /*< The epoch in which the DCB was closed */
+    struct dcb      *next;          /*< Next pointer for the zombie list or the free pool */
 } DCBMM;
 
 /* DCB states */
@@ -206,6 +273,7 @@ typedef struct dcb
     dcb_role_t      dcb_role;
     SPINLOCK        dcb_initlock;
     DCBEVENTQ       evq;            /**< The event queue for this DCB */
+    int             owner;          /**< Owning polling thread or -1 if shared */
     int             fd;             /**< The descriptor */
     dcb_state_t     state;          /**< Current descriptor state */
     SSL_STATE       ssl_state;      /**< Current state of SSL if in use */
@@ -232,9 +300,9 @@ typedef struct dcb
 
     DCBSTATS        stats;          /**< DCB related statistics */
     unsigned int    dcb_server_status; /*< the server role indicator from SERVER */
-    struct dcb      *next;          /**< Next DCB in the chain of allocated DCB's */
     struct dcb      *nextpersistent;   /**< Next DCB in the persistent pool for SERVER */
     time_t          persistentstart;   /**< Time when DCB placed in persistent pool */
+    int             persistpool;       /**< Polling thread whose pool an unowned DCB goes to */
     struct service  *service;       /**< The related service */
     void            *data;          /**< Specific client data */
     DCBMM           memdata;        /**< The data related to DCB memory management */
@@ -248,14 +316,27 @@ typedef struct dcb
     int             polloutbusy;
     int             writecheck;
     long            last_read;      /*< Last time the DCB received data */
+    DCB_URING       *uring;         /**< io_uring state or NULL if epoll is used */
+    DCB_SPLICE      *splice;        /**< Splice pass-through state or NULL */
+    GWBUF           *recv_region;   /**< Region that received data is sliced from */
+    TIMER           timer;          /**< Idle, connect or persistent pool timeout */
     int             high_water;     /**< High water mark */
     int             low_water;      /**< Low water mark */
+    SPINLOCK        throttlelock;   /**< Protects the list of throttled DCBs */
+    struct dcb      *throttled;     /**< Backend DCBs whose reads this client DCB paused */
+    struct dcb      *throttled_by;  /**< The DCB that paused the reads or NULL */
+    struct dcb      *throttle_next; /**< Next DCB paused by the same client DCB */
+    int             buffered[MEMBUDGET_N_KINDS]; /**< Queued data charged to the budget */
+    struct service  *budget_service; /**< The service the queued data is charged to */
+    bool            batched;        /**< The queue is written at the end of a write batch */
+    struct dcb      *batch_next;    /**< Next DCB of the same write batch */
     struct server   *server;        /**< The associated backend server */
     SSL*            ssl;            /*< SSL struct for connection */
     bool            ssl_read_want_read;    /*< Flag */
     bool            ssl_read_want_write;    /*< Flag */
     bool            ssl_write_want_read;    /*< Flag */
     bool            ssl_write_want_write;    /*< Flag */
+    int             ssl_write_len;  /*< Length of a coalesced SSL write that must be retried */
     int             dcb_port;       /**< port of target server */
     skygw_chk_t     dcb_chk_tail;
 } DCB;
@@ -292,7 +373,9 @@ int           fail_accept_errno;
 #define DCB_BELOW_LOW_WATER(x)          ((x)->low_water && (x)->writeqlen < (x)->low_water)
 #define DCB_ABOVE_HIGH_WATER(x)         ((x)->high_water && (x)->writeqlen > (x)->high_water)
 
-#define DCB_POLL_BUSY(x)                ((x)->evq.next != NULL)
+#define DCB_POLL_BUSY(x)                ((x)->evq.next != NULL || (x)->evq.sched != DCB_SCHED_IDLE || \
+                                         (x)->evq.posted_events != 0)
+#define DCB_URING_BUSY(x)               ((x)->uring != NULL && (x)->uring->refs > 0)
 
 DCB *dcb_get_zombies(void);
 int dcb_write(DCB *, GWBUF *);
@@ -304,8 +387,11 @@ DCB *dcb_connect(struct server *, struct session *, const char *);
 DCB *dcb_clone(DCB *);
 int dcb_read(DCB *, GWBUF **, int);
 int dcb_drain_writeq(DCB *);
+void dcb_batch_begin();
+void dcb_batch_end();
 void dcb_close(DCB *);
 DCB *dcb_process_zombies(int);              /* Process Zombies except the one behind the pointer */
+void dcb_epoch_init(int n_threads);
 void printAllDCBs();                         /* Debug to print all DCB in the system */
 void printDCB(DCB *);                        /* Debug print routine */
 void dprintAllDCBs(DCB *);                   /* Debug to print all DCB in the system */
@@ -320,7 +406,8 @@ int dcb_add_callback(DCB *, DCB_REASON, int (*)(struct dcb *, DCB_REASON, void *
 int dcb_remove_callback(DCB *, DCB_REASON, int (*)(struct dcb *, DCB_REASON, void *), void *);
 int dcb_isvalid(DCB *);                     /* Check the DCB is in the linked list */
 int dcb_count_by_usage(DCB_USAGE);          /* Return counts of DCBs */
-int dcb_persistent_clean_count(DCB *, bool);      /* Clean persistent and return count */
+int dcb_persistent_clean_count(struct server *, bool); /* Clean persistent and return count */
+void dcb_persistent_discard(DCB *);              /* Close a list of DCBs taken from a pool */
 
 void dcb_call_foreach (struct server* server, DCB_REASON reason);
 void dcb_hangup_foreach (struct server* server);
@@ -331,6 +418,13 @@ int dcb_accept_SSL(DCB* dcb);
 int dcb_connect_SSL(DCB* dcb);
 int dcb_listen(DCB *listener, const char *config, const char *protocol_name);
 void dcb_append_readqueue(DCB *dcb, GWBUF *buffer);
+void dcb_uring_sent(DCB *dcb, int written);
+bool dcb_throttle_reads(DCB *dcb);
+void dcb_buffered_add(DCB *dcb, membudget_kind_t kind, int bytes);
+int dcb_writeq_client_count();
+bool dcb_splice_start(DCB *client, DCB *backend);
+void dcb_splice_stop(DCB *dcb);
+bool dcb_splice_read(DCB *dcb);
 
 /**
  * DCB flags values
@@ -338,6 +432,10 @@ void dcb_append_readqueue(DCB *dcb, GWBUF *buffer);
 #define DCBF_CLONE              0x0001  /*< DCB is a clone */
 #define DCBF_HUNG               0x0002  /*< Hangup has been dispatched */
 #define DCBF_REPLIED    0x0004  /*< DCB was written to */
+#define DCBF_REUSEPORT          0x0008  /*< Listener socket is bound with SO_REUSEPORT */
+#define DCBF_CONNECTING         0x0010  /*< Backend connection is not yet established */
+#define DCBF_PREWARM            0x0020  /*< Backend connection is opened only to fill the pool */
+#define DCBF_REUSED             0x0040  /*< Taken from the pool, session state not yet reset */
 
 #define DCB_IS_CLONE(d) ((d)->flags & DCBF_CLONE)
 #define DCB_REPLIED(d) ((d)->flags & DCBF_REPLIED)
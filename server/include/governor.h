@@ -0,0 +1,77 @@
+#ifndef _GOVERNOR_H
+#define _GOVERNOR_H
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file governor.h  - Decides when an idle polling thread spins and when it blocks
+ *
+ * A polling thread that runs out of work can either keep calling epoll_wait
+ * without a timeout (spin) or block in the kernel. Spinning picks up the next
+ * event without a wakeup but burns CPU, blocking is cheap but adds the wakeup
+ * latency to the next event. The governor measures how long the thread stays
+ * idle before the next event arrives and spins only as long as that is likely
+ * to pay off.
+ *
+ * The governor is owned by one polling thread, only the counters are read by
+ * other threads.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The goal of the governor */
+typedef enum
+{
+    GOVERNOR_EFFICIENCY,    /**< Spin only when it is cheaper than blocking */
+    GOVERNOR_LATENCY        /**< Spin through short and moderate idle periods */
+} governor_mode_t;
+
+/** What the thread is doing */
+typedef enum
+{
+    GOVERNOR_WORKING,
+    GOVERNOR_SPINNING,
+    GOVERNOR_BLOCKED
+} governor_state_t;
+
+#define GOVERNOR_WAKEUP_NS      20000   /**< Approximate cost of blocking and waking up */
+#define GOVERNOR_MAX_SPIN_NS    500000  /**< Longest spin in the latency mode */
+#define GOVERNOR_MAX_GAP_NS     1000000000 /**< Longer idle periods are counted as this */
+
+typedef struct
+{
+    governor_mode_t  mode;
+    governor_state_t state;         /**< Current state */
+    uint64_t         state_start;   /**< When the current state was entered */
+    uint64_t         idle_start;    /**< When the thread ran out of work, 0 when working */
+    uint32_t         log_gap;       /**< Moving average of log2 of the idle periods, 24.8 fixed point */
+    int              spins;         /**< Empty non-blocking polls in this idle period */
+    int              timeout;       /**< Timeout of the next blocking poll in milliseconds */
+    uint64_t         spin_ns;       /**< Total time spent spinning */
+    uint64_t         block_ns;      /**< Total time spent blocked */
+    uint64_t         work_ns;       /**< Total time spent working */
+    uint64_t         n_spin_wakeups;  /**< Idle periods that ended while spinning */
+    uint64_t         n_block_wakeups; /**< Idle periods that ended while blocked */
+} POLL_GOVERNOR;
+
+extern void governor_init(POLL_GOVERNOR *gov, governor_mode_t mode, uint64_t now);
+extern bool governor_spin(POLL_GOVERNOR *gov, uint64_t now, int min_spins);
+extern int  governor_block(POLL_GOVERNOR *gov, uint64_t now, int max_sleep);
+extern void governor_timed_out(POLL_GOVERNOR *gov, int max_sleep);
+extern void governor_wake(POLL_GOVERNOR *gov, uint64_t now);
+extern uint64_t governor_gap(const POLL_GOVERNOR *gov);
+extern uint64_t governor_spin_budget(const POLL_GOVERNOR *gov);
+extern const char *governor_mode_to_string(governor_mode_t mode);
+
+#endif
@@ -30,6 +30,7 @@
  */
 #include <skygw_debug.h>
 #include <spinlock.h>
+#include <mutex.h>
 #include <atomic.h>
 #include <dcb.h>
 
@@ -78,9 +79,7 @@ typedef struct hashtable
     HASHMEMORYFN vcopyfn;         /**< Optional value copy function */
     HASHMEMORYFN kfreefn;         /**< Optional key free function */
     HASHMEMORYFN vfreefn;         /**< Optional value free function */
-    SPINLOCK spin;                /**< Internal spinlock for the hashtable */
-    int n_readers;                /**< Number of clients reading the table */
-    int writelock;                /**< The table is locked by a writer */
+    RWLOCK lock;                  /**< Readers and writer lock of the table */
     bool ht_isflat;               /**< Indicates whether hashtable is in stack or heap */
     int n_elements;               /**< Number of added elements */
 #if defined(SS_DEBUG)
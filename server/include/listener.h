@@ -46,6 +46,8 @@ typedef struct servlistener
     char *authenticator;        /**< Name of authenticator */
     SSL_LISTENER *ssl;          /**< Structure of SSL data or NULL */
     struct dcb *listener;       /**< The DCB for the listener */
+    struct dcb **shards;        /**< Listeners of the other threads with reuseport */
+    int n_shards;               /**< Number of listener shards */
     struct  servlistener *next; /**< Next service protocol */
 } SERV_LISTENER;
 
@@ -14,6 +14,7 @@
 #define LOG_MANAGER_H
 
 #include <stdbool.h>
+#include <pthread.h>
 #include <syslog.h>
 #include <unistd.h>
 
@@ -88,6 +89,7 @@ void mxs_log_finish(void);
 int mxs_log_flush();
 int mxs_log_flush_sync();
 int mxs_log_rotate();
+bool mxs_log_get_writer_thread(pthread_t* thread);
 
 int  mxs_log_set_priority_enabled(int priority, bool enabled);
 void mxs_log_set_syslog_enabled(bool enabled);
@@ -0,0 +1,62 @@
+#ifndef _MAILBOX_H
+#define _MAILBOX_H
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file mailbox.h  - Lock-free multi-producer, single-consumer queues
+ *
+ * A mailbox is an intrusive queue: the nodes are embedded in the objects that
+ * are posted and each node carries the function the consumer calls for it.
+ * Any thread can push nodes into a mailbox without locking but only one
+ * thread, the owner of the mailbox, may pop them.
+ *
+ * A node may only be in one mailbox at a time and it must not be pushed again
+ * before it has been popped.
+ */
+
+#include <stddef.h>
+
+#define MAILBOX_CACHE_LINE 64
+
+typedef struct mailbox_node
+{
+    struct mailbox_node * volatile next;           /*< Next node in the mailbox */
+    void (*handler)(struct mailbox_node *node);    /*< Called by the consumer */
+} MAILBOX_NODE;
+
+typedef struct mailbox
+{
+    MAILBOX_NODE * volatile head;    /*< The last pushed node, updated by the producers */
+    char         pad1[MAILBOX_CACHE_LINE - sizeof(void *)];
+    MAILBOX_NODE *tail;              /*< The next node to pop, only used by the consumer */
+    MAILBOX_NODE stub;               /*< Keeps the queue non-empty */
+    volatile int length;             /*< Number of nodes in the mailbox */
+} MAILBOX;
+
+extern void mailbox_init(MAILBOX *mailbox);
+extern void mailbox_push(MAILBOX *mailbox, MAILBOX_NODE *node);
+extern MAILBOX_NODE *mailbox_pop(MAILBOX *mailbox);
+
+/**
+ * Return the approximate number of nodes in a mailbox
+ *
+ * @param mailbox The mailbox
+ * @return Number of nodes that have been pushed but not popped
+ */
+static inline int mailbox_length(const MAILBOX *mailbox)
+{
+    return mailbox->length;
+}
+
+#endif
@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <openssl/sha.h>
 #include <spinlock.h>
+#include <governor.h>
 /**
  * @file config.h The configuration handling elements
  *
@@ -37,6 +38,8 @@
 #define _SYSNAME_STR_LENGTH     256     /**< sysname len */
 #define _RELEASE_STR_LENGTH     256     /**< release len */
 #define DEFAULT_NTHREADS        1 /**< Default number of polling threads */
+#define DEFAULT_WRITEQ_HIGH_WATER (16 * 1024 * 1024) /**< Client write queue size that pauses the backends */
+#define DEFAULT_WRITEQ_LOW_WATER  8192               /**< Client write queue size that resumes them */
 /**
  * Maximum length for configuration parameter value.
  */
@@ -70,6 +73,25 @@ enum
 
 #define PARAM_IS_TYPE(p,t) ((p) & (t))
 
+/**
+ * The way in which the polling threads share the work
+ */
+typedef enum
+{
+    POLL_MODE_GLOBAL,   /**< One epoll set and one event queue shared by all threads */
+    POLL_MODE_WORKER,   /**< Each thread has its own epoll set and owns its DCBs */
+    POLL_MODE_STEALING  /**< Per-thread run queues, idle threads steal work from others */
+} poll_mode_t;
+
+/**
+ * How the network I/O of the client and backend connections is done
+ */
+typedef enum
+{
+    IO_BACKEND_EPOLL,   /**< Readiness events from epoll, read() and write() */
+    IO_BACKEND_URING    /**< Completions of multishot receives and sends from io_uring */
+} io_backend_t;
+
 /**
  * The config parameter
  */
@@ -115,12 +137,22 @@ typedef struct
     unsigned long id;                                  /**< MaxScale ID */
     unsigned int  n_nbpoll;                            /**< Tune number of non-blocking polls */
     unsigned int  pollsleep;                           /**< Wait time in blocking polls */
+    poll_mode_t   poll_mode;                           /**< How the polling threads share work */
+    governor_mode_t poll_governor;                     /**< When the polling threads spin */
+    io_backend_t  io_backend;                          /**< How the network I/O is done */
+    bool          reuseport;                           /**< One SO_REUSEPORT listener per thread */
+    char*         cpu_affinity;                        /**< CPU affinity of the threads */
+    unsigned int  buffer_hugepages;                    /**< Size of the buffer arena in megabytes */
     int           syslog;                              /**< Log to syslog */
     int           maxlog;                              /**< Log to MaxScale's own logs */
     int           log_to_shm;                          /**< Write log-file to shared memory */
     unsigned int  auth_conn_timeout;                   /**< Connection timeout for the user authentication */
     unsigned int  auth_read_timeout;                   /**< Read timeout for the user authentication */
     unsigned int  auth_write_timeout;                  /**< Write timeout for the user authentication */
+    unsigned int  backend_connect_timeout;             /**< Timeout for establishing backend connections */
+    unsigned int  writeq_high_water;                   /**< Client write queue size that pauses the backends */
+    unsigned int  writeq_low_water;                    /**< Client write queue size that resumes the backends */
+    unsigned int  buffer_budget;                       /**< Limit of the buffered data in megabytes */
     char          qc_name[PATH_MAX];                   /**< The name of the query classifier to load */
     char*         qc_args;                             /**< Arguments for the query classifier */
 } GATEWAY_CONF;
@@ -150,6 +182,16 @@ bool                config_load(char *);
 unsigned int        config_nbpolls();
 double              config_percentage_value(char *str);
 unsigned int        config_pollsleep();
+poll_mode_t         config_poll_mode();
+governor_mode_t     config_poll_governor();
+io_backend_t        config_io_backend();
+bool                config_reuseport();
+char*               config_cpu_affinity();
+unsigned int        config_buffer_hugepages();
+unsigned int        config_backend_connect_timeout();
+unsigned int        config_writeq_high_water();
+unsigned int        config_writeq_low_water();
+unsigned int        config_buffer_budget();
 int                 config_reload();
 bool                config_set_qualified_param(CONFIG_PARAMETER* param,
                                                void* val,
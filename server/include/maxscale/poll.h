@@ -15,6 +15,7 @@
 #include <dcb.h>
 #include <gwbitmask.h>
 #include <resultset.h>
+#include <timerwheel.h>
 #include <sys/epoll.h>
 
 /**
@@ -53,6 +54,7 @@ extern  int             poll_add_dcb(DCB *);
 extern  int             poll_remove_dcb(DCB *);
 extern  void            poll_waitevents(void *);
 extern  void            poll_shutdown();
+extern  int             poll_thread_id();
 extern  GWBITMASK       *poll_bitmask();
 extern  void            poll_set_maxwait(unsigned int);
 extern  void            poll_set_nonblocking_polls(unsigned int);
@@ -63,8 +65,15 @@ extern  void            dShowEventQ(DCB *dcb);
 extern  void            dShowEventStats(DCB *dcb);
 extern  int             poll_get_stat(POLL_STAT stat);
 extern  RESULTSET       *eventTimesGetList();
+extern  RESULTSET       *eventLatencyGetList();
 extern  void            poll_fake_event(DCB *dcb, enum EPOLL_EVENTS ev);
 extern  void            poll_fake_hangup_event(DCB *dcb);
 extern  void            poll_fake_write_event(DCB *dcb);
 extern  void            poll_fake_read_event(DCB *dcb);
+extern  void            poll_timer_add(TIMER *timer, void (*fn)(void *), void *data, long ms);
+extern  bool            poll_timer_cancel(TIMER *timer);
+extern  bool            poll_post(int thread_id, void (*fn)(void *), void *data);
+extern  int             poll_uring_send(DCB *dcb);
+extern  void            poll_pause_reads(DCB *dcb);
+extern  void            poll_resume_reads(DCB *dcb);
 #endif
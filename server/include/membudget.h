@@ -0,0 +1,54 @@
+#ifndef _MEMBUDGET_H
+#define _MEMBUDGET_H
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file membudget.h  - Accounting of the data buffered by MaxScale
+ *
+ * The queued data of the connections, the delay queues, the session command
+ * histories and the queues of the tee filter are charged to the subsystem
+ * that holds them. The process wide totals are kept in counters of the
+ * polling threads, so charging the data does not bounce a shared cache line
+ * between the threads. The per service totals are kept in the services.
+ *
+ * When a budget is configured and the total grows over it, the reads of the
+ * sessions with the longest client write queues are paused until those
+ * queues have drained.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct service;
+
+/** The subsystems that buffer data */
+typedef enum
+{
+    MEMBUDGET_WRITEQ,   /**< Data waiting to be written to a socket */
+    MEMBUDGET_DELAYQ,   /**< Data waiting for a backend connection to be established */
+    MEMBUDGET_SESCMD,   /**< Session command histories of readwritesplit */
+    MEMBUDGET_TEE,      /**< Queries waiting for the branch of the tee filter */
+    MEMBUDGET_N_KINDS
+} membudget_kind_t;
+
+extern void membudget_init(int n_threads, uint64_t budget);
+extern void membudget_add(membudget_kind_t kind, struct service *service, int64_t bytes);
+extern int64_t membudget_kind_total(membudget_kind_t kind);
+extern int64_t membudget_total();
+extern uint64_t membudget_budget();
+extern bool membudget_exceeded();
+extern bool membudget_kind_exceeded(membudget_kind_t kind);
+extern const char *membudget_kind_name(membudget_kind_t kind);
+
+#endif
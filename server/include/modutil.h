@@ -39,6 +39,43 @@
 #define IS_FULL_RESPONSE(buf) (modutil_count_signal_packets(buf,0,0) == 2)
 #define PTR_EOF_MORE_RESULTS(b) ((PTR_IS_EOF(b) && ptr[7] & 0x08))
 
+/**
+ * Iterator over the MySQL packets in a chain of buffers
+ *
+ * The packets are inspected in place: only the headers are copied out of the
+ * buffers and the payload can be read with modutil_iter_copy and
+ * modutil_iter_lenenc even when it is spread over several buffers.
+ */
+typedef struct packet_iter
+{
+    GWBUF_CURSOR pos;       /*< Start of the current packet */
+    GWBUF_CURSOR end;       /*< End of the current packet */
+    size_t       offset;    /*< Offset of the current packet in the chain */
+    uint32_t     len;       /*< Payload length of the current packet */
+    uint8_t      seq;       /*< Sequence number of the current packet */
+    uint8_t      cmd;       /*< First byte of the payload, zero if there is none */
+    bool         complete;  /*< The whole packet is in the chain */
+    bool         partial;   /*< The length of the packet is known but it is incomplete */
+} PACKET_ITER;
+
+/**
+ * How far the reply to a command sent to a backend has been received
+ */
+typedef enum reply_state
+{
+    REPLY_STATE_DONE,   /*< The whole reply has been received */
+    REPLY_STATE_START,  /*< Nothing has been received yet */
+    REPLY_STATE_RSET    /*< A part of a result set has been received */
+} reply_state_t;
+
+/**
+ * Follows the reply to the last command sent to a backend to find where it ends
+ */
+typedef struct reply_tracker
+{
+    reply_state_t state;    /*< State of the reply */
+    int           n_eof;    /*< EOF packets still expected in the result set */
+} REPLY_TRACKER;
 
 extern int      modutil_is_SQL(GWBUF *);
 extern int      modutil_is_SQL_prepare(GWBUF *);
@@ -61,6 +98,13 @@ GWBUF*          modutil_create_mysql_err_msg(int             packet_number,
                                              const char      *statemsg,
                                              const char      *msg);
 int modutil_count_signal_packets(GWBUF*, int, int, int*);
+void modutil_iter_init(PACKET_ITER* iter, GWBUF* buf);
+bool modutil_iter_next(PACKET_ITER* iter);
+uint8_t* modutil_iter_data(const PACKET_ITER* iter);
+size_t modutil_iter_copy(const PACKET_ITER* iter, size_t pos, size_t bytes, uint8_t* dest);
+bool modutil_iter_lenenc(const PACKET_ITER* iter, size_t* pos, uint64_t* value);
+bool modutil_reply_start(REPLY_TRACKER* tracker, uint8_t command);
+bool modutil_reply_track(REPLY_TRACKER* tracker, GWBUF* buf);
 mxs_pcre2_result_t modutil_mysql_wildcard_match(const char* pattern, const char* string);
 
 /** Character and token searching functions */
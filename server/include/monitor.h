@@ -20,6 +20,7 @@
 #include <maxconfig.h>
 #include <externcmd.h>
 #include <secrets.h>
+#include <statistics.h>
 
 /**
  * @file monitor.h      The interface to the monitor module
@@ -188,6 +189,9 @@ typedef struct monitor
     MONITOR_OBJECT *module;       /**< The "monitor object" */
     void *handle;                 /**< Handle returned from startMonitor */
     size_t interval;              /**< The monitor interval */
+    ts_stats_t n_checks;          /**< Number of connection checks to the servers */
+    ts_stats_t n_failures;        /**< Number of failed connection checks */
+    ts_hist_t h_check;            /**< Time spent in the connection checks */
     struct monitor *next;         /**< Next monitor in the linked list */
 } MONITOR;
 
@@ -0,0 +1,113 @@
+#ifndef _MUTEX_H
+#define _MUTEX_H
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file mutex.h
+ *
+ * Blocking locks for MaxScale.
+ *
+ * A spinlock is the cheapest lock when it is held for a few instructions,
+ * but a thread that waits for it burns its whole timeslice if the holder
+ * has been preempted. The locks in this file spin for a short while and
+ * then put the waiting thread to sleep on a futex until the lock is
+ * released. They are meant for locks that may be held for a long time,
+ * for example while a list is walked or a table is reloaded.
+ *
+ * The MUTEX is an exclusive lock. The RWLOCK allows many readers or one
+ * writer at a time, a waiting writer stops new readers from taking the
+ * lock so that a steady stream of readers can not starve the writers.
+ */
+#include <spinlock.h>
+#include <stdbool.h>
+
+/** How many times a lock is polled before the thread goes to sleep */
+#define MUTEX_SPIN_COUNT 200
+
+/**
+ * The mutex structure.
+ *
+ * The lock value is 0 if the mutex is free, 1 if it is held and 2 if it is
+ * held and threads may be sleeping on it. In builds with the SPINLOCK_PROFILE
+ * option set the structure also holds the same profile fields as a SPINLOCK
+ * and the number of times a thread went to sleep.
+ */
+typedef struct mutex
+{
+    int lock;         /*< 0 free, 1 held, 2 held with sleepers */
+#if SPINLOCK_PROFILE
+    int spins;        /*< Number of spins on this lock */
+    int maxspins;     /*< Max no of spins to acquire lock */
+    int acquired;     /*< No. of times lock was acquired */
+    int waiting;      /*< No. of threads acquiring this lock */
+    int max_waiting;  /*< Max no of threads waiting for lock */
+    int contended;    /*< No. of times acquire was contended */
+    int sleeps;       /*< No. of times a thread slept on the lock */
+    THREAD owner;     /*< Last owner of this lock */
+#endif
+} MUTEX;
+
+#if SPINLOCK_PROFILE
+#define MUTEX_INIT { 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+#else
+#define MUTEX_INIT { 0 }
+#endif
+
+#define MUTEX_IS_LOCKED(l) ((l)->lock != 0 ? true : false)
+
+/** The write lock bit of the RWLOCK state, the rest of the bits count the readers */
+#define RWLOCK_WRITER 0x40000000
+
+/**
+ * The reader-writer lock structure.
+ *
+ * The readers sleep on rseq and the writers on wseq. The sequence numbers
+ * are changed before the sleepers are woken so that a thread that is about
+ * to sleep can not miss the wake up.
+ */
+typedef struct rwlock
+{
+    int state;        /*< Number of readers or RWLOCK_WRITER */
+    int writers;      /*< Writers holding or waiting for the lock */
+    int rseq;         /*< Futex word of the sleeping readers */
+    int wseq;         /*< Futex word of the sleeping writers */
+    int rsleepers;    /*< Number of sleeping readers */
+    int wsleepers;    /*< Number of sleeping writers */
+#if SPINLOCK_PROFILE
+    int acquired;     /*< No. of times lock was acquired */
+    int contended;    /*< No. of times acquire was contended */
+    int sleeps;       /*< No. of times a thread slept on the lock */
+#endif
+} RWLOCK;
+
+#if SPINLOCK_PROFILE
+#define RWLOCK_INIT { 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+#else
+#define RWLOCK_INIT { 0, 0, 0, 0, 0, 0 }
+#endif
+
+extern void mutex_init(MUTEX *lock);
+extern void mutex_acquire(MUTEX *lock);
+extern int mutex_acquire_nowait(MUTEX *lock);
+extern void mutex_release(MUTEX *lock);
+extern void mutex_stats(MUTEX *lock, void (*reporter)(void *, char *, int), void *hdl);
+
+extern void rwlock_init(RWLOCK *lock);
+extern void rwlock_read_acquire(RWLOCK *lock);
+extern void rwlock_read_release(RWLOCK *lock);
+extern void rwlock_write_acquire(RWLOCK *lock);
+extern void rwlock_write_release(RWLOCK *lock);
+extern void rwlock_stats(RWLOCK *lock, void (*reporter)(void *, char *, int), void *hdl);
+
+#endif
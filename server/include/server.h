@@ -14,6 +14,8 @@
  */
 #include <dcb.h>
 #include <resultset.h>
+#include <statistics.h>
+#include <mutex.h>
 
 /**
  * @file service.h
@@ -64,12 +66,50 @@ typedef struct server_params
  */
 typedef struct
 {
-    int n_connections; /**< Number of connections */
-    int n_current;     /**< Current connections */
-    int n_current_ops; /**< Current active operations */
-    int n_persistent;  /**< Current persistent pool */
+    ts_stats_t n_connections; /**< Number of connections */
+    ts_stats_t n_current;     /**< Current connections */
+    ts_stats_t n_current_ops; /**< Current active operations */
+    ts_hist_t  h_first_byte;  /**< Nanoseconds from a request to the first reply packet */
+    ts_hist_t  h_response;    /**< Nanoseconds from a request to the complete reply */
+    int n_persistent;         /**< Current persistent pool */
 } SERVER_STATS;
 
+/**
+ * The response time measurement of one request sent to a server
+ *
+ * A router starts the measurement when it writes a request to a backend
+ * and records the time of the first reply packet and of the complete reply
+ * into the histograms of the server and the service.
+ */
+typedef struct
+{
+    uint64_t sent_ns;     /**< When the request was sent, 0 if no reply is expected */
+    bool     first_byte;  /**< The first reply packet has been recorded */
+} SERVER_LATENCY;
+
+/** Column titles of the rows printed by dprintServerLatency */
+#define SERVER_LATENCY_HEADER \
+    "\t\tServer               Replies     First byte p99  Response p50  Response p99 (us)\n"
+
+#define SERVER_POOL_PAD 64 /**< Keeps the pools of the threads on separate cache lines */
+
+/**
+ * The unused persistent connections of one polling thread
+ *
+ * The connections are reused in LIFO order so that the most recently used
+ * connection, the one most likely to be alive and warm, is taken first.
+ * Only the owning thread takes connections from its pool, the lock guards
+ * the pool against the timers and the diagnostics.
+ */
+typedef struct server_pool
+{
+    MUTEX          lock;           /**< Lock for the connection list */
+    struct dcb     *head;          /**< Unused connections, the most recently used first */
+    int            count;          /**< Number of connections in the list */
+    int            warming;        /**< Connections being opened to fill the pool */
+    char           pad[SERVER_POOL_PAD];
+} SERVER_POOL;
+
 /**
  * The SERVER structure defines a backend server. Each server has a name
  * or IP address for the server, a port that the server listens on and
@@ -104,9 +144,10 @@ typedef struct server
     bool           master_err_is_logged; /*< If node failed, this indicates whether it is logged */
     bool           slave_configured; /**< Server is configured as a replication slave
                                       * TODO: Remove this for 2.1 */
-    DCB            *persistent;    /**< List of unused persistent connections to the server */
-    SPINLOCK       persistlock;    /**< Lock for adjusting the persistent connections list */
+    SERVER_POOL    *persistent;    /**< Unused persistent connections, one pool per thread */
+    int            n_pools;        /**< Number of pools, the last one is for unowned DCBs */
     long           persistpoolmax; /**< Maximum size of persistent connections pool */
+    long           persistpoolmin; /**< Connections kept open in the pool of each thread */
     long           persistmaxtime; /**< Maximum number of seconds connection can live */
     int            persistmax;     /**< Maximum pool size actually achieved since startup */
     uint8_t        charset;        /**< Default server character set */
@@ -216,10 +257,17 @@ extern char *serverGetParameter(SERVER *, char *);
 extern void server_update(SERVER *, char *, char *, char *);
 extern void server_set_unique_name(SERVER *, char *);
 extern DCB  *server_get_persistent(SERVER *, char *, const char *);
+extern SERVER_POOL *server_get_pool(SERVER *, int);
 extern void server_update_address(SERVER *, char *);
 extern void server_update_port(SERVER *,  unsigned short);
 extern RESULTSET *serverGetList();
 extern unsigned int server_map_status(char *str);
 extern bool server_set_version_string(SERVER* server, const char* string);
+extern void server_latency_start(SERVER_LATENCY *latency);
+extern void server_latency_reply(SERVER_LATENCY *latency, SERVER *server,
+                                 struct service *service, bool complete);
+extern void dprintLatency(DCB *dcb, const char *desc, ts_hist_t hist);
+extern void dprintServerLatency(DCB *dcb, SERVER *server);
+extern RESULTSET *serverLatencyGetList();
 
 #endif
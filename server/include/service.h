@@ -16,6 +16,7 @@
 #include <time.h>
 #include <gw_protocol.h>
 #include <spinlock.h>
+#include <mutex.h>
 #include <dcb.h>
 #include <server.h>
 #include <listener.h>
@@ -24,6 +25,8 @@
 #include <resultset.h>
 #include <maxconfig.h>
 #include <queuemanager.h>
+#include <membudget.h>
+#include <statistics.h>
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -65,8 +68,10 @@ typedef struct
 {
     time_t started;         /**< The time when the service was started */
     int    n_failed_starts; /**< Number of times this service has failed to start */
-    int    n_sessions;      /**< Number of sessions created on service since start */
-    int    n_current;       /**< Current number of sessions */
+    ts_stats_t n_sessions;  /**< Number of sessions created on service since start */
+    ts_stats_t n_current;   /**< Current number of sessions */
+    ts_hist_t h_first_byte; /**< Nanoseconds from a request to the first reply packet */
+    ts_hist_t h_response;   /**< Nanoseconds from a request to the complete reply */
 } SERVICE_STATS;
 
 /**
@@ -145,7 +150,7 @@ typedef struct service
     bool strip_db_esc;                 /*< Remove the '\' characters from database names
                                         * when querying them from the server. MySQL Workbench seems
                                         * to escape at least the underscore character. */
-    SPINLOCK users_table_spin;         /**< The spinlock for users data refresh */
+    MUTEX users_table_lock;            /**< The lock for users data refresh */
     SERVICE_REFRESH_RATE rate_limit;   /**< The refresh rate limit for users table */
     FILTER_DEF **filters;              /**< Ordered list of filters */
     int n_filters;                     /**< Number of filters */
@@ -154,6 +159,7 @@ typedef struct service
     struct service *next;              /**< The next service in the linked list */
     bool retry_start;                  /*< If starting of the service should be retried later */
     bool log_auth_warnings;            /*< Log authentication failures and warnings */
+    int64_t buffered[MEMBUDGET_N_KINDS]; /*< Buffered data of the sessions per subsystem */
 } SERVICE;
 
 typedef enum count_spec_t
@@ -219,6 +225,7 @@ extern void service_shutdown();
 extern int serviceSessionCountAll();
 extern RESULTSET *serviceGetList();
 extern RESULTSET *serviceGetListenerList();
+extern RESULTSET *serviceGetBufferedList();
 extern bool service_all_services_have_listeners();
 
 #endif
@@ -39,6 +39,7 @@
 #include <resultset.h>
 #include <skygw_utils.h>
 #include <log_manager.h>
+#include <membudget.h>
 
 struct dcb;
 struct service;
@@ -108,6 +109,33 @@ typedef enum
     SESSION_LIST_CONNECTION
 } SESSIONLISTFILTER;
 
+/** Size of the blocks the session arena is carved from */
+#define SESSION_ARENA_BLOCK_SIZE    4096
+/** Alignment of the session arena allocations */
+#define SESSION_ARENA_ALIGN         16
+/** Freed allocations up to this size are reused by the session arena */
+#define SESSION_ARENA_MAX_RECYCLE   256
+#define SESSION_ARENA_N_CLASSES     (SESSION_ARENA_MAX_RECYCLE / SESSION_ARENA_ALIGN)
+
+struct session_arena_block;
+
+/**
+ * Memory that lives as long as the session
+ *
+ * The modules allocate their session state from the arena of the session
+ * and the whole arena is released at once when the session is freed. The
+ * first block of the arena is kept for the next session that reuses the
+ * session structure.
+ */
+typedef struct
+{
+    SPINLOCK                    lock;
+    struct session_arena_block  *blocks;    /*< The blocks, the current one first */
+    void                        *free_lists[SESSION_ARENA_N_CLASSES]; /*< Freed allocations by size */
+    size_t                      used;       /*< Bytes allocated and not freed */
+    size_t                      reserved;   /*< Bytes in the blocks */
+} SESSION_ARENA;
+
 /**
  * The session status block
  *
@@ -136,18 +164,13 @@ typedef struct session
     struct session  *next;            /*< Linked list of all sessions */
     int             refcount;         /*< Reference count on the session */
     bool            ses_is_child;     /*< this is a child session */
+    int64_t         buffered;         /*< Data buffered for the session in bytes */
+    SESSION_ARENA   arena;            /*< Memory released with the session */
 #if defined(SS_DEBUG)
     skygw_chk_t     ses_chk_tail;
 #endif
 } SESSION;
 
-/** Whether to do session timeout checks */
-extern bool check_timeouts;
-
-/** When the next timeout check is done. This is compared to hkheartbeat in
- * hk_heartbeat.h */
-extern long next_timeout_check;
-
 #define SESSION_PROTOCOL(x, type)       DCB_PROTOCOL((x)->client_dcb, type)
 
 /**
@@ -182,10 +205,13 @@ void dprintSession(struct dcb *, SESSION *);
 void dListSessions(struct dcb *);
 char *session_state(session_state_t);
 bool session_link_dcb(SESSION *, struct dcb *);
+void session_timeout_changed(struct service *service);
 SESSION* get_session_by_router_ses(void* rses);
 void session_enable_log_priority(SESSION* ses, int priority);
 void session_disable_log_priority(SESSION* ses, int priority);
+void session_buffered_add(SESSION *session, membudget_kind_t kind, int bytes);
+void session_add_weight(SESSION *session, int bytes);
+void *session_arena_alloc(SESSION *session, size_t size);
+void session_arena_free(SESSION *session, void *ptr, size_t size);
 RESULTSET *sessionGetList(SESSIONLISTFILTER);
-void process_idle_sessions();
-void enable_session_timeouts();
 #endif
@@ -24,7 +24,61 @@
  * @endverbatim
  */
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef void* ts_stats_t;
+typedef void* ts_hist_t;
+
+/** Size of the per-thread slots, each slot is on a cache line of its own */
+#define TS_CACHE_LINE 64
+
+/** The kinds of metrics in the registry */
+typedef enum
+{
+    TS_METRIC_COUNTER,      /**< A value that only grows */
+    TS_METRIC_GAUGE,        /**< A value that goes up and down */
+    TS_METRIC_HISTOGRAM     /**< A distribution of values */
+} ts_metric_type_t;
+
+/**
+ * A named metric in the registry. The counters and gauges are ts_stats_t
+ * objects and the histograms ts_hist_t objects.
+ */
+typedef struct ts_metric
+{
+    char              *name;    /**< Name of the metric */
+    char              *labels;  /**< Labels as name="value" pairs separated by commas or NULL */
+    char              *help;    /**< Description of the metric */
+    ts_metric_type_t  type;     /**< The kind of the metric */
+    void              *data;    /**< The ts_stats_t or ts_hist_t */
+    struct ts_metric  *next;
+} TS_METRIC;
+
+/**
+ * The histograms are log-linear: values below TS_HIST_SUB_BUCKETS are counted
+ * exactly and every power of two above that is divided into
+ * TS_HIST_SUB_BUCKETS buckets. The relative error of a value read from a
+ * histogram is at most 1 / TS_HIST_SUB_BUCKETS.
+ */
+#define TS_HIST_SUB_BITS    4
+#define TS_HIST_SUB_BUCKETS (1 << TS_HIST_SUB_BITS)
+#define TS_HIST_BUCKETS     ((64 - TS_HIST_SUB_BITS + 1) * TS_HIST_SUB_BUCKETS)
+
+/** Buffer size that holds a label formatted by ts_metric_label */
+#define TS_LABEL_SIZE(name, value) (strlen(name) + 2 * strlen(value) + 4)
+
+/** The merged values of a histogram */
+typedef struct
+{
+    uint64_t count;     /**< Number of values */
+    uint64_t sum;       /**< Sum of the values */
+    uint64_t max;       /**< Largest value */
+    uint64_t p50;       /**< Median */
+    uint64_t p99;       /**< 99th percentile */
+    uint64_t p999;      /**< 99.9th percentile */
+} ts_hist_summary_t;
 
 /** stats_init should be called only once */
 void ts_stats_init();
@@ -32,13 +86,30 @@ void ts_stats_init();
 /** No-op for now */
 void ts_stats_end();
 
-/** Every thread should call set_current_thread_id only once */
+/** Every polling thread should call set_current_thread_id only once */
 void ts_stats_set_thread_id(int id);
 
 ts_stats_t ts_stats_alloc();
+ts_stats_t ts_stats_register(const char *name, const char *labels, const char *help,
+                             ts_metric_type_t type);
 void ts_stats_free(ts_stats_t stats);
-void ts_stats_add(ts_stats_t stats, int value);
-void ts_stats_set(ts_stats_t stats, int value);
-int ts_stats_sum(ts_stats_t stats);
+void ts_stats_add(ts_stats_t stats, int64_t value);
+void ts_stats_set(ts_stats_t stats, int64_t value);
+int64_t ts_stats_sum(ts_stats_t stats);
+
+ts_hist_t ts_hist_alloc();
+ts_hist_t ts_hist_register(const char *name, const char *labels, const char *help);
+void ts_hist_free(ts_hist_t hist);
+void ts_hist_add(ts_hist_t hist, uint64_t value);
+uint64_t ts_hist_percentile(ts_hist_t hist, double percentile);
+void ts_hist_summary(ts_hist_t hist, ts_hist_summary_t *summary);
+
+void ts_metric_set_labels(void *data, const char *labels);
+char *ts_metric_label(char *buf, size_t size, const char *name, const char *value);
+void ts_metric_foreach(void (*fn)(const TS_METRIC *metric, void *data), void *data);
+char *ts_metric_export(size_t *len);
+
+/** Current CLOCK_MONOTONIC time in nanoseconds */
+uint64_t ts_clock_ns();
 
 #endif
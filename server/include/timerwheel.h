@@ -0,0 +1,80 @@
+#ifndef _TIMERWHEEL_H
+#define _TIMERWHEEL_H
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file timerwheel.h  - Hierarchical timer wheels
+ *
+ * A timer wheel keeps timers in slots indexed by their expiry tick. The
+ * timers that expire within TW_SLOTS ticks are in the first level, one slot
+ * per tick, and each following level covers TW_SLOTS times the range of the
+ * previous one. When the first level wraps around, the timers of the next
+ * slot of the second level are moved to the first level and so on. This
+ * makes arming and cancelling a timer O(1) regardless of the number of timers.
+ *
+ * The timers are embedded in the objects that use them and a wheel is not
+ * thread safe: the users of a wheel must serialise the access to it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TW_BITS     6
+#define TW_SLOTS    (1 << TW_BITS)
+#define TW_MASK     (TW_SLOTS - 1)
+#define TW_LEVELS   4
+
+/** The longest delay a timer can have, longer delays are re-armed when they come due */
+#define TW_MAX_DELAY ((1ULL << (TW_BITS * TW_LEVELS)) - 1)
+
+struct timerwheel;
+
+typedef struct timer
+{
+    struct timer      *next;      /*< Next timer in the slot */
+    struct timer      *prev;      /*< Previous timer in the slot */
+    uint64_t          expires;    /*< The tick when the timer expires */
+    void              (*fn)(void *data); /*< Called when the timer expires */
+    void              *data;      /*< Data passed to the function */
+    struct timerwheel *wheel;     /*< The wheel the timer is armed in or NULL */
+} TIMER;
+
+typedef struct timerwheel
+{
+    uint64_t now;                          /*< The current tick of the wheel */
+    int      n_timers;                     /*< Number of armed timers */
+    TIMER    slots[TW_LEVELS][TW_SLOTS];   /*< List heads of the slots */
+    TIMER    expired;                      /*< Timers that have expired */
+} TIMERWHEEL;
+
+extern void timerwheel_init(TIMERWHEEL *wheel, uint64_t now);
+extern void timer_init(TIMER *timer, void (*fn)(void *), void *data);
+extern void timerwheel_add(TIMERWHEEL *wheel, TIMER *timer, uint64_t expires);
+extern bool timerwheel_cancel(TIMER *timer);
+extern void timerwheel_advance(TIMERWHEEL *wheel, uint64_t now);
+extern TIMER *timerwheel_pop_expired(TIMERWHEEL *wheel);
+
+/**
+ * Check whether a timer is armed
+ *
+ * @param timer The timer
+ * @return True if the timer is armed in a wheel and has not yet been fired
+ */
+static inline bool timer_is_armed(const TIMER *timer)
+{
+    return timer->wheel != NULL;
+}
+
+#endif
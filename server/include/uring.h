@@ -0,0 +1,106 @@
+#ifndef _URING_H
+#define _URING_H
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file uring.h  - A minimal io_uring interface
+ *
+ * The rings are used through the raw system calls so that no library is
+ * needed. Each ring has a set of provided buffers that the kernel fills
+ * with the data of multishot receives. A ring must only be used by one
+ * thread at a time.
+ *
+ * The io_uring support is only compiled in when the kernel headers have
+ * the multishot receive, see HAVE_IO_URING. Without it uring_create
+ * always fails.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define URING_ENTRIES       256     /**< Size of the submission queue */
+#define URING_BUF_COUNT     256     /**< Number of provided buffers, a power of two */
+#define URING_BUF_SIZE      16384   /**< Size of a provided buffer */
+#define URING_BUF_GROUP     0       /**< Buffer group ID of the provided buffers */
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+
+typedef struct
+{
+    int                  fd;            /**< The ring descriptor */
+    unsigned             *sq_head;      /**< Consumed by the kernel */
+    unsigned             *sq_tail;      /**< Published by us */
+    unsigned             sq_mask;
+    unsigned             sq_entries;
+    unsigned             sq_local_tail; /**< Prepared but not published */
+    struct io_uring_sqe  *sqes;
+    unsigned             *cq_head;      /**< Consumed by us */
+    unsigned             *cq_tail;      /**< Published by the kernel */
+    unsigned             cq_mask;
+    struct io_uring_cqe  *cqes;
+    void                 *ring_mem;     /**< Mapping of the rings */
+    size_t               ring_size;
+    size_t               sqes_size;
+    struct io_uring_buf_ring *buf_ring; /**< Ring of provided buffers */
+    unsigned             buf_tail;
+    char                 *buffers;      /**< Memory of the provided buffers */
+    uint64_t             n_enter;       /**< Number of io_uring_enter calls */
+    uint64_t             n_sqes;        /**< Number of submitted requests */
+    uint64_t             n_cqes;        /**< Number of completions */
+} URING;
+
+extern URING *uring_create();
+extern void uring_destroy(URING *ring);
+extern struct io_uring_sqe *uring_get_sqe(URING *ring);
+extern int uring_submit(URING *ring, unsigned wait);
+extern struct io_uring_cqe *uring_peek_cqe(URING *ring);
+extern void uring_cqe_seen(URING *ring);
+extern char *uring_buffer(URING *ring, const struct io_uring_cqe *cqe);
+extern void uring_recycle_buffer(URING *ring, const struct io_uring_cqe *cqe);
+extern bool uring_supported();
+
+/**
+ * Number of requests that have been prepared but not submitted
+ *
+ * @param ring  The ring
+ * @return Number of unsubmitted requests
+ */
+static inline unsigned uring_pending(const URING *ring)
+{
+    return ring->sq_local_tail - *ring->sq_tail;
+}
+
+#else
+
+typedef struct uring URING;
+
+static inline URING *uring_create()
+{
+    return NULL;
+}
+
+static inline void uring_destroy(URING *ring)
+{
+}
+
+static inline bool uring_supported()
+{
+    return false;
+}
+
+#endif
+
+#endif
@@ -559,7 +559,7 @@ cdc_refresh_users(SERVICE *service)
 {
     int ret = 1;
     /* check for another running getUsers request */
-    if (!spinlock_acquire_nowait(&service->users_table_spin))
+    if (!mutex_acquire_nowait(&service->users_table_lock))
     {
         MXS_DEBUG("%s: [service_refresh_users] failed to get get lock for "
                   "loading new users' table: another thread is loading users",
@@ -572,7 +572,7 @@ cdc_refresh_users(SERVICE *service)
     if ((time(NULL) < (service->rate_limit.last + CDC_USERS_REFRESH_TIME)) ||
         (service->rate_limit.nloads > CDC_USERS_REFRESH_MAX_PER_TIME))
     {
-        spinlock_release(&service->users_table_spin);
+        mutex_release(&service->users_table_lock);
         MXS_ERROR("%s: Refresh rate limit exceeded for load of users' table.",
                   service->name);
 
@@ -591,7 +591,7 @@ cdc_refresh_users(SERVICE *service)
     ret = cdc_replace_users(service);
 
     /* remove lock */
-    spinlock_release(&service->users_table_spin);
+    mutex_release(&service->users_table_lock);
 
     if (ret >= 0)
     {
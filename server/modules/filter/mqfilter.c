@@ -1533,7 +1533,8 @@ static int clientReply(FILTER* instance, void *session, GWBUF *reply)
     MQ_SESSION *my_session = (MQ_SESSION *) session;
     MQ_INSTANCE *my_instance = (MQ_INSTANCE *) instance;
     char t_buf[128], *combined;
-    unsigned int pkt_len = pktlen(reply->sbuf->data), offset = 0;
+    unsigned char *data = (unsigned char*) GWBUF_DATA(reply);
+    unsigned int pkt_len = pktlen(data), offset = 0;
     amqp_basic_properties_t *prop;
 
     if (my_session->was_query)
@@ -1568,12 +1569,12 @@ static int clientReply(FILTER* instance, void *session, GWBUF *reply)
             memcpy(combined + offset, t_buf, strnlen(t_buf, 40));
             offset += strnlen(t_buf, 40);
 
-            if (*(reply->sbuf->data + 4) == 0x00)
+            if (*(data + 4) == 0x00)
             {
                 /**OK packet*/
                 unsigned int aff_rows = 0, l_id = 0, s_flg = 0, wrn = 0;
-                unsigned char *ptr = (unsigned char*) (reply->sbuf->data + 5);
-                pkt_len = pktlen(reply->sbuf->data);
+                unsigned char *ptr = data + 5;
+                pkt_len = pktlen(data);
                 aff_rows = consume_leitoi(&ptr);
                 l_id = consume_leitoi(&ptr);
                 s_flg |= *ptr++;
@@ -1600,20 +1601,20 @@ static int clientReply(FILTER* instance, void *session, GWBUF *reply)
                 was_last = 1;
 
             }
-            else if (*(reply->sbuf->data + 4) == 0xff)
+            else if (*(data + 4) == 0xff)
             {
                 /**ERR packet*/
                 sprintf(combined + offset, "ERROR - message: %.*s",
-                        (int) (reply->end - ((void*) (reply->sbuf->data + 13))),
-                        (char *) reply->sbuf->data + 13);
+                        (int) (reply->end - ((void*) (data + 13))),
+                        (char *) data + 13);
                 packet_ok = 1;
                 was_last = 1;
 
             }
-            else if (*(reply->sbuf->data + 4) == 0xfb)
+            else if (*(data + 4) == 0xfb)
             {
                 /**LOCAL_INFILE request packet*/
-                unsigned char *rset = (unsigned char*) reply->sbuf->data;
+                unsigned char *rset = data;
                 strcpy(combined + offset, "LOCAL_INFILE: ");
                 strncat(combined + offset, (const char*) rset + 5, pktlen(rset));
                 packet_ok = 1;
@@ -1623,7 +1624,7 @@ static int clientReply(FILTER* instance, void *session, GWBUF *reply)
             else
             {
                 /**Result set*/
-                unsigned char *rset = (unsigned char*) (reply->sbuf->data + 4);
+                unsigned char *rset = data + 4;
                 char *tmp;
                 unsigned int col_cnt = consume_leitoi(&rset);
 
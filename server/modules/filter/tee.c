@@ -175,8 +175,10 @@ typedef struct
     GWBUF* tee_replybuf; /* Buffer for reply */
     GWBUF* tee_partials[2];
     GWBUF* queue;
+    int queued; /* Size of the queue charged to the session */
     SPINLOCK tee_lock;
     DCB* client_dcb;
+    SESSION* session; /* The client session */
 
 #ifdef SS_DEBUG
     long d_id;
@@ -199,6 +201,7 @@ static orphan_session_t* allOrphans = NULL;
 
 static SPINLOCK orphanLock;
 static int packet_is_required(GWBUF *queue);
+static void tee_queue_charge(TEE_SESSION *my_session);
 static int detect_loops(TEE_INSTANCE *instance, HASHTABLE* ht, SERVICE* session);
 int internal_route(DCB* dcb);
 GWBUF* clone_query(TEE_INSTANCE* my_instance, TEE_SESSION* my_session, GWBUF* buffer);
@@ -514,6 +517,7 @@ newSession(FILTER *instance, SESSION *session)
         my_session->residual = 0;
         my_session->tee_replybuf = NULL;
         my_session->client_dcb = session->client_dcb;
+        my_session->session = session;
         my_session->instance = my_instance;
         my_session->client_multistatement = false;
         my_session->queue = NULL;
@@ -724,6 +728,12 @@ freeSession(FILTER *instance, void *session)
     {
         gwbuf_free(my_session->tee_replybuf);
     }
+    if (my_session->queue)
+    {
+        gwbuf_free(my_session->queue);
+        my_session->queue = NULL;
+        tee_queue_charge(my_session);
+    }
     free(session);
 
     orphan_free(NULL);
@@ -818,6 +828,7 @@ routeQuery(FILTER *instance, void *session, GWBUF *queue)
         buffer = modutil_get_next_MySQL_packet(&queue);
         my_session->queue = queue;
     }
+    tee_queue_charge(my_session);
 
     if (buffer == NULL)
     {
@@ -1061,6 +1072,7 @@ clientReply(FILTER* instance, void *session, GWBUF *reply)
         !my_session->waiting[CHILD])
     {
         GWBUF* buffer = modutil_get_next_MySQL_packet(&my_session->queue);
+        tee_queue_charge(my_session);
         GWBUF* clone = clone_query(my_session->instance, my_session, buffer);
         reset_session_state(my_session, buffer);
         spinlock_release(&my_session->tee_lock);
@@ -1120,6 +1132,23 @@ diagnostic(FILTER *instance, void *fsession, DCB *dcb)
     }
 }
 
+/**
+ * Charge the change in the size of the query queue to the session
+ *
+ * @param my_session    The tee session
+ */
+static void
+tee_queue_charge(TEE_SESSION *my_session)
+{
+    int queued = gwbuf_length(my_session->queue);
+
+    if (queued != my_session->queued)
+    {
+        session_buffered_add(my_session->session, MEMBUDGET_TEE, queued - my_session->queued);
+        my_session->queued = queued;
+    }
+}
+
 /**
  * Determine if the packet is a command that must be sent to the branch
  * to maintain the session consistancy. These are COM_INIT_DB,
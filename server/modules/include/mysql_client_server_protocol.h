@@ -92,6 +92,9 @@
 #define MAX_CHUNK SMALL_CHUNK * 8 * 4
 #define ToHex(Y) (Y>='0'&&Y<='9'?Y-'0':Y-'A'+10)
 #define COM_QUIT_PACKET_SIZE (4+1)
+#define COM_RESET_CONNECTION_PACKET_SIZE (4+1)
+/** COM_RESET_CONNECTION, not known to the client library headers of all versions */
+#define GW_MYSQL_COM_RESET_CONNECTION 0x1f
 struct dcb;
 
 #define MYSQL_AUTH_SUCCEEDED 0
@@ -287,6 +290,8 @@ typedef struct
     unsigned        long tid;                         /*< MySQL Thread ID, in
         * handshake */
     unsigned int    charset;                          /*< MySQL character set at connect time */
+    int             ignore_replies;                   /*< Replies to internal commands
+        * that are not routed */
 #if defined(SS_DEBUG)
     skygw_chk_t     protocol_chk_tail;
 #endif
@@ -323,6 +328,7 @@ void           mysql_protocol_done (DCB* dcb);
 const char *gw_mysql_protocol_state2string(int state);
 int        mysql_send_com_quit(DCB* dcb, int packet_number, GWBUF* buf);
 GWBUF*     mysql_create_com_quit(GWBUF* bufparam, int packet_number);
+GWBUF*     mysql_create_com_reset_connection();
 
 int mysql_send_custom_error (
     DCB *dcb,
@@ -26,6 +26,9 @@
  * @endverbatim
  */
 #include <dcb.h>
+#include <server.h>
+#include <modutil.h>
+#include <statistics.h>
 
 /**
  * Internal structure used to define the set of backend servers we are routing
@@ -55,6 +58,8 @@ typedef struct router_client_session
     DCB *client_dcb; /**< Client DCB */
     struct router_client_session *next;
     int rses_capabilities; /*< input type, for example */
+    REPLY_TRACKER reply; /*< The reply to the last command */
+    SERVER_LATENCY latency; /*< Response time of the last command */
 #if defined(SS_DEBUG)
     skygw_chk_t rses_chk_tail;
 #endif
@@ -65,8 +70,9 @@ typedef struct router_client_session
  */
 typedef struct
 {
-    int n_sessions; /*< Number sessions created     */
-    int n_queries; /*< Number of queries forwarded */
+    ts_stats_t n_sessions; /*< Number sessions created     */
+    ts_stats_t n_queries; /*< Number of queries forwarded */
+    ts_stats_t n_spliced; /*< Number of sessions switched to splice */
 } ROUTER_STATS;
 
 /**
@@ -80,6 +86,7 @@ typedef struct router_instance
     BACKEND **servers; /*< List of backend servers                  */
     unsigned int bitmask; /*< Bitmask to apply to server->status       */
     unsigned int bitvalue; /*< Required value of server->status         */
+    bool splice; /*< Move the data of the sessions with splice   */
     ROUTER_STATS stats; /*< Statistics for this router               */
     struct router_instance
         *next;
@@ -26,6 +26,9 @@
 
 #include <dcb.h>
 #include <hashtable.h>
+#include <modutil.h>
+#include <server.h>
+#include <statistics.h>
 #include <math.h>
 
 #undef PREP_STMT_CACHING
@@ -234,6 +237,10 @@ typedef struct backend_ref_st
     GWBUF*          bref_pending_cmd; /**< For stmt which can't be routed due active sescmd execution */
     unsigned char   reply_cmd;  /**< The reply the backend server sent to a session command.
                                  * Used to detect slaves that fail to execute session command. */
+    REPLY_TRACKER   bref_reply;       /**< The reply to the last statement, used by the
+                                       * multiplexing mode to find the points where a
+                                       * backend connection is idle */
+    SERVER_LATENCY  bref_latency;     /**< Response time of the last statement */
 #if defined(SS_DEBUG)
     skygw_chk_t     bref_chk_tail;
 #endif
@@ -266,6 +273,8 @@ typedef struct rwsplit_config_st
                                              * to the master after a multistatement query. */
     enum failure_mode rw_master_failure_mode; /**< Master server failure handling mode.
                                                * @see enum failure_mode */
+    bool              rw_multiplex; /**< Release the backend connections between
+                                     * transactions */
 } rwsplit_config_t;
 
 #if defined(PREP_STMT_CACHING)
@@ -313,8 +322,11 @@ struct router_client_session
     bool             have_tmp_tables;
     uint64_t         rses_load_data_sent; /*< How much data has been sent */
     DCB*             client_dcb;
+    struct session*  rses_session;  /*< The client session, the session commands are charged to it */
     int              pos_generator;
     backend_ref_t    *forced_node; /*< Current server where all queries should be sent */
+    bool             rses_pinned;   /*< Session state prevents releasing the backends */
+    bool             rses_detached; /*< The backends have been released between transactions */
 #if defined(PREP_STMT_CACHING)
     HASHTABLE*       rses_prep_stmt[2];
 #endif
@@ -330,11 +342,13 @@ struct router_client_session
  */
 typedef struct
 {
-    int     n_sessions; /*< Number sessions created */
-    int     n_queries;  /*< Number of queries forwarded */
-    int     n_master;   /*< Number of stmts sent to master */
-    int     n_slave;    /*< Number of stmts sent to slave */
-    int     n_all;      /*< Number of stmts sent to all */
+    ts_stats_t n_sessions; /*< Number sessions created */
+    ts_stats_t n_queries;  /*< Number of queries forwarded */
+    ts_stats_t n_master;   /*< Number of stmts sent to master */
+    ts_stats_t n_slave;    /*< Number of stmts sent to slave */
+    ts_stats_t n_all;      /*< Number of stmts sent to all */
+    ts_stats_t n_detached; /*< Number of times a session released its backends */
+    ts_stats_t n_attached; /*< Number of times a session took new backends */
 } ROUTER_STATS;
 
 /**
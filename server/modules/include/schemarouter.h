@@ -29,6 +29,8 @@
 
 #include <dcb.h>
 #include <hashtable.h>
+#include <modutil.h>
+#include <server.h>
 #include <mysql_client_server_protocol.h>
 #include <pcre2.h>
 /**
@@ -267,6 +269,8 @@ typedef struct backend_ref_st
     int             bref_num_result_wait; /*< Number of not yet received results */
     sescmd_cursor_t bref_sescmd_cur; /*< Session command cursor */
     GWBUF*          bref_pending_cmd; /*< For stmt which can't be routed due active sescmd execution */
+    REPLY_TRACKER   bref_reply; /*< The reply to the last statement */
+    SERVER_LATENCY  bref_latency; /*< Response time of the last statement */
 #if defined(SS_DEBUG)
     skygw_chk_t     bref_chk_tail;
 #endif
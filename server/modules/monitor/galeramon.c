@@ -36,6 +36,7 @@
 
 #include <galeramon.h>
 #include <dcb.h>
+#include <affinity.h>
 
 static void monitorMain(void *);
 
@@ -484,6 +485,9 @@ monitorMain(void *arg)
     handle = (GALERA_MONITOR *) mon->handle;
     spinlock_release(&mon->lock);
     master_stickiness = handle->disableMasterFailback;
+
+    affinity_set_other_thread("monitor");
+
     if (mysql_thread_init())
     {
         MXS_ERROR("mysql_thread_init failed in monitor module. Exiting.");
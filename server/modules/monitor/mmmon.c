@@ -27,6 +27,7 @@
 
 #include <mmmon.h>
 #include <dcb.h>
+#include <affinity.h>
 
 static void monitorMain(void *);
 
@@ -554,6 +555,8 @@ monitorMain(void *arg)
     spinlock_release(&mon->lock);
     detect_stale_master = handle->detectStaleMaster;
 
+    affinity_set_other_thread("monitor");
+
     if (mysql_thread_init())
     {
         MXS_ERROR("Fatal : mysql_thread_init failed in monitor module. Exiting.");
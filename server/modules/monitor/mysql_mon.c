@@ -48,6 +48,7 @@
 #include <mysqlmon.h>
 #include <dcb.h>
 #include <modutil.h>
+#include <affinity.h>
 
 extern char *strcasestr(const char *haystack, const char *needle);
 
@@ -791,6 +792,8 @@ monitorMain(void *arg)
     replication_heartbeat = handle->replicationHeartbeat;
     detect_stale_master = handle->detectStaleMaster;
 
+    affinity_set_other_thread("monitor");
+
     if (mysql_thread_init())
     {
         MXS_ERROR("mysql_thread_init failed in monitor module. Exiting.");
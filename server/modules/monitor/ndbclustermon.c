@@ -27,6 +27,7 @@
 
 
 #include <mysqlmon.h>
+#include <affinity.h>
 
 static void monitorMain(void *);
 
@@ -375,6 +376,8 @@ monitorMain(void *arg)
     handle = (MYSQL_MONITOR *) mon->handle;
     spinlock_release(&mon->lock);
 
+    affinity_set_other_thread("monitor");
+
     if (mysql_thread_init())
     {
         MXS_ERROR("Fatal : mysql_thread_init failed in monitor module. Exiting.");
@@ -38,6 +38,7 @@
 #include <modinfo.h>
 #include <log_manager.h>
 #include <resultset.h>
+#include <statistics.h>
 
 /* @see function load_module in load_utils.c for explanation of the following
  * lint directives.
@@ -54,6 +55,8 @@ MODULE_INFO info =
 
 #define ISspace(x) isspace((int)(x))
 #define HTTP_SERVER_STRING "MaxScale(c) v.1.0.0"
+#define HTTPD_JSON_CONTENT "application/json"
+#define HTTPD_METRICS_CONTENT "text/plain; version=0.0.4"
 static char *version_str = "V1.1.1";
 
 static int httpd_read_event(DCB* dcb);
@@ -65,7 +68,8 @@ static int httpd_accept(DCB *dcb);
 static int httpd_close(DCB *dcb);
 static int httpd_listen(DCB *dcb, char *config);
 static int httpd_get_line(int sock, char *buf, int size);
-static void httpd_send_headers(DCB *dcb, int final);
+static void httpd_send_headers(DCB *dcb, int final, const char *content_type);
+static void httpd_send_metrics(DCB *dcb);
 static char *httpd_default_auth();
 
 /**
@@ -252,8 +256,17 @@ static int httpd_read_event(DCB* dcb)
      * Now begins the server reply
      */
 
+    /** The metrics are read directly from the statistics without routing
+     * the request to the service */
+    if (strcmp(url, "/metrics") == 0)
+    {
+        httpd_send_metrics(dcb);
+        dcb_close(dcb);
+        return 0;
+    }
+
     /* send all the basic headers and close with \r\n */
-    httpd_send_headers(dcb, 1);
+    httpd_send_headers(dcb, 1, HTTPD_JSON_CONTENT);
 
 #if 0
     /**
@@ -451,8 +464,12 @@ static int httpd_get_line(int sock, char *buf, int size)
 
 /**
  * HTTPD send basic headers with 200 OK
+ *
+ * @param dcb           The client DCB
+ * @param final         Close the headers
+ * @param content_type  The content type of the reply
  */
-static void httpd_send_headers(DCB *dcb, int final)
+static void httpd_send_headers(DCB *dcb, int final, const char *content_type)
 {
     char date[64] = "";
     const char *fmt = "%a, %d %b %Y %H:%M:%S GMT";
@@ -464,8 +481,8 @@ static void httpd_send_headers(DCB *dcb, int final)
 
     dcb_printf(dcb,
                "HTTP/1.1 200 OK\r\nDate: %s\r\nServer: %s\r\nConnection: "
-               "close\r\nContent-Type: application/json\r\n",
-               date, HTTP_SERVER_STRING);
+               "close\r\nContent-Type: %s\r\n",
+               date, HTTP_SERVER_STRING, content_type);
 
     /* close the headers */
     if (final)
@@ -473,3 +490,35 @@ static void httpd_send_headers(DCB *dcb, int final)
         dcb_printf(dcb, "\r\n");
     }
 }
+
+/**
+ * Send the registered metrics in the Prometheus text format
+ *
+ * The metrics are formatted from the per-thread statistics, no session,
+ * DCB or service locks are taken.
+ *
+ * @param dcb   The client DCB
+ */
+static void httpd_send_metrics(DCB *dcb)
+{
+    size_t len;
+    char *text = ts_metric_export(&len);
+    GWBUF *buf = NULL;
+
+    if (text == NULL || (len > 0 && (buf = gwbuf_alloc(len)) == NULL))
+    {
+        MXS_ERROR("Failed to allocate memory for the metrics.");
+        dcb_printf(dcb, "HTTP/1.1 500 Internal Server Error\r\nConnection: close\r\n\r\n");
+        free(text);
+        return;
+    }
+
+    httpd_send_headers(dcb, 0, HTTPD_METRICS_CONTENT);
+    dcb_printf(dcb, "Content-Length: %lu\r\n\r\n", (unsigned long)len);
+    if (buf)
+    {
+        memcpy(GWBUF_DATA(buf), text, len);
+        dcb->func.write(dcb, buf);
+    }
+    free(text);
+}
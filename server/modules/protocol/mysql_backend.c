@@ -75,6 +75,7 @@ static int gw_MySQLWrite_backend(DCB *dcb, GWBUF *queue);
 static int gw_error_backend_event(DCB *dcb);
 static int gw_backend_close(DCB *dcb);
 static int gw_backend_hangup(DCB *dcb);
+static void backend_reset_connection(DCB *dcb);
 static int backend_write_delayqueue(DCB *dcb);
 static void backend_set_delayqueue(DCB *dcb, GWBUF *queue);
 static int gw_change_user(DCB *backend_dcb, SERVER *server, SESSION *in_session, GWBUF *queue);
@@ -936,6 +937,7 @@ gw_read_reply_or_error(DCB *dcb, MYSQL_session local_session)
              */
             gwbuf_free(dcb->delayq);
             dcb->delayq = NULL;
+            dcb_buffered_add(dcb, MEMBUDGET_DELAYQ, -dcb->buffered[MEMBUDGET_DELAYQ]);
             spinlock_release(&dcb->authlock);
 
             /* Only reload the users table if authentication failed and the
@@ -947,6 +949,13 @@ gw_read_reply_or_error(DCB *dcb, MYSQL_session local_session)
             {
                 service_refresh_users(dcb->session->service);
             }
+
+            /** The router does not know the connections that fill the pool */
+            if (dcb->flags & DCBF_PREWARM)
+            {
+                dcb_close(dcb);
+                return 1;
+            }
 #if defined(SS_DEBUG)
             MXS_DEBUG("%lu [gw_read_backend_event] "
                   "calling handleError. Backend "
@@ -996,6 +1005,14 @@ gw_read_reply_or_error(DCB *dcb, MYSQL_session local_session)
                   dcb->fd,
                   local_session.user);
 
+            /** A connection opened to fill the pool goes to the pool now */
+            if (dcb->flags & DCBF_PREWARM)
+            {
+                spinlock_release(&dcb->authlock);
+                dcb_close(dcb);
+                return 0;
+            }
+
             /* check the delay queue and flush the data */
             if (dcb->delayq)
             {
@@ -1091,6 +1108,33 @@ gw_read_and_write(DCB *dcb, MYSQL_session local_session)
             }
         }
 
+        /** The replies to the commands sent by MaxScale itself are not routed */
+        while (read_buffer && ((MySQLProtocol *)dcb->protocol)->ignore_replies > 0)
+        {
+            GWBUF *reply = modutil_get_next_MySQL_packet(&read_buffer);
+            uint8_t *data;
+
+            if (reply == NULL)
+            {
+                break;
+            }
+            data = (uint8_t *)GWBUF_DATA(reply);
+            if (MYSQL_GET_COMMAND(data) == 0xff)
+            {
+                MXS_INFO("Resetting a pooled connection to server '%s' failed with "
+                         "error %d, the session state of the previous session is kept.",
+                         dcb->server->unique_name, MYSQL_GET_ERRCODE(data));
+            }
+            atomic_add(&((MySQLProtocol *)dcb->protocol)->ignore_replies, -1);
+            gwbuf_free(reply);
+        }
+
+        if (read_buffer == NULL)
+        {
+            return_code = 0;
+            goto return_rc;
+        }
+
     do
     {
         GWBUF *stmt = NULL;
@@ -1177,6 +1221,28 @@ return_rc:
     return return_code;
 }
 
+/**
+ * Reset the session state that the previous session left on a pooled connection
+ *
+ * The pool only gives a connection to a session of the same user, so the
+ * state is reset with COM_RESET_CONNECTION instead of a COM_CHANGE_USER
+ * that would authenticate the user again. The command is sent in front of
+ * the first query of the session and its reply is discarded, so the reset
+ * adds no round trip.
+ *
+ * @param dcb   The backend DCB taken from the pool
+ */
+static void backend_reset_connection(DCB *dcb)
+{
+    GWBUF *buf = mysql_create_com_reset_connection();
+
+    if (buf)
+    {
+        atomic_add(&((MySQLProtocol *)dcb->protocol)->ignore_replies, 1);
+        dcb_write(dcb, buf);
+    }
+}
+
 /*
  * EPOLLOUT handler for the MySQL Backend protocol module.
  *
@@ -1303,6 +1369,15 @@ static int gw_MySQLWrite_backend(DCB *dcb, GWBUF *queue)
                       STRPROTOCOLSTATE(backend_protocol->protocol_auth_state));
 
             spinlock_release(&dcb->authlock);
+
+            if (dcb->flags & DCBF_REUSED)
+            {
+                dcb->flags &= ~DCBF_REUSED;
+                if (cmd != MYSQL_COM_QUIT)
+                {
+                    backend_reset_connection(dcb);
+                }
+            }
             /**
              * Statement type is used in readwrite split router.
              * Command is *not* set for readconn router.
@@ -1386,6 +1461,12 @@ static int gw_error_backend_event(DCB *dcb)
         dcb_close(dcb);
         return 1;
     }
+    if (dcb->flags & DCBF_PREWARM)
+    {
+        /** The router does not know the connections that fill the pool */
+        dcb_close(dcb);
+        return 1;
+    }
     rsession = session->router_session;
     router = session->service->router;
     router_instance = session->service->router_instance;
@@ -1505,6 +1586,12 @@ static int gw_backend_hangup(DCB *dcb)
         dcb->dcb_errhandle_called = true;
         goto retblock;
     }
+    if (dcb->flags & DCBF_PREWARM)
+    {
+        /** The router does not know the connections that fill the pool */
+        dcb_close(dcb);
+        goto retblock;
+    }
     session = dcb->session;
 
     if (session == NULL)
@@ -1656,6 +1743,7 @@ static int gw_backend_close(DCB *dcb)
 static void backend_set_delayqueue(DCB *dcb, GWBUF *queue)
 {
     /* Append data */
+    dcb_buffered_add(dcb, MEMBUDGET_DELAYQ, gwbuf_length(queue));
     dcb->delayq = gwbuf_append(dcb->delayq, queue);
 }
 
@@ -1680,6 +1768,8 @@ static int backend_write_delayqueue(DCB *dcb)
     {
         localq = dcb->delayq;
         dcb->delayq = NULL;
+        /** The data is charged to the write queue by dcb_write */
+        dcb_buffered_add(dcb, MEMBUDGET_DELAYQ, -dcb->buffered[MEMBUDGET_DELAYQ]);
 
         if (MYSQL_IS_CHANGE_USER(((uint8_t *)GWBUF_DATA(localq))))
         {
@@ -2062,13 +2152,15 @@ static GWBUF* process_response_data(DCB* dcb,
                 /** Read next packet */
             else
             {
-                uint8_t* data;
+                PACKET_ITER iter;
 
                 /** Read next packet length if there is at least
                  * three bytes left. If there is less than three
                  * bytes in the buffer or it is NULL, we need to
                  wait for more data from the backend server.*/
-                if (*readbuf == NULL || gwbuf_length(*readbuf) < 3)
+                modutil_iter_init(&iter, *readbuf);
+
+                if (!modutil_iter_next(&iter) && !iter.partial)
                 {
                     MXS_DEBUG("%lu [%s] Read %d packets. Waiting for %d more "
                               "packets for a total of %d packets.",
@@ -2084,9 +2176,7 @@ static GWBUF* process_response_data(DCB* dcb,
                     protocol_set_response_status(p, initial_packets, initial_bytes);
                     return NULL;
                 }
-                uint8_t packet_len[3];
-                gwbuf_copy_data(*readbuf, 0, 3, packet_len);
-                nbytes_left = gw_mysql_get_byte3(packet_len) + MYSQL_HEADER_LEN;
+                nbytes_left = iter.len + MYSQL_HEADER_LEN;
                 /** Store new status to protocol structure */
                 protocol_set_response_status(p, npackets_left, nbytes_left);
             }
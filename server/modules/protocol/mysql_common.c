@@ -49,6 +49,7 @@
 #include <skygw_utils.h>
 #include <log_manager.h>
 #include <netinet/tcp.h>
+#include <modutil.h>
 
 static server_command_t* server_command_init(server_command_t* srvcmd, mysql_server_cmd_t cmd);
 
@@ -209,6 +210,33 @@ GWBUF* mysql_create_com_quit(GWBUF* bufparam,
     return buf;
 }
 
+/**
+ * Create a COM_RESET_CONNECTION packet
+ *
+ * The command resets the session state of a connection without the
+ * authentication round trip of COM_CHANGE_USER.
+ *
+ * @return The packet or NULL if memory allocation failed
+ */
+GWBUF* mysql_create_com_reset_connection()
+{
+    GWBUF* buf = gwbuf_alloc(COM_RESET_CONNECTION_PACKET_SIZE);
+
+    if (buf)
+    {
+        uint8_t* data = GWBUF_DATA(buf);
+
+        *data++ = 0x1;
+        *data++ = 0x0;
+        *data++ = 0x0;
+        *data++ = 0x0;
+        *data   = GW_MYSQL_COM_RESET_CONNECTION;
+        gwbuf_set_type(buf, GWBUF_TYPE_MYSQL);
+    }
+
+    return buf;
+}
+
 int mysql_send_com_quit(DCB*   dcb,
                         int    packet_number,
                         GWBUF* bufparam)
@@ -526,64 +554,7 @@ int mysql_send_auth_error(DCB        *dcb,
  */
 GWBUF* gw_MySQL_get_next_packet(GWBUF** p_readbuf)
 {
-    GWBUF* packetbuf;
-    GWBUF* readbuf;
-    size_t buflen;
-    size_t packetlen;
-    size_t totalbuflen;
-    uint8_t* data;
-    size_t nbytes_copied = 0;
-    uint8_t* target;
-
-    readbuf = *p_readbuf;
-
-    if (readbuf == NULL)
-    {
-        packetbuf = NULL;
-        goto return_packetbuf;
-    }
-    CHK_GWBUF(readbuf);
-
-    if (GWBUF_EMPTY(readbuf))
-    {
-        packetbuf = NULL;
-        goto return_packetbuf;
-    }
-    totalbuflen = gwbuf_length(readbuf);
-    data = (uint8_t *)GWBUF_DATA((readbuf));
-    packetlen = MYSQL_GET_PACKET_LEN(data) + 4;
-
-    /** packet is incomplete */
-    if (packetlen > totalbuflen)
-    {
-        packetbuf = NULL;
-        goto return_packetbuf;
-    }
-
-    packetbuf = gwbuf_alloc(packetlen);
-    target = GWBUF_DATA(packetbuf);
-    packetbuf->gwbuf_type = readbuf->gwbuf_type; /*< Copy the type too */
-    /**
-     * Copy first MySQL packet to packetbuf and leave posible other
-     * packets to read buffer.
-     */
-    while (nbytes_copied < packetlen && totalbuflen > 0)
-    {
-        uint8_t* src = GWBUF_DATA((*p_readbuf));
-        size_t   bytestocopy;
-
-        buflen = GWBUF_LENGTH((*p_readbuf));
-        bytestocopy = buflen < (packetlen - nbytes_copied) ? buflen : packetlen - nbytes_copied;
-
-        memcpy(target + nbytes_copied, src, bytestocopy);
-        *p_readbuf = gwbuf_consume((*p_readbuf), bytestocopy);
-        totalbuflen = gwbuf_length((*p_readbuf));
-        nbytes_copied += bytestocopy;
-    }
-    ss_dassert(buflen == 0 || nbytes_copied == packetlen);
-
-return_packetbuf:
-    return packetbuf;
+    return modutil_get_next_MySQL_packet(p_readbuf);
 }
 
 /**
@@ -820,17 +791,17 @@ void init_response_status(GWBUF*             buf,
                           int*               npackets,
                           ssize_t*           nbytes_left)
 {
-    uint8_t readbuf[3];
+    uint8_t readbuf[2] = {0, 0};
     int nparam = 0;
     int nattr = 0;
-    uint8_t* data;
+    PACKET_ITER iter;
 
     ss_dassert(gwbuf_length(buf) >= 3);
 
-    /** Read command byte */
-    gwbuf_copy_data(buf, 4, 1, readbuf);
+    modutil_iter_init(&iter, buf);
+    modutil_iter_next(&iter);
 
-    if (readbuf[0] == 0xff) /*< error */
+    if (iter.cmd == 0xff) /*< error */
     {
         *npackets = 1;
     }
@@ -839,9 +810,9 @@ void init_response_status(GWBUF*             buf,
         switch (cmd)
         {
         case MYSQL_COM_STMT_PREPARE:
-            gwbuf_copy_data(buf, 9, 2, readbuf);
+            modutil_iter_copy(&iter, 5, 2, readbuf);
             nparam = gw_mysql_get_byte2(readbuf);
-            gwbuf_copy_data(buf, 11, 2, readbuf);
+            modutil_iter_copy(&iter, 7, 2, readbuf);
             nattr = gw_mysql_get_byte2(readbuf);
             *npackets = 1 + nparam + MIN(1, nparam) + nattr + MIN(nattr, 1);
             break;
@@ -862,8 +833,7 @@ void init_response_status(GWBUF*             buf,
         }
     }
 
-    gwbuf_copy_data(buf, 0, 3, readbuf);
-    *nbytes_left = gw_mysql_get_byte3(readbuf) + MYSQL_HEADER_LEN;
+    *nbytes_left = iter.len + MYSQL_HEADER_LEN;
     /**
      * There is at least one complete packet in the buffer so buffer is bigger
      * than packet
@@ -112,6 +112,10 @@ struct subcommand showoptions[] = {
       "Show all buffers with backtrace",
       {0, 0, 0} },
 #endif
+    { "bufferpools", 0, dprintBufferPools,
+      "Show the statistics of the buffer pools",
+      "Show the statistics of the buffer pools",
+      {0, 0, 0} },
     { "dcbs", 0, dprintAllDCBs,
       "Show all descriptor control blocks (network connections)",
       "Show all descriptor control blocks (network connections)",
@@ -694,9 +694,12 @@ static struct uri_table {
 	{ "/sessions", maxinfoSessionsAll },
 	{ "/clients", maxinfoClientSessions },
 	{ "/servers", serverGetList },
+	{ "/servers/latency", serverLatencyGetList },
 	{ "/variables", maxinfo_variables },
 	{ "/status", maxinfo_status },
 	{ "/event/times", eventTimesGetList },
+	{ "/event/latency", eventLatencyGetList },
+	{ "/buffered", serviceGetBufferedList },
 	{ NULL, NULL }
 };
 
@@ -201,6 +201,26 @@ exec_show_servers(DCB *dcb, MAXINFO_TREE *tree)
     resultset_free(set);
 }
 
+/**
+ * Fetch the response times of the servers and stream as a result set
+ *
+ * @param dcb   DCB to which to stream result set
+ * @param tree  Potential like clause (currently unused)
+ */
+static void
+exec_show_serverLatency(DCB *dcb, MAXINFO_TREE *tree)
+{
+    RESULTSET   *set;
+
+    if ((set = serverLatencyGetList()) == NULL)
+    {
+        return;
+    }
+
+    resultset_stream_mysql(set, dcb);
+    resultset_free(set);
+}
+
 /**
  * Fetch the list of modules and stream as a result set
  *
@@ -261,6 +281,46 @@ exec_show_eventTimes(DCB *dcb, MAXINFO_TREE *tree)
     resultset_free(set);
 }
 
+/**
+ * Fetch the event latency percentiles
+ *
+ * @param dcb   DCB to which to send result set
+ * @param tree  Potential like clause (currently unused)
+ */
+static void
+exec_show_eventLatency(DCB *dcb, MAXINFO_TREE *tree)
+{
+    RESULTSET   *set;
+
+    if ((set = eventLatencyGetList()) == NULL)
+    {
+        return;
+    }
+
+    resultset_stream_mysql(set, dcb);
+    resultset_free(set);
+}
+
+/**
+ * Fetch the data buffered by MaxScale and by the services
+ *
+ * @param dcb   DCB to which to send result set
+ * @param tree  Potential like clause (currently unused)
+ */
+static void
+exec_show_bufferedData(DCB *dcb, MAXINFO_TREE *tree)
+{
+    RESULTSET   *set;
+
+    if ((set = serviceGetBufferedList()) == NULL)
+    {
+        return;
+    }
+
+    resultset_stream_mysql(set, dcb);
+    resultset_free(set);
+}
+
 /**
  * The table of show commands that are supported
  */
@@ -277,9 +337,12 @@ static struct
     { "sessions", exec_show_sessions },
     { "clients", exec_show_clients },
     { "servers", exec_show_servers },
+    { "serverLatency", exec_show_serverLatency },
     { "modules", exec_show_modules },
     { "monitors", exec_show_monitors },
     { "eventTimes", exec_show_eventTimes },
+    { "eventLatency", exec_show_eventLatency },
+    { "bufferedData", exec_show_bufferedData },
     { NULL, NULL }
 };
 
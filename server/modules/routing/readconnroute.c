@@ -72,6 +72,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <service.h>
 #include <server.h>
@@ -187,6 +188,9 @@ static inline void free_readconn_instance(ROUTER_INSTANCE *router)
             }
         }
         free(router->servers);
+        ts_stats_free(router->stats.n_sessions);
+        ts_stats_free(router->stats.n_queries);
+        ts_stats_free(router->stats.n_spliced);
         free(router);
     }
 }
@@ -218,6 +222,23 @@ createInstance(SERVICE *service, char **options)
     inst->service = service;
     spinlock_init(&inst->lock);
 
+    char labels[TS_LABEL_SIZE("service", service->name)];
+    ts_metric_label(labels, sizeof(labels), "service", service->name);
+    inst->stats.n_sessions = ts_stats_register("maxscale_router_sessions_total", labels,
+                                               "Number of router sessions created",
+                                               TS_METRIC_COUNTER);
+    inst->stats.n_queries = ts_stats_register("maxscale_router_queries_total", labels,
+                                              "Number of queries forwarded",
+                                              TS_METRIC_COUNTER);
+    inst->stats.n_spliced = ts_stats_register("maxscale_router_spliced_sessions_total", labels,
+                                              "Number of sessions switched to splice",
+                                              TS_METRIC_COUNTER);
+    if (!inst->stats.n_sessions || !inst->stats.n_queries || !inst->stats.n_spliced)
+    {
+        free_readconn_instance(inst);
+        return NULL;
+    }
+
     /*
      * We need an array of the backend servers in the instance structure so
      * that we can maintain a count of the number of connections to each
@@ -350,12 +371,16 @@ createInstance(SERVICE *service, char **options)
                 inst->bitmask |= (SERVER_NDB);
                 inst->bitvalue |= SERVER_NDB;
             }
+            else if (!strcasecmp(options[i], "splice"))
+            {
+                inst->splice = true;
+            }
             else
             {
                 MXS_WARNING("Unsupported router "
                             "option \'%s\' for readconnroute. "
                             "Expected router options are "
-                            "[slave|master|synced|ndb|running]",
+                            "[slave|master|synced|ndb|running|splice]",
                             options[i]);
                 error = true;
             }
@@ -530,8 +555,8 @@ newSession(ROUTER *instance, SESSION *session)
                       * 1000) / inst->servers[i]->weight ==
                      ((candidate->current_connection_count + 1) *
                       1000) / candidate->weight &&
-                     inst->servers[i]->server->stats.n_connections <
-                     candidate->server->stats.n_connections)
+                     ts_stats_sum(inst->servers[i]->server->stats.n_connections) <
+                     ts_stats_sum(candidate->server->stats.n_connections))
             {
                 /* This running server has the same number
                 of connections currently as the candidate
@@ -594,7 +619,7 @@ newSession(ROUTER *instance, SESSION *session)
                      DCB_REASON_NOT_RESPONDING,
                      &handle_state_switch,
                      client_rses);
-    inst->stats.n_sessions++;
+    ts_stats_add(inst->stats.n_sessions, 1);
 
     /**
      * Add this session to the list of active sessions.
@@ -733,7 +758,7 @@ routeQuery(ROUTER *instance, void *router_session, GWBUF *queue)
     mysql_server_cmd_t mysql_command = proto->current_command;
     bool rses_is_closed;
 
-    inst->stats.n_queries++;
+    ts_stats_add(inst->stats.n_queries, 1);
 
     /** Dirty read for quick check if router is closed. */
     if (router_cli_ses->rses_closed)
@@ -784,6 +809,12 @@ routeQuery(ROUTER *instance, void *router_session, GWBUF *queue)
                 trc = modutil_get_SQL(queue);
             }
         default:
+            /** The measurement starts before the write as the reply can be
+             * processed by another thread before the write returns */
+            if (modutil_reply_start(&router_cli_ses->reply, mysql_command))
+            {
+                server_latency_start(&router_cli_ses->latency);
+            }
             rc = backend_dcb->func.write(backend_dcb, queue);
             break;
     }
@@ -824,11 +855,16 @@ diagnostics(ROUTER *router, DCB *dcb)
     }
     spinlock_release(&router_inst->lock);
 
-    dcb_printf(dcb, "\tNumber of router sessions:   	%d\n",
-               router_inst->stats.n_sessions);
+    dcb_printf(dcb, "\tNumber of router sessions:   	%" PRId64 "\n",
+               ts_stats_sum(router_inst->stats.n_sessions));
     dcb_printf(dcb, "\tCurrent no. of router sessions:	%d\n", i);
-    dcb_printf(dcb, "\tNumber of queries forwarded:   	%d\n",
-               router_inst->stats.n_queries);
+    dcb_printf(dcb, "\tNumber of queries forwarded:   	%" PRId64 "\n",
+               ts_stats_sum(router_inst->stats.n_queries));
+    if (router_inst->splice)
+    {
+        dcb_printf(dcb, "\tNumber of spliced sessions:   	%" PRId64 "\n",
+                   ts_stats_sum(router_inst->stats.n_spliced));
+    }
     if ((weightby = serviceGetWeightingParameter(router_inst->service))
         != NULL)
     {
@@ -847,6 +883,12 @@ diagnostics(ROUTER *router, DCB *dcb)
         }
 
     }
+    dcb_printf(dcb, "\tBackend response times:\n");
+    dcb_printf(dcb, SERVER_LATENCY_HEADER);
+    for (i = 0; router_inst->servers[i]; i++)
+    {
+        dprintServerLatency(dcb, router_inst->servers[i]->server);
+    }
 }
 
 /**
@@ -862,8 +904,35 @@ diagnostics(ROUTER *router, DCB *dcb)
 static void
 clientReply(ROUTER *instance, void *router_session, GWBUF *queue, DCB *backend_dcb)
 {
-    ss_dassert(backend_dcb->session->client_dcb != NULL);
-    SESSION_ROUTE_REPLY(backend_dcb->session, queue);
+    ROUTER_INSTANCE *inst = (ROUTER_INSTANCE *) instance;
+    ROUTER_CLIENT_SES *router_cli_ses = (ROUTER_CLIENT_SES *) router_session;
+    SESSION *session = backend_dcb->session;
+
+    ss_dassert(session->client_dcb != NULL);
+
+    if (router_cli_ses->reply.state != REPLY_STATE_DONE)
+    {
+        bool complete = modutil_reply_track(&router_cli_ses->reply, queue);
+        server_latency_reply(&router_cli_ses->latency, backend_dcb->server,
+                             inst->service, complete);
+    }
+
+    SESSION_ROUTE_REPLY(session, queue);
+
+    /**
+     * The first reply shows that the backend has been authenticated. From
+     * then on nothing needs to look at the data, unless filters do or the
+     * connection is returned to a persistent pool, which needs to see the
+     * end of the session.
+     */
+    if (inst->splice && backend_dcb->splice == NULL &&
+        session->service->n_filters == 0 &&
+        backend_dcb->server->persistpoolmax == 0 &&
+        !router_cli_ses->rses_closed &&
+        dcb_splice_start(session->client_dcb, backend_dcb))
+    {
+        ts_stats_add(inst->stats.n_spliced, 1);
+    }
 }
 
 /**
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <strings.h>
 #include <string.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -156,7 +157,8 @@ static bool select_connect_backend_servers(backend_ref_t **p_master_ref,
                                            select_criteria_t select_criteria,
                                            SESSION *session,
                                            ROUTER_INSTANCE *router,
-                                           bool new_session);
+                                           bool new_session,
+                                           bool multiplex);
 
 static bool get_dcb(DCB **dcb, ROUTER_CLIENT_SES *rses, backend_type_t btype,
                     char *name, int max_rlag);
@@ -192,7 +194,8 @@ static mysql_sescmd_t *mysql_sescmd_init(rses_property_t *rses_prop,
 
 static rses_property_t *mysql_sescmd_get_property(mysql_sescmd_t *scmd);
 
-static rses_property_t *rses_property_init(rses_property_type_t prop_type);
+static rses_property_t *rses_property_init(ROUTER_CLIENT_SES *rses,
+                                           rses_property_type_t prop_type);
 
 static int rses_property_add(ROUTER_CLIENT_SES *rses, rses_property_t *prop);
 
@@ -258,6 +261,13 @@ static int hashcmpfun(void *, void *);
 static bool check_for_multi_stmt(ROUTER_CLIENT_SES *rses, GWBUF *buf,
                                  mysql_server_cmd_t packet_type);
 static bool send_readonly_error(DCB *dcb);
+static void check_session_pinning(ROUTER_CLIENT_SES *rses, qc_query_type_t qtype,
+                                  mysql_server_cmd_t packet_type);
+static void bref_reply_start(backend_ref_t *bref, mysql_server_cmd_t packet_type);
+static void bref_track_reply(backend_ref_t *bref, GWBUF *buf, SERVICE *service);
+static bool rses_can_detach(ROUTER_CLIENT_SES *rses);
+static void rses_detach_backends(ROUTER_CLIENT_SES *rses);
+static bool rses_attach_backends(ROUTER_CLIENT_SES *rses);
 
 static int hashkeyfun(void *key)
 {
@@ -484,10 +494,55 @@ static inline void free_rwsplit_instance(ROUTER_INSTANCE *router)
             }
         }
         free(router->servers);
+        ts_stats_free(router->stats.n_sessions);
+        ts_stats_free(router->stats.n_queries);
+        ts_stats_free(router->stats.n_master);
+        ts_stats_free(router->stats.n_slave);
+        ts_stats_free(router->stats.n_all);
+        ts_stats_free(router->stats.n_detached);
+        ts_stats_free(router->stats.n_attached);
         free(router);
     }
 }
 
+/**
+ * Register the statistics of a router instance
+ *
+ * @param router    The router instance
+ * @return True if the statistics were created
+ */
+static bool rwsplit_stats_alloc(ROUTER_INSTANCE *router)
+{
+    ROUTER_STATS *stats = &router->stats;
+    char labels[TS_LABEL_SIZE("service", router->service->name)];
+
+    ts_metric_label(labels, sizeof(labels), "service", router->service->name);
+    stats->n_sessions = ts_stats_register("maxscale_router_sessions_total", labels,
+                                          "Number of router sessions created",
+                                          TS_METRIC_COUNTER);
+    stats->n_queries = ts_stats_register("maxscale_router_queries_total", labels,
+                                         "Number of queries forwarded",
+                                         TS_METRIC_COUNTER);
+    stats->n_master = ts_stats_register("maxscale_rwsplit_master_queries_total", labels,
+                                        "Number of statements sent to the master",
+                                        TS_METRIC_COUNTER);
+    stats->n_slave = ts_stats_register("maxscale_rwsplit_slave_queries_total", labels,
+                                       "Number of statements sent to a slave",
+                                       TS_METRIC_COUNTER);
+    stats->n_all = ts_stats_register("maxscale_rwsplit_all_queries_total", labels,
+                                     "Number of statements sent to all servers",
+                                     TS_METRIC_COUNTER);
+    stats->n_detached = ts_stats_register("maxscale_rwsplit_backend_releases_total", labels,
+                                          "Number of times a session released its backends",
+                                          TS_METRIC_COUNTER);
+    stats->n_attached = ts_stats_register("maxscale_rwsplit_backend_reacquisitions_total", labels,
+                                          "Number of times a session took new backends",
+                                          TS_METRIC_COUNTER);
+
+    return stats->n_sessions && stats->n_queries && stats->n_master && stats->n_slave &&
+           stats->n_all && stats->n_detached && stats->n_attached;
+}
+
 /**
  * Create an instance of read/write statement router within the MaxScale.
  *
@@ -512,6 +567,12 @@ static ROUTER *createInstance(SERVICE *service, char **options)
     router->service = service;
     spinlock_init(&router->lock);
 
+    if (!rwsplit_stats_alloc(router))
+    {
+        free_rwsplit_instance(router);
+        return NULL;
+    }
+
     /** Calculate number of servers */
     sref = service->dbref;
     nservers = 0;
@@ -658,6 +719,29 @@ static ROUTER *createInstance(SERVICE *service, char **options)
         router->rwsplit_config.rw_max_sescmd_history_size = 0;
     }
 
+    if (router->rwsplit_config.rw_multiplex)
+    {
+        if (router->rwsplit_config.rw_disable_sescmd_hist)
+        {
+            MXS_WARNING("Service '%s' has disabled the session command history, the "
+                        "backend connections can't be released between transactions "
+                        "and 'multiplex' will have no effect.", service->name);
+        }
+
+        for (int n = 0; router->servers[n]; n++)
+        {
+            SERVER *server = router->servers[n]->backend_server;
+
+            if (server->persistpoolmax == 0)
+            {
+                MXS_WARNING("Service '%s' multiplexes its backend connections but "
+                            "server '%s' has no 'persistpoolmax'. The released "
+                            "connections to it will be closed instead of pooled.",
+                            service->name, server->unique_name);
+            }
+        }
+    }
+
     /**
      * Set default value for max_slave_connections as 100%. This way
      * LEAST_CURRENT_OPERATIONS allows us to balance evenly across all the
@@ -736,7 +820,8 @@ static void *newSession(ROUTER *router_inst, SESSION *session)
     int i;
     const int min_nservers = 1; /*< hard-coded for now */
 
-    client_rses = (ROUTER_CLIENT_SES *)calloc(1, sizeof(ROUTER_CLIENT_SES));
+    /** The router session lives in the arena of the client session */
+    client_rses = (ROUTER_CLIENT_SES *)session_arena_alloc(session, sizeof(ROUTER_CLIENT_SES));
 
     if (client_rses == NULL)
     {
@@ -750,6 +835,7 @@ static void *newSession(ROUTER *router_inst, SESSION *session)
 
     client_rses->router = router;
     client_rses->client_dcb = session->client_dcb;
+    client_rses->rses_session = session;
     /**
      * If service config has been changed, reload config from service to
      * router instance first.
@@ -786,13 +872,12 @@ static void *newSession(ROUTER *router_inst, SESSION *session)
     /**
      * Create backend reference objects for this session.
      */
-    backend_ref = (backend_ref_t *)calloc(1, router_nservers * sizeof(backend_ref_t));
+    backend_ref = (backend_ref_t *)session_arena_alloc(session, router_nservers *
+                                                       sizeof(backend_ref_t));
 
     if (backend_ref == NULL)
     {
-        /** log this */
-        free(client_rses);
-        free(backend_ref);
+        session_arena_free(session, client_rses, sizeof(ROUTER_CLIENT_SES));
         client_rses = NULL;
         goto return_rses;
     }
@@ -832,15 +917,17 @@ static void *newSession(ROUTER *router_inst, SESSION *session)
 
     if (!succp)
     {
-        free(client_rses->rses_backend_ref);
-        free(client_rses);
+        session_arena_free(session, client_rses->rses_backend_ref,
+                           router_nservers * sizeof(backend_ref_t));
+        session_arena_free(session, client_rses, sizeof(ROUTER_CLIENT_SES));
         client_rses = NULL;
         goto return_rses;
     }
     succp = select_connect_backend_servers(&master_ref, backend_ref, router_nservers,
                                            max_nslaves, max_slave_rlag,
                                            client_rses->rses_config.rw_slave_select_criteria,
-                                           session, router, false);
+                                           session, router, false,
+                                           client_rses->rses_config.rw_multiplex);
 
     rses_end_locked_router_action(client_rses);
 
@@ -851,8 +938,9 @@ static void *newSession(ROUTER *router_inst, SESSION *session)
      */
     if (!succp)
     {
-        free(client_rses->rses_backend_ref);
-        free(client_rses);
+        session_arena_free(session, client_rses->rses_backend_ref,
+                           router_nservers * sizeof(backend_ref_t));
+        session_arena_free(session, client_rses, sizeof(ROUTER_CLIENT_SES));
         client_rses = NULL;
         goto return_rses;
     }
@@ -870,7 +958,7 @@ static void *newSession(ROUTER *router_inst, SESSION *session)
         client_rses->rses_config.rw_max_slave_conn_count = n_conn;
     }
 
-    router->stats.n_sessions += 1;
+    ts_stats_add(router->stats.n_sessions, 1);
 
     /**
      * Version is bigger than zero once initialized.
@@ -1050,12 +1138,9 @@ static void freeSession(ROUTER *router_instance, void *router_client_session)
         }
     }
     /*
-     * We are no longer in the linked list, free
-     * all the memory and other resources associated
-     * to the client session.
+     * We are no longer in the linked list. The router session and the
+     * backend references are released with the arena of the client session.
      */
-    free(router_cli_ses->rses_backend_ref);
-    free(router_cli_ses);
     return;
 }
 
@@ -1756,22 +1841,11 @@ static void check_create_tmp_table(ROUTER_CLIENT_SES *router_cli_ses,
 
     if (rses_prop_tmp == NULL)
     {
-        if ((rses_prop_tmp = (rses_property_t *)calloc(1, sizeof(rses_property_t))))
+        if ((rses_prop_tmp = rses_property_init(router_cli_ses, RSES_PROP_TYPE_TMPTABLES)))
         {
-#if defined(SS_DEBUG)
-            rses_prop_tmp->rses_prop_chk_top = CHK_NUM_ROUTER_PROPERTY;
-            rses_prop_tmp->rses_prop_chk_tail = CHK_NUM_ROUTER_PROPERTY;
-#endif
-            rses_prop_tmp->rses_prop_rsession = router_cli_ses;
             rses_prop_tmp->rses_prop_refcount = 1;
-            rses_prop_tmp->rses_prop_next = NULL;
-            rses_prop_tmp->rses_prop_type = RSES_PROP_TYPE_TMPTABLES;
             router_cli_ses->rses_properties[RSES_PROP_TYPE_TMPTABLES] = rses_prop_tmp;
         }
-        else
-        {
-            MXS_ERROR("Call to malloc() failed.");
-        }
     }
     if (rses_prop_tmp)
     {
@@ -1835,6 +1909,45 @@ static DCB *rses_get_client_dcb(ROUTER_CLIENT_SES *rses)
     return NULL;
 }
 
+/**
+ * @brief Check if a statement can be routed by its header alone
+ *
+ * The data of LOAD DATA LOCAL INFILE and the prepared statement commands are
+ * routed without parsing them so they do not have to be copied into one
+ * buffer. The header and the command byte must still be in the first buffer
+ * as the backend protocol reads them from there.
+ *
+ * @param rses     Router session
+ * @param querybuf Buffer containing the statement
+ * @return True if the statement does not need to be contiguous
+ */
+static bool stmt_is_header_only(ROUTER_CLIENT_SES *rses, GWBUF *querybuf)
+{
+    PACKET_ITER iter;
+    bool rval = false;
+
+    modutil_iter_init(&iter, querybuf);
+
+    if (querybuf && GWBUF_LENGTH(querybuf) > MYSQL_HEADER_LEN && modutil_iter_next(&iter))
+    {
+        switch (iter.cmd)
+        {
+        case MYSQL_COM_STMT_EXECUTE:
+        case MYSQL_COM_STMT_SEND_LONG_DATA:
+        case MYSQL_COM_STMT_CLOSE:
+        case MYSQL_COM_STMT_RESET:
+            rval = true;
+            break;
+
+        default:
+            rval = rses->rses_load_active;
+            break;
+        }
+    }
+
+    return rval;
+}
+
 /**
  * @brief The main routing entry point
  *
@@ -1879,7 +1992,10 @@ static int routeQuery(ROUTER *instance, void *router_session, GWBUF *querybuf)
             {
                 rses->client_dcb->dcb_readqueue = gwbuf_append(rses->client_dcb->dcb_readqueue, tmpbuf);
             }
-            querybuf = gwbuf_make_contiguous(querybuf);
+            if (!stmt_is_header_only(rses, querybuf))
+            {
+                querybuf = gwbuf_make_contiguous(querybuf);
+            }
 
             /** Mark buffer to as MySQL type */
             gwbuf_set_type(querybuf, GWBUF_TYPE_MYSQL);
@@ -1973,7 +2089,6 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
 {
     qc_query_type_t qtype = QUERY_TYPE_UNKNOWN;
     mysql_server_cmd_t packet_type = MYSQL_COM_UNDEFINED;
-    uint8_t *packet;
     size_t packet_len;
     int ret = 0;
     DCB *target_dcb = NULL;
@@ -1982,11 +2097,15 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
     int rlag_max = MAX_RLAG_UNDEFINED;
     backend_type_t btype; /*< target backend type */
 
-    ss_dassert(querybuf->next == NULL); // The buffer must be contiguous.
+    PACKET_ITER iter;
+
+    /** The buffer must be contiguous if the statement is parsed */
+    ss_dassert(querybuf->next == NULL || stmt_is_header_only(rses, querybuf));
     ss_dassert(!GWBUF_IS_TYPE_UNDEFINED(querybuf));
 
-    packet = GWBUF_DATA(querybuf);
-    packet_len = gw_mysql_get_byte3(packet);
+    modutil_iter_init(&iter, querybuf);
+    modutil_iter_next(&iter);
+    packet_len = iter.len;
 
     if (packet_len == 0)
     {
@@ -2000,7 +2119,8 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
     }
     else
     {
-        packet_type = packet[4];
+        /** The data of LOAD DATA LOCAL INFILE has no command byte */
+        packet_type = rses->rses_load_active ? MYSQL_COM_UNDEFINED : iter.cmd;
 
         switch (packet_type)
         {
@@ -2055,6 +2175,24 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
             goto retblock;
         }
 
+        /** A multiplexed session takes new backend connections when the
+         * first statement after a released transaction arrives */
+        if (rses->rses_detached)
+        {
+            if (packet_type == MYSQL_COM_QUIT)
+            {
+                rses_end_locked_router_action(rses);
+                succp = true;
+                goto retblock;
+            }
+            else if (!rses_attach_backends(rses))
+            {
+                rses_end_locked_router_action(rses);
+                succp = false;
+                goto retblock;
+            }
+        }
+
         /** Check for multi-statement queries. If no master server is available
          * and a multi-statement is issued, an error is returned to the client
          * when the query is routed.
@@ -2083,6 +2221,11 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
         }
         check_create_tmp_table(rses, querybuf, qtype);
 
+        if (rses->rses_config.rw_multiplex && !rses->rses_pinned)
+        {
+            check_session_pinning(rses, qtype, packet_type);
+        }
+
         /**
          * Check if this is a LOAD DATA LOCAL INFILE query. If so, send all queries
          * to the master until the last, empty packet arrives.
@@ -2144,8 +2287,8 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
             {
                 uint8_t *packet = GWBUF_DATA(querybuf);
                 unsigned char ptype = packet[4];
-                size_t len = MIN(GWBUF_LENGTH(querybuf),
-                                 MYSQL_GET_PACKET_LEN((unsigned char *)querybuf->start) - 1);
+                size_t len = MIN(GWBUF_LENGTH(querybuf) - MYSQL_HEADER_LEN - 1,
+                                 packet_len - 1);
                 char *data = (char *)&packet[5];
                 char *contentstr = strndup(data, MIN(len, RWSPLIT_TRACE_MSG_LEN));
                 char *qtypestr = qc_get_qtype_str(qtype);
@@ -2242,12 +2385,12 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
              * response. Statement is examined in route_session_write.
              * Router locking is done inside the function.
              */
-            succp = route_session_write(rses, gwbuf_clone(querybuf), inst,
+            succp = route_session_write(rses, gwbuf_clone_all(querybuf), inst,
                                         packet_type, qtype);
 
             if (succp)
             {
-                atomic_add(&inst->stats.n_all, 1);
+                ts_stats_add(inst->stats.n_all, 1);
             }
             goto retblock;
         }
@@ -2361,7 +2504,7 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
 #if defined(SS_EXTRA_DEBUG)
             MXS_INFO("Found DCB for slave.");
 #endif
-            atomic_add(&inst->stats.n_slave, 1);
+            ts_stats_add(inst->stats.n_slave, 1);
         }
         else
         {
@@ -2376,7 +2519,7 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
 
         if (succp && master_dcb == curr_master_dcb)
         {
-            atomic_add(&inst->stats.n_master, 1);
+            ts_stats_add(inst->stats.n_master, 1);
             target_dcb = master_dcb;
         }
         else
@@ -2419,28 +2562,41 @@ static bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
                  (SERVER_IS_MASTER(bref->bref_backend->backend_server) ? "master"
                   : "slave"), bref->bref_backend->backend_server->name,
                  bref->bref_backend->backend_server->port);
+        /** The replies to pipelined statements are not told apart, a
+         * session that pipelines keeps its backends */
+        if (rses->rses_config.rw_multiplex && !rses->rses_pinned &&
+            (bref->bref_reply.state != REPLY_STATE_DONE || bref->bref_pending_cmd))
+        {
+            rses->rses_pinned = true;
+            MXS_INFO("Session pipelines statements, keeping the backend connections "
+                     "until the session is closed.");
+        }
+
         /**
          * Store current stmt if execution of previous session command
-         * hasn't completed yet.
+         * hasn't completed yet. A multiplexed session replays the history
+         * also on the master so the master must wait as well.
          */
-        if (sescmd_cursor_is_active(scur) && bref != rses->rses_master_ref)
+        if (sescmd_cursor_is_active(scur) &&
+            (bref != rses->rses_master_ref || rses->rses_config.rw_multiplex))
         {
-            bref->bref_pending_cmd = gwbuf_append(bref->bref_pending_cmd, gwbuf_clone(querybuf));
+            bref->bref_pending_cmd = gwbuf_append(bref->bref_pending_cmd, gwbuf_clone_all(querybuf));
             rses_end_locked_router_action(rses);
             goto retblock;
         }
 
-        if ((ret = target_dcb->func.write(target_dcb, gwbuf_clone(querybuf))) == 1)
+        if ((ret = target_dcb->func.write(target_dcb, gwbuf_clone_all(querybuf))) == 1)
         {
             backend_ref_t *bref;
 
-            atomic_add(&inst->stats.n_queries, 1);
+            ts_stats_add(inst->stats.n_queries, 1);
             /**
              * Add one query response waiter to backend reference
              */
             bref = get_bref_from_dcb(rses, target_dcb);
             bref_set_state(bref, BREF_QUERY_ACTIVE);
             bref_set_state(bref, BREF_WAITING_RESULT);
+            bref_reply_start(bref, packet_type);
         }
         else
         {
@@ -2558,24 +2714,37 @@ static void diagnostic(ROUTER *instance, DCB *dcb)
 
     double master_pct = 0.0, slave_pct = 0.0, all_pct = 0.0;
 
-    if (router->stats.n_queries > 0)
+    int64_t n_queries = ts_stats_sum(router->stats.n_queries);
+    int64_t n_master = ts_stats_sum(router->stats.n_master);
+    int64_t n_slave = ts_stats_sum(router->stats.n_slave);
+    int64_t n_all = ts_stats_sum(router->stats.n_all);
+
+    if (n_queries > 0)
     {
-        master_pct = ((double)router->stats.n_master / (double)router->stats.n_queries) * 100.0;
-        slave_pct = ((double)router->stats.n_slave / (double)router->stats.n_queries) * 100.0;
-        all_pct = ((double)router->stats.n_all / (double)router->stats.n_queries) * 100.0;
+        master_pct = ((double)n_master / (double)n_queries) * 100.0;
+        slave_pct = ((double)n_slave / (double)n_queries) * 100.0;
+        all_pct = ((double)n_all / (double)n_queries) * 100.0;
     }
 
-    dcb_printf(dcb, "\tNumber of router sessions:           	%d\n",
-               router->stats.n_sessions);
+    dcb_printf(dcb, "\tNumber of router sessions:           	%" PRId64 "\n",
+               ts_stats_sum(router->stats.n_sessions));
     dcb_printf(dcb, "\tCurrent no. of router sessions:      	%d\n", i);
-    dcb_printf(dcb, "\tNumber of queries forwarded:          	%d\n",
-               router->stats.n_queries);
-    dcb_printf(dcb, "\tNumber of queries forwarded to master:	%d (%.2f%%)\n",
-               router->stats.n_master, master_pct);
-    dcb_printf(dcb, "\tNumber of queries forwarded to slave: 	%d (%.2f%%)\n",
-               router->stats.n_slave, slave_pct);
-    dcb_printf(dcb, "\tNumber of queries forwarded to all:   	%d (%.2f%%)\n",
-               router->stats.n_all, all_pct);
+    dcb_printf(dcb, "\tNumber of queries forwarded:          	%" PRId64 "\n",
+               n_queries);
+    dcb_printf(dcb, "\tNumber of queries forwarded to master:	%" PRId64 " (%.2f%%)\n",
+               n_master, master_pct);
+    dcb_printf(dcb, "\tNumber of queries forwarded to slave: 	%" PRId64 " (%.2f%%)\n",
+               n_slave, slave_pct);
+    dcb_printf(dcb, "\tNumber of queries forwarded to all:   	%" PRId64 " (%.2f%%)\n",
+               n_all, all_pct);
+
+    if (router->rwsplit_config.rw_multiplex)
+    {
+        dcb_printf(dcb, "\tNumber of backend releases:           	%" PRId64 "\n",
+                   ts_stats_sum(router->stats.n_detached));
+        dcb_printf(dcb, "\tNumber of backend reacquisitions:     	%" PRId64 "\n",
+                   ts_stats_sum(router->stats.n_attached));
+    }
 
     if ((weightby = serviceGetWeightingParameter(router->service)) != NULL)
     {
@@ -2588,12 +2757,20 @@ static void diagnostic(ROUTER *instance, DCB *dcb)
         for (i = 0; router->servers[i]; i++)
         {
             backend = router->servers[i];
-            dcb_printf(dcb, "\t\t%-20s %3.1f%%     %-6d  %-6d  %d\n",
+            dcb_printf(dcb, "\t\t%-20s %3.1f%%     %-6" PRId64 "  %-6d  %" PRId64 "\n",
                        backend->backend_server->unique_name, (float)backend->weight / 10,
-                       backend->backend_server->stats.n_current, backend->backend_conn_count,
-                       backend->backend_server->stats.n_current_ops);
+                       ts_stats_sum(backend->backend_server->stats.n_current),
+                       backend->backend_conn_count,
+                       ts_stats_sum(backend->backend_server->stats.n_current_ops));
         }
     }
+
+    dcb_printf(dcb, "\tBackend response times:\n");
+    dcb_printf(dcb, SERVER_LATENCY_HEADER);
+    for (i = 0; router->servers[i]; i++)
+    {
+        dprintServerLatency(dcb, router->servers[i]->backend_server);
+    }
 }
 
 /**
@@ -2714,7 +2891,8 @@ static void clientReply(ROUTER *instance, void *router_session, GWBUF *writebuf,
                     router_cli_ses->rses_config.rw_slave_select_criteria,
                     router_cli_ses->rses_master_ref->bref_dcb->session,
                     router_cli_ses->router,
-                    true);
+                    true,
+                    router_cli_ses->rses_config.rw_multiplex);
             }
         }
         /**
@@ -2737,6 +2915,12 @@ static void clientReply(ROUTER *instance, void *router_session, GWBUF *writebuf,
         bref_clear_state(bref, BREF_WAITING_RESULT);
     }
 
+    if (writebuf != NULL && !sescmd_cursor_is_active(scur) &&
+        bref->bref_reply.state != REPLY_STATE_DONE)
+    {
+        bref_track_reply(bref, writebuf, router_inst->service);
+    }
+
     if (writebuf != NULL && client_dcb != NULL)
     {
         /** Write reply to client DCB */
@@ -2776,15 +2960,16 @@ static void clientReply(ROUTER *instance, void *router_session, GWBUF *writebuf,
         CHK_GWBUF(bref->bref_pending_cmd);
 
         if ((ret = bref->bref_dcb->func.write(bref->bref_dcb,
-                       gwbuf_clone(bref->bref_pending_cmd))) == 1)
+                       gwbuf_clone_all(bref->bref_pending_cmd))) == 1)
         {
             ROUTER_INSTANCE* inst = (ROUTER_INSTANCE *)instance;
-            atomic_add(&inst->stats.n_queries, 1);
+            ts_stats_add(inst->stats.n_queries, 1);
             /**
              * Add one query response waiter to backend reference
              */
             bref_set_state(bref, BREF_QUERY_ACTIVE);
             bref_set_state(bref, BREF_WAITING_RESULT);
+            bref_reply_start(bref, MYSQL_GET_COMMAND((uint8_t *)GWBUF_DATA(bref->bref_pending_cmd)));
         }
         else
         {
@@ -2803,6 +2988,12 @@ static void clientReply(ROUTER *instance, void *router_session, GWBUF *writebuf,
         gwbuf_free(bref->bref_pending_cmd);
         bref->bref_pending_cmd = NULL;
     }
+
+    /** A multiplexed session releases its backends between transactions */
+    if (rses_can_detach(router_cli_ses))
+    {
+        rses_detach_backends(router_cli_ses);
+    }
     /** Unlock router session */
     rses_end_locked_router_action(router_cli_ses);
 
@@ -2818,8 +3009,8 @@ int bref_cmp_router_conn(const void *bref1, const void *bref2)
 
     if (b1->weight == 0 && b2->weight == 0)
     {
-        return b1->backend_server->stats.n_current -
-               b2->backend_server->stats.n_current;
+        return (int)(ts_stats_sum(b1->backend_server->stats.n_current) -
+                     ts_stats_sum(b2->backend_server->stats.n_current));
     }
     else if (b1->weight == 0)
     {
@@ -2842,8 +3033,8 @@ int bref_cmp_global_conn(const void *bref1, const void *bref2)
 
     if (b1->weight == 0 && b2->weight == 0)
     {
-        return b1->backend_server->stats.n_current -
-               b2->backend_server->stats.n_current;
+        return (int)(ts_stats_sum(b1->backend_server->stats.n_current) -
+                     ts_stats_sum(b2->backend_server->stats.n_current));
     }
     else if (b1->weight == 0)
     {
@@ -2854,8 +3045,8 @@ int bref_cmp_global_conn(const void *bref1, const void *bref2)
         return -1;
     }
 
-    return ((1000 + 1000 * b1->backend_server->stats.n_current) / b1->weight) -
-           ((1000 + 1000 * b2->backend_server->stats.n_current) / b2->weight);
+    return (int)(((1000 + 1000 * ts_stats_sum(b1->backend_server->stats.n_current)) / b1->weight) -
+                 ((1000 + 1000 * ts_stats_sum(b2->backend_server->stats.n_current)) / b2->weight));
 }
 
 /** Compare relication lag between backend servers */
@@ -2878,8 +3069,8 @@ int bref_cmp_current_load(const void *bref1, const void *bref2)
 
     if (b1->weight == 0 && b2->weight == 0)
     {
-        return b1->backend_server->stats.n_current -
-               b2->backend_server->stats.n_current;
+        return (int)(ts_stats_sum(b1->backend_server->stats.n_current) -
+                     ts_stats_sum(b2->backend_server->stats.n_current));
     }
     else if (b1->weight == 0)
     {
@@ -2890,8 +3081,8 @@ int bref_cmp_current_load(const void *bref1, const void *bref2)
         return -1;
     }
 
-    return ((1000 * s1->stats.n_current_ops) - b1->weight) -
-           ((1000 * s2->stats.n_current_ops) - b2->weight);
+    return (int)(((1000 * ts_stats_sum(s1->stats.n_current_ops)) - b1->weight) -
+                 ((1000 * ts_stats_sum(s2->stats.n_current_ops)) - b2->weight));
 }
 
 static void bref_clear_state(backend_ref_t *bref, bref_state_t state)
@@ -2905,7 +3096,6 @@ static void bref_clear_state(backend_ref_t *bref, bref_state_t state)
     if ((state & BREF_WAITING_RESULT) && (bref->bref_state & BREF_WAITING_RESULT))
     {
         int prev1;
-        int prev2;
 
         /** Decrease waiter count */
         prev1 = atomic_add(&bref->bref_num_result_wait, -1);
@@ -2916,15 +3106,9 @@ static void bref_clear_state(backend_ref_t *bref, bref_state_t state)
         }
         else
         {
-            /** Decrease global operation count */
-            prev2 = atomic_add(&bref->bref_backend->backend_server->stats.n_current_ops, -1);
-            ss_dassert(prev2 > 0);
-            if (prev2 <= 0)
-            {
-                MXS_ERROR("[%s] Error: negative current operation count in backend %s:%u",
-                          __FUNCTION__, bref->bref_backend->backend_server->name,
-                          bref->bref_backend->backend_server->port);
-            }
+            /** Decrease global operation count, the per-thread parts are
+             * summed when read so a single part can go below zero */
+            ts_stats_add(bref->bref_backend->backend_server->stats.n_current_ops, -1);
         }
     }
 
@@ -2942,7 +3126,6 @@ static void bref_set_state(backend_ref_t *bref, bref_state_t state)
     if ((state & BREF_WAITING_RESULT) && (bref->bref_state & BREF_WAITING_RESULT) == 0)
     {
         int prev1;
-        int prev2;
 
         /** Increase waiter count */
         prev1 = atomic_add(&bref->bref_num_result_wait, 1);
@@ -2955,15 +3138,7 @@ static void bref_set_state(backend_ref_t *bref, bref_state_t state)
                       bref->bref_backend->backend_server->port);
         }
         /** Increase global operation count */
-        prev2 =
-            atomic_add(&bref->bref_backend->backend_server->stats.n_current_ops, 1);
-        ss_dassert(prev2 >= 0);
-        if (prev2 < 0)
-        {
-            MXS_ERROR("[%s] Error: negative current operation count in backend %s:%u",
-                      __FUNCTION__, bref->bref_backend->backend_server->name,
-                      bref->bref_backend->backend_server->port);
-        }
+        ts_stats_add(bref->bref_backend->backend_server->stats.n_current_ops, 1);
     }
 
     bref->bref_state |= state;
@@ -3051,8 +3226,8 @@ void log_server_connections(select_criteria_t select_criteria,
             switch (select_criteria)
             {
                 case LEAST_GLOBAL_CONNECTIONS:
-                    MXS_INFO("MaxScale connections : %d in \t%s:%d %s",
-                             b->backend_server->stats.n_current, b->backend_server->name,
+                    MXS_INFO("MaxScale connections : %" PRId64 " in \t%s:%d %s",
+                             ts_stats_sum(b->backend_server->stats.n_current), b->backend_server->name,
                              b->backend_server->port, STRSRVSTATUS(b->backend_server));
                     break;
 
@@ -3063,8 +3238,8 @@ void log_server_connections(select_criteria_t select_criteria,
                     break;
 
                 case LEAST_CURRENT_OPERATIONS:
-                    MXS_INFO("current operations : %d in \t%s:%d %s",
-                             b->backend_server->stats.n_current_ops,
+                    MXS_INFO("current operations : %" PRId64 " in \t%s:%d %s",
+                             ts_stats_sum(b->backend_server->stats.n_current_ops),
                              b->backend_server->name, b->backend_server->port,
                              STRSRVSTATUS(b->backend_server));
                     break;
@@ -3163,6 +3338,9 @@ backend_ref_t* get_slave_candidate(backend_ref_t *bref, int n, const SERVER *mas
  * @param select_criteria Slave selection criteria
  * @param session Client session
  * @param router Router instance
+ * @param active_session True if the session already has its master
+ * @param multiplex True if the session is multiplexed and the master must
+ * replay the session command history like the slaves
  * @return true, if at least one master and one slave was found.
  */
 static bool select_connect_backend_servers(backend_ref_t **p_master_ref,
@@ -3172,7 +3350,8 @@ static bool select_connect_backend_servers(backend_ref_t **p_master_ref,
                                            select_criteria_t select_criteria,
                                            SESSION *session,
                                            ROUTER_INSTANCE *router,
-                                           bool active_session)
+                                           bool active_session,
+                                           bool multiplex)
 {
     if (p_master_ref == NULL || backend_ref == NULL)
     {
@@ -3231,7 +3410,10 @@ static bool select_connect_backend_servers(backend_ref_t **p_master_ref,
             if (bref_valid_for_connect(&backend_ref[i]) &&
                 master_host && serv == master_host)
             {
-                if (connect_server(&backend_ref[i], session, false))
+                /** A multiplexed session replays its history also on the master,
+                 * otherwise the master executes the session commands as they
+                 * are routed and a replayed history would interleave with them */
+                if (connect_server(&backend_ref[i], session, multiplex))
                 {
                     *p_master_ref = &backend_ref[i];
                     break;
@@ -3340,16 +3522,17 @@ static bool select_connect_backend_servers(backend_ref_t **p_master_ref,
 /**
  * Create a generic router session property strcture.
  */
-static rses_property_t *rses_property_init(rses_property_type_t prop_type)
+static rses_property_t *rses_property_init(ROUTER_CLIENT_SES *rses,
+                                           rses_property_type_t prop_type)
 {
     rses_property_t *prop;
 
-    prop = (rses_property_t *)calloc(1, sizeof(rses_property_t));
+    prop = (rses_property_t *)session_arena_alloc(rses->rses_session, sizeof(rses_property_t));
     if (prop == NULL)
     {
-        MXS_ERROR("Error: Malloc returned NULL. (%s:%d)", __FILE__, __LINE__);
         return NULL;
     }
+    prop->rses_prop_rsession = rses;
     prop->rses_prop_type = prop_type;
 #if defined(SS_DEBUG)
     prop->rses_prop_chk_top = CHK_NUM_ROUTER_PROPERTY;
@@ -3389,7 +3572,8 @@ static void rses_property_done(rses_property_t *prop)
             ss_dassert(false);
             break;
     }
-    free(prop);
+    /** A recycled property is reused by the next session command */
+    session_arena_free(prop->rses_prop_rsession->rses_session, prop, sizeof(rses_property_t));
 }
 
 /**
@@ -3484,6 +3668,8 @@ static mysql_sescmd_t *mysql_sescmd_init(rses_property_t *rses_prop,
     sescmd->my_sescmd_buf = sescmd_buf;
     sescmd->my_sescmd_packet_type = packet_type;
     sescmd->position = atomic_add(&rses->pos_generator, 1);
+    /** The history is kept until it is pruned or the session is freed */
+    session_buffered_add(rses->rses_session, MEMBUDGET_SESCMD, gwbuf_length(sescmd_buf));
 
     return sescmd;
 }
@@ -3496,6 +3682,11 @@ static void mysql_sescmd_done(mysql_sescmd_t *sescmd)
         return;
     }
     CHK_RSES_PROP(sescmd->my_sescmd_prop);
+    if (sescmd->my_sescmd_prop->rses_prop_rsession)
+    {
+        session_buffered_add(sescmd->my_sescmd_prop->rses_prop_rsession->rses_session,
+                             MEMBUDGET_SESCMD, -gwbuf_length(sescmd->my_sescmd_buf));
+    }
     gwbuf_free(sescmd->my_sescmd_buf);
     memset(sescmd, 0, sizeof(mysql_sescmd_t));
 }
@@ -4111,7 +4302,7 @@ static bool route_session_write(ROUTER_CLIENT_SES *router_cli_ses,
             if (BREF_IS_IN_USE((&backend_ref[i])))
             {
                 nbackends += 1;
-                if ((rc = dcb->func.write(dcb, gwbuf_clone(querybuf))) == 1)
+                if ((rc = dcb->func.write(dcb, gwbuf_clone_all(querybuf))) == 1)
                 {
                     nsucc += 1;
                 }
@@ -4188,7 +4379,7 @@ static bool route_session_write(ROUTER_CLIENT_SES *router_cli_ses,
      * prevent it from being released before properties
      * are cleaned up as a part of router sessionclean-up.
      */
-    if ((prop = rses_property_init(RSES_PROP_TYPE_SESCMD)) == NULL)
+    if ((prop = rses_property_init(router_cli_ses, RSES_PROP_TYPE_SESCMD)) == NULL)
     {
         MXS_ERROR("Router session property initialization failed");
         rses_end_locked_router_action(router_cli_ses);
@@ -4377,6 +4568,10 @@ static bool rwsplit_process_router_options(ROUTER_INSTANCE *router,
             {
                 router->rwsplit_config.rw_strict_multi_stmt = config_truth_value(value);
             }
+            else if (strcmp(options[i], "multiplex") == 0)
+            {
+                router->rwsplit_config.rw_multiplex = config_truth_value(value);
+            }
             else if (strcmp(options[i], "master_failure_mode") == 0)
             {
                 if (strcasecmp(value, "fail_instantly") == 0)
@@ -4695,7 +4890,8 @@ static bool handle_error_new_connection(ROUTER_INSTANCE *inst,
                                                router_nservers,
                                                max_nslaves, max_slave_rlag,
                                                myrses->rses_config.rw_slave_select_criteria,
-                                               ses, inst, true);
+                                               ses, inst, true,
+                                               myrses->rses_config.rw_multiplex);
     }
 
 return_succp:
@@ -4804,7 +5000,7 @@ static bool have_enough_servers(ROUTER_CLIENT_SES **p_rses, const int min_nsrv,
                           (*p_rses)->rses_config.rw_max_slave_conn_percent, dbgpct);
             }
         }
-        free(*p_rses);
+        session_arena_free((*p_rses)->rses_session, *p_rses, sizeof(ROUTER_CLIENT_SES));
         *p_rses = NULL;
         succp = false;
     }
@@ -5176,3 +5372,196 @@ static bool send_readonly_error(DCB *dcb)
 
     return succp;
 }
+
+/**
+ * @brief Check whether a statement ties the session to its backend connections
+ *
+ * User variables, prepared statements, temporary tables, multi-statement
+ * queries and COM_CHANGE_USER create state that the session command history
+ * can't recreate on another connection. Once such a statement is routed,
+ * the session keeps its connections until it is closed.
+ *
+ * @param rses Router client session, must be locked
+ * @param qtype Query type of the statement
+ * @param packet_type Command of the statement
+ */
+static void check_session_pinning(ROUTER_CLIENT_SES *rses, qc_query_type_t qtype,
+                                  mysql_server_cmd_t packet_type)
+{
+    const char *reason = NULL;
+
+    if (QUERY_IS_TYPE(qtype, QUERY_TYPE_USERVAR_WRITE))
+    {
+        reason = "user variable";
+    }
+    else if (QUERY_IS_TYPE(qtype, QUERY_TYPE_PREPARE_STMT) ||
+             QUERY_IS_TYPE(qtype, QUERY_TYPE_PREPARE_NAMED_STMT) ||
+             packet_type == MYSQL_COM_STMT_PREPARE ||
+             packet_type == MYSQL_COM_STMT_EXECUTE)
+    {
+        reason = "prepared statement";
+    }
+    else if (rses->have_tmp_tables)
+    {
+        reason = "temporary table";
+    }
+    else if (rses->forced_node)
+    {
+        reason = "multi-statement query";
+    }
+    else if (packet_type == MYSQL_COM_CHANGE_USER)
+    {
+        reason = "COM_CHANGE_USER";
+    }
+
+    if (reason)
+    {
+        rses->rses_pinned = true;
+        MXS_INFO("Session uses a %s, keeping the backend connections until "
+                 "the session is closed.", reason);
+    }
+}
+
+/**
+ * @brief Start tracking the reply to a statement routed to a backend
+ *
+ * @param bref Backend reference the statement was written to
+ * @param packet_type Command of the statement
+ */
+static void bref_reply_start(backend_ref_t *bref, mysql_server_cmd_t packet_type)
+{
+    if (modutil_reply_start(&bref->bref_reply, packet_type))
+    {
+        server_latency_start(&bref->bref_latency);
+    }
+}
+
+/**
+ * @brief Follow the reply to a statement and record its response time
+ *
+ * @param bref Backend reference that sent the reply
+ * @param buf Part of the reply, only complete packets
+ * @param service The service of the router
+ */
+static void bref_track_reply(backend_ref_t *bref, GWBUF *buf, SERVICE *service)
+{
+    bool complete = modutil_reply_track(&bref->bref_reply, buf);
+
+    server_latency_reply(&bref->bref_latency, bref->bref_backend->backend_server,
+                         service, complete);
+}
+
+/**
+ * @brief Check whether the session can release its backend connections
+ *
+ * @param rses Router client session, must be locked
+ * @return True if no transaction is open, the session has no state that
+ * can't be replayed and all backends have replied to everything sent to them
+ */
+static bool rses_can_detach(ROUTER_CLIENT_SES *rses)
+{
+    if (!rses->rses_config.rw_multiplex || rses->rses_closed || rses->rses_detached ||
+        rses->rses_pinned || rses->rses_config.rw_disable_sescmd_hist ||
+        !rses->rses_autocommit_enabled || rses->rses_transaction_active ||
+        rses->rses_load_active)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        backend_ref_t *bref = &rses->rses_backend_ref[i];
+
+        if (BREF_IS_IN_USE(bref) &&
+            (BREF_IS_WAITING_RESULT(bref) || BREF_IS_QUERY_ACTIVE(bref) ||
+             sescmd_cursor_is_active(&bref->bref_sescmd_cur) ||
+             bref->bref_pending_cmd != NULL ||
+             bref->bref_reply.state != REPLY_STATE_DONE))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Release the backend connections of an idle session
+ *
+ * The connections are closed which returns them to the persistent connection
+ * pools of the servers. The session takes new connections when its next
+ * statement arrives.
+ *
+ * @param rses Router client session, must be locked
+ */
+static void rses_detach_backends(ROUTER_CLIENT_SES *rses)
+{
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        backend_ref_t *bref = &rses->rses_backend_ref[i];
+        DCB *dcb = bref->bref_dcb;
+
+        if (BREF_IS_IN_USE(bref))
+        {
+            bref_clear_state(bref, BREF_IN_USE);
+            bref_set_state(bref, BREF_CLOSED);
+            RW_CHK_DCB(bref, dcb);
+
+            if (dcb && dcb->state == DCB_STATE_POLLING)
+            {
+                dcb_close(dcb);
+            }
+
+            RW_CLOSE_BREF(bref);
+            bref->bref_dcb = NULL;
+            atomic_add(&bref->bref_backend->backend_conn_count, -1);
+        }
+    }
+
+    rses->rses_master_ref = NULL;
+    rses->rses_detached = true;
+    ts_stats_add(rses->router->stats.n_detached, 1);
+}
+
+/**
+ * @brief Take new backend connections for a session that released its own
+ *
+ * The servers are selected as for a new session and the session command
+ * history is executed on every connection before the statement is routed.
+ *
+ * @param rses Router client session, must be locked
+ * @return True if the session has the backends it needs
+ */
+static bool rses_attach_backends(ROUTER_CLIENT_SES *rses)
+{
+    bool succp;
+
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        /** Servers that failed earlier are candidates for the new connections */
+        bref_clear_state(&rses->rses_backend_ref[i], BREF_FATAL_FAILURE);
+    }
+
+    succp = select_connect_backend_servers(&rses->rses_master_ref,
+                                           rses->rses_backend_ref,
+                                           rses->rses_nbackends,
+                                           rses_get_max_slavecount(rses, rses->rses_nbackends),
+                                           rses_get_max_replication_lag(rses),
+                                           rses->rses_config.rw_slave_select_criteria,
+                                           rses->rses_session,
+                                           rses->router,
+                                           false,
+                                           rses->rses_config.rw_multiplex);
+
+    if (succp)
+    {
+        rses->rses_detached = false;
+        ts_stats_add(rses->router->stats.n_attached, 1);
+    }
+    else
+    {
+        MXS_ERROR("Failed to take new backend connections for a multiplexed session.");
+    }
+
+    return succp;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl.
+ *
+ * Change Date: 2019-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file testrwsplit.c - Tests of the readwritesplit backend selection
+ *
+ * The router is compiled into the test so that its static functions can be
+ * called. The backend connections are fake DCBs that count the writes.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+
+#define dcb_connect test_dcb_connect
+#include "../readwritesplit.c"
+#undef dcb_connect
+
+static int n_writes;
+
+/**
+ * Count the writes to a fake backend connection
+ */
+static int
+test_write(DCB *dcb, GWBUF *buf)
+{
+    n_writes++;
+    gwbuf_free(buf);
+    return 1;
+}
+
+/**
+ * Return a fake backend connection instead of connecting to the server
+ */
+DCB *
+test_dcb_connect(SERVER *server, SESSION *session, const char *protocol)
+{
+    DCB *dcb = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL);
+
+    dcb->server = server;
+    dcb->session = session;
+    dcb->func.write = test_write;
+    return dcb;
+}
+
+/**
+ * Create a COM_QUERY packet
+ */
+static GWBUF *
+create_query(const char *sql)
+{
+    size_t len = strlen(sql) + 1;
+    GWBUF *buf = gwbuf_alloc(len + 4);
+    uint8_t *data = GWBUF_DATA(buf);
+
+    data[0] = len;
+    data[1] = len >> 8;
+    data[2] = len >> 16;
+    data[3] = 0;
+    data[4] = MYSQL_COM_QUERY;
+    memcpy(data + 5, sql, len - 1);
+    return buf;
+}
+
+/**
+ * test1    Connect the master of a session that has session command history
+ *
+ * A multiplexed session replays the history on the new master connection.
+ * In other sessions the master executes the session commands as they are
+ * routed and nothing may be written to a new master connection before the
+ * next statement.
+ */
+static int
+test1()
+{
+    static SESSION session;
+    static ROUTER_INSTANCE router;
+    static ROUTER_CLIENT_SES rses;
+    BACKEND backend;
+    backend_ref_t bref;
+    SERVER *server;
+
+    ss_dfprintf(stderr, "testrwsplit : reconnect the master of a session with history");
+    server = server_alloc("127.0.0.1", "MySQLBackend", 3306);
+    server_set_status(server, SERVER_RUNNING | SERVER_MASTER);
+    session.state = SESSION_STATE_ROUTER_READY;
+
+    memset(&backend, 0, sizeof(backend));
+    backend.backend_server = server;
+    backend.be_valid = true;
+    backend.be_chk_top = CHK_NUM_BACKEND;
+    backend.be_chk_tail = CHK_NUM_BACKEND;
+
+    rses.rses_chk_top = CHK_NUM_ROUTER_SES;
+    rses.rses_chk_tail = CHK_NUM_ROUTER_SES;
+    rses.rses_session = &session;
+    rses.rses_backend_ref = &bref;
+    rses.rses_nbackends = 1;
+    rses.router = &router;
+    spinlock_init(&rses.rses_lock);
+
+    ss_info_dassert(rses_begin_locked_router_action(&rses), "The session should be open");
+    rses_property_t *prop = rses_property_init(&rses, RSES_PROP_TYPE_SESCMD);
+    mysql_sescmd_init(prop, create_query("SET @a = 1"), MYSQL_COM_QUERY, &rses);
+    rses_property_add(&rses, prop);
+
+    for (int multiplex = 0; multiplex < 2; multiplex++)
+    {
+        memset(&bref, 0, sizeof(bref));
+        bref.bref_chk_top = CHK_NUM_BACKEND_REF;
+        bref.bref_chk_tail = CHK_NUM_BACKEND_REF;
+        bref.bref_sescmd_cur.scmd_cur_chk_top = CHK_NUM_SESCMD_CUR;
+        bref.bref_sescmd_cur.scmd_cur_chk_tail = CHK_NUM_SESCMD_CUR;
+        bref.bref_backend = &backend;
+        bref.bref_sescmd_cur.scmd_cur_rses = &rses;
+        bref.bref_sescmd_cur.scmd_cur_ptr_property = &rses.rses_properties[RSES_PROP_TYPE_SESCMD];
+        rses.rses_master_ref = NULL;
+        rses.rses_config.rw_multiplex = multiplex;
+        n_writes = 0;
+
+        ss_info_dassert(select_connect_backend_servers(&rses.rses_master_ref, &bref, 1, 0, 0,
+                                                       LEAST_CURRENT_OPERATIONS, &session,
+                                                       &router, false, rses.rses_config.rw_multiplex),
+                        "The master should be connected");
+        ss_info_dassert(rses.rses_master_ref == &bref && BREF_IS_IN_USE(&bref),
+                        "The master reference should be in use");
+
+        if (multiplex)
+        {
+            ss_info_dassert(n_writes == 1, "A multiplexed session should replay the history");
+            ss_info_dassert(sescmd_cursor_is_active(&bref.bref_sescmd_cur),
+                            "The master should wait for the replies to the history");
+        }
+        else
+        {
+            ss_info_dassert(n_writes == 0, "The history should not be replayed on the master");
+            ss_info_dassert(!sescmd_cursor_is_active(&bref.bref_sescmd_cur),
+                            "The master should not wait for session command replies");
+        }
+    }
+
+    rses_end_locked_router_action(&rses);
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    result += test1();
+
+    exit(result);
+}
@@ -12,6 +12,7 @@
  */
 #include <my_config.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <strings.h>
 #include <string.h>
 #include <stdlib.h>
@@ -151,6 +152,7 @@ static bool route_session_write(ROUTER_CLIENT_SES* router_client_ses,
                                 qc_query_type_t    qtype);
 static void bref_clear_state(backend_ref_t* bref, bref_state_t state);
 static void bref_set_state(backend_ref_t*   bref, bref_state_t state);
+static void bref_reply_start(backend_ref_t* bref, mysql_server_cmd_t packet_type);
 static sescmd_cursor_t* backend_ref_get_sescmd_cursor (backend_ref_t* bref);
 static int  router_handle_state_switch(DCB* dcb, DCB_REASON reason, void* data);
 static bool handle_error_new_connection(ROUTER_INSTANCE*   inst,
@@ -2315,6 +2317,7 @@ static int routeQuery(ROUTER* instance,
             bref_set_state(bref, BREF_QUERY_ACTIVE);
             bref_set_state(bref, BREF_WAITING_RESULT);
             atomic_add(&bref->bref_backend->stats.queries, 1);
+            bref_reply_start(bref, packet_type);
         }
         else
         {
@@ -2453,9 +2456,31 @@ static void diagnostic(ROUTER *instance, DCB *dcb)
     }
     dcb_printf(dcb, "Shard map cache hits: %d\n", router->stats.shmap_cache_hit);
     dcb_printf(dcb, "Shard map cache misses: %d\n", router->stats.shmap_cache_miss);
+
+    /** Backend response times */
+    dcb_printf(dcb, "\n\33[1;4mBackend Response Times\33[0m\n");
+    dcb_printf(dcb, SERVER_LATENCY_HEADER);
+    for (i = 0; router->servers[i]; i++)
+    {
+        dprintServerLatency(dcb, router->servers[i]->backend_server);
+    }
     dcb_printf(dcb, "\n");
 }
 
+/**
+ * Start tracking the reply to a statement routed to a backend
+ *
+ * @param bref          Backend reference the statement was written to
+ * @param packet_type   Command of the statement
+ */
+static void bref_reply_start(backend_ref_t* bref, mysql_server_cmd_t packet_type)
+{
+    if (modutil_reply_start(&bref->bref_reply, packet_type))
+    {
+        server_latency_start(&bref->bref_latency);
+    }
+}
+
 /**
  * Client Reply routine
  *
@@ -2685,6 +2710,14 @@ static void clientReply(ROUTER* instance,
         bref_clear_state(bref, BREF_WAITING_RESULT);
     }
 
+    if (writebuf != NULL && !sescmd_cursor_is_active(scur) &&
+        bref->bref_reply.state != REPLY_STATE_DONE)
+    {
+        bool complete = modutil_reply_track(&bref->bref_reply, writebuf);
+        server_latency_reply(&bref->bref_latency, bref->bref_backend->backend_server,
+                             ((ROUTER_INSTANCE *)instance)->service, complete);
+    }
+
     if (writebuf != NULL && client_dcb != NULL)
     {
         unsigned char* cmd = (unsigned char*) writebuf->start;
@@ -2733,6 +2766,7 @@ static void clientReply(ROUTER* instance,
              */
             bref_set_state(bref, BREF_QUERY_ACTIVE);
             bref_set_state(bref, BREF_WAITING_RESULT);
+            bref_reply_start(bref, MYSQL_GET_COMMAND((uint8_t *)GWBUF_DATA(bref->bref_pending_cmd)));
         }
         else
         {
@@ -2773,8 +2807,8 @@ int bref_cmp_global_conn(const void* bref1, const void* bref2)
     BACKEND* b1 = ((backend_ref_t *)bref1)->bref_backend;
     BACKEND* b2 = ((backend_ref_t *)bref2)->bref_backend;
 
-    return ((1000 * b1->backend_server->stats.n_current) / b1->weight)
-        - ((1000 * b2->backend_server->stats.n_current) / b2->weight);
+    return (int)(((1000 * ts_stats_sum(b1->backend_server->stats.n_current)) / b1->weight)
+                 - ((1000 * ts_stats_sum(b2->backend_server->stats.n_current)) / b2->weight));
 }
 
 
@@ -2796,8 +2830,8 @@ int bref_cmp_current_load(const void* bref1, const void* bref2)
     BACKEND* b1 = ((backend_ref_t *)bref1)->bref_backend;
     BACKEND* b2 = ((backend_ref_t *)bref2)->bref_backend;
 
-    return ((1000 * s1->stats.n_current_ops) - b1->weight)
-        - ((1000 * s2->stats.n_current_ops) - b2->weight);
+    return (int)(((1000 * ts_stats_sum(s1->stats.n_current_ops)) - b1->weight)
+                 - ((1000 * ts_stats_sum(s2->stats.n_current_ops)) - b2->weight));
 }
 
 static void bref_clear_state(backend_ref_t* bref, bref_state_t state)
@@ -2814,7 +2848,6 @@ static void bref_clear_state(backend_ref_t* bref, bref_state_t state)
     else
     {
         int prev1;
-        int prev2;
 
         /** Decrease waiter count */
         prev1 = atomic_add(&bref->bref_num_result_wait, -1);
@@ -2826,15 +2859,7 @@ static void bref_clear_state(backend_ref_t* bref, bref_state_t state)
         else
         {
             /** Decrease global operation count */
-            prev2 = atomic_add(&bref->bref_backend->backend_server->stats.n_current_ops, -1);
-            ss_dassert(prev2 > 0);
-            if (prev2 <= 0)
-            {
-                MXS_ERROR("[%s] Error: negative current operation count in backend %s:%u",
-                          __FUNCTION__,
-                          bref->bref_backend->backend_server->name,
-                          bref->bref_backend->backend_server->port);
-            }
+            ts_stats_add(bref->bref_backend->backend_server->stats.n_current_ops, -1);
         }
     }
 }
@@ -2853,7 +2878,6 @@ static void bref_set_state(backend_ref_t* bref, bref_state_t state)
     else
     {
         int prev1;
-        int prev2;
 
         /** Increase waiter count */
         prev1 = atomic_add(&bref->bref_num_result_wait, 1);
@@ -2867,15 +2891,7 @@ static void bref_set_state(backend_ref_t* bref, bref_state_t state)
                       bref->bref_backend->backend_server->port);
         }
         /** Increase global operation count */
-        prev2 = atomic_add(&bref->bref_backend->backend_server->stats.n_current_ops, 1);
-        ss_dassert(prev2 >= 0);
-        if (prev2 < 0)
-        {
-            MXS_ERROR("[%s] Error: negative current operation count in backend %s:%u",
-                      __FUNCTION__,
-                      bref->bref_backend->backend_server->name,
-                      bref->bref_backend->backend_server->port);
-        }
+        ts_stats_add(bref->bref_backend->backend_server->stats.n_current_ops, 1);
     }
 }
 
@@ -2946,9 +2962,9 @@ static bool connect_backend_servers(backend_ref_t*   backend_ref,
         {
             BACKEND* b = backend_ref[i].bref_backend;
 
-            MXS_INFO("MaxScale connections : %d (%d) in \t%s:%d %s",
+            MXS_INFO("MaxScale connections : %d (%" PRId64 ") in \t%s:%d %s",
                      b->backend_conn_count,
-                     b->backend_server->stats.n_current,
+                     ts_stats_sum(b->backend_server->stats.n_current),
                      b->backend_server->name,
                      b->backend_server->port,
                      STRSRVSTATUS(b->backend_server));
@@ -11,6 +11,7 @@
  * Public License.
  */
 #include <stdio.h>
+#include <inttypes.h>
 #include <router.h>
 #include <modinfo.h>
 #include <server.h>
@@ -454,9 +455,9 @@ DCB	*dcb = session->session->client_dcb;
 static void
 service_row(SERVICE *service, DCB *dcb)
 {
-	dcb_printf(dcb, "<TR><TD>%s</TD><TD>%s</TD><TD>%d</TD><TD>%d</TD></TR>\n",
+	dcb_printf(dcb, "<TR><TD>%s</TD><TD>%s</TD><TD>%" PRId64 "</TD><TD>%" PRId64 "</TD></TR>\n",
 		service->name, service->routerModule,
-		service->stats.n_current, service->stats.n_sessions);
+		ts_stats_sum(service->stats.n_current), ts_stats_sum(service->stats.n_sessions));
 }
 
 /**
@@ -532,9 +533,9 @@ DCB	*dcb = session->session->client_dcb;
 static void
 server_row(SERVER *server, DCB *dcb)
 {
-	dcb_printf(dcb, "<TR><TD>%s</TD><TD>%s</TD><TD>%d</TD><TD>%s</TD><TD>%d</TD></TR>\n",
+	dcb_printf(dcb, "<TR><TD>%s</TD><TD>%s</TD><TD>%d</TD><TD>%s</TD><TD>%" PRId64 "</TD></TR>\n",
 		server->unique_name, server->name, server->port,
-		server_status(server), server->stats.n_current);
+		server_status(server), ts_stats_sum(server->stats.n_current));
 }
 
 /**